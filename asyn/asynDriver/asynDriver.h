@@ -93,6 +93,9 @@ typedef struct asynInterface{
 /*registerPort attributes*/
 #define ASYN_MULTIDEVICE  0x0001
 #define ASYN_CANBLOCK     0x0002
+/* With ASYN_MULTIDEVICE|ASYN_CANBLOCK: queued requests for different addresses
+ * are run concurrently by a pool of port threads */
+#define ASYN_MULTITHREAD  0x0004
 
 /*standard values for asynUser.reason*/
 #define ASYN_REASON_SIGNAL -1
@@ -110,6 +113,15 @@ typedef struct interruptNode{
     ELLNODE node;
     void    *drvPvt;
 }interruptNode;
+
+/* interruptStartReason addr that selects the users of every address */
+#define ASYN_ANY_ADDR (-2)
+
+/* Element of the list returned by interruptStartReason */
+typedef struct interruptReasonNode{
+    ELLNODE       node;
+    interruptNode *pinterruptNode;
+}interruptReasonNode;
 
 typedef struct asynManager {
     void      (*report)(FILE *fp,int details,const char*portName);
@@ -183,6 +195,15 @@ typedef struct asynManager {
     asynStatus (*setTimeStamp)(asynUser *pasynUser, const epicsTimeStamp *pTimeStamp);
 
     const char *(*strStatus)(asynStatus status);
+    /* Same as interruptStart but plist only holds the users that were
+     * registered with the given reason and addr (interruptReasonNode).
+     * addr is the value returned by getAddr when the user was added, i.e. -1
+     * for the port itself, or ASYN_ANY_ADDR for the users of all addresses.
+     * interruptEnd must be called when done. */
+    asynStatus (*interruptStartReason)(void *pasynPvt,int reason,int addr,
+                                  ELLLIST **plist);
+    /* Number of port threads of an ASYN_MULTITHREAD port. Can only be increased */
+    asynStatus (*setPortThreads)(asynUser *pasynUser, int nThreads);
 }asynManager;
 epicsShareExtern asynManager *pasynManager;
 
@@ -27,6 +27,7 @@
 #include <epicsThread.h>
 #include <epicsTime.h>
 #include <epicsTimer.h>
+#include <epicsExit.h>
 #include <cantProceed.h>
 #include <epicsAssert.h>
 
@@ -47,6 +48,7 @@
 #define DEFAULT_SECONDS_BETWEEN_PORT_CONNECT 20
 #define DEFAULT_AUTOCONNECT_TIMEOUT 0.5
 #define DEFAULT_QUEUE_LOCK_PORT_TIMEOUT 2.0
+#define DEFAULT_PORT_THREADS 4
 
 /* This is taken from dbDefs.h, which we don't want to include */
 /* Subtract member byte offset, returning pointer to parent object */
@@ -94,9 +96,38 @@ typedef struct memNode {
  * Ensure adequate alignment
  */
 #define NODESIZE (((sizeof(memNode)+15)/16)*16)
+
+/* Each thread that calls memMalloc or memFree has a memCache.
+ * Nodes are taken from and returned to it without any locking. Only when a
+ * size class is empty or full are MEM_CACHE_BATCH nodes moved between the
+ * cache and asynBase.memList, which requires asynBase.lock.
+ * createAsynUser and freeAsynUser use the same scheme for userPvts.
+ */
+#define MEM_CACHE_SIZE  16
+#define MEM_CACHE_BATCH (MEM_CACHE_SIZE/2)
+typedef struct memCache {
+    ELLNODE       node;     /*For asynBase.memCacheList*/
+    BOOL          threadExited; /*Can be reused by another thread*/
+    memNode       *cached[nMemList]; /*Linked via memNode.node.next*/
+    int           nCached[nMemList];
+    /* Statistics. Only written by the thread that owns the cache */
+    unsigned long nHit[nMemList];
+    unsigned long nMiss[nMemList];
+    unsigned long nMalloc[nMemList];
+    unsigned long nFree[nMemList];
+    userPvt       *cachedUser; /*Linked via userPvt.node.next*/
+    int           nCachedUser;
+    unsigned long nUserHit;
+    unsigned long nUserMiss;
+}memCache;
 
+#define INITIAL_PORT_HASH_SIZE 64
+
 typedef struct asynBase {
     ELLLIST           asynPortList;
+    port              **portHash; /*Chained via port.hashNext*/
+    int               portHashSize; /*always a power of 2*/
+    int               numberPorts;
     ELLLIST           asynUserFreeList;
     ELLLIST           interruptNodeFree;
     epicsTimerQueueId timerQueue;
@@ -104,12 +135,24 @@ typedef struct asynBase {
     epicsMutexId      lockTrace;
     tracePvt          trace;
     ELLLIST           memList[nMemList];
+    ELLLIST           memCacheList;
+    epicsThreadPrivateId memCacheId;
     /* following for connectPort */
     epicsTimerQueueId connectPortTimerQueue;
     double            autoConnectTimeout;
 }asynBase;
 static asynBase *pasynBase = 0;
 
+/* Users of an interruptBase registered with the same reason and addr */
+typedef struct interruptReason {
+    ELLNODE      node;      /*For interruptBase.reasonHash*/
+    int          reason;
+    int          addr;
+    ELLLIST      userList;  /*of interruptReasonNode*/
+}interruptReason;
+
+#define INITIAL_REASON_HASH_SIZE 64
+
 typedef struct interruptBase {
     ELLLIST      callbackList;
     ELLLIST      addRemoveList;
@@ -117,6 +160,11 @@ typedef struct interruptBase {
     BOOL         listModified;
     port         *pport;
     asynInterface *pasynInterface;
+    /* The following index callbackList by (reason,addr) and by reason */
+    ELLLIST      *reasonHash;
+    int          reasonHashSize; /*always a power of 2*/
+    int          numberReasons;
+    ELLLIST      emptyList;
 }interruptBase;
 
 typedef struct interruptNodePvt {
@@ -125,6 +173,9 @@ typedef struct interruptNodePvt {
     BOOL     isOnAddRemoveList;
     epicsEventId  callbackDone;
     interruptBase *pinterruptBase;
+    /* [0] for (reason,addr), [1] for (reason,ASYN_ANY_ADDR) */
+    interruptReason *pinterruptReason[2];
+    interruptReasonNode reasonNode[2];
     interruptNode nodePublic;
 }interruptNodePvt;
 
@@ -134,7 +185,29 @@ typedef struct interfaceNode {
     interruptBase *pinterruptBase;
 }interfaceNode;
 
-typedef struct dpCommon { /*device/port common fields*/
+typedef struct dpCommon dpCommon;
+
+/* Requests queued for one port or device at one priority.
+ * While requestList is not empty the dpQueue is in port.queueList, which is
+ * kept in the order in which the requests at the head of each dpQueue were
+ * queued. portThread therefore looks at each port or device once rather than
+ * at each request, and still processes requests in the order they were queued.
+ */
+typedef struct dpQueue {
+    ELLNODE       node;     /*For port.queueList*/
+    dpCommon      *pdpCommon;
+    ELLLIST       requestList; /*of userPvt*/
+    BOOL          inQueueList;
+}dpQueue;
+
+/* Requests added to the end count up from 0 and requests added to the front
+ * count down from 0, so the span of live sequence numbers grows with every
+ * request.  They are 64 bits so that it never reaches 2^63, where
+ * the comparison would wrap.
+ */
+#define SEQUENCE_BEFORE(a,b) ((epicsInt64)((a)-(b)) < 0)
+
+struct dpCommon { /*device/port common fields*/
     BOOL           enabled;
     BOOL           connected;
     BOOL           autoConnect;
@@ -144,12 +217,14 @@ typedef struct dpCommon { /*device/port common fields*/
     ELLLIST        exceptionUserList;
     ELLLIST        exceptionNotifyList;
     BOOL           exceptionActive;
+    BOOL           processActive; /*a port thread is calling processUser*/
     epicsTimeStamp lastConnectDisconnect;
     unsigned long  numberConnects;
     tracePvt       trace;
     port           *pport;
     device         *pdevice; /* 0 if port.dpc*/
-}dpCommon;
+    dpQueue        queue[NUMBER_QUEUE_PRIORITIES]; /*only if ASYN_CANBLOCK*/
+};
 
 typedef struct exceptionUser {
     ELLNODE           node;
@@ -161,7 +236,7 @@ typedef struct exceptionUser {
 
 typedef enum {callbackIdle,callbackActive,callbackCanceled}callbackState;
 struct userPvt {
-    ELLNODE       node;        /*For asynPort.queueList*/
+    ELLNODE       node;        /*For dpQueue.requestList*/
     /* timer,...,state are for queueRequest callbacks*/
     epicsTimerId  timer;
     epicsEventId  callbackDone;
@@ -177,6 +252,8 @@ struct userPvt {
     exceptionUser *pexceptionUser;
     BOOL          freeAfterCallback;
     BOOL          isQueued;
+    dpQueue       *pdpQueue;   /*while isQueued*/
+    epicsUInt64   queueSequence;
     asynUser      user;
 };
 
@@ -184,8 +261,14 @@ struct device {
     ELLNODE   node;     /*For asynPort.deviceList*/
     dpCommon  dpc;
     int       addr;
+    epicsMutexId synchronousLock; /*only if port is ASYN_MULTITHREAD*/
 };
 
+/* Devices with addr below MAX_DEVICE_TABLE_SIZE are found via port.deviceTable.
+ * Larger addresses are only found by searching port.deviceList */
+#define INITIAL_DEVICE_TABLE_SIZE 16
+#define MAX_DEVICE_TABLE_SIZE 4096
+
 typedef enum portConnectStatus {
     portConnectSuccess,
     portConnectDevice,
@@ -195,11 +278,14 @@ typedef enum portConnectStatus {
 
 struct port {
     ELLNODE       node;  /*For asynBase.asynPortList*/
+    port          *hashNext; /*For asynBase.portHash*/
     char          *portName;
     epicsMutexId  asynManagerLock; /*for asynManager*/
     epicsMutexId  synchronousLock; /*for synchronous drivers*/
     dpCommon      dpc;
     ELLLIST       deviceList;
+    device        **deviceTable; /*indexed by addr*/
+    int           deviceTableSize;
     ELLLIST       interfaceList;
     int           attributes;
     /* The following are for autoConnect*/
@@ -210,10 +296,24 @@ struct port {
     asynLockPortNotify *pasynLockPortNotify;
     void          *lockPortNotifyPvt;
     /*The following are only initialized/used if attributes&ASYN_CANBLOCK*/
-    ELLLIST       queueList[NUMBER_QUEUE_PRIORITIES];
+    ELLLIST       queueList[NUMBER_QUEUE_PRIORITIES]; /*of dpQueue*/
+    epicsUInt64   queueSequence;  /*of the last request added at the end*/
+    epicsUInt64   frontSequence;  /*of the last request added at the front*/
     BOOL          queueStateChange;
+    unsigned long queueChanges;     /*queueStateChange is reset by each port thread*/
     epicsEventId  notifyPortThread;
     epicsThreadId threadid;
+    /* The following are for ASYN_MULTITHREAD*/
+    int           numberThreads;
+    int           numberActive;     /*port threads calling processUser*/
+    unsigned int  threadPriority;
+    unsigned int  threadStackSize;
+    int           syncLockDepth;    /*protected by synchronousLock*/
+    epicsThreadId syncLockOwner;    /*thread holding the port lock*/
+    int           numberDeviceLocks; /*device locks held or being taken*/
+    BOOL          portLockWaiting;  /*port lock waits for deviceUnlockEvent*/
+    epicsEventId  deviceUnlockEvent;
+    epicsThreadPrivateId deviceLocksHeldId; /*device locks held by a thread*/
     userPvt       *pblockProcessHolder;
     /* following are for portConnect */
     asynUser      *pconnectUser;
@@ -245,6 +345,8 @@ typedef struct queueLockPortPvt {
           - ( (char *)&(((exceptionUser *)0)->notifyNode) - (char *)0 ) ) )
 
 /* internal methods */
+static interruptReason *locateInterruptReason(interruptBase *pinterruptBase,
+            int reason,int addr,BOOL allocNew);
 static void tracePvtInit(tracePvt *ptracePvt);
 static void tracePvtFree(tracePvt *ptracePvt);
 static void asynInit(void);
@@ -253,6 +355,7 @@ static void dpCommonFree(dpCommon *pdpCommon);
 static dpCommon *findDpCommon(userPvt *puserPvt);
 static tracePvt *findTracePvt(userPvt *puserPvt);
 static port *locatePort(const char *portName);
+static void addPort(port *pport);
 static device *locateDevice(port *pport,int addr,BOOL allocNew);
 static interfaceNode *locateInterfaceNode(
             ELLLIST *plist,const char *interfaceType,BOOL allocNew);
@@ -262,6 +365,16 @@ static void queueTimeoutCallback(void *pvt);
 static BOOL autoConnectDevice(port *pport,device *pdevice);
 static void connectAttempt(dpCommon *pdpCommon);
 static void portThread(port *pport);
+static BOOL createPortThread(port *pport);
+static void lockSynchronous(port *pport,device *pdevice);
+static void dpQueueUpdate(port *pport,dpQueue *pdpQueue);
+static void queueAdd(port *pport,userPvt *puserPvt,dpQueue *pdpQueue,
+    BOOL addToFront);
+static void queueRemove(port *pport,userPvt *puserPvt);
+static userPvt *dpQueueCandidate(port *pport,dpQueue *pdpQueue);
+static userPvt *userCacheGet(void);
+static void userCachePut(userPvt *puserPvt);
+static void unlockSynchronous(port *pport,device *pdevice);
 /* functions for portConnect */
 static void initPortConnect(port *ppport);
 static void portConnectTimerCallback(void *pvt);
@@ -295,6 +408,7 @@ static asynStatus unlockPort(asynUser *pasynUser);
 static asynStatus queueLockPort(asynUser *pasynUser);
 static asynStatus queueUnlockPort(asynUser *pasynUser);
 static asynStatus setQueueLockPortTimeout(asynUser *pasynUser, double timeout);
+static asynStatus setPortThreads(asynUser *pasynUser, int nThreads);
 static asynStatus canBlock(asynUser *pasynUser,int *yesNo);
 static asynStatus getAddr(asynUser *pasynUser,int *addr);
 static asynStatus getPortName(asynUser *pasynUser,const char **pportName);
@@ -326,6 +440,8 @@ static asynStatus removeInterruptUser(asynUser *pasynUser,
                                    interruptNode*pinterruptNode);
 static asynStatus interruptStart(void *pasynPvt,ELLLIST **plist);
 static asynStatus interruptEnd(void *pasynPvt);
+static asynStatus interruptStartReason(void *pasynPvt,int reason,int addr,
+                                   ELLLIST **plist);
 static void defaultTimeStampSource(void *userPvt, epicsTimeStamp *pTimeStamp);
 static asynStatus registerTimeStampSource(asynUser *pasynUser, void *userPvt, timeStampCallback callback);
 static asynStatus unregisterTimeStampSource(asynUser *pasynUser);
@@ -384,7 +500,9 @@ static asynManager manager = {
     updateTimeStamp,
     getTimeStamp,
     setTimeStamp,
-    strStatus
+    strStatus,
+    interruptStartReason,
+    setPortThreads
 };
 epicsShareDef asynManager *pasynManager = &manager;
 
@@ -487,6 +605,8 @@ static void asynInit(void)
     pasynBase->lockTrace = epicsMutexMustCreate();
     tracePvtInit(&pasynBase->trace);
     for(i=0; i<nMemList; i++) ellInit(&pasynBase->memList[i]);
+    ellInit(&pasynBase->memCacheList);
+    pasynBase->memCacheId = epicsThreadPrivateCreate();
     pasynBase->connectPortTimerQueue = epicsTimerQueueAllocate(
         0,epicsThreadPriorityScanLow);
     pasynBase->autoConnectTimeout = DEFAULT_AUTOCONNECT_TIMEOUT;
@@ -495,6 +615,7 @@ static void asynInit(void)
 static void dpCommonInit(port *pport,device *pdevice,BOOL autoConnect)
 {
     dpCommon *pdpCommon;
+    int      i;
 
     if(pdevice) {
         pdpCommon = &pdevice->dpc;
@@ -510,6 +631,10 @@ static void dpCommonInit(port *pport,device *pdevice,BOOL autoConnect)
     pdpCommon->pport = pport;
     pdpCommon->pdevice = pdevice;
     tracePvtInit(&pdpCommon->trace);
+    for(i=0; i<NUMBER_QUEUE_PRIORITIES; i++) {
+        pdpCommon->queue[i].pdpCommon = pdpCommon;
+        ellInit(&pdpCommon->queue[i].requestList);
+    }
 }
 
 static void dpCommonFree(dpCommon *pdpCommon)
@@ -537,36 +662,101 @@ static tracePvt *findTracePvt(userPvt *puserPvt)
 /*locatePort returns 0 if portName is not registered*/
 static port *locatePort(const char *portName)
 {
-    port *pport;
+    port *pport = 0;
 
     if(!pasynBase) asynInit();
     epicsMutexMustLock(pasynBase->lock);
-    pport = (port *)ellFirst(&pasynBase->asynPortList);
-    while(pport) {
-        if(strcmp(pport->portName,portName)==0) break;
-        pport = (port *)ellNext(&pport->node);
+    if(pasynBase->portHash) {
+        pport = pasynBase->portHash[
+            epicsStrHash(portName,0) & (pasynBase->portHashSize-1)];
+        while(pport) {
+            if(strcmp(pport->portName,portName)==0) break;
+            pport = pport->hashNext;
+        }
     }
     epicsMutexUnlock(pasynBase->lock);
     return pport;
 }
 
+/*addPort must be called with asynBase.lock held*/
+static void addPort(port *pport)
+{
+    port **pbucket;
+
+    if(!pasynBase->portHash
+    || pasynBase->numberPorts >= 2*pasynBase->portHashSize) {
+        /* Keep the chains short by doubling the number of buckets */
+        int  oldSize = pasynBase->portHashSize;
+        port **oldHash = pasynBase->portHash;
+        port *pnext;
+        int  i;
+
+        pasynBase->portHashSize = (oldSize ? 2*oldSize : INITIAL_PORT_HASH_SIZE);
+        pasynBase->portHash = callocMustSucceed(
+            pasynBase->portHashSize,sizeof(port *),"asynManager:addPort");
+        for(i=0; i<oldSize; i++) {
+            for(pnext=oldHash[i]; pnext; ) {
+                port *pmove = pnext;
+
+                pnext = pmove->hashNext;
+                pbucket = &pasynBase->portHash[epicsStrHash(pmove->portName,0)
+                    & (pasynBase->portHashSize-1)];
+                pmove->hashNext = *pbucket;
+                *pbucket = pmove;
+            }
+        }
+        free(oldHash);
+    }
+    pbucket = &pasynBase->portHash[epicsStrHash(pport->portName,0)
+        & (pasynBase->portHashSize-1)];
+    pport->hashNext = *pbucket;
+    *pbucket = pport;
+    pasynBase->numberPorts++;
+    ellAdd(&pasynBase->asynPortList,&pport->node);
+}
+
+/*locateDevice must be called with asynManagerLock held*/
 static device *locateDevice(port *pport,int addr,BOOL allocNew)
 {
-    device *pdevice;
+    device *pdevice = 0;
 
     assert(pport);
     if(!(pport->attributes&ASYN_MULTIDEVICE) || addr < 0) return(0);
-    pdevice = (device *)ellFirst(&pport->deviceList);
-    while(pdevice) {
-        if(pdevice->addr == addr) return pdevice;
-        pdevice = (device *)ellNext(&pdevice->node);
+    if(addr<pport->deviceTableSize) {
+        pdevice = pport->deviceTable[addr];
+    } else if(addr>=MAX_DEVICE_TABLE_SIZE) {
+        pdevice = (device *)ellFirst(&pport->deviceList);
+        while(pdevice) {
+            if(pdevice->addr == addr) break;
+            pdevice = (device *)ellNext(&pdevice->node);
+        }
     }
     if(!pdevice && allocNew) {
         pdevice = callocMustSucceed(1,sizeof(device),
             "asynManager:locateDevice");
         pdevice->addr = addr;
+        if(pport->attributes&ASYN_MULTITHREAD)
+            pdevice->synchronousLock = epicsMutexMustCreate();
         dpCommonInit(pport,pdevice,pport->dpc.autoConnect);
         ellAdd(&pport->deviceList,&pdevice->node);
+        if(addr<MAX_DEVICE_TABLE_SIZE) {
+            if(addr>=pport->deviceTableSize) {
+                int    newSize = (pport->deviceTableSize ?
+                    pport->deviceTableSize : INITIAL_DEVICE_TABLE_SIZE);
+                device **oldTable = pport->deviceTable;
+
+                while(newSize<=addr) newSize *= 2;
+                pport->deviceTable = callocMustSucceed(newSize,sizeof(device *),
+                    "asynManager:locateDevice");
+                if(oldTable) {
+                    memcpy(pport->deviceTable,oldTable,
+                        pport->deviceTableSize*sizeof(device *));
+                    free(oldTable);
+                }
+                pport->deviceTableSize = newSize;
+            }
+            pport->deviceTable[addr] = pdevice;
+        }
     }
     return pdevice;
 }
@@ -589,7 +779,102 @@ static interfaceNode *locateInterfaceNode(
     }
     return pinterfaceNode;
 }
+
+static unsigned int interruptReasonHash(int reason,int addr)
+{
+    unsigned int hash = (unsigned int)reason*2654435761u;
+
+    hash ^= (unsigned int)addr + 0x9e3779b9u + (hash<<6) + (hash>>2);
+    return hash;
+}
+
+/*locateInterruptReason must be called with asynManagerLock held*/
+static interruptReason *locateInterruptReason(interruptBase *pinterruptBase,
+            int reason,int addr,BOOL allocNew)
+{
+    interruptReason *pinterruptReason;
+    ELLLIST *pbucket;
+
+    if(!pinterruptBase->reasonHash) {
+        if(!allocNew) return 0;
+        pinterruptBase->reasonHashSize = INITIAL_REASON_HASH_SIZE;
+        pinterruptBase->reasonHash = callocMustSucceed(
+            pinterruptBase->reasonHashSize,sizeof(ELLLIST),
+            "asynManager:locateInterruptReason");
+    }
+    pbucket = &pinterruptBase->reasonHash[
+        interruptReasonHash(reason,addr) & (pinterruptBase->reasonHashSize-1)];
+    pinterruptReason = (interruptReason *)ellFirst(pbucket);
+    while(pinterruptReason) {
+        if(pinterruptReason->reason==reason && pinterruptReason->addr==addr)
+            return pinterruptReason;
+        pinterruptReason = (interruptReason *)ellNext(&pinterruptReason->node);
+    }
+    if(!allocNew) return 0;
+    if(pinterruptBase->numberReasons >= 2*pinterruptBase->reasonHashSize) {
+        /* Keep the chains short by doubling the number of buckets */
+        int      oldSize = pinterruptBase->reasonHashSize;
+        ELLLIST  *oldHash = pinterruptBase->reasonHash;
+        int      i;
+
+        pinterruptBase->reasonHashSize = 2*oldSize;
+        pinterruptBase->reasonHash = callocMustSucceed(
+            pinterruptBase->reasonHashSize,sizeof(ELLLIST),
+            "asynManager:locateInterruptReason");
+        for(i=0; i<oldSize; i++) {
+            while((pinterruptReason = (interruptReason *)ellGet(&oldHash[i]))) {
+                ellAdd(&pinterruptBase->reasonHash[
+                    interruptReasonHash(pinterruptReason->reason,
+                        pinterruptReason->addr)
+                    & (pinterruptBase->reasonHashSize-1)],
+                    &pinterruptReason->node);
+            }
+        }
+        free(oldHash);
+        pbucket = &pinterruptBase->reasonHash[
+            interruptReasonHash(reason,addr) & (pinterruptBase->reasonHashSize-1)];
+    }
+    pinterruptReason = callocMustSucceed(1,sizeof(interruptReason),
+        "asynManager:locateInterruptReason");
+    pinterruptReason->reason = reason;
+    pinterruptReason->addr = addr;
+    ellInit(&pinterruptReason->userList);
+    ellAdd(pbucket,&pinterruptReason->node);
+    pinterruptBase->numberReasons++;
+    return pinterruptReason;
+}
 
+/*addReasonNode and removeReasonNode must be called with asynManagerLock held*/
+static void addReasonNode(interruptBase *pinterruptBase,
+            interruptNodePvt *pinterruptNodePvt,int which,int reason,int addr)
+{
+    interruptReason *pinterruptReason;
+
+    pinterruptReason = locateInterruptReason(pinterruptBase,reason,addr,TRUE);
+    pinterruptNodePvt->pinterruptReason[which] = pinterruptReason;
+    pinterruptNodePvt->reasonNode[which].pinterruptNode =
+        &pinterruptNodePvt->nodePublic;
+    ellAdd(&pinterruptReason->userList,
+        &pinterruptNodePvt->reasonNode[which].node);
+}
+
+static void removeReasonNode(interruptBase *pinterruptBase,
+            interruptNodePvt *pinterruptNodePvt,int which)
+{
+    interruptReason *pinterruptReason = pinterruptNodePvt->pinterruptReason[which];
+
+    ellDelete(&pinterruptReason->userList,
+        &pinterruptNodePvt->reasonNode[which].node);
+    pinterruptNodePvt->pinterruptReason[which] = 0;
+    if(ellCount(&pinterruptReason->userList)==0) {
+        ellDelete(&pinterruptBase->reasonHash[
+            interruptReasonHash(pinterruptReason->reason,pinterruptReason->addr)
+            & (pinterruptBase->reasonHashSize-1)],&pinterruptReason->node);
+        pinterruptBase->numberReasons--;
+        free(pinterruptReason);
+    }
+}
+
 /* While an exceptionActive exceptionCallbackAdd and exceptionCallbackRemove
    will wait to be notified that exceptionActive is no longer true.  */
 static void announceExceptionOccurred(port *pport, device *pdevice, asynException exception)
@@ -615,6 +900,7 @@ static void announceExceptionOccurred(port *pport, device *pdevice, asynExceptio
     }
     pdpCommon->exceptionActive = FALSE;
     pport->queueStateChange = TRUE;
+    pport->queueChanges++;
     epicsMutexUnlock(pport->asynManagerLock);
     if(pport->attributes&ASYN_CANBLOCK)
         epicsEventSignal(pport->notifyPortThread);
@@ -633,7 +919,6 @@ static void queueTimeoutCallback(void *pvt)
     userPvt  *puserPvt = (userPvt *)pvt;
     asynUser *pasynUser = &puserPvt->user;
     port     *pport = puserPvt->pport;
-    int      i;
 
     epicsMutexMustLock(pport->asynManagerLock);
     if(!puserPvt->isQueued) {
@@ -643,28 +928,18 @@ static void queueTimeoutCallback(void *pvt)
             pport->portName );
         return;
     }
-    for(i=asynQueuePriorityConnect; i>=asynQueuePriorityLow; i--) {
-        puserPvt = (userPvt *)ellFirst(&pport->queueList[i]);
-        while(puserPvt) {
-            if(pasynUser == &puserPvt->user) {
-                ellDelete(&pport->queueList[i],&puserPvt->node);
-                break;
-            }
-            puserPvt = (userPvt *)ellNext(&puserPvt->node);
-        }
-        if (puserPvt) break;
-    }
-    if(!puserPvt) {
+    if(!puserPvt->pdpQueue) {
         epicsMutexUnlock(pport->asynManagerLock);
         asynPrint(pasynUser,ASYN_TRACE_ERROR,
             "%s asynManager:queueTimeoutCallback LOGIC ERROR\n",
             pport->portName);
         return;
     }
+    queueRemove(pport,puserPvt);
     asynPrint(pasynUser,ASYN_TRACE_FLOW,
         "%s asynManager:queueTimeoutCallback\n", pport->portName);
-    puserPvt->isQueued = FALSE;
     pport->queueStateChange = TRUE;
+    pport->queueChanges++;
     if(puserPvt->timeoutUser) {
         puserPvt->state = callbackActive;
         epicsMutexUnlock(pport->asynManagerLock);
@@ -675,9 +950,7 @@ static void queueTimeoutCallback(void *pvt)
         puserPvt->state = callbackIdle;
         if(puserPvt->freeAfterCallback) {
             puserPvt->freeAfterCallback = FALSE;
-            epicsMutexMustLock(pasynBase->lock);
-            ellAdd(&pasynBase->asynUserFreeList,&puserPvt->node);
-            epicsMutexUnlock(pasynBase->lock);
+            userCachePut(puserPvt);
         }
     }
     epicsMutexUnlock(pport->asynManagerLock);
@@ -722,6 +995,172 @@ static BOOL autoConnectDevice(port *pport,device *pdevice)
     return pdevice->dpc.connected;
 }
 
+/* For an ASYN_MULTITHREAD port each device has its own synchronousLock,
+ * so the port threads can call the driver for different addresses at the
+ * same time. Locking the port itself (pdevice 0) excludes all devices.
+ * The lock order is the port synchronousLock first, always. A thread that
+ * holds no device lock takes the port lock before it takes a device lock,
+ * and releases it once it is counted in numberDeviceLocks, so it waits
+ * while the port is locked. That includes devices created after the port
+ * was locked. The port lock waits until numberDeviceLocks only counts the
+ * device locks of its own thread. A thread that already holds a device lock
+ * does not take the port lock again, because a port lock cannot complete
+ * until it releases its device locks. That is also why lockPort and
+ * queueLockPort for the port itself fail in a thread that holds a device
+ * lock but not the port lock. Must not be called with asynManagerLock held.
+ */
+static int deviceLocksHeld(port *pport)
+{
+    return (int)(size_t)epicsThreadPrivateGet(pport->deviceLocksHeldId);
+}
+
+static BOOL lockOrderViolation(port *pport,device *pdevice)
+{
+    BOOL violation;
+
+    if(pdevice || !(pport->attributes&ASYN_MULTITHREAD)) return FALSE;
+    if(deviceLocksHeld(pport) == 0) return FALSE;
+    epicsMutexMustLock(pport->asynManagerLock);
+    violation = (pport->syncLockOwner != epicsThreadGetIdSelf());
+    epicsMutexUnlock(pport->asynManagerLock);
+    return violation;
+}
+
+static void lockSynchronous(port *pport,device *pdevice)
+{
+    int nHeld;
+
+    if(pdevice && (pport->attributes&ASYN_MULTITHREAD)) {
+        nHeld = deviceLocksHeld(pport);
+        if(nHeld == 0) epicsMutexMustLock(pport->synchronousLock);
+        epicsMutexMustLock(pport->asynManagerLock);
+        pport->numberDeviceLocks++;
+        epicsMutexUnlock(pport->asynManagerLock);
+        if(nHeld == 0) epicsMutexUnlock(pport->synchronousLock);
+        epicsMutexMustLock(pdevice->synchronousLock);
+        epicsThreadPrivateSet(pport->deviceLocksHeldId,(void *)(size_t)(nHeld + 1));
+        return;
+    }
+    epicsMutexMustLock(pport->synchronousLock);
+    if(!(pport->attributes&ASYN_MULTITHREAD)) return;
+    if(pport->syncLockDepth++ > 0) return;
+    nHeld = deviceLocksHeld(pport);
+    epicsMutexMustLock(pport->asynManagerLock);
+    pport->syncLockOwner = epicsThreadGetIdSelf();
+    while(pport->numberDeviceLocks > nHeld) {
+        pport->portLockWaiting = TRUE;
+        epicsMutexUnlock(pport->asynManagerLock);
+        epicsEventMustWait(pport->deviceUnlockEvent);
+        epicsMutexMustLock(pport->asynManagerLock);
+    }
+    pport->portLockWaiting = FALSE;
+    epicsMutexUnlock(pport->asynManagerLock);
+}
+
+static void unlockSynchronous(port *pport,device *pdevice)
+{
+    BOOL wake;
+
+    if(pdevice && (pport->attributes&ASYN_MULTITHREAD)) {
+        epicsMutexUnlock(pdevice->synchronousLock);
+        epicsThreadPrivateSet(pport->deviceLocksHeldId,
+            (void *)(size_t)(deviceLocksHeld(pport) - 1));
+        epicsMutexMustLock(pport->asynManagerLock);
+        pport->numberDeviceLocks--;
+        wake = pport->portLockWaiting;
+        epicsMutexUnlock(pport->asynManagerLock);
+        if(wake) epicsEventSignal(pport->deviceUnlockEvent);
+        return;
+    }
+    if((pport->attributes&ASYN_MULTITHREAD) && --pport->syncLockDepth == 0) {
+        epicsMutexMustLock(pport->asynManagerLock);
+        pport->syncLockOwner = 0;
+        epicsMutexUnlock(pport->asynManagerLock);
+    }
+    epicsMutexUnlock(pport->synchronousLock);
+}
+
+/* The queue functions must be called with asynManagerLock held.
+ * dpQueueUpdate puts pdpQueue in the right place in port.queueList after the
+ * request at its head has changed.
+ */
+static void dpQueueUpdate(port *pport,dpQueue *pdpQueue)
+{
+    ELLLIST *plist = &pport->queueList[pdpQueue - pdpQueue->pdpCommon->queue];
+    userPvt *phead = (userPvt *)ellFirst(&pdpQueue->requestList);
+    dpQueue *pprev;
+
+    if(pdpQueue->inQueueList) {
+        ellDelete(plist,&pdpQueue->node);
+        pdpQueue->inQueueList = FALSE;
+    }
+    if(!phead) return;
+    /*New requests are usually the latest so search from the end*/
+    pprev = (dpQueue *)ellLast(plist);
+    while(pprev && SEQUENCE_BEFORE(phead->queueSequence,
+    ((userPvt *)ellFirst(&pprev->requestList))->queueSequence)) {
+        pprev = (dpQueue *)ellPrevious(&pprev->node);
+    }
+    ellInsert(plist,(pprev ? &pprev->node : 0),&pdpQueue->node);
+    pdpQueue->inQueueList = TRUE;
+}
+
+static void queueAdd(port *pport,userPvt *puserPvt,dpQueue *pdpQueue,
+    BOOL addToFront)
+{
+    if(addToFront) {
+        puserPvt->queueSequence = pport->frontSequence--;
+        ellInsert(&pdpQueue->requestList,0,&puserPvt->node);
+    } else {
+        puserPvt->queueSequence = ++pport->queueSequence;
+        ellAdd(&pdpQueue->requestList,&puserPvt->node);
+    }
+    puserPvt->pdpQueue = pdpQueue;
+    puserPvt->isQueued = TRUE;
+    if(addToFront || ellCount(&pdpQueue->requestList)==1)
+        dpQueueUpdate(pport,pdpQueue);
+}
+
+static void queueRemove(port *pport,userPvt *puserPvt)
+{
+    dpQueue *pdpQueue = puserPvt->pdpQueue;
+    BOOL    wasHead = (ellFirst(&pdpQueue->requestList)==&puserPvt->node);
+
+    ellDelete(&pdpQueue->requestList,&puserPvt->node);
+    puserPvt->pdpQueue = 0;
+    puserPvt->isQueued = FALSE;
+    if(wasHead) dpQueueUpdate(pport,pdpQueue);
+}
+
+/* Returns the request of pdpQueue that may be processed, if any.
+ * While a block holder exists only its own request may be processed.
+ */
+static userPvt *dpQueueCandidate(port *pport,dpQueue *pdpQueue)
+{
+    dpCommon *pdpCommon = pdpQueue->pdpCommon;
+    userPvt  *pholder = pport->pblockProcessHolder;
+
+    if(!pholder) pholder = pdpCommon->pblockProcessHolder;
+    if(!pholder) return (userPvt *)ellFirst(&pdpQueue->requestList);
+    if(pdpCommon->pblockProcessHolder
+    && pdpCommon->pblockProcessHolder!=pholder) return 0;
+    if(!pholder->isQueued || pholder->pdpQueue!=pdpQueue) return 0;
+    return pholder;
+}
+
+/* processAllowed must be called with asynManagerLock held.
+ * Requests for the same device never run concurrently, which keeps them in
+ * the order they were queued. A request for the port itself waits until no
+ * other request is active and no request may start while it is active.
+ * With a single port thread nothing is active while the queues are scanned.
+ */
+static BOOL processAllowed(port *pport,dpCommon *pdpCommon)
+{
+    if(pport->dpc.processActive) return FALSE;
+    if(pdpCommon==&pport->dpc) return (pport->numberActive==0);
+    return !pdpCommon->processActive;
+}
+
 static void connectAttempt(dpCommon *pdpCommon)
 {
     port           *pport = pdpCommon->pport;
@@ -734,11 +1173,16 @@ static void connectAttempt(dpCommon *pdpCommon)
     int            addr;
 
     addr = (pdevice ? pdevice->addr : -1);
+    /* The port threads of an ASYN_MULTITHREAD port can connect different
+     * devices at the same time, so each attempt needs its own asynUser */
+    if(pport->attributes&ASYN_MULTITHREAD)
+        pasynUser = pasynManager->createAsynUser(0,0);
     status = pasynManager->connectDevice(pasynUser,pport->portName,addr);
     if(status!=asynSuccess) {
         reportConnectStatus(pport, portConnectDevice,
             "%s %d autoConnect connectDevice failed.\n",
             pport->portName,addr);
+        if(pasynUser!=pport->pasynUser) pasynManager->freeAsynUser(pasynUser);
         return;
     }
     pasynInterface = pasynManager->findInterface(pasynUser,asynCommonType,TRUE);
@@ -755,9 +1199,14 @@ static void connectAttempt(dpCommon *pdpCommon)
     pasynUser->errorMessage[0] = '\0';
     /* When we were called we were not connected, but we could have connected since that test? */
     if (!pdpCommon->connected) {
-        epicsMutexMustLock(pport->synchronousLock);
+        lockSynchronous(pport,pdevice);
+        /* Another port thread may have connected while this one waited */
+        if (pdpCommon->connected) {
+            unlockSynchronous(pport,pdevice);
+            goto disconnect;
+        }
         status = pasynCommon->connect(drvPvt,pasynUser);
-        epicsMutexUnlock(pport->synchronousLock);
+        unlockSynchronous(pport,pdevice);
         if (status != asynSuccess) {
             reportConnectStatus(pport, portConnectDriver,
                 "%s %d autoConnect could not connect: %s\n", pport->portName, addr, pasynUser->errorMessage);
@@ -774,14 +1223,23 @@ disconnect:
             "%s %d autoConnect disconnect failed.\n",
             pport->portName,addr);
     }
+    if(pasynUser!=pport->pasynUser) pasynManager->freeAsynUser(pasynUser);
 }
 
+/* Only needed with more than one port thread. Another thread may be waiting
+ * for a request that this thread skipped or that is now allowed to run */
+static void wakePortThreads(port *pport)
+{
+    if(pport->numberThreads>1) epicsEventSignal(pport->notifyPortThread);
+}
+
 static void portThread(port *pport)
 {
     userPvt  *puserPvt;
     asynUser *pasynUser;
     double   timeout;
     BOOL     callTimeoutUser = FALSE;
+    BOOL     barrier;
 
     taskwdInsert(epicsThreadGetIdSelf(),0,0);
     while(1) {
@@ -791,25 +1249,45 @@ static void portThread(port *pport)
             epicsMutexUnlock(pport->asynManagerLock);
             continue;
         }
+        /*A request for the port that must wait for other port threads*/
+        barrier = FALSE;
         /*Process ALL connect/disconnect requests first*/
-        while((puserPvt = (userPvt *)ellFirst(
-        &pport->queueList[asynQueuePriorityConnect]))) {
+        while(1) {
+            dpCommon *pdpCommon = 0;
+            dpQueue  *pdpQueue;
             asynStatus status = asynSuccess;
 
+            puserPvt = 0;
+            for(pdpQueue = (dpQueue *)ellFirst(
+            &pport->queueList[asynQueuePriorityConnect]);
+            pdpQueue; pdpQueue = (dpQueue *)ellNext(&pdpQueue->node)) {
+                pdpCommon = pdpQueue->pdpCommon;
+                if(processAllowed(pport,pdpCommon)) {
+                    puserPvt = (userPvt *)ellFirst(&pdpQueue->requestList);
+                    break;
+                }
+                if(pdpCommon==&pport->dpc) {
+                    barrier = TRUE;
+                    break;
+                }
+            }
+            if(!puserPvt) break;
             assert(puserPvt->isQueued);
-            ellDelete(&pport->queueList[asynQueuePriorityConnect],
-               &puserPvt->node);
-            puserPvt->isQueued = FALSE;
+            queueRemove(pport,puserPvt);
+            pport->queueChanges++;
             pasynUser = userPvtToAsynUser(puserPvt);
             pasynUser->errorMessage[0] = '\0';
             asynPrint(pasynUser,ASYN_TRACE_FLOW,
                 "asynManager connect queueCallback port:%s\n",
                  pport->portName);
             puserPvt->state = callbackActive;
+            pdpCommon->processActive = TRUE;
+            pport->numberActive++;
             timeout = puserPvt->timeout;
+            wakePortThreads(pport);
             epicsMutexUnlock(pport->asynManagerLock);
             if(puserPvt->timer && timeout>0.0) epicsTimerCancel(puserPvt->timer);
-            epicsMutexMustLock(pport->synchronousLock);
+            lockSynchronous(pport,pdpCommon->pdevice);
             if(pport->pasynLockPortNotify) {
                 status = pport->pasynLockPortNotify->lock(
                    pport->lockPortNotifyPvt,pasynUser);
@@ -825,18 +1303,23 @@ static void portThread(port *pport)
                         "%s queueCallback pasynLockPortNotify:lock error %s\n",
                          pport->portName,pasynUser->errorMessage);
             }
-            epicsMutexUnlock(pport->synchronousLock);
+            unlockSynchronous(pport,pdpCommon->pdevice);
             epicsMutexMustLock(pport->asynManagerLock);
+            pdpCommon->processActive = FALSE;
+            pport->numberActive--;
+            wakePortThreads(pport);
             if (puserPvt->state==callbackCanceled)
                 epicsEventSignal(puserPvt->callbackDone);
             puserPvt->state = callbackIdle;
             if(puserPvt->freeAfterCallback) {
                 puserPvt->freeAfterCallback = FALSE;
-                epicsMutexMustLock(pasynBase->lock);
-                ellAdd(&pasynBase->asynUserFreeList,&puserPvt->node);
-                epicsMutexUnlock(pasynBase->lock);
+                userCachePut(puserPvt);
             }
         }
+        if(barrier) {
+            epicsMutexUnlock(pport->asynManagerLock);
+            continue; /*while (1); */
+        }
         if(!pport->dpc.connected) {
             if(!autoConnectDevice(pport,0)) {
                 epicsMutexUnlock(pport->asynManagerLock);
@@ -846,49 +1329,64 @@ static void portThread(port *pport)
         while(1) {
             int i;
             dpCommon *pdpCommon = 0;
+            dpQueue  *pdpQueue;
             asynStatus status = asynSuccess;
 
             callTimeoutUser = FALSE;
             pport->queueStateChange = FALSE;
+            puserPvt = 0;
             for(i=asynQueuePriorityHigh; i>=asynQueuePriorityLow; i--) {
-                for(puserPvt = (userPvt *)ellFirst(&pport->queueList[i]);
-                puserPvt; puserPvt = (userPvt *)ellNext(&puserPvt->node)) {
-                    pdpCommon = findDpCommon(puserPvt);
-                    assert(pdpCommon);
+                for(pdpQueue = (dpQueue *)ellFirst(&pport->queueList[i]);
+                pdpQueue; pdpQueue = (dpQueue *)ellNext(&pdpQueue->node)) {
+                    pdpCommon = pdpQueue->pdpCommon;
 
                     if(!pdpCommon->enabled) continue;
+                    if(!processAllowed(pport,pdpCommon)) {
+                        if(pdpCommon==&pport->dpc) {
+                            barrier = TRUE;
+                            break;
+                        }
+                        continue;
+                    }
                     if(!pdpCommon->connected) {
+                        unsigned long queueChanges = pport->queueChanges;
+
+                        /*autoConnectDevice may release asynManagerLock*/
                         autoConnectDevice(pdpCommon->pport,
                             pdpCommon->pdevice);
-                        if(pport->queueStateChange) {
-                            puserPvt = 0;
+                        if(pport->queueStateChange
+                        || pport->queueChanges!=queueChanges) {
+                            pport->queueStateChange = TRUE;
                             break;
                         }
+                        /*Another port thread is still connecting it*/
+                        if(pdpCommon->autoConnectActive) continue;
                     }
-                    if(!pdpCommon->connected && puserPvt->timeoutUser!=0) {
-                       callTimeoutUser = TRUE;
-                    }
-                    if((pport->pblockProcessHolder==NULL
-                        || pport->pblockProcessHolder==puserPvt)
-                    && (pdpCommon->pblockProcessHolder==NULL
-                        || pdpCommon->pblockProcessHolder==puserPvt)) {
+                    puserPvt = dpQueueCandidate(pport,pdpQueue);
+                    if(puserPvt) {
+                        if(!pdpCommon->connected && puserPvt->timeoutUser!=0) {
+                           callTimeoutUser = TRUE;
+                        }
                         assert(puserPvt->isQueued);
-                        ellDelete(&pport->queueList[i],&puserPvt->node);
-                        puserPvt->isQueued = FALSE;
+                        queueRemove(pport,puserPvt);
+                        pport->queueChanges++;
                         break;
                     }
                 }
-                if(puserPvt || pport->queueStateChange) break; /*for*/
+                if(puserPvt || pport->queueStateChange || barrier) break; /*for*/
             }
             if(!puserPvt) break; /*while(1)*/
             pasynUser = userPvtToAsynUser(puserPvt);
             pasynUser->errorMessage[0] = '\0';
             asynPrint(pasynUser,ASYN_TRACE_FLOW,"asynManager::portThread port=%s callback\n",pport->portName);
             puserPvt->state = callbackActive;
+            pdpCommon->processActive = TRUE;
+            pport->numberActive++;
             timeout = puserPvt->timeout;
+            wakePortThreads(pport);
             epicsMutexUnlock(pport->asynManagerLock);
             if(puserPvt->timer && timeout>0.0) epicsTimerCancel(puserPvt->timer);
-            epicsMutexMustLock(pport->synchronousLock);
+            lockSynchronous(pport,pdpCommon->pdevice);
             if(pport->pasynLockPortNotify) {
                 status = pport->pasynLockPortNotify->lock(
                    pport->lockPortNotifyPvt,pasynUser);
@@ -908,8 +1406,11 @@ static void portThread(port *pport)
                         "%s queueCallback pasynLockPortNotify:lock error %s\n",
                          pport->portName,pasynUser->errorMessage);
             }    
-            epicsMutexUnlock(pport->synchronousLock);
+            unlockSynchronous(pport,pdpCommon->pdevice);
             epicsMutexMustLock(pport->asynManagerLock);
+            pdpCommon->processActive = FALSE;
+            pport->numberActive--;
+            wakePortThreads(pport);
             if(puserPvt->blockPortCount>0)
                 pport->pblockProcessHolder = puserPvt;
             if(puserPvt->blockDeviceCount>0)
@@ -919,15 +1420,32 @@ static void portThread(port *pport)
             puserPvt->state = callbackIdle;
             if(puserPvt->freeAfterCallback) {
                 puserPvt->freeAfterCallback = FALSE;
-                epicsMutexMustLock(pasynBase->lock);
-                ellAdd(&pasynBase->asynUserFreeList,&puserPvt->node);
-                epicsMutexUnlock(pasynBase->lock);
+                userCachePut(puserPvt);
             }
             if(pport->queueStateChange) break;
         }
         epicsMutexUnlock(pport->asynManagerLock);
     }
 }
+
+static BOOL createPortThread(port *pport)
+{
+    char name[64];
+    epicsThreadId threadid;
+
+    if(pport->numberThreads==0) {
+        epicsSnprintf(name,sizeof(name),"%s",pport->portName);
+    } else {
+        epicsSnprintf(name,sizeof(name),"%s_%d",pport->portName,pport->numberThreads);
+    }
+    threadid = epicsThreadCreate(name,pport->threadPriority,
+        pport->threadStackSize,(EPICSTHREADFUNC)portThread,pport);
+    if(!threadid) return FALSE;
+    if(pport->numberThreads==0) pport->threadid = threadid;
+    pport->numberThreads++;
+    return TRUE;
+}
+
 static void queueLockPortCallback(asynUser *pasynUser)
 {
     userPvt  *puserPvt = asynUserToUserPvt(pasynUser);
@@ -1017,8 +1535,6 @@ static void reportPrintPort(printPortArgs *pprintPortArgs)
         showDevices = 0;
         details = -details;
     }
-    for(i=asynQueuePriorityLow; i<=asynQueuePriorityConnect; i++) 
-        nQueued += ellCount(&pport->queueList[i]);
     pdpc = &pport->dpc;
     fprintf(fp,"%s multiDevice:%s canBlock:%s autoConnect:%s\n",
         pport->portName,
@@ -1031,17 +1547,36 @@ static void reportPrintPort(printPortArgs *pprintPortArgs)
         syncStatus = epicsMutexTryLock(pport->synchronousLock);
         if(syncStatus==epicsMutexLockOK)
              epicsMutexUnlock(pport->synchronousLock);
+        /* The queues can only be walked with the lock, and the report
+         * must not wait for a port that is stuck holding it */
         mgrStatus = epicsMutexTryLock(pport->asynManagerLock);
-        if(mgrStatus==epicsMutexLockOK)
-             epicsMutexUnlock(pport->asynManagerLock);
+        if(mgrStatus==epicsMutexLockOK) {
+            for(i=asynQueuePriorityLow; i<=asynQueuePriorityConnect; i++) {
+                dpQueue *pdpQueue = (dpQueue *)ellFirst(&pport->queueList[i]);
+
+                while(pdpQueue) {
+                    nQueued += ellCount(&pdpQueue->requestList);
+                    pdpQueue = (dpQueue *)ellNext(&pdpQueue->node);
+                }
+            }
+            epicsMutexUnlock(pport->asynManagerLock);
+        }
         fprintf(fp,"    enabled:%s connected:%s numberConnects %lu\n",
             (pdpc->enabled ? "Yes" : "No"),
             (pdpc->connected ? "Yes" : "No"),
              pdpc->numberConnects);
-        fprintf(fp,"    nDevices %d nQueued %d blocked:%s\n",
-            ellCount(&pport->deviceList),
-            nQueued,
-            (pport->pblockProcessHolder ? "Yes" : "No"));
+        if(mgrStatus==epicsMutexLockOK)
+            fprintf(fp,"    nDevices %d nQueued %d blocked:%s\n",
+                ellCount(&pport->deviceList),
+                nQueued,
+                (pport->pblockProcessHolder ? "Yes" : "No"));
+        else
+            fprintf(fp,"    nDevices %d nQueued lock busy blocked:%s\n",
+                ellCount(&pport->deviceList),
+                (pport->pblockProcessHolder ? "Yes" : "No"));
+        if(pport->attributes&ASYN_MULTITHREAD)
+            fprintf(fp,"    portThreads %d active %d\n",
+                pport->numberThreads, pport->numberActive);
         fprintf(fp,"    asynManagerLock:%s synchronousLock:%s\n",
             ((mgrStatus==epicsMutexLockOK) ? "No" : "Yes"),
             ((syncStatus==epicsMutexLockOK) ? "No" : "Yes"));
@@ -1088,8 +1623,15 @@ static void reportPrintPort(printPortArgs *pprintPortArgs)
             pdevice = (device *)ellNext(&pdevice->node);
         }
     }
+    /* An interpose layer may wrap asynCommon to add to the driver report */
+    pinterfaceNode = locateInterfaceNode(&pport->dpc.interposeInterfaceList,
+        asynCommonType,FALSE);
+    if(pinterfaceNode && pinterfaceNode->pasynInterface) {
+        pasynCommon = (asynCommon *)pinterfaceNode->pasynInterface->pinterface;
+        drvPvt = pinterfaceNode->pasynInterface->drvPvt;
+    }
     pinterfaceNode = (interfaceNode *)ellFirst(&pport->interfaceList);
-    while(pinterfaceNode) {
+    while(pinterfaceNode && !pasynCommon) {
         asynInterface *pasynInterface = pinterfaceNode->pasynInterface;
         if(strcmp(pasynInterface->interfaceType,asynCommonType)==0) {
             pasynCommon = (asynCommon *)pasynInterface->pinterface;
@@ -1101,6 +1643,21 @@ static void reportPrintPort(printPortArgs *pprintPortArgs)
     if(pasynCommon) {
         pasynCommon->report(drvPvt,fp,details);
     }
+    /* Interpose layers for a single address, e.g. asynInterposeDelay,
+     * add their own report after the driver's */
+    if (showDevices) {
+        device *pdevice = (device *)ellFirst(&pport->deviceList);
+        while(pdevice) {
+            pinterfaceNode = locateInterfaceNode(
+                &pdevice->dpc.interposeInterfaceList,asynCommonType,FALSE);
+            if(pinterfaceNode && pinterfaceNode->pasynInterface) {
+                asynInterface *pasynInterface = pinterfaceNode->pasynInterface;
+                ((asynCommon *)pasynInterface->pinterface)->report(
+                    pasynInterface->drvPvt,fp,details);
+            }
+            pdevice = (device *)ellNext(&pdevice->node);
+        }
+    }
 #ifdef CYGWIN32
     /* This is a (hopefully) temporary fix for a problem with POSIX threads on Cygwin.
      * If a thread is very short-lived, which this report thread will be if the amount of
@@ -1111,6 +1668,42 @@ static void reportPrintPort(printPortArgs *pprintPortArgs)
     epicsEventSignal(done);
 }
 
+/* Memory is freed by other threads than the one that allocated it,
+ * so the number outstanding is only meaningful summed over all caches */
+static void reportMemory(FILE *fp)
+{
+    memCache      *pmemCache;
+    unsigned long nHit,nMiss,nMalloc,nFree;
+    int           ind;
+
+    fprintf(fp,"asynManager memMalloc/memFree threads %d\n",
+        ellCount(&pasynBase->memCacheList));
+    for(ind=0; ind<nMemList; ind++) {
+        nHit = nMiss = nMalloc = nFree = 0;
+        epicsMutexMustLock(pasynBase->lock);
+        for(pmemCache = (memCache *)ellFirst(&pasynBase->memCacheList);
+        pmemCache; pmemCache = (memCache *)ellNext(&pmemCache->node)) {
+            nHit += pmemCache->nHit[ind];
+            nMiss += pmemCache->nMiss[ind];
+            nMalloc += pmemCache->nMalloc[ind];
+            nFree += pmemCache->nFree[ind];
+        }
+        epicsMutexUnlock(pasynBase->lock);
+        fprintf(fp,"    size %4lu hits %lu misses %lu outstanding bytes %ld\n",
+            (unsigned long)memListSize[ind],nHit,nMiss,
+            (long)(nMalloc-nFree)*(long)memListSize[ind]);
+    }
+    nHit = nMiss = 0;
+    epicsMutexMustLock(pasynBase->lock);
+    for(pmemCache = (memCache *)ellFirst(&pasynBase->memCacheList);
+    pmemCache; pmemCache = (memCache *)ellNext(&pmemCache->node)) {
+        nHit += pmemCache->nUserHit;
+        nMiss += pmemCache->nUserMiss;
+    }
+    epicsMutexUnlock(pasynBase->lock);
+    fprintf(fp,"    createAsynUser hits %lu misses %lu\n",nHit,nMiss);
+}
+
 static void report(FILE *fp,int details,const char *portName)
 {
     port *pport;
@@ -1145,6 +1738,7 @@ static void report(FILE *fp,int details,const char *portName)
             epicsEventMustWait(done);
             pport = (port *)ellNext(&pport->node);
         }
+        if(details>=1) reportMemory(fp);
     }
     epicsEventDestroy(done);
 }
@@ -1156,10 +1750,8 @@ static asynUser *createAsynUser(userCallback process, userCallback timeout)
     int      nbytes;
 
     if(!pasynBase) asynInit();
-    epicsMutexMustLock(pasynBase->lock);
-    puserPvt = (userPvt *)ellFirst(&pasynBase->asynUserFreeList);
+    puserPvt = userCacheGet();
     if(!puserPvt) {
-        epicsMutexUnlock(pasynBase->lock);
         nbytes = sizeof(userPvt) + ERROR_MESSAGE_SIZE + 1;
         puserPvt = callocMustSucceed(1,nbytes,"asynCommon:registerDriver");
         puserPvt->timer = epicsTimerQueueCreateTimer(
@@ -1169,8 +1761,6 @@ static asynUser *createAsynUser(userCallback process, userCallback timeout)
         pasynUser->errorMessage = (char *)(puserPvt +1);
         pasynUser->errorMessageSize = ERROR_MESSAGE_SIZE;
     } else {
-        ellDelete(&pasynBase->asynUserFreeList,&puserPvt->node);
-        epicsMutexUnlock(pasynBase->lock);
         pasynUser = userPvtToAsynUser(puserPvt);
     }
     puserPvt->processUser = process;
@@ -1221,20 +1811,115 @@ static asynStatus freeAsynUser(asynUser *pasynUser)
         status = disconnect(pasynUser);
         if(status!=asynSuccess) return asynError;
     }
-    epicsMutexMustLock(pasynBase->lock);
     if(puserPvt->state==callbackIdle) {
-        ellAdd(&pasynBase->asynUserFreeList,&puserPvt->node);
+        userCachePut(puserPvt);
     } else {
         puserPvt->freeAfterCallback = TRUE;
     }
-    epicsMutexUnlock(pasynBase->lock);
     return asynSuccess;
 }
 
+static void memCacheThreadExit(void *arg)
+{
+    memCache *pmemCache = (memCache *)arg;
+    memNode  *pmemNode;
+    userPvt  *puserPvt;
+    int      ind;
+
+    epicsMutexMustLock(pasynBase->lock);
+    for(ind=0; ind<nMemList; ind++) {
+        while((pmemNode = pmemCache->cached[ind])) {
+            pmemCache->cached[ind] = (memNode *)pmemNode->node.next;
+            ellAdd(&pasynBase->memList[ind],&pmemNode->node);
+        }
+        pmemCache->nCached[ind] = 0;
+    }
+    while((puserPvt = pmemCache->cachedUser)) {
+        pmemCache->cachedUser = (userPvt *)puserPvt->node.next;
+        ellAdd(&pasynBase->asynUserFreeList,&puserPvt->node);
+    }
+    pmemCache->nCachedUser = 0;
+    pmemCache->threadExited = TRUE;
+    epicsMutexUnlock(pasynBase->lock);
+}
+
+static memCache *getMemCache(void)
+{
+    memCache *pmemCache = epicsThreadPrivateGet(pasynBase->memCacheId);
+
+    if(pmemCache) return pmemCache;
+    epicsMutexMustLock(pasynBase->lock);
+    pmemCache = (memCache *)ellFirst(&pasynBase->memCacheList);
+    while(pmemCache && !pmemCache->threadExited)
+        pmemCache = (memCache *)ellNext(&pmemCache->node);
+    if(pmemCache) {
+        pmemCache->threadExited = FALSE;
+    } else {
+        pmemCache = callocMustSucceed(1,sizeof(memCache),
+            "asynManager::getMemCache");
+        ellAdd(&pasynBase->memCacheList,&pmemCache->node);
+    }
+    epicsMutexUnlock(pasynBase->lock);
+    epicsThreadPrivateSet(pasynBase->memCacheId,pmemCache);
+    /*Without epicsAtThreadExit the nodes cached by a thread that exits are lost*/
+#if !LT_EPICSBASE(3,15,0,1)
+    epicsAtThreadExit(memCacheThreadExit,pmemCache);
+#endif
+    return pmemCache;
+}
+
+/* Returns NULL if no free userPvt is available*/
+static userPvt *userCacheGet(void)
+{
+    memCache *pmemCache = getMemCache();
+    userPvt  *puserPvt;
+
+    if(pmemCache->cachedUser) {
+        pmemCache->nUserHit++;
+    } else {
+        pmemCache->nUserMiss++;
+        epicsMutexMustLock(pasynBase->lock);
+        while(pmemCache->nCachedUser<MEM_CACHE_BATCH
+        && (puserPvt = (userPvt *)ellGet(&pasynBase->asynUserFreeList))) {
+            puserPvt->node.next = (ELLNODE *)pmemCache->cachedUser;
+            pmemCache->cachedUser = puserPvt;
+            pmemCache->nCachedUser++;
+        }
+        epicsMutexUnlock(pasynBase->lock);
+    }
+    puserPvt = pmemCache->cachedUser;
+    if(puserPvt) {
+        pmemCache->cachedUser = (userPvt *)puserPvt->node.next;
+        pmemCache->nCachedUser--;
+    }
+    return puserPvt;
+}
+
+static void userCachePut(userPvt *puserPvt)
+{
+    memCache *pmemCache = getMemCache();
+
+    if(pmemCache->nCachedUser>=MEM_CACHE_SIZE) {
+        userPvt *pflush;
+
+        epicsMutexMustLock(pasynBase->lock);
+        while(pmemCache->nCachedUser>MEM_CACHE_BATCH) {
+            pflush = pmemCache->cachedUser;
+            pmemCache->cachedUser = (userPvt *)pflush->node.next;
+            pmemCache->nCachedUser--;
+            ellAdd(&pasynBase->asynUserFreeList,&pflush->node);
+        }
+        epicsMutexUnlock(pasynBase->lock);
+    }
+    puserPvt->node.next = (ELLNODE *)pmemCache->cachedUser;
+    pmemCache->cachedUser = puserPvt;
+    pmemCache->nCachedUser++;
+}
+
 static void *memMalloc(size_t size)
 {
     int ind;
-    ELLLIST *pmemList;
+    memCache *pmemCache;
     memNode *pmemNode;
     
     if(!pasynBase) asynInit();
@@ -1244,25 +1929,38 @@ static void *memMalloc(size_t size)
     if(ind>=nMemList) {
         return mallocMustSucceed(size,"asynManager::memMalloc");
     }
-    pmemList = &pasynBase->memList[ind];
-    epicsMutexMustLock(pasynBase->lock);
-    pmemNode = (memNode *)ellFirst(pmemList);
+    pmemCache = getMemCache();
+    pmemCache->nMalloc[ind]++;
+    if(pmemCache->cached[ind]) {
+        pmemCache->nHit[ind]++;
+    } else {
+        pmemCache->nMiss[ind]++;
+        epicsMutexMustLock(pasynBase->lock);
+        while(pmemCache->nCached[ind]<MEM_CACHE_BATCH
+        && (pmemNode = (memNode *)ellGet(&pasynBase->memList[ind]))) {
+            pmemNode->node.next = (ELLNODE *)pmemCache->cached[ind];
+            pmemCache->cached[ind] = pmemNode;
+            pmemCache->nCached[ind]++;
+        }
+        epicsMutexUnlock(pasynBase->lock);
+    }
+    pmemNode = pmemCache->cached[ind];
     if(pmemNode) {
-         ellDelete(pmemList,&pmemNode->node);
-     } else {
+        pmemCache->cached[ind] = (memNode *)pmemNode->node.next;
+        pmemCache->nCached[ind]--;
+    } else {
         /* Note: pmemNode->memory must be multiple of 16 in order to hold any data type */
         pmemNode = mallocMustSucceed(NODESIZE + memListSize[ind],
              "asynManager::memMalloc");
         pmemNode->memory = (char *)pmemNode + NODESIZE;
-     }
-     epicsMutexUnlock(pasynBase->lock);
-     return pmemNode->memory;
+    }
+    return pmemNode->memory;
 }
 
 static void memFree(void *pmem,size_t size)
 {
     int ind;
-    ELLLIST *pmemList;
+    memCache *pmemCache;
     memNode *pmemNode;
     
     assert(size>0);
@@ -1275,12 +1973,25 @@ static void memFree(void *pmem,size_t size)
         if(size<=memListSize[ind]) break;
     }
     assert(ind<nMemList);
-    pmemList = &pasynBase->memList[ind];
     pmemNode = (memNode *)((char *)pmem - NODESIZE);
     assert(pmemNode->memory==pmem);
-    epicsMutexMustLock(pasynBase->lock);
-    ellAdd(pmemList,&pmemNode->node);
-    epicsMutexUnlock(pasynBase->lock);
+    pmemCache = getMemCache();
+    pmemCache->nFree[ind]++;
+    if(pmemCache->nCached[ind]>=MEM_CACHE_SIZE) {
+        memNode *pflush;
+
+        epicsMutexMustLock(pasynBase->lock);
+        while(pmemCache->nCached[ind]>MEM_CACHE_BATCH) {
+            pflush = pmemCache->cached[ind];
+            pmemCache->cached[ind] = (memNode *)pflush->node.next;
+            pmemCache->nCached[ind]--;
+            ellAdd(&pasynBase->memList[ind],&pflush->node);
+        }
+        epicsMutexUnlock(pasynBase->lock);
+    }
+    pmemNode->node.next = (ELLNODE *)pmemCache->cached[ind];
+    pmemCache->cached[ind] = pmemNode;
+    pmemCache->nCached[ind]++;
 }
 
 static asynStatus isMultiDevice(asynUser *pasynUser,
@@ -1558,16 +2269,14 @@ static asynStatus queueRequest(asynUser *pasynUser,
         asynPrint(pasynUser,ASYN_TRACE_FLOW,
             "%s addr %d queueRequest priority %d from lockHolder\n",
             pport->portName,addr,priority);
-        ellInsert(&pport->queueList[priority],0,&puserPvt->node);
     } else {
         asynPrint(pasynUser,ASYN_TRACE_FLOW,
             "%s addr %d queueRequest priority %d not lockHolder\n",
             pport->portName,addr,priority);
-        /*Add to end of list*/
-        ellAdd(&pport->queueList[priority],&puserPvt->node);
     }
+    queueAdd(pport,puserPvt,&pdpCommon->queue[priority],addToFront);
     pport->queueStateChange = TRUE;
-    puserPvt->isQueued = TRUE;
+    pport->queueChanges++;
     if(timeout<=0.0) {
         puserPvt->timeout = 0.0;
     } else {
@@ -1588,7 +2297,6 @@ static asynStatus cancelRequest(asynUser *pasynUser,int *wasQueued)
     device   *pdevice = puserPvt->pdevice;
     double   timeout;
     int      addr = (pdevice ? pdevice->addr : -1);
-    int      i;
     *wasQueued = 0; /*Initialize to not removed*/
     if(!pport) {
         asynPrint(pasynUser,ASYN_TRACE_ERROR,
@@ -1612,30 +2320,20 @@ static asynStatus cancelRequest(asynUser *pasynUser,int *wasQueued)
         }
         return asynSuccess;
     }
-    for(i=asynQueuePriorityConnect; i>=asynQueuePriorityLow; i--) {
-        puserPvt = (userPvt *)ellFirst(&pport->queueList[i]);
-        while(puserPvt) {
-            if(pasynUser == &puserPvt->user) {
-                ellDelete(&pport->queueList[i],&puserPvt->node);
-                *wasQueued = 1;
-                break;
-            }
-            puserPvt = (userPvt *)ellNext(&puserPvt->node);
-        }
-        if(puserPvt) break;
-    }
-    if(!puserPvt) {
+    if(!puserPvt->pdpQueue) {
         asynPrint(pasynUser,ASYN_TRACE_ERROR,
             "%s addr %d asynManager:cancelRequest LOGIC ERROR\n",
             pport->portName, addr);
         epicsMutexUnlock(pport->asynManagerLock);
         return asynError;
     }
+    queueRemove(pport,puserPvt);
+    *wasQueued = 1;
     asynPrint(pasynUser,ASYN_TRACE_FLOW,
              "%s addr %d asynManager:cancelRequest\n",
               pport->portName,addr);
-    puserPvt->isQueued = FALSE;
     pport->queueStateChange = TRUE;
+    pport->queueChanges++;
     timeout = puserPvt->timeout;
     epicsMutexUnlock(pport->asynManagerLock);
     if(puserPvt->timer && timeout>0.0) epicsTimerCancel(puserPvt->timer);
@@ -1672,6 +2370,14 @@ static asynStatus blockProcessCallback(asynUser *pasynUser, int allDevices)
         puserPvt->blockPortCount++;
     else 
         puserPvt->blockDeviceCount++;
+    /* If called from processCallback other port threads must not start
+     * requests before this one completes and becomes the holder */
+    if((pport->attributes&ASYN_MULTITHREAD) && puserPvt->state==callbackActive) {
+        if(allDevices)
+            pport->pblockProcessHolder = puserPvt;
+        else
+            findDpCommon(puserPvt)->pblockProcessHolder = puserPvt;
+    }
     epicsMutexUnlock(pport->asynManagerLock);
     return asynSuccess;
 }
@@ -1738,7 +2444,13 @@ static asynStatus lockPort(asynUser *pasynUser)
         return asynError;
     }
     asynPrint(pasynUser,ASYN_TRACE_FLOW,"%s lockPort\n", pport->portName);
-    epicsMutexMustLock(pport->synchronousLock);
+    if(lockOrderViolation(pport,findDpCommon(puserPvt)->pdevice)) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                "asynManager::lockPort %s this thread holds a device lock, "
+                "the port must be locked first",pport->portName);
+        return asynError;
+    }
+    lockSynchronous(pport,findDpCommon(puserPvt)->pdevice);
     if(pport->pasynLockPortNotify) {
         pport->pasynLockPortNotify->lock(
            pport->lockPortNotifyPvt,pasynUser);
@@ -1762,11 +2474,11 @@ static asynStatus unlockPort(asynUser *pasynUser)
         status = pport->pasynLockPortNotify->unlock(
            pport->lockPortNotifyPvt,pasynUser);
         if(status!=asynSuccess) {
-            epicsMutexUnlock(pport->synchronousLock);
+            unlockSynchronous(pport,findDpCommon(puserPvt)->pdevice);
             return status;
         }
     }
-    epicsMutexUnlock(pport->synchronousLock);
+    unlockSynchronous(pport,findDpCommon(puserPvt)->pdevice);
     return asynSuccess;
 }
 
@@ -1786,6 +2498,12 @@ static asynStatus queueLockPort(asynUser *pasynUser)
         return asynError;
     }
     if (pport->attributes & ASYN_CANBLOCK) {   /* Asynchronous driver */
+        if (lockOrderViolation(pport,findDpCommon(puserPvt)->pdevice)) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                "asynManager::queueLockPort %s this thread holds a device lock, "
+                "the port must be locked first",pport->portName);
+            return asynError;
+        }
         plockPortPvt = epicsThreadPrivateGet(pport->queueLockPortId);
         if (!plockPortPvt) {
             /* This is the first time queueLockPort has been called for this thread */
@@ -1970,9 +2688,19 @@ static asynStatus registerPort(const char *portName,
     pport = callocMustSucceed(len,sizeof(char),"asynCommon:registerDriver");
     pport->portName = (char *)(pport + 1);
     strcpy(pport->portName,portName);
+    if((attributes&ASYN_MULTITHREAD)
+    && (!(attributes&ASYN_MULTIDEVICE) || !(attributes&ASYN_CANBLOCK))) {
+        printf("asynCommon:registerDriver %s ASYN_MULTITHREAD ignored, "
+            "port must be ASYN_MULTIDEVICE and ASYN_CANBLOCK\n",portName);
+        attributes &= ~ASYN_MULTITHREAD;
+    }
     pport->attributes = attributes;
     pport->asynManagerLock = epicsMutexMustCreate();
     pport->synchronousLock = epicsMutexMustCreate();
+    if(attributes&ASYN_MULTITHREAD) {
+        pport->deviceUnlockEvent = epicsEventMustCreate(epicsEventEmpty);
+        pport->deviceLocksHeldId = epicsThreadPrivateCreate();
+    }
     pport->queueLockPortId = epicsThreadPrivateCreate();
     pport->timeStampSource = defaultTimeStampSource;
     dpCommonInit(pport,0,autoConnect);
@@ -1988,9 +2716,9 @@ static asynStatus registerPort(const char *portName,
         stackSize = stackSize ?
                        stackSize :
                        epicsThreadGetStackSize(epicsThreadStackMedium);
-        pport->threadid = epicsThreadCreate(portName,priority,stackSize,        
-             (EPICSTHREADFUNC)portThread,pport);
-        if(!pport->threadid){
+        pport->threadPriority = priority;
+        pport->threadStackSize = stackSize;
+        if(!createPortThread(pport)){
             printf("asynCommon:registerDriver %s epicsThreadCreate failed \n",
                 portName);
             epicsEventDestroy(pport->notifyPortThread);
@@ -2002,8 +2730,17 @@ static asynStatus registerPort(const char *portName,
             return asynError;
         }
     }
+    if(attributes&ASYN_MULTITHREAD) {
+        while(pport->numberThreads<DEFAULT_PORT_THREADS) {
+            if(!createPortThread(pport)) {
+                printf("asynCommon:registerDriver %s epicsThreadCreate failed, "
+                    "using %d port threads\n",portName,pport->numberThreads);
+                break;
+            }
+        }
+    }
     epicsMutexMustLock(pasynBase->lock);
-    ellAdd(&pasynBase->asynPortList,&pport->node);
+    addPort(pport);
     epicsMutexUnlock(pasynBase->lock);
     return asynSuccess;
 }
@@ -2227,6 +2964,42 @@ static asynStatus setQueueLockPortTimeout(asynUser *pasynUser, double timeout)
     return asynSuccess;
 }
 
+static asynStatus setPortThreads(asynUser *pasynUser, int nThreads)
+{
+    userPvt    *puserPvt = asynUserToUserPvt(pasynUser);
+    port *pport = puserPvt->pport;
+    asynStatus status = asynSuccess;
+
+    if(!pport) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager:setPortThreads not connected to device");
+        return asynError;
+    }
+    if(!(pport->attributes&ASYN_MULTITHREAD)) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager:setPortThreads port %s is not ASYN_MULTITHREAD",
+            pport->portName);
+        return asynError;
+    }
+    epicsMutexMustLock(pport->asynManagerLock);
+    if(nThreads<pport->numberThreads) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager:setPortThreads port %s already has %d threads",
+            pport->portName,pport->numberThreads);
+        status = asynError;
+    }
+    while(status==asynSuccess && pport->numberThreads<nThreads) {
+        if(!createPortThread(pport)) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                "asynManager:setPortThreads port %s epicsThreadCreate failed",
+                pport->portName);
+            status = asynError;
+        }
+    }
+    epicsMutexUnlock(pport->asynManagerLock);
+    return status;
+}
+
 static asynStatus registerInterruptSource(const char *portName,
     asynInterface *pasynInterface, void **pasynPvt)
 {
@@ -2263,6 +3036,7 @@ static asynStatus registerInterruptSource(const char *portName,
     pinterfaceNode->pinterruptBase = pinterruptBase;
     ellInit(&pinterruptBase->callbackList);
     ellInit(&pinterruptBase->addRemoveList);
+    ellInit(&pinterruptBase->emptyList);
     pinterruptBase->pasynInterface = pinterfaceNode->pasynInterface;
     pinterruptBase->pport = pport;
     *pasynPvt = pinterruptBase;
@@ -2321,6 +3095,8 @@ static interruptNode *createInterruptNode(void *pasynPvt)
         epicsMutexUnlock(pasynBase->lock);
         pinterruptNodePvt->isOnList = 0;
         pinterruptNodePvt->isOnAddRemoveList = 0;
+        pinterruptNodePvt->pinterruptReason[0] = 0;
+        pinterruptNodePvt->pinterruptReason[1] = 0;
         memset(&pinterruptNodePvt->nodePublic,0,sizeof(interruptNode));
     } else {
         epicsMutexUnlock(pasynBase->lock);
@@ -2359,7 +3135,10 @@ static asynStatus addInterruptUser(asynUser *pasynUser,
     interruptNodePvt *pinterruptNodePvt = interruptNodeToPvt(pinterruptNode);
     interruptBase    *pinterruptBase = pinterruptNodePvt->pinterruptBase;
     port             *pport = pinterruptBase->pport;
+    int              addr;
     
+    /* The user is indexed by the reason and address it has at this time */
+    if(getAddr(pasynUser,&addr)!=asynSuccess) addr = -1;
     epicsMutexMustLock(pport->asynManagerLock);
     if(pinterruptNodePvt->isOnList) {
         epicsMutexUnlock(pport->asynManagerLock);
@@ -2383,6 +3162,9 @@ static asynStatus addInterruptUser(asynUser *pasynUser,
     }
     ellAdd(&pinterruptBase->callbackList,&pinterruptNode->node);
     pinterruptNodePvt->isOnList = TRUE;
+    addReasonNode(pinterruptBase,pinterruptNodePvt,0,pasynUser->reason,addr);
+    addReasonNode(pinterruptBase,pinterruptNodePvt,1,pasynUser->reason,
+        ASYN_ANY_ADDR);
     epicsMutexUnlock(pport->asynManagerLock);
     return asynSuccess;
 }
@@ -2417,6 +3199,8 @@ static asynStatus removeInterruptUser(asynUser *pasynUser,
     }
     ellDelete(&pinterruptBase->callbackList,&pinterruptNode->node);
     pinterruptNodePvt->isOnList = FALSE;
+    removeReasonNode(pinterruptBase,pinterruptNodePvt,0);
+    removeReasonNode(pinterruptBase,pinterruptNodePvt,1);
     epicsMutexUnlock(pport->asynManagerLock);
     return asynSuccess;
 }
@@ -2434,6 +3218,24 @@ static asynStatus interruptStart(void *pasynPvt,ELLLIST **plist)
     return asynSuccess;
 }
 
+static asynStatus interruptStartReason(void *pasynPvt,int reason,int addr,
+                                   ELLLIST **plist)
+{
+    interruptBase  *pinterruptBase = (interruptBase *)pasynPvt;
+    port *pport = pinterruptBase->pport;
+    interruptReason *pinterruptReason;
+
+    epicsMutexMustLock(pport->asynManagerLock);
+    pinterruptBase->callbackActive = TRUE;
+    pinterruptBase->listModified = FALSE;
+    pinterruptReason = locateInterruptReason(pinterruptBase,reason,addr,FALSE);
+    epicsMutexUnlock(pport->asynManagerLock);
+    /* While callbackActive the list can not change, not even become empty */
+    *plist = (pinterruptReason ? &pinterruptReason->userList
+                               : &pinterruptBase->emptyList);
+    return asynSuccess;
+}
+
 static asynStatus interruptEnd(void *pasynPvt)
 {
     interruptBase  *pinterruptBase = (interruptBase *)pasynPvt;
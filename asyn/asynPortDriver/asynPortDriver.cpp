@@ -9,6 +9,7 @@
  */
 
 #include <vector>
+#include <map>
 #include <memory>
 
 #include <stdlib.h>
@@ -39,6 +40,55 @@
 
 static const char *driverName = "asynPortDriver";
 
+/** Class to iterate over the interrupt clients registered for one reason and address.
+  * It uses the reason index maintained by asynManager so the cost of a callback
+  * does not depend on the number of clients registered for other parameters.
+  * The address of each client is still found with the virtual getAddress method at the time
+  * of the callback, so a derived class that overrides getAddress gets the same clients
+  * as when every client was checked. */
+template <typename interruptType>
+class interruptClientList {
+public:
+    interruptClientList(asynPortDriver *pPort, void *interruptPvt, int reason, int addr)
+        : pPort(pPort), interruptPvt(interruptPvt), addr(addr), pnode(NULL)
+    {
+        pasynManager->interruptStartReason(interruptPvt, reason, ASYN_ANY_ADDR, &pclientList);
+    }
+    ~interruptClientList()
+    {
+        pasynManager->interruptEnd(interruptPvt);
+    }
+    /** Returns the next client for the address, or NULL when there are no more clients. */
+    interruptType *next()
+    {
+        int address;
+
+        for (;;) {
+            pnode = pnode ? (interruptReasonNode *)ellNext(&pnode->node)
+                          : (interruptReasonNode *)ellFirst(pclientList);
+            if (!pnode) return NULL;
+            interruptType *pInterrupt = (interruptType *)pnode->pinterruptNode->drvPvt;
+            pPort->getAddress(pInterrupt->pasynUser, &address);
+            /* If this is not a multi-device then address is -1, change to 0 */
+            if (address == -1) address = 0;
+            if (address == addr) return pInterrupt;
+        }
+    }
+private:
+    asynPortDriver *pPort;
+    void *interruptPvt;
+    int addr;
+    ELLLIST *pclientList;
+    interruptReasonNode *pnode;
+};
+
+/** Orders parameter names the same way paramVal::nameEquals compares them, i.e. case-insensitive */
+struct paramNameLess {
+    bool operator()(const char *a, const char *b) const {
+        return epicsStrCaseCmp(a, b) < 0;
+    }
+};
+
 /** Class to support parameter library (also called parameter list);
   * set and get values indexed by parameter number (pasynUser->reason)
   * and do asyn callbacks when parameters change.
@@ -88,8 +138,11 @@ private:
     void registerParameterChange(paramVal *param, int index);
 
     asynPortDriver *pasynPortDriver;
-    std::vector<unsigned> flags;
+    std::vector<unsigned> flags;     /* Changed parameters, in the order they changed */
+    std::vector<char> flagged;       /* flagged[i] is true if i is in flags */
     std::vector<paramVal*> vals;
+    /* Index of vals by name, the keys point to the names owned by vals */
+    std::map<const char*, int, paramNameLess> nameIndex;
 };
 
 /** Constructor for paramList class.
@@ -107,12 +160,11 @@ paramList::~paramList()
 
 asynStatus paramList::setFlag(int index)
 {
-    size_t i;
-
     if (index < 0 || (size_t)index >= this->vals.size()) return asynParamBadIndex;
     /* See if we have already set the flag for this parameter */
-    for (i=0; i<flags.size(); i++) if (flags[i] == (unsigned)index) return asynSuccess;
-    /* If not found add a flag */
+    if (this->flagged[index]) return asynSuccess;
+    /* If not add a flag */
+    this->flagged[index] = 1;
     this->flags.push_back((unsigned)index);
     return asynSuccess;
 }
@@ -134,9 +186,11 @@ asynStatus paramList::createParam(const char *name, asynParamType type, int *ind
     std::auto_ptr<paramVal> param(new paramVal(name, type));
 
     vals.push_back(param.get());
+    flagged.push_back(0);
     flags.reserve(vals.size());
     param.release();
     *index = vals.size()-1;
+    nameIndex[vals[*index]->getName()] = *index;
     return asynSuccess;
 }
 
@@ -155,11 +209,11 @@ asynStatus paramList::getNumParams(int *numParams)
   * \return Returns asynParamNotFound if name is not found in the parameter list. */
 asynStatus paramList::findParam(const char *name, int *index)
 {
-    for (size_t i=0; i<this->vals.size(); i++) {
-        if (this->vals[i]->nameEquals(name)) {
-            *index = i;
-            return asynSuccess;
-        }
+    std::map<const char*, int, paramNameLess>::const_iterator it;
+
+    if (name && ((it = this->nameIndex.find(name)) != this->nameIndex.end())) {
+        *index = it->second;
+        return asynSuccess;
     }
     *index=-1;
     return asynParamNotFound;
@@ -607,12 +661,10 @@ asynStatus paramList::getName(int index, const char **value)
 /** Calls the registered asyn callback functions for all clients for an integer parameter */
 asynStatus paramList::int32Callback(int command, int addr)
 {
-    ELLLIST *pclientList;
-    interruptNode *pnode;
+    asynInt32Interrupt *pInterrupt;
     asynStandardInterfaces *pInterfaces = this->pasynPortDriver->getAsynStdInterfaces();
     epicsTimeStamp timeStamp;
     this->pasynPortDriver->getTimeStamp(&timeStamp);
-    int address;
     epicsInt32 value;
     int alarmStatus=0;
     int alarmSeverity=0;
@@ -623,40 +675,29 @@ asynStatus paramList::int32Callback(int command, int addr)
     getAlarmStatus(command, &alarmStatus);
     getAlarmSeverity(command, &alarmSeverity);
     if (!pInterfaces->int32InterruptPvt) return asynParamNotFound;
-    pasynManager->interruptStart(pInterfaces->int32InterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynInt32Interrupt *pInterrupt = (asynInt32Interrupt *) pnode->drvPvt;
-        this->pasynPortDriver->getAddress(pInterrupt->pasynUser, &address);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (address == -1) address = 0;
-        if ((command == pInterrupt->pasynUser->reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 value);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+    interruptClientList<asynInt32Interrupt> clients(this->pasynPortDriver, pInterfaces->int32InterruptPvt,
+        command, addr);
+    while ((pInterrupt = clients.next())) {
+        /* Set the status for the callback */
+        pInterrupt->pasynUser->auxStatus = status;
+        pInterrupt->pasynUser->alarmStatus = alarmStatus;
+        pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
+        /* Set the timestamp for the callback */
+        pInterrupt->pasynUser->timestamp = timeStamp;
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             value);
     }
-    pasynManager->interruptEnd(pInterfaces->int32InterruptPvt);
     return asynSuccess;
 }
 
 /** Calls the registered asyn callback functions for all clients for a 64-bit integer parameter */
 asynStatus paramList::int64Callback(int command, int addr)
 {
-    ELLLIST *pclientList;
-    interruptNode *pnode;
+    asynInt64Interrupt *pInterrupt;
     asynStandardInterfaces *pInterfaces = this->pasynPortDriver->getAsynStdInterfaces();
     epicsTimeStamp timeStamp;
     this->pasynPortDriver->getTimeStamp(&timeStamp);
-    int address;
     epicsInt64 value;
     int alarmStatus=0;
     int alarmSeverity=0;
@@ -667,40 +708,29 @@ asynStatus paramList::int64Callback(int command, int addr)
     getAlarmStatus(command, &alarmStatus);
     getAlarmSeverity(command, &alarmSeverity);
     if (!pInterfaces->int64InterruptPvt) return asynParamNotFound;
-    pasynManager->interruptStart(pInterfaces->int64InterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynInt64Interrupt *pInterrupt = (asynInt64Interrupt *) pnode->drvPvt;
-        this->pasynPortDriver->getAddress(pInterrupt->pasynUser, &address);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (address == -1) address = 0;
-        if ((command == pInterrupt->pasynUser->reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 value);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+    interruptClientList<asynInt64Interrupt> clients(this->pasynPortDriver, pInterfaces->int64InterruptPvt,
+        command, addr);
+    while ((pInterrupt = clients.next())) {
+        /* Set the status for the callback */
+        pInterrupt->pasynUser->auxStatus = status;
+        pInterrupt->pasynUser->alarmStatus = alarmStatus;
+        pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
+        /* Set the timestamp for the callback */
+        pInterrupt->pasynUser->timestamp = timeStamp;
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             value);
     }
-    pasynManager->interruptEnd(pInterfaces->int64InterruptPvt);
     return asynSuccess;
 }
 
 /** Calls the registered asyn callback functions for all clients for an UInt32 parameter */
 asynStatus paramList::uint32Callback(int command, int addr, epicsUInt32 interruptMask)
 {
-    ELLLIST *pclientList;
-    interruptNode *pnode;
+    asynUInt32DigitalInterrupt *pInterrupt;
     asynStandardInterfaces *pInterfaces = this->pasynPortDriver->getAsynStdInterfaces();
     epicsTimeStamp timeStamp;
     this->pasynPortDriver->getTimeStamp(&timeStamp);
-    int address;
     epicsUInt32 value;
     int alarmStatus=0;
     int alarmSeverity=0;
@@ -711,41 +741,30 @@ asynStatus paramList::uint32Callback(int command, int addr, epicsUInt32 interrup
     getAlarmStatus(command, &alarmStatus);
     getAlarmSeverity(command, &alarmSeverity);
     if (!pInterfaces->uInt32DigitalInterruptPvt) return asynParamNotFound;
-    pasynManager->interruptStart(pInterfaces->uInt32DigitalInterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynUInt32DigitalInterrupt *pInterrupt = (asynUInt32DigitalInterrupt *) pnode->drvPvt;
-        this->pasynPortDriver->getAddress(pInterrupt->pasynUser, &address);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (address == -1) address = 0;
-        if ((command == pInterrupt->pasynUser->reason) &&
-            (address == addr) &&
-            (pInterrupt->mask & interruptMask)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 pInterrupt->mask & value);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+    interruptClientList<asynUInt32DigitalInterrupt> clients(this->pasynPortDriver, pInterfaces->uInt32DigitalInterruptPvt,
+        command, addr);
+    while ((pInterrupt = clients.next())) {
+        if (!(pInterrupt->mask & interruptMask)) continue;
+        /* Set the status for the callback */
+        pInterrupt->pasynUser->auxStatus = status;
+        pInterrupt->pasynUser->alarmStatus = alarmStatus;
+        pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
+        /* Set the timestamp for the callback */
+        pInterrupt->pasynUser->timestamp = timeStamp;
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             pInterrupt->mask & value);
     }
-    pasynManager->interruptEnd(pInterfaces->uInt32DigitalInterruptPvt);
     return asynSuccess;
 }
 
 /** Calls the registered asyn callback functions for all clients for a double parameter */
 asynStatus paramList::float64Callback(int command, int addr)
 {
-    ELLLIST *pclientList;
-    interruptNode *pnode;
+    asynFloat64Interrupt *pInterrupt;
     asynStandardInterfaces *pInterfaces = this->pasynPortDriver->getAsynStdInterfaces();
     epicsTimeStamp timeStamp;
     this->pasynPortDriver->getTimeStamp(&timeStamp);
-    int address;
     epicsFloat64 value;
     int alarmStatus=0;
     int alarmSeverity=0;
@@ -756,40 +775,29 @@ asynStatus paramList::float64Callback(int command, int addr)
     getAlarmStatus(command, &alarmStatus);
     getAlarmSeverity(command, &alarmSeverity);
     if (!pInterfaces->float64InterruptPvt) return asynParamNotFound;
-    pasynManager->interruptStart(pInterfaces->float64InterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynFloat64Interrupt *pInterrupt = (asynFloat64Interrupt *) pnode->drvPvt;
-        this->pasynPortDriver->getAddress(pInterrupt->pasynUser, &address);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (address == -1) address = 0;
-        if ((command == pInterrupt->pasynUser->reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 value);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+    interruptClientList<asynFloat64Interrupt> clients(this->pasynPortDriver, pInterfaces->float64InterruptPvt,
+        command, addr);
+    while ((pInterrupt = clients.next())) {
+        /* Set the status for the callback */
+        pInterrupt->pasynUser->auxStatus = status;
+        pInterrupt->pasynUser->alarmStatus = alarmStatus;
+        pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
+        /* Set the timestamp for the callback */
+        pInterrupt->pasynUser->timestamp = timeStamp;
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             value);
     }
-    pasynManager->interruptEnd(pInterfaces->float64InterruptPvt);
     return asynSuccess;
 }
 
 /** Calls the registered asyn callback functions for all clients for a string parameter */
 asynStatus paramList::octetCallback(int command, int addr)
 {
-    ELLLIST *pclientList;
-    interruptNode *pnode;
+    asynOctetInterrupt *pInterrupt;
     asynStandardInterfaces *pInterfaces = this->pasynPortDriver->getAsynStdInterfaces();
     epicsTimeStamp timeStamp;
     this->pasynPortDriver->getTimeStamp(&timeStamp);
-    int address;
     char *value;
     int alarmStatus=0;
     int alarmSeverity=0;
@@ -801,28 +809,19 @@ asynStatus paramList::octetCallback(int command, int addr)
     getAlarmStatus(command, &alarmStatus);
     getAlarmSeverity(command, &alarmSeverity);
     if (!pInterfaces->octetInterruptPvt) return asynParamNotFound;
-    pasynManager->interruptStart(pInterfaces->octetInterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynOctetInterrupt *pInterrupt = (asynOctetInterrupt *) pnode->drvPvt;
-        this->pasynPortDriver->getAddress(pInterrupt->pasynUser, &address);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (address == -1) address = 0;
-        if ((command == pInterrupt->pasynUser->reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 value, strlen(value)+1, ASYN_EOM_END);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+    interruptClientList<asynOctetInterrupt> clients(this->pasynPortDriver, pInterfaces->octetInterruptPvt,
+        command, addr);
+    while ((pInterrupt = clients.next())) {
+        /* Set the status for the callback */
+        pInterrupt->pasynUser->auxStatus = status;
+        pInterrupt->pasynUser->alarmStatus = alarmStatus;
+        pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
+        /* Set the timestamp for the callback */
+        pInterrupt->pasynUser->timestamp = timeStamp;
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             value, strlen(value)+1, ASYN_EOM_END);
     }
-    pasynManager->interruptEnd(pInterfaces->octetInterruptPvt);
     return asynSuccess;
 }
 
@@ -871,6 +870,8 @@ asynStatus paramList::callCallbacks(int addr)
     catch (ParamListInvalidIndex&) {
         return asynParamBadIndex;
     }
+    for (size_t i = 0; i < this->flags.size(); i++)
+        this->flagged[this->flags[i]] = 0;
     flags.clear();
     return status;
 }
@@ -1728,39 +1729,27 @@ template <typename epicsType, typename interruptType>
 asynStatus asynPortDriver::doCallbacksArray(epicsType *value, size_t nElements,
                                             int reason, int address, void *interruptPvt)
 {
-    ELLLIST *pclientList;
-    interruptNode *pnode;
+    interruptType *pInterrupt;
     asynStatus status;
     int alarmStatus;
     int alarmSeverity;
     epicsTimeStamp timeStamp; getTimeStamp(&timeStamp);
-    int addr;
 
-    pasynManager->interruptStart(interruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
     getParamStatus(address, reason, &status);
     getParamAlarmStatus(address, reason, &alarmStatus);
     getParamAlarmSeverity(address, reason, &alarmSeverity);
-    while (pnode) {
-        interruptType *pInterrupt = (interruptType *)pnode->drvPvt;
-        this->getAddress(pInterrupt->pasynUser, &addr);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (addr == -1) addr = 0;
-        if ((pInterrupt->pasynUser->reason == reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 value, nElements);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+    interruptClientList<interruptType> clients(this, interruptPvt, reason, address);
+    while ((pInterrupt = clients.next())) {
+        /* Set the status for the callback */
+        pInterrupt->pasynUser->auxStatus = status;
+        pInterrupt->pasynUser->alarmStatus = alarmStatus;
+        pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
+        /* Set the timestamp for the callback */
+        pInterrupt->pasynUser->timestamp = timeStamp;
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             value, nElements);
     }
-    pasynManager->interruptEnd(interruptPvt);
     return asynSuccess;
 }
 
@@ -3096,39 +3085,28 @@ asynStatus asynPortDriver::writeGenericPointer(asynUser *pasynUser, void *generi
   * \param[in] address A client will be called if address matches the address registered for that client. */
 asynStatus asynPortDriver::doCallbacksGenericPointer(void *genericPointer, int reason, int address)
 {
-    ELLLIST *pclientList;
-    interruptNode *pnode;
+    asynGenericPointerInterrupt *pInterrupt;
     epicsTimeStamp timeStamp; getTimeStamp(&timeStamp);
     asynStatus status;
     int alarmStatus;
     int alarmSeverity;
-    int addr;
 
     getParamStatus(address, reason, &status);
     getParamAlarmStatus(address, reason, &alarmStatus);
     getParamAlarmSeverity(address, reason, &alarmSeverity);
-    pasynManager->interruptStart(this->asynStdInterfaces.genericPointerInterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynGenericPointerInterrupt *pInterrupt = (asynGenericPointerInterrupt *)pnode->drvPvt;
-        this->getAddress(pInterrupt->pasynUser, &addr);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (addr == -1) addr = 0;
-        if ((pInterrupt->pasynUser->reason == reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 genericPointer);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+    interruptClientList<asynGenericPointerInterrupt> clients(this, this->asynStdInterfaces.genericPointerInterruptPvt,
+        reason, address);
+    while ((pInterrupt = clients.next())) {
+        /* Set the status for the callback */
+        pInterrupt->pasynUser->auxStatus = status;
+        pInterrupt->pasynUser->alarmStatus = alarmStatus;
+        pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
+        /* Set the timestamp for the callback */
+        pInterrupt->pasynUser->timestamp = timeStamp;
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             genericPointer);
     }
-    pasynManager->interruptEnd(this->asynStdInterfaces.genericPointerInterruptPvt);
     return asynSuccess;
 }
 
@@ -3249,26 +3227,15 @@ asynStatus asynPortDriver::writeEnum(asynUser *pasynUser, char *strings[], int v
   * \param[in] address A client will be called if address matches the address registered for that client. */
 asynStatus asynPortDriver::doCallbacksEnum(char *strings[], int values[], int severities[], size_t nElements, int reason, int address)
 {
-    ELLLIST *pclientList;
-    interruptNode *pnode;
-    int addr;
+    asynEnumInterrupt *pInterrupt;
 
-    pasynManager->interruptStart(this->asynStdInterfaces.enumInterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynEnumInterrupt *pInterrupt = (asynEnumInterrupt *)pnode->drvPvt;
-        this->getAddress(pInterrupt->pasynUser, &addr);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (addr == -1) addr = 0;
-        if ((pInterrupt->pasynUser->reason == reason) &&
-            (address == addr)) {
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 strings, values, severities, nElements);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+    interruptClientList<asynEnumInterrupt> clients(this, this->asynStdInterfaces.enumInterruptPvt,
+        reason, address);
+    while ((pInterrupt = clients.next())) {
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             strings, values, severities, nElements);
     }
-    pasynManager->interruptEnd(this->asynStdInterfaces.enumInterruptPvt);
     return asynSuccess;
 }
 
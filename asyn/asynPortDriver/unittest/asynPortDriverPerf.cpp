@@ -0,0 +1,143 @@
+/*************************************************************************\
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+*     National Laboratory.
+* Distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+
+/*
+ * Measures the time to create and find N parameters, and to set N parameters
+ * and call callParamCallbacks(), for increasing N.
+ * The time per parameter should stay roughly constant.
+ */
+
+#include <stdexcept>
+
+#include <stdio.h>
+
+#include <epicsGuard.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include <asynPortDriver.h>
+#include <asynPortClient.h>
+
+// fake out asynPortDriver callback dispatching
+extern "C" int interruptAccept;
+int interruptAccept=1;
+
+namespace {
+
+typedef epicsGuard<asynPortDriver> Guard;
+
+size_t cbcount;
+
+void int32cb(void *userPvt, asynUser *pasynUser, epicsInt32 data)
+{
+    cbcount++;
+}
+
+#define NUM_LOOPS 10
+
+void timeSetAndCallback(int numParams)
+{
+    char portName[32];
+    char paramName[32];
+    epicsTimeStamp start, end;
+    int firstParam = -1;
+    int index;
+    int i, loop;
+    double elapsed;
+
+    /* asyn ports are forever, so this port is never deleted */
+    sprintf(portName, "perf%d", numParams);
+    asynPortDriver *pPort = new asynPortDriver(portName, 0,
+                               asynDrvUserMask|asynInt32Mask,
+                               asynInt32Mask, 0, 0, 0,
+                               epicsThreadGetStackSize(epicsThreadStackSmall));
+
+    for (i=0; i<numParams; i++) {
+        sprintf(paramName, "P%d", i);
+        pPort->createParam(paramName, asynParamInt32, &index);
+        if (i == 0) firstParam = index;
+    }
+
+    /* One I/O Intr client on the first parameter */
+    asynInt32Client client(portName, 0, "P0");
+    client.registerInterruptUser(&int32cb);
+
+    cbcount = 0;
+    epicsTimeGetCurrent(&start);
+    for (loop=0; loop<NUM_LOOPS; loop++) {
+        Guard G(*pPort);
+        for (i=0; i<numParams; i++) {
+            /* Set each parameter twice, it must only be queued once */
+            pPort->setIntegerParam(firstParam+i, loop);
+            pPort->setIntegerParam(firstParam+i, loop+1);
+        }
+        pPort->callParamCallbacks();
+    }
+    epicsTimeGetCurrent(&end);
+    elapsed = epicsTimeDiffInSeconds(&end, &start);
+
+    testOk(cbcount == NUM_LOOPS, "%d parameters, %d callbacks", numParams, (int)cbcount);
+    testDiag("%d parameters: %f ms per loop, %f us per parameter",
+             numParams, elapsed/NUM_LOOPS*1e3, elapsed/NUM_LOOPS/numParams*1e6);
+}
+
+void timeCreateAndFind(int numParams)
+{
+    char portName[32];
+    char paramName[32];
+    epicsTimeStamp start, created, found;
+    int index;
+    int i;
+    int numFound = 0;
+
+    sprintf(portName, "perfCreate%d", numParams);
+    asynPortDriver *pPort = new asynPortDriver(portName, 0,
+                               asynDrvUserMask|asynInt32Mask,
+                               asynInt32Mask, 0, 0, 0,
+                               epicsThreadGetStackSize(epicsThreadStackSmall));
+
+    epicsTimeGetCurrent(&start);
+    for (i=0; i<numParams; i++) {
+        sprintf(paramName, "PARAM_%d", i);
+        pPort->createParam(paramName, asynParamInt32, &index);
+    }
+    epicsTimeGetCurrent(&created);
+    /* This is what drvUserCreate does for each record */
+    for (i=0; i<numParams; i++) {
+        sprintf(paramName, "param_%d", i);
+        if (pPort->findParam(paramName, &index) == asynSuccess) numFound++;
+    }
+    epicsTimeGetCurrent(&found);
+
+    testOk(numFound == numParams, "%d parameters, found %d", numParams, numFound);
+    testDiag("%d parameters: createParam %f s, findParam %f s",
+             numParams, epicsTimeDiffInSeconds(&created, &start),
+             epicsTimeDiffInSeconds(&found, &created));
+}
+
+} // namespace
+
+MAIN(asynPortDriverPerf)
+{
+    int numParams;
+
+    testPlan(5);
+    interruptAccept=1;
+    try {
+        for (numParams=100; numParams<=10000; numParams*=10) {
+            timeSetAndCallback(numParams);
+        }
+        for (numParams=5000; numParams<=50000; numParams*=10) {
+            timeCreateAndFind(numParams);
+        }
+    } catch(std::exception& e) {
+        testAbort("Unhandled C++ exception: %s", e.what());
+    }
+    return testDone();
+}
@@ -162,14 +162,70 @@ void testA()
     }
 }
 
+size_t cbcountAddr[3];
+
+void int32cbAddr(void *userPvt, asynUser *pasynUser,
+                                       epicsInt32 data)
+{
+    int addr = -1;
+    pasynManager->getAddr(pasynUser, &addr);
+    testDiag("int32cbAddr() called with %d for addr %d", (int)data, addr);
+    cbcountAddr[addr]++;
+}
+
+asynPortDriver *portB;
+
+void testB()
+{
+    portB = new asynPortDriver("portB", 3,
+                               asynDrvUserMask|asynInt32Mask,
+                               asynInt32Mask, ASYN_MULTIDEVICE, 0, 0,
+                               epicsThreadGetStackSize(epicsThreadStackSmall));
+
+    int idxA=-1, idxB=-1;
+
+    testDiag("Callbacks are only dispatched to clients with matching reason and address");
+
+    testOk1(portB->createParam("a", asynParamInt32, &idxA)==asynSuccess);
+    testOk1(portB->createParam("b", asynParamInt32, &idxB)==asynSuccess);
+
+    asynInt32Client clientA0("portB", 0, "a");
+    asynInt32Client clientA1("portB", 1, "a");
+    asynInt32Client clientB1("portB", 1, "b");
+    testOk1(clientA0.registerInterruptUser(&int32cbAddr)==asynSuccess);
+    testOk1(clientA1.registerInterruptUser(&int32cbAddr)==asynSuccess);
+    testOk1(clientB1.registerInterruptUser(&int32cbAddr)==asynSuccess);
+
+    {
+        Guard G(*portB);
+        portB->setIntegerParam(1, idxA, 1);
+        testOk1(portB->callParamCallbacks(1)==asynSuccess);
+    }
+    testOk1(cbcountAddr[0]==0);
+    testOk1(cbcountAddr[1]==1);
+    testOk1(cbcountAddr[2]==0);
+
+    {
+        Guard G(*portB);
+        portB->setIntegerParam(0, idxA, 2);
+        portB->setIntegerParam(1, idxB, 3);
+        testOk1(portB->callParamCallbacks(0)==asynSuccess);
+        testOk1(portB->callParamCallbacks(1)==asynSuccess);
+    }
+    testOk1(cbcountAddr[0]==1);
+    testOk1(cbcountAddr[1]==2);
+    testOk1(cbcountAddr[2]==0);
+}
+
 } // namespace
 
 MAIN(asynPortDriverTest)
 {
-    testPlan(54);
+    testPlan(68);
     interruptAccept=1;
     try {
         testA();
+        testB();
     } catch(std::exception& e) {
         testAbort("Unhandled C++ exception: %s", e.what());
     }
@@ -0,0 +1,188 @@
+/*asynBufferPool.c*/
+/***********************************************************************
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+* National Laboratory.
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/* Buffers are allocated in size classes. Up to 1<<FINE_CLASS bytes the
+ * classes are powers of 2. Above that each power of 2 is split into 4 steps
+ * (1, 1.25, 1.5 and 1.75 times), so a large waveform wastes at most 25%.
+ * Each buffer is preceded by a header that records its size class, and a free
+ * buffer uses the same header to link it into the free list of its class.
+ * Freed buffers are kept for reuse, so after the first few callbacks
+ * at a given size no further malloc or free is done.
+ * Each class has its own lock, so callbacks of different sizes do not
+ * contend with each other.
+ * The free lists hold at most MAX_FREE_BYTES, so a burst of large callbacks
+ * does not keep its memory for the life of the IOC. Buffers larger than that
+ * are not pooled.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <cantProceed.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+
+#define epicsExportSharedSymbols
+#include <shareLib.h>
+#include "asynDriver.h"
+#include "asynBufferPool.h"
+
+#if LT_EPICSBASE(3,15,0,1)
+#define POOL_USE_LOCK
+#else
+#include <epicsAtomic.h>
+#endif
+
+/* Smallest class is 1<<MIN_CLASS bytes */
+#define MIN_CLASS 6
+/* Classes above 1<<FINE_CLASS bytes are 1.25, 1.5 and 1.75 times a power of 2 */
+#define FINE_CLASS 12
+/* Largest class is 1<<MAX_CLASS bytes, which is MAX_FREE_BYTES */
+#define MAX_CLASS 26
+#define FINE_STEPS 4
+#define NUM_CLASSES ((FINE_CLASS - MIN_CLASS) + FINE_STEPS*(MAX_CLASS - FINE_CLASS) + 1)
+/* sizeClass of a buffer that is not pooled */
+#define NO_CLASS NUM_CLASSES
+/* Buffers freed when the free lists already hold this much go back to free() */
+#define MAX_FREE_BYTES ((size_t)1 << MAX_CLASS)
+
+/* Large enough for any element alignment */
+typedef union poolHeader {
+    struct {
+        union poolHeader *next;
+        size_t           sizeClass;
+    } s;
+    double   alignDouble;
+    char     pad[16];
+} poolHeader;
+
+typedef struct poolClass {
+    epicsMutexId lock;
+    poolHeader   *freeList;
+} poolClass;
+
+static epicsThreadOnceId poolOnceId = EPICS_THREAD_ONCE_INIT;
+static poolClass poolClasses[NUM_CLASSES];
+static size_t freeBytes;
+
+#ifdef POOL_USE_LOCK
+static epicsMutexId freeBytesLock;
+
+static size_t addFreeBytes(size_t nbytes)
+{
+    size_t total;
+
+    epicsMutexMustLock(freeBytesLock);
+    total = freeBytes += nbytes;
+    epicsMutexUnlock(freeBytesLock);
+    return total;
+}
+
+static void subFreeBytes(size_t nbytes)
+{
+    epicsMutexMustLock(freeBytesLock);
+    freeBytes -= nbytes;
+    epicsMutexUnlock(freeBytesLock);
+}
+#else
+#define addFreeBytes(nbytes) epicsAtomicAddSizeT(&freeBytes, (nbytes))
+#define subFreeBytes(nbytes) epicsAtomicSubSizeT(&freeBytes, (nbytes))
+#endif
+
+static void poolInit(void *arg)
+{
+    size_t sc;
+
+    for (sc = 0; sc < NUM_CLASSES; sc++)
+        poolClasses[sc].lock = epicsMutexMustCreate();
+#ifdef POOL_USE_LOCK
+    freeBytesLock = epicsMutexMustCreate();
+#endif
+}
+
+static size_t classSize(size_t sc)
+{
+    size_t fine;
+
+    if (sc <= FINE_CLASS - MIN_CLASS) return (size_t)1 << (MIN_CLASS + sc);
+    fine = sc - (FINE_CLASS - MIN_CLASS);
+    return (size_t)(FINE_STEPS + fine % FINE_STEPS) << (FINE_CLASS - 2 + fine / FINE_STEPS);
+}
+
+/* Smallest class that holds nbytes, or NO_CLASS */
+static size_t sizeClass(size_t nbytes)
+{
+    size_t sc = 0;
+    size_t octave, step;
+
+    if (nbytes > MAX_FREE_BYTES) return NO_CLASS;
+    if (nbytes <= ((size_t)1 << FINE_CLASS)) {
+        while (((size_t)1 << (MIN_CLASS + sc)) < nbytes) sc++;
+        return sc;
+    }
+    /* (1<<octave) < nbytes <= (2<<octave) */
+    for (octave = FINE_CLASS; ((size_t)2 << octave) < nbytes; octave++);
+    /* Steps of (1<<octave)/4 above 1<<octave, 1 to FINE_STEPS */
+    step = (nbytes - ((size_t)1 << octave) + ((size_t)1 << (octave - 2)) - 1) >> (octave - 2);
+    return (FINE_CLASS - MIN_CLASS) + FINE_STEPS*(octave - FINE_CLASS) + step;
+}
+
+void *asynBufferPoolAlloc(size_t nbytes)
+{
+    poolHeader *phdr = NULL;
+    poolClass *pclass;
+    size_t sc = sizeClass(nbytes);
+
+    if (sc == NO_CLASS) {
+        phdr = mallocMustSucceed(sizeof(poolHeader) + nbytes, "asynBufferPoolAlloc");
+        phdr->s.sizeClass = NO_CLASS;
+        phdr->s.next = NULL;
+        return phdr + 1;
+    }
+    epicsThreadOnce(&poolOnceId, poolInit, NULL);
+    pclass = &poolClasses[sc];
+    epicsMutexMustLock(pclass->lock);
+    phdr = pclass->freeList;
+    if (phdr)
+        pclass->freeList = phdr->s.next;
+    epicsMutexUnlock(pclass->lock);
+    if (phdr) {
+        subFreeBytes(classSize(sc));
+    } else {
+        phdr = mallocMustSucceed(sizeof(poolHeader) + classSize(sc),
+                                 "asynBufferPoolAlloc");
+        phdr->s.sizeClass = sc;
+    }
+    phdr->s.next = NULL;
+    return phdr + 1;
+}
+
+void asynBufferPoolFree(void *pbuffer)
+{
+    poolHeader *phdr;
+    poolClass *pclass;
+    size_t nbytes;
+
+    if (!pbuffer) return;
+    phdr = (poolHeader *)pbuffer - 1;
+    if (phdr->s.sizeClass == NO_CLASS) {
+        free(phdr);
+        return;
+    }
+    nbytes = classSize(phdr->s.sizeClass);
+    if (addFreeBytes(nbytes) > MAX_FREE_BYTES) {
+        subFreeBytes(nbytes);
+        free(phdr);
+        return;
+    }
+    pclass = &poolClasses[phdr->s.sizeClass];
+    epicsMutexMustLock(pclass->lock);
+    phdr->s.next = pclass->freeList;
+    pclass->freeList = phdr;
+    epicsMutexUnlock(pclass->lock);
+}
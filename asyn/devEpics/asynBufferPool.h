@@ -0,0 +1,35 @@
+/*  asynBufferPool.h*/
+/***********************************************************************
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+* National Laboratory.
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/* Pool of variable size buffers shared by all device supports.
+ * Buffers are rounded up to a power of 2, or to 1.25, 1.5 or 1.75 times a
+ * power of 2 above 4 kB, and freed buffers are kept on a free list for that
+ * size, up to a total of 64 MB, so the array device
+ * supports can size ring buffer elements to the data actually received
+ * rather than to NELM.
+ */
+
+#ifndef asynBufferPoolH
+#define asynBufferPoolH
+
+#include <stddef.h>
+#include <shareLib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+/* Returns a buffer of at least nbytes. Never returns NULL */
+epicsShareFunc void *asynBufferPoolAlloc(size_t nbytes);
+/* Return a buffer from asynBufferPoolAlloc to the pool. NULL is ignored */
+epicsShareFunc void asynBufferPoolFree(void *pbuffer);
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+#endif  /* asynBufferPoolH */
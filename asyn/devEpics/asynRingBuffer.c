@@ -0,0 +1,263 @@
+/*asynRingBuffer.c*/
+/***********************************************************************
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+* National Laboratory.
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/* Bounded multi-producer multi-consumer FIFO.
+ * Each cell carries a sequence number that tells producers and consumers
+ * whether the cell holds the element for a given position
+ * (after D. Vyukov's bounded MPMC queue).
+ * Positions only ever increase; the cell index is position % size.
+ * A producer always claims the next position. If the FIFO is full the
+ * element size positions earlier is still in the cell, and that producer,
+ * and only that one, discards it. Each put therefore discards at most one
+ * element, so the callers can keep exactly one scan request per element.
+ * A cell is filled for position pos when its sequence is pos+1 and free for
+ * the next lap when it is pos+size. With size 1 these are the same, so a
+ * producer could overwrite a cell that a consumer is still copying out;
+ * a size of 1 is therefore rounded up to 2.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cantProceed.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+
+#define epicsExportSharedSymbols
+#include <shareLib.h>
+#include "asynDriver.h"
+#include "asynRingBuffer.h"
+
+#if LT_EPICSBASE(3,15,0,1)
+#define RING_USE_LOCK
+#else
+#include <epicsAtomic.h>
+#endif
+
+/* Offset of the element in a cell. Large enough for any element alignment */
+#define CELL_HEADER 16
+
+/* A put that finds another thread in the middle of using its cell yields
+ * this many times, then sleeps. The other thread may have a lower priority,
+ * e.g. a scan thread preempted by a SCHED_FIFO driver thread on the same
+ * CPU, and yielding alone would never let it run. */
+#define RING_SPIN_LIMIT 100
+
+typedef struct ringCell {
+    size_t sequence;
+} ringCell;
+
+struct asynRingBuffer {
+    size_t       size;
+    size_t       elementSize;
+    size_t       cellSize;
+    char         *cells;
+    size_t       enqueuePos;
+    size_t       dequeuePos;
+    int          overflows;
+#ifdef RING_USE_LOCK
+    epicsMutexId lock;
+#endif
+};
+
+#define RING_CELL(pring,pos) \
+    ((ringCell *)((pring)->cells + ((pos) % (pring)->size) * (pring)->cellSize))
+#define CELL_DATA(pcell) ((char *)(pcell) + CELL_HEADER)
+/* Distance between two positions, correct across wrap around of size_t */
+#define POS_DIFF(a,b) ((ptrdiff_t)((a) - (b)))
+
+#ifdef RING_USE_LOCK
+#define loadPos(p)            (*(p))
+#define storePos(p,v)         (*(p) = (v))
+#define casPos(p,old,new)     (*(p) == (old) ? (*(p) = (new), (old)) : *(p))
+#define incrOverflows(p)      ((*(p))++)
+#else
+static size_t loadPos(size_t *p)
+{
+    size_t value = epicsAtomicGetSizeT(p);
+    /* Reads of the cell data must not be done before the sequence is seen */
+    epicsAtomicReadMemoryBarrier();
+    return value;
+}
+
+static void storePos(size_t *p, size_t value)
+{
+    /* Publish the cell data (or finish reading it) before the sequence */
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetSizeT(p, value);
+}
+#define casPos(p,old,new)     epicsAtomicCmpAndSwapSizeT((p),(old),(new))
+#define incrOverflows(p)      epicsAtomicIncrIntT(p)
+#endif
+
+static void ringBackoff(int *pspins)
+{
+    if (++*pspins < RING_SPIN_LIMIT)
+        epicsThreadSleep(0.0);
+    else
+        epicsThreadSleep(epicsThreadSleepQuantum());
+}
+
+asynRingBuffer *asynRingBufferCreate(int size, size_t elementSize)
+{
+    asynRingBuffer *pring;
+    size_t i;
+
+    if (size < 0) size = 0;
+    if (size == 1) size = 2;
+    pring = callocMustSucceed(1, sizeof(*pring), "asynRingBufferCreate");
+    pring->size = size;
+    pring->elementSize = elementSize;
+    pring->cellSize = (CELL_HEADER + elementSize + CELL_HEADER - 1) & ~(size_t)(CELL_HEADER - 1);
+    pring->cells = callocMustSucceed(size ? size : 1, pring->cellSize, "asynRingBufferCreate");
+    for (i=0; i<(size_t)size; i++) RING_CELL(pring, i)->sequence = i;
+#ifdef RING_USE_LOCK
+    pring->lock = epicsMutexMustCreate();
+#endif
+    return pring;
+}
+
+void asynRingBufferDelete(asynRingBuffer *pring)
+{
+    if (!pring) return;
+#ifdef RING_USE_LOCK
+    epicsMutexDestroy(pring->lock);
+#endif
+    free(pring->cells);
+    free(pring);
+}
+
+static int ringGet(asynRingBuffer *pring, void *pelement)
+{
+    ringCell *pcell;
+    size_t pos, sequence;
+    ptrdiff_t diff;
+
+    for (;;) {
+        pos = loadPos(&pring->dequeuePos);
+        pcell = RING_CELL(pring, pos);
+        sequence = loadPos(&pcell->sequence);
+        diff = POS_DIFF(sequence, pos + 1);
+        if (diff == 0) {
+            /* Cell holds the element for this position, try to claim it */
+            if (casPos(&pring->dequeuePos, pos, pos + 1) == pos) break;
+        } else if (diff < 0) {
+            /* Producer has not filled this cell yet, FIFO is empty */
+            return 0;
+        }
+        /* Another consumer took this position, try again */
+    }
+    if (pelement) memcpy(pelement, CELL_DATA(pcell), pring->elementSize);
+    /* Make the cell available to the producer one lap ahead */
+    storePos(&pcell->sequence, pos + pring->size);
+    return 1;
+}
+
+static int ringPut(asynRingBuffer *pring, const void *pelement, void *pdropped)
+{
+    ringCell *pcell;
+    size_t pos, oldest, dequeuePos;
+    int dropped = 0;
+    int spins = 0;
+
+    if (pring->size == 0) {
+        incrOverflows(&pring->overflows);
+        if (pdropped) memcpy(pdropped, pelement, pring->elementSize);
+        return 1;
+    }
+    /* Claim the next position */
+    do {
+        pos = loadPos(&pring->enqueuePos);
+    } while (casPos(&pring->enqueuePos, pos, pos + 1) != pos);
+    pcell = RING_CELL(pring, pos);
+    oldest = pos - pring->size;
+    for (;;) {
+        dequeuePos = loadPos(&pring->dequeuePos);
+        if (POS_DIFF(dequeuePos, oldest) > 0) {
+            /* A consumer took the previous element in this cell,
+             * wait until it has finished copying it out */
+            if (loadPos(&pcell->sequence) == pos) break;
+        } else if (dequeuePos == oldest) {
+            /* FIFO is full. Discard the oldest element, once its producer
+             * has finished writing it */
+            if (casPos(&pring->dequeuePos, oldest, oldest + 1) == oldest) {
+                dropped = 1;
+                incrOverflows(&pring->overflows);
+                while (loadPos(&pcell->sequence) != oldest + 1) ringBackoff(&spins);
+                if (pdropped) memcpy(pdropped, CELL_DATA(pcell), pring->elementSize);
+                break;
+            }
+            continue;
+        }
+        /* A consumer is still copying out the previous element of this cell,
+         * or the producer of an earlier position has not discarded its
+         * element yet */
+        ringBackoff(&spins);
+    }
+    memcpy(CELL_DATA(pcell), pelement, pring->elementSize);
+    storePos(&pcell->sequence, pos + 1);
+    return dropped;
+}
+
+int asynRingBufferPutGetDropped(asynRingBuffer *pring, const void *pelement,
+                                void *pdropped)
+{
+    int dropped;
+
+#ifdef RING_USE_LOCK
+    epicsMutexMustLock(pring->lock);
+    dropped = ringPut(pring, pelement, pdropped);
+    epicsMutexUnlock(pring->lock);
+#else
+    dropped = ringPut(pring, pelement, pdropped);
+#endif
+    return dropped;
+}
+
+int asynRingBufferPut(asynRingBuffer *pring, const void *pelement)
+{
+    return asynRingBufferPutGetDropped(pring, pelement, NULL);
+}
+
+int asynRingBufferGet(asynRingBuffer *pring, void *pelement)
+{
+    int got;
+
+#ifdef RING_USE_LOCK
+    epicsMutexMustLock(pring->lock);
+    got = ringGet(pring, pelement);
+    epicsMutexUnlock(pring->lock);
+#else
+    got = ringGet(pring, pelement);
+#endif
+    return got;
+}
+
+int asynRingBufferGetOverflows(asynRingBuffer *pring)
+{
+    int overflows;
+
+#ifdef RING_USE_LOCK
+    epicsMutexMustLock(pring->lock);
+    overflows = pring->overflows;
+    pring->overflows = 0;
+    epicsMutexUnlock(pring->lock);
+#else
+    do {
+        overflows = epicsAtomicGetIntT(&pring->overflows);
+    } while (overflows &&
+             epicsAtomicCmpAndSwapIntT(&pring->overflows, overflows, 0) != overflows);
+#endif
+    return overflows;
+}
+
+int asynRingBufferSize(asynRingBuffer *pring)
+{
+    return (int)pring->size;
+}
@@ -0,0 +1,51 @@
+/*  asynRingBuffer.h*/
+/***********************************************************************
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+* National Laboratory.
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/* Fixed size FIFO of fixed size elements used by the device supports to
+ * pass callback values from driver threads to record processing.
+ * Any number of threads may put and get concurrently.
+ * With EPICS base 3.15 and later no lock is taken, older versions use a mutex.
+ * When the FIFO is full asynRingBufferPut discards the oldest element,
+ * so the most recent value is never lost.
+ */
+
+#ifndef asynRingBufferH
+#define asynRingBufferH
+
+#include <stddef.h>
+#include <shareLib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+typedef struct asynRingBuffer asynRingBuffer;
+
+/* Create a FIFO holding up to size elements of elementSize bytes.
+ * A size of 1 is rounded up to 2, see asynRingBufferSize */
+epicsShareFunc asynRingBuffer *asynRingBufferCreate(int size, size_t elementSize);
+epicsShareFunc void asynRingBufferDelete(asynRingBuffer *pring);
+/* Copy *pelement into the FIFO. Returns 1 if the oldest element had to be
+ * discarded to make room, i.e. the number of elements did not change,
+ * and 0 if the new element was added. */
+epicsShareFunc int asynRingBufferPut(asynRingBuffer *pring, const void *pelement);
+/* Same as asynRingBufferPut, but a discarded element is copied to *pdropped
+ * so the caller can release anything it points to */
+epicsShareFunc int asynRingBufferPutGetDropped(asynRingBuffer *pring,
+                                               const void *pelement, void *pdropped);
+/* Remove the oldest element and copy it to *pelement (if not NULL).
+ * Returns 1 if an element was removed, 0 if the FIFO was empty */
+epicsShareFunc int asynRingBufferGet(asynRingBuffer *pring, void *pelement);
+/* Number of elements discarded by asynRingBufferPut since the last call */
+epicsShareFunc int asynRingBufferGetOverflows(asynRingBuffer *pring);
+epicsShareFunc int asynRingBufferSize(asynRingBuffer *pring);
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+#endif  /* asynRingBufferH */
@@ -38,6 +38,7 @@
 
 #include <epicsExport.h>
 #include "asynDriver.h"
+#include "asynRingBuffer.h"
 #include "asynDrvUser.h"
 #include "asynFloat64SyncIO.h"
 #include "asynEpicsUtils.h"
@@ -68,11 +69,7 @@ typedef struct devPvt{
     void              *registrarPvt;
     int               canBlock;
     epicsMutexId      devPvtLock;
-    ringBufferElement *ringBuffer;
-    int               ringHead;
-    int               ringTail;
-    int               ringSize;
-    int               ringBufferOverflows;
+    asynRingBuffer    *ringBuffer;
     ringBufferElement result;
     asynStatus        lastStatus;
     epicsFloat64      sum;
@@ -257,7 +254,7 @@ static long createRingBuffer(dbCommon *pr)
     
     if (!pPvt->ringBuffer) {
         DBENTRY *pdbentry = dbAllocEntry(pdbbase);
-        pPvt->ringSize = DEFAULT_RING_BUFFER_SIZE;
+        int ringSize = DEFAULT_RING_BUFFER_SIZE;
         status = dbFindRecord(pdbentry, pr->name);
         if (status) {
             asynPrint(pPvt->pasynUser, ASYN_TRACE_ERROR,
@@ -266,8 +263,8 @@ static long createRingBuffer(dbCommon *pr)
             return -1;
         }
         sizeString = dbGetInfo(pdbentry, "asyn:FIFO");
-        if (sizeString) pPvt->ringSize = atoi(sizeString);
-        pPvt->ringBuffer = callocMustSucceed(pPvt->ringSize+1, sizeof *pPvt->ringBuffer, "%s::createRingBuffer");
+        if (sizeString) ringSize = atoi(sizeString);
+        pPvt->ringBuffer = asynRingBufferCreate(ringSize, sizeof(ringBufferElement));
     }
     return asynSuccess;
 }
@@ -375,7 +372,7 @@ static void interruptCallbackInput(void *drvPvt, asynUser *pasynUser,
 {
     devPvt *pPvt = (devPvt *)drvPvt;
     dbCommon *pr = pPvt->pr;
-    ringBufferElement *rp;
+    ringBufferElement element;
     static const char *functionName="interruptCallbackInput";
 
     asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
@@ -394,27 +391,16 @@ static void interruptCallbackInput(void *drvPvt, asynUser *pasynUser,
      * Instead we just return.  There will then be nothing in the ring buffer, so the first
      * read will do a read from the driver, which should be OK. */
     if (!interruptAccept) return;
-    epicsMutexLock(pPvt->devPvtLock);
-    rp = &pPvt->ringBuffer[pPvt->ringHead];
-    rp->value = value;
-    rp->time = pasynUser->timestamp;
-    rp->status = pasynUser->auxStatus;
-    rp->alarmStatus = pasynUser->alarmStatus;
-    rp->alarmSeverity = pasynUser->alarmSeverity;
-    pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize) ? 0 : pPvt->ringHead+1;
-    if (pPvt->ringHead == pPvt->ringTail) {
-        /* There was no room in the ring buffer.  In the past we just threw away
-         * the new value.  However, it is better to remove the oldest value from the
-         * ring buffer and add the new one.  That way the final value the record receives
-         * is guaranteed to be the most recent value */
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-        pPvt->ringBufferOverflows++;
-    } else {
+    element.value = value;
+    element.time = pasynUser->timestamp;
+    element.status = pasynUser->auxStatus;
+    element.alarmStatus = pasynUser->alarmStatus;
+    element.alarmSeverity = pasynUser->alarmSeverity;
+    if (!asynRingBufferPut(pPvt->ringBuffer, &element)) {
         /* We only need to request the record to process if we added a new
          * element to the ring buffer, not if we just replaced an element. */
         scanIoRequest(pPvt->ioScanPvt);
     }
-    epicsMutexUnlock(pPvt->devPvtLock);
 }
 
 static void interruptCallbackOutput(void *drvPvt, asynUser *pasynUser,
@@ -422,34 +408,29 @@ static void interruptCallbackOutput(void *drvPvt, asynUser *pasynUser,
 {
     devPvt *pPvt = (devPvt *)drvPvt;
     dbCommon *pr = pPvt->pr;
-    ringBufferElement *rp;
+    ringBufferElement element;
     static const char *functionName="interruptCallbackOutput";
 
     asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
         "%s %s::%s new value=%f\n",
         pr->name, driverName, functionName,value);
     if (!interruptAccept) return;
-    epicsMutexLock(pPvt->devPvtLock);
-    rp = &pPvt->ringBuffer[pPvt->ringHead];
-    rp->value = value;
-    rp->time = pasynUser->timestamp;
-    rp->status = pasynUser->auxStatus;
-    rp->alarmStatus = pasynUser->alarmStatus;
-    rp->alarmSeverity = pasynUser->alarmSeverity;
-    pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize) ? 0 : pPvt->ringHead+1;
-    if (pPvt->ringHead == pPvt->ringTail) {
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-        pPvt->ringBufferOverflows++;
-    } else {
+    element.value = value;
+    element.time = pasynUser->timestamp;
+    element.status = pasynUser->auxStatus;
+    element.alarmStatus = pasynUser->alarmStatus;
+    element.alarmSeverity = pasynUser->alarmSeverity;
+    if (!asynRingBufferPut(pPvt->ringBuffer, &element)) {
         /* If this callback was received during asynchronous record processing
          * we must defer calling callbackRequest until end of record processing */
+        epicsMutexLock(pPvt->devPvtLock);
         if (pPvt->asyncProcessingActive) {
             pPvt->numDeferredOutputCallbacks++;
         } else { 
             callbackRequest(&pPvt->outputCallback);
         }
+        epicsMutexUnlock(pPvt->devPvtLock);
     }
-    epicsMutexUnlock(pPvt->devPvtLock);
 }
 
 static void outputCallbackCallback(CALLBACK *pcb)
@@ -484,7 +465,7 @@ static void interruptCallbackAverage(void *drvPvt, asynUser *pasynUser,
     devPvt *pPvt = (devPvt *)drvPvt;
     dbCommon *pr = pPvt->pr;
     aiRecord *pai = (aiRecord *)pr;
-    ringBufferElement *rp;
+    ringBufferElement element;
     int numToAverage;
     static const char *functionName="interruptCallbackAverage";
 
@@ -505,28 +486,18 @@ static void interruptCallbackAverage(void *drvPvt, asynUser *pasynUser,
         numToAverage = (int)(pai->sval + 0.5);
         if (numToAverage < 1) numToAverage = 1; 
         if (pPvt->numAverage >= numToAverage) {
-            rp = &pPvt->ringBuffer[pPvt->ringHead];
-            rp->value = pPvt->sum/pPvt->numAverage;
+            element.value = pPvt->sum/pPvt->numAverage;
             pPvt->numAverage = 0;
             pPvt->sum = 0.;
-            rp->time = pasynUser->timestamp;
-            rp->status = pasynUser->auxStatus;
-            rp->alarmStatus = pasynUser->alarmStatus;
-            rp->alarmSeverity = pasynUser->alarmSeverity;
-            pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize) ? 0 : pPvt->ringHead+1;
-            if (pPvt->ringHead == pPvt->ringTail) {
-                /* There was no room in the ring buffer.  In the past we just threw away
-                 * the new value.  However, it is better to remove the oldest value from the
-                 * ring buffer and add the new one.  That way the final value the record receives
-                 * is guaranteed to be the most recent value */
-                pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-                pPvt->ringBufferOverflows++;
-            } /* End ring buffer full */
-            else {
+            element.time = pasynUser->timestamp;
+            element.status = pasynUser->auxStatus;
+            element.alarmStatus = pasynUser->alarmStatus;
+            element.alarmSeverity = pasynUser->alarmSeverity;
+            if (!asynRingBufferPut(pPvt->ringBuffer, &element)) {
                 /* We only need to request the record to process if we added a new
                  * element to the ring buffer, not if we just replaced an element. */
                 scanIoRequest(pPvt->ioScanPvt);
-            }  
+            }
         } /* End numAverage=SVAL, so time to compute average */
     } /* End SCAN=I/O Intr */
     else { 
@@ -542,22 +513,18 @@ static int getCallbackValue(devPvt *pPvt)
     int ret = 0;
     static const char *functionName="getCallbackValue";
 
-    epicsMutexLock(pPvt->devPvtLock);
-    if (pPvt->ringTail != pPvt->ringHead) {
-        if (pPvt->ringBufferOverflows > 0) {
+    if (pPvt->ringBuffer && asynRingBufferGet(pPvt->ringBuffer, &pPvt->result)) {
+        int overflows = asynRingBufferGetOverflows(pPvt->ringBuffer);
+        if (overflows > 0) {
             asynPrint(pPvt->pasynUser, ASYN_TRACE_WARNING,
                 "%s %s::%s warning, %d ring buffer overflows\n",
-                                    pPvt->pr->name, driverName, functionName,pPvt->ringBufferOverflows);
-            pPvt->ringBufferOverflows = 0;
+                pPvt->pr->name, driverName, functionName, overflows);
         }
-        pPvt->result = pPvt->ringBuffer[pPvt->ringTail];
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
         asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
             "%s %s::%s from ringBuffer value=%f\n",
                                             pPvt->pr->name, driverName, functionName, pPvt->result.value);
         ret = 1;
     }
-    epicsMutexUnlock(pPvt->devPvtLock);
     return ret;
 }
 
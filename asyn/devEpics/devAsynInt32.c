@@ -48,6 +48,7 @@
 
 #include <epicsExport.h>
 #include "asynDriver.h"
+#include "asynRingBuffer.h"
 #include "asynDrvUser.h"
 #include "asynInt32.h"
 #include "asynInt32SyncIO.h"
@@ -86,11 +87,7 @@ typedef struct devPvt{
     epicsInt32        deviceLow;
     epicsInt32        deviceHigh;
     epicsMutexId      devPvtLock;
-    ringBufferElement *ringBuffer;
-    int               ringHead;
-    int               ringTail;
-    int               ringSize;
-    int               ringBufferOverflows;
+    asynRingBuffer    *ringBuffer;
     ringBufferElement result;
     asynStatus        lastStatus;
     interruptCallbackInt32 interruptCallback;
@@ -368,7 +365,7 @@ static long createRingBuffer(dbCommon *pr)
     
     if (!pPvt->ringBuffer) {
         DBENTRY *pdbentry = dbAllocEntry(pdbbase);
-        pPvt->ringSize = DEFAULT_RING_BUFFER_SIZE;
+        int ringSize = DEFAULT_RING_BUFFER_SIZE;
         status = dbFindRecord(pdbentry, pr->name);
         if (status) {
             asynPrint(pPvt->pasynUser, ASYN_TRACE_ERROR,
@@ -377,8 +374,8 @@ static long createRingBuffer(dbCommon *pr)
             return -1;
         }
         sizeString = dbGetInfo(pdbentry, "asyn:FIFO");
-        if (sizeString) pPvt->ringSize = atoi(sizeString);
-        pPvt->ringBuffer = callocMustSucceed(pPvt->ringSize+1, sizeof *pPvt->ringBuffer, "devAsynInt32::createRingBuffer");
+        if (sizeString) ringSize = atoi(sizeString);
+        pPvt->ringBuffer = asynRingBufferCreate(ringSize, sizeof(ringBufferElement));
     }
     return asynSuccess;
 }
@@ -544,7 +541,7 @@ static void interruptCallbackInput(void *drvPvt, asynUser *pasynUser,
 {
     devPvt *pPvt = (devPvt *)drvPvt;
     dbCommon *pr = pPvt->pr;
-    ringBufferElement *rp;
+    ringBufferElement element;
     static const char *functionName="interruptCallbackInput";
 
     if (pPvt->mask) {
@@ -567,27 +564,16 @@ static void interruptCallbackInput(void *drvPvt, asynUser *pasynUser,
      * Instead we just return.  There will then be nothing in the ring buffer, so the first
      * read will do a read from the driver, which should be OK. */
     if (!interruptAccept) return;
-    epicsMutexLock(pPvt->devPvtLock);
-    rp = &pPvt->ringBuffer[pPvt->ringHead];
-    rp->value = value;
-    rp->time = pasynUser->timestamp;
-    rp->status = pasynUser->auxStatus;
-    rp->alarmStatus = pasynUser->alarmStatus;
-    rp->alarmSeverity = pasynUser->alarmSeverity;
-    pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize) ? 0 : pPvt->ringHead+1;
-    if (pPvt->ringHead == pPvt->ringTail) {
-        /* There was no room in the ring buffer.  In the past we just threw away
-         * the new value.  However, it is better to remove the oldest value from the
-         * ring buffer and add the new one.  That way the final value the record receives
-         * is guaranteed to be the most recent value */
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-        pPvt->ringBufferOverflows++;
-    } else {
+    element.value = value;
+    element.time = pasynUser->timestamp;
+    element.status = pasynUser->auxStatus;
+    element.alarmStatus = pasynUser->alarmStatus;
+    element.alarmSeverity = pasynUser->alarmSeverity;
+    if (!asynRingBufferPut(pPvt->ringBuffer, &element)) {
         /* We only need to request the record to process if we added a new
          * element to the ring buffer, not if we just replaced an element. */
         scanIoRequest(pPvt->ioScanPvt);
     }
-    epicsMutexUnlock(pPvt->devPvtLock);
 }
 
 static void interruptCallbackOutput(void *drvPvt, asynUser *pasynUser,
@@ -595,7 +581,7 @@ static void interruptCallbackOutput(void *drvPvt, asynUser *pasynUser,
 {
     devPvt *pPvt = (devPvt *)drvPvt;
     dbCommon *pr = pPvt->pr;
-    ringBufferElement *rp;
+    ringBufferElement element;
     static const char *functionName="interruptCallbackOutput";
 
     if (pPvt->mask) {
@@ -606,27 +592,22 @@ static void interruptCallbackOutput(void *drvPvt, asynUser *pasynUser,
         "%s %s::%s new value=%d\n",
         pr->name, driverName, functionName, value);
     if (!interruptAccept) return;
-    epicsMutexLock(pPvt->devPvtLock);
-    rp = &pPvt->ringBuffer[pPvt->ringHead];
-    rp->value = value;
-    rp->time = pasynUser->timestamp;
-    rp->status = pasynUser->auxStatus;
-    rp->alarmStatus = pasynUser->alarmStatus;
-    rp->alarmSeverity = pasynUser->alarmSeverity;
-    pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize) ? 0 : pPvt->ringHead+1;
-    if (pPvt->ringHead == pPvt->ringTail) {
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-        pPvt->ringBufferOverflows++;
-    } else {
+    element.value = value;
+    element.time = pasynUser->timestamp;
+    element.status = pasynUser->auxStatus;
+    element.alarmStatus = pasynUser->alarmStatus;
+    element.alarmSeverity = pasynUser->alarmSeverity;
+    if (!asynRingBufferPut(pPvt->ringBuffer, &element)) {
         /* If this callback was received during asynchronous record processing
          * we must defer calling callbackRequest until end of record processing */
+        epicsMutexLock(pPvt->devPvtLock);
         if (pPvt->asyncProcessingActive) {
             pPvt->numDeferredOutputCallbacks++;
         } else { 
             callbackRequest(&pPvt->outputCallback);
         }
+        epicsMutexUnlock(pPvt->devPvtLock);
     }
-    epicsMutexUnlock(pPvt->devPvtLock);
 }
 
 static void outputCallbackCallback(CALLBACK *pcb)
@@ -660,7 +641,7 @@ static void interruptCallbackAverage(void *drvPvt, asynUser *pasynUser,
 {
     devPvt *pPvt = (devPvt *)drvPvt;
     aiRecord *pai = (aiRecord *)pPvt->pr;
-    ringBufferElement *rp;
+    ringBufferElement element;
     int numToAverage;
     static const char *functionName="interruptCallbackAverage";
 
@@ -686,30 +667,20 @@ static void interruptCallbackAverage(void *drvPvt, asynUser *pasynUser,
         if (numToAverage < 1) numToAverage = 1; 
         if (pPvt->numAverage >= numToAverage) {
             double dval;
-            rp = &pPvt->ringBuffer[pPvt->ringHead];
             dval = pPvt->sum/pPvt->numAverage;
             dval += (pPvt->sum>0.0) ? 0.5 : -0.5;
-            rp->value = (epicsInt32)dval;
+            element.value = (epicsInt32)dval;
             pPvt->numAverage = 0;
             pPvt->sum = 0.;
-            rp->time = pasynUser->timestamp;
-            rp->status = pasynUser->auxStatus;
-            rp->alarmStatus = pasynUser->alarmStatus;
-            rp->alarmSeverity = pasynUser->alarmSeverity;
-            pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize) ? 0 : pPvt->ringHead+1;
-            if (pPvt->ringHead == pPvt->ringTail) {
-                /* There was no room in the ring buffer.  In the past we just threw away
-                 * the new value.  However, it is better to remove the oldest value from the
-                 * ring buffer and add the new one.  That way the final value the record receives
-                 * is guaranteed to be the most recent value */
-                pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-                pPvt->ringBufferOverflows++;
-            } /* End ring buffer full */
-            else {
+            element.time = pasynUser->timestamp;
+            element.status = pasynUser->auxStatus;
+            element.alarmStatus = pasynUser->alarmStatus;
+            element.alarmSeverity = pasynUser->alarmSeverity;
+            if (!asynRingBufferPut(pPvt->ringBuffer, &element)) {
                 /* We only need to request the record to process if we added a new
                  * element to the ring buffer, not if we just replaced an element. */
                 scanIoRequest(pPvt->ioScanPvt);
-            }  
+            }
         } /* End numAverage=SVAL, so time to compute average */
     } /* End SCAN=I/O Intr */
     else { 
@@ -781,22 +752,18 @@ static int getCallbackValue(devPvt *pPvt)
     int ret = 0;
     static const char *functionName="getCallbackValue";
 
-    epicsMutexLock(pPvt->devPvtLock);
-    if (pPvt->ringTail != pPvt->ringHead) {
-        if (pPvt->ringBufferOverflows > 0) {
+    if (pPvt->ringBuffer && asynRingBufferGet(pPvt->ringBuffer, &pPvt->result)) {
+        int overflows = asynRingBufferGetOverflows(pPvt->ringBuffer);
+        if (overflows > 0) {
             asynPrint(pPvt->pasynUser, ASYN_TRACE_WARNING,
                 "%s %s::%s warning, %d ring buffer overflows\n",
-                pPvt->pr->name, driverName, functionName, pPvt->ringBufferOverflows);
-            pPvt->ringBufferOverflows = 0;
+                pPvt->pr->name, driverName, functionName, overflows);
         }
-        pPvt->result = pPvt->ringBuffer[pPvt->ringTail];
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
         asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
             "%s %s::%s from ringBuffer value=%d\n",
             pPvt->pr->name, driverName, functionName,pPvt->result.value);
         ret = 1;
     }
-    epicsMutexUnlock(pPvt->devPvtLock);
     return ret;
 }
 
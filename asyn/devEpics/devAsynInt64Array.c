@@ -15,6 +15,7 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <alarm.h>
 #include <recGbl.h>
@@ -38,6 +39,8 @@
 #include "asynDrvUser.h"
 #include "asynInt64Array.h"
 #include "asynEpicsUtils.h"
+#include "asynRingBuffer.h"
+#include "asynBufferPool.h"
 
 #include "devAsynXXXArray.h"
 
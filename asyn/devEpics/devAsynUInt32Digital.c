@@ -45,6 +45,7 @@
 
 #include <epicsExport.h>
 #include "asynDriver.h"
+#include "asynRingBuffer.h"
 #include "asynDrvUser.h"
 #include "asynUInt32Digital.h"
 #include "asynUInt32DigitalSyncIO.h"
@@ -82,11 +83,7 @@ typedef struct devPvt{
     int               canBlock;
     epicsMutexId      devPvtLock;
     epicsUInt32        mask;
-    ringBufferElement *ringBuffer;
-    int               ringHead;
-    int               ringTail;
-    int               ringSize;
-    int               ringBufferOverflows;
+    asynRingBuffer    *ringBuffer;
     ringBufferElement result;
     asynStatus        lastStatus;
     interruptCallbackUInt32Digital interruptCallback;
@@ -325,7 +322,7 @@ static long createRingBuffer(dbCommon *pr)
     
     if (!pPvt->ringBuffer) {
         DBENTRY *pdbentry = dbAllocEntry(pdbbase);
-        pPvt->ringSize = DEFAULT_RING_BUFFER_SIZE;
+        int ringSize = DEFAULT_RING_BUFFER_SIZE;
         status = dbFindRecord(pdbentry, pr->name);
         if (status) {
             asynPrint(pPvt->pasynUser, ASYN_TRACE_ERROR,
@@ -334,8 +331,8 @@ static long createRingBuffer(dbCommon *pr)
             return -1;
         }
         sizeString = dbGetInfo(pdbentry, "asyn:FIFO");
-        if (sizeString) pPvt->ringSize = atoi(sizeString);
-        pPvt->ringBuffer = callocMustSucceed(pPvt->ringSize+1, sizeof *pPvt->ringBuffer, "%s::createRingBuffer");
+        if (sizeString) ringSize = atoi(sizeString);
+        pPvt->ringBuffer = asynRingBufferCreate(ringSize, sizeof(ringBufferElement));
     }
     return asynSuccess;
 }
@@ -452,7 +449,7 @@ static void interruptCallbackInput(void *drvPvt, asynUser *pasynUser,
 {
     devPvt *pPvt = (devPvt *)drvPvt;
     dbCommon *pr = pPvt->pr;
-    ringBufferElement *rp;
+    ringBufferElement element;
     static const char *functionName="interruptCallbackInput";
 
     asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
@@ -471,27 +468,16 @@ static void interruptCallbackInput(void *drvPvt, asynUser *pasynUser,
      * Instead we just return.  There will then be nothing in the ring buffer, so the first
      * read will do a read from the driver, which should be OK. */
     if (!interruptAccept) return;
-    epicsMutexLock(pPvt->devPvtLock);
-    rp = &pPvt->ringBuffer[pPvt->ringHead];
-    rp->value = value;
-    rp->time = pasynUser->timestamp;
-    rp->status = pasynUser->auxStatus;
-    rp->alarmStatus = pasynUser->alarmStatus;
-    rp->alarmSeverity = pasynUser->alarmSeverity;
-    pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize) ? 0 : pPvt->ringHead+1;
-    if (pPvt->ringHead == pPvt->ringTail) {
-        /* There was no room in the ring buffer.  In the past we just threw away
-         * the new value.  However, it is better to remove the oldest value from the
-         * ring buffer and add the new one.  That way the final value the record receives
-         * is guaranteed to be the most recent value */
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-        pPvt->ringBufferOverflows++;
-    } else {
+    element.value = value;
+    element.time = pasynUser->timestamp;
+    element.status = pasynUser->auxStatus;
+    element.alarmStatus = pasynUser->alarmStatus;
+    element.alarmSeverity = pasynUser->alarmSeverity;
+    if (!asynRingBufferPut(pPvt->ringBuffer, &element)) {
         /* We only need to request the record to process if we added a 
          * new element to the ring buffer, not if we just replaced an element. */
         scanIoRequest(pPvt->ioScanPvt);
-    }    
-    epicsMutexUnlock(pPvt->devPvtLock);
+    }
 }
 
 static void interruptCallbackOutput(void *drvPvt, asynUser *pasynUser,
@@ -499,34 +485,29 @@ static void interruptCallbackOutput(void *drvPvt, asynUser *pasynUser,
 {
     devPvt *pPvt = (devPvt *)drvPvt;
     dbCommon *pr = pPvt->pr;
-    ringBufferElement *rp;
+    ringBufferElement element;
     static const char *functionName="interruptCallbackOutput";
 
     asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
         "%s %s::%s new value=%u\n",
         pr->name, driverName, functionName, value);
     if (!interruptAccept) return;
-    epicsMutexLock(pPvt->devPvtLock);
-    rp = &pPvt->ringBuffer[pPvt->ringHead];
-    rp->value = value;
-    rp->time = pasynUser->timestamp;
-    rp->status = pasynUser->auxStatus;
-    rp->alarmStatus = pasynUser->alarmStatus;
-    rp->alarmSeverity = pasynUser->alarmSeverity;
-    pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize) ? 0 : pPvt->ringHead+1;
-    if (pPvt->ringHead == pPvt->ringTail) {
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
-        pPvt->ringBufferOverflows++;
-    } else {
+    element.value = value;
+    element.time = pasynUser->timestamp;
+    element.status = pasynUser->auxStatus;
+    element.alarmStatus = pasynUser->alarmStatus;
+    element.alarmSeverity = pasynUser->alarmSeverity;
+    if (!asynRingBufferPut(pPvt->ringBuffer, &element)) {
         /* If this callback was received during asynchronous record processing
          * we must defer calling callbackRequest until end of record processing */
+        epicsMutexLock(pPvt->devPvtLock);
         if (pPvt->asyncProcessingActive) {
             pPvt->numDeferredOutputCallbacks++;
         } else { 
             callbackRequest(&pPvt->outputCallback);
         }
+        epicsMutexUnlock(pPvt->devPvtLock);
     }
-    epicsMutexUnlock(pPvt->devPvtLock);
 }
 
 static void outputCallbackCallback(CALLBACK *pcb)
@@ -616,22 +597,18 @@ static int getCallbackValue(devPvt *pPvt)
     int ret = 0;
     static const char *functionName="getCallbackValue";
 
-    epicsMutexLock(pPvt->devPvtLock);
-    if (pPvt->ringTail != pPvt->ringHead) {
-        if (pPvt->ringBufferOverflows > 0) {
+    if (pPvt->ringBuffer && asynRingBufferGet(pPvt->ringBuffer, &pPvt->result)) {
+        int overflows = asynRingBufferGetOverflows(pPvt->ringBuffer);
+        if (overflows > 0) {
             asynPrint(pPvt->pasynUser, ASYN_TRACE_WARNING,
                 "%s %s::%s warning, %d ring buffer overflows\n",
-                                    pPvt->pr->name, driverName, functionName, pPvt->ringBufferOverflows);
-            pPvt->ringBufferOverflows = 0;
+                pPvt->pr->name, driverName, functionName, overflows);
         }
-        pPvt->result = pPvt->ringBuffer[pPvt->ringTail];
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize) ? 0 : pPvt->ringTail+1;
         asynPrint(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,
             "%s %s::%s from ringBuffer value=%d\n",
                                             pPvt->pr->name, driverName, functionName,pPvt->result.value);
         ret = 1;
     }
-    epicsMutexUnlock(pPvt->devPvtLock);
     return ret;
 }
 
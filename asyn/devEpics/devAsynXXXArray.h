@@ -25,7 +25,7 @@
                                                                                                    \
                                                                                                    \
 typedef struct ringBufferElement {                                                                 \
-    EPICS_TYPE          *pValue;                                                                   \
+    EPICS_TYPE          *pValue; /* From asynBufferPoolAlloc, len elements */                      \
     size_t              len;                                                                       \
     epicsTimeStamp      time;                                                                      \
     asynStatus          status;                                                                    \
@@ -44,12 +44,8 @@ typedef struct devAsynWfPvt{
     IOSCANPVT           ioScanPvt;                                                                 \
     asynStatus          lastStatus;                                                                \
     int                 isOutput;                                                                  \
-    epicsMutexId        ringBufferLock;                                                            \
-    ringBufferElement   *ringBuffer;                                                               \
-    int                 ringHead;                                                                  \
-    int                 ringTail;                                                                  \
+    asynRingBuffer      *ringBuffer;                                                               \
     int                 ringSize;                                                                  \
-    int                 ringBufferOverflows;                                                       \
     ringBufferElement   result;                                                                    \
     int                 gotValue; /* For interruptCallbackInput */                                 \
     INTERRUPT           interruptCallback;                                                         \
@@ -110,7 +106,6 @@ static long initCommon(dbCommon *pr, DBLINK *plink,
     pasynUser = pasynManager->createAsynUser(callback, 0);                                         \
     pasynUser->userPvt = pPvt;                                                                     \
     pPvt->pasynUser = pasynUser;                                                                   \
-    pPvt->ringBufferLock = epicsMutexCreate();                                                     \
     /* This device support only supports signed and unsigned versions of the EPICS data type  */   \
     if ((pwf->ftvl != SIGNED_TYPE) && (pwf->ftvl != UNSIGNED_TYPE)) {                              \
         errlogPrintf("%s::initCommon, %s field type must be SIGNED_TYPE or UNSIGNED_TYPE\n",       \
@@ -197,7 +192,6 @@ static long createRingBuffer(dbCommon *pr)
 {                                                                                                  \
     devAsynWfPvt *pPvt = (devAsynWfPvt *)pr->dpvt;                                                 \
     asynStatus status;                                                                             \
-    waveformRecord *pwf = (waveformRecord *)pr;                                                    \
     const char *sizeString;                                                                        \
                                                                                                    \
     if (!pPvt->ringBuffer) {                                                                       \
@@ -211,17 +205,13 @@ static long createRingBuffer(dbCommon *pr)
         sizeString = dbGetInfo(pdbentry, "asyn:FIFO");                                             \
         if (sizeString) pPvt->ringSize = atoi(sizeString);                                         \
         if (pPvt->ringSize > 0) {                                                                  \
-            int i;                                                                                 \
-            pPvt->ringBuffer = callocMustSucceed(                                                  \
-                                   pPvt->ringSize, sizeof(*pPvt->ringBuffer),                      \
-                                   "devAsynXXXArray::getIoIntInfo creating ring buffer");          \
-            /* Allocate array for each ring buffer element */                                      \
-            for (i=0; i<pPvt->ringSize; i++) {                                                     \
-                pPvt->ringBuffer[i].pValue =                                                       \
-                    (EPICS_TYPE *)callocMustSucceed(                                               \
-                        pwf->nelm, sizeof(EPICS_TYPE),                                             \
-                        "devAsynXXXArray::getIoIntInfo creating ring element array");              \
-            }                                                                                      \
+            /* The arrays are not allocated here, each element gets a buffer                       \
+             * of the size actually received from the shared pool */                               \
+            pPvt->ringBuffer = asynRingBufferCreate(pPvt->ringSize, sizeof(ringBufferElement));    \
+            /* asyn:FIFO=1 gets a ring of 2, report the size actually used */                      \
+            pPvt->ringSize = asynRingBufferSize(pPvt->ringBuffer);                                 \
+        } else {                                                                                   \
+            pPvt->ringSize = 0;                                                                    \
         }                                                                                          \
     }                                                                                              \
     return asynSuccess;                                                                            \
@@ -322,19 +312,17 @@ static long processCommon(dbCommon *pr)
             /* Copy data from ring buffer */                                                       \
             EPICS_TYPE *pData = (EPICS_TYPE *)pwf->bptr;                                           \
             ringBufferElement *rp = &pPvt->result;                                                 \
-            int i;                                                                                 \
-            /* Need to copy the array with the lock because that is shared even though             \
-               pPvt->result is a copy */                                                           \
+            /* rp->pValue was removed from the ring buffer so no other thread uses it */           \
             if (rp->status == asynSuccess) {                                                       \
-                epicsMutexLock(pPvt->ringBufferLock);                                              \
-                for (i=0; i<(int)rp->len; i++) pData[i] = rp->pValue[i];                           \
-                epicsMutexUnlock(pPvt->ringBufferLock);                                            \
-                pwf->nord = rp->len;                                                               \
+                if (rp->len > 0) memcpy(pData, rp->pValue, rp->len*sizeof(EPICS_TYPE));            \
+                pwf->nord = (epicsUInt32)rp->len;                                                  \
                 asynPrintIO(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,                                  \
                     (char *)pwf->bptr, pwf->nord*sizeof(EPICS_TYPE),                               \
                     "%s %s::processCommon nord=%d, pwf->bptr data:",                               \
                     pwf->name, driverName, pwf->nord);                                             \
             }                                                                                      \
+            asynBufferPoolFree(rp->pValue);                                                        \
+            rp->pValue = NULL;                                                                     \
             pwf->time = rp->time;                                                                  \
         }                                                                                          \
     }                                                                                              \
@@ -407,19 +395,15 @@ static void callbackWfIn(asynUser *pasynUser)
 static int getRingBufferValue(devAsynWfPvt *pPvt)                                                  \
 {                                                                                                  \
     int ret = 0;                                                                                   \
-    epicsMutexLock(pPvt->ringBufferLock);                                                          \
-    if (pPvt->ringTail != pPvt->ringHead) {                                                        \
-        if (pPvt->ringBufferOverflows > 0) {                                                       \
+    if (asynRingBufferGet(pPvt->ringBuffer, &pPvt->result)) {                                      \
+        int overflows = asynRingBufferGetOverflows(pPvt->ringBuffer);                              \
+        if (overflows > 0) {                                                                       \
             asynPrint(pPvt->pasynUser, ASYN_TRACE_WARNING,                                         \
                 "%s %s::getRingBufferValue error, %d ring buffer overflows\n",                     \
-                pPvt->pr->name, driverName, pPvt->ringBufferOverflows);                            \
-            pPvt->ringBufferOverflows = 0;                                                         \
+                pPvt->pr->name, driverName, overflows);                                            \
         }                                                                                          \
-        pPvt->result = pPvt->ringBuffer[pPvt->ringTail];                                           \
-        pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize-1) ? 0 : pPvt->ringTail+1;                \
         ret = 1;                                                                                   \
     }                                                                                              \
-    epicsMutexUnlock(pPvt->ringBufferLock);                                                        \
     return ret;                                                                                    \
 }                                                                                                  \
                                                                                                    \
@@ -428,7 +412,6 @@ static void interruptCallback(void *drvPvt, asynUser *pasynUser,
 {                                                                                                  \
     devAsynWfPvt *pPvt = (devAsynWfPvt *)drvPvt;                                                   \
     waveformRecord *pwf = (waveformRecord *)pPvt->pr;                                              \
-    int i;                                                                                         \
     EPICS_TYPE *pData = (EPICS_TYPE *)pwf->bptr;                                                   \
                                                                                                    \
     asynPrintIO(pPvt->pasynUser, ASYN_TRACEIO_DEVICE,                                              \
@@ -440,7 +423,7 @@ static void interruptCallback(void *drvPvt, asynUser *pasynUser,
         dbScanLock((dbCommon *)pwf);                                                               \
         if (len > pwf->nelm) len = pwf->nelm;                                                      \
         if (pasynUser->auxStatus == asynSuccess) {                                                 \
-            for (i=0; i<(int)len; i++) pData[i] = value[i];                                        \
+            memcpy(pData, value, len*sizeof(EPICS_TYPE));                                          \
             pwf->nord = (epicsUInt32)len;                                                          \
         }                                                                                          \
         pwf->time = pasynUser->timestamp;                                                          \
@@ -455,30 +438,29 @@ static void interruptCallback(void *drvPvt, asynUser *pasynUser,
             scanIoRequest(pPvt->ioScanPvt);                                                        \
     } else {                                                                                       \
         /* Using a ring buffer */                                                                  \
-        ringBufferElement *rp;                                                                     \
+        ringBufferElement element, dropped;                                                        \
                                                                                                    \
         /* If interruptAccept is false we just return.  This prevents more ring pushes than pops.  \
          * There will then be nothing in the ring buffer, so the first                             \
          * read will do a read from the driver, which should be OK. */                             \
         if (!interruptAccept) return;                                                              \
                                                                                                    \
-        epicsMutexLock(pPvt->ringBufferLock);                                                      \
-        rp = &pPvt->ringBuffer[pPvt->ringHead];                                                    \
         if (len > pwf->nelm) len = pwf->nelm;                                                      \
-        rp->len = len;                                                                             \
-        for (i=0; i<(int)len; i++) rp->pValue[i] = value[i];                                       \
-        rp->time = pasynUser->timestamp;                                                           \
-        rp->status = pasynUser->auxStatus;                                                         \
-        rp->alarmStatus = pasynUser->alarmStatus;                                                  \
-        rp->alarmSeverity = pasynUser->alarmSeverity;                                              \
-        pPvt->ringHead = (pPvt->ringHead==pPvt->ringSize-1) ? 0 : pPvt->ringHead+1;                \
-        if (pPvt->ringHead == pPvt->ringTail) {                                                    \
+        if (pasynUser->auxStatus != asynSuccess) len = 0;                                          \
+        /* The element only holds as much memory as the data received */                           \
+        element.pValue = len ? asynBufferPoolAlloc(len*sizeof(EPICS_TYPE)) : NULL;                 \
+        if (len) memcpy(element.pValue, value, len*sizeof(EPICS_TYPE));                            \
+        element.len = len;                                                                         \
+        element.time = pasynUser->timestamp;                                                       \
+        element.status = pasynUser->auxStatus;                                                     \
+        element.alarmStatus = pasynUser->alarmStatus;                                              \
+        element.alarmSeverity = pasynUser->alarmSeverity;                                          \
+        if (asynRingBufferPutGetDropped(pPvt->ringBuffer, &element, &dropped)) {                   \
             /* There was no room in the ring buffer.  In the past we just threw away               \
              * the new value.  However, it is better to remove the oldest value from the           \
              * ring buffer and add the new one.  That way the final value the record receives      \
              * is guaranteed to be the most recent value */                                        \
-            pPvt->ringTail = (pPvt->ringTail==pPvt->ringSize-1) ? 0 : pPvt->ringTail+1;            \
-            pPvt->ringBufferOverflows++;                                                           \
+            asynBufferPoolFree(dropped.pValue);                                                    \
         } else {                                                                                   \
             /* We only need to request the record to process if we added a new                     \
              * element to the ring buffer, not if we just replaced an element. */                  \
@@ -487,7 +469,6 @@ static void interruptCallback(void *drvPvt, asynUser *pasynUser,
             else                                                                                   \
                 scanIoRequest(pPvt->ioScanPvt);                                                    \
         }                                                                                          \
-        epicsMutexUnlock(pPvt->ringBufferLock);                                                    \
     }                                                                                              \
 }                                                                                                  \
 
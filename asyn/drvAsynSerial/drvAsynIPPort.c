@@ -34,6 +34,11 @@
  * the code as of version 1.29 should be used as the starting point.
  */
 
+/* recvmmsg() needs _GNU_SOURCE */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE
+#endif
+
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>
@@ -45,6 +50,7 @@
 #include <errlog.h>
 #include <iocsh.h>
 #include <epicsAssert.h>
+#include <epicsEvent.h>
 #include <epicsExit.h>
 #include <epicsStdio.h>
 #include <epicsString.h>
@@ -68,6 +74,15 @@
 # include <sys/un.h>
 #endif
 
+#if !defined(_WIN32) && !defined(vxWorks)
+# define HAS_SENDMSG 1
+# include <sys/uio.h>
+#endif
+
+#if defined(__linux__)
+# define HAS_RECVMMSG 1
+#endif
+
 #if defined(__rtems__)
 # define USE_SOCKTIMEOUT
 #else
@@ -94,6 +109,25 @@
 
 #define ISCOM_UNKNOWN (-1)
 
+/* Limits for the udpBatch and udpMaxSize options */
+#define UDP_BATCH_MAX 64
+#define UDP_MAX_SIZE 65507
+/* How often the UDP receive thread checks for changes when idle */
+#define UDP_THREAD_POLL 0.1
+
+/*
+ * Datagrams received together by recvmmsg(), waiting to be read
+ */
+typedef struct {
+    int                nSlots;
+    int                slotSize;
+    char              *buf;             /* nSlots buffers of slotSize */
+    int               *len;             /* Length of each datagram */
+    osiSockAddr       *from;            /* Source of each datagram */
+    int                next;            /* Next datagram to return */
+    int                count;           /* Datagrams not yet returned */
+} udpBatch_t;
+
 /*
  * This structure holds the hardware-specific information for a single
  * asyn link.  There is one for each IP socket.
@@ -107,9 +141,31 @@ typedef struct {
     int                flags;
     int                isCom;
     int                disconnectOnReadTimeout;
+    int                preConnect;
+    double             connectTimeout;  /* 0 means block in connect() */
     SOCKET             fd;
     unsigned long      nRead;
     unsigned long      nWritten;
+    unsigned long      nReadCalls;      /* System calls, for report() */
+    unsigned long      nWriteCalls;
+    unsigned long      nPollCalls;
+    unsigned long      nSetsockoptCalls;
+    int                recvTimeoutMsec; /* Last timeouts set on fd, 0 if none */
+    int                sendTimeoutMsec;
+    int                udpBatchSize;    /* Datagrams per receive call, 0 for recvfrom() */
+    int                udpMaxSize;
+    udpBatch_t        *udpBatch;
+    int                udpCallbacks;    /* Receive thread calls interrupt users */
+    int                udpThreadStarted;
+    int                udpThreadExit;   /* Set with the port locked to stop the thread */
+    epicsEventId       udpThreadDone;   /* Signalled by the thread as it exits */
+    SOCKET             udpWakeFd;       /* Loopback socket that wakes the thread's poll() */
+    osiSockAddr        udpWakeAddr;
+    void              *octetCallbackPvt;
+    char              *dgramBuf;        /* Gathers a writev that sendmsg can't send as one datagram */
+    size_t             dgramBufSize;
+    unsigned long      nDatagrams;
+    unsigned long      nTruncated;
     union {
       osiSockAddr        oa;
 #if defined(HAS_AF_UNIX)
@@ -127,6 +183,7 @@ typedef struct {
 #define FLAG_BROADCAST                  0x1
 #define FLAG_CONNECT_PER_TRANSACTION    0x2
 #define FLAG_SHUTDOWN                   0x4
+#define FLAG_CONNECT_PENDING            0x8
 #define FLAG_NEED_LOOKUP                0x100
 #define FLAG_DONE_LOOKUP                0x200
 
@@ -143,12 +200,18 @@ struct pollfd {
 };
 static int poll(struct pollfd fds[], int nfds, int timeout)
 {
-    fd_set fdset;
+    fd_set readset, writeset;
     struct timeval tv, *ptv;
+    SOCKET maxfd = 0;
+    int i, n;
 
-    assert(nfds == 1);
-    FD_ZERO(&fdset);
-    FD_SET(fds[0].fd,&fdset);
+    FD_ZERO(&readset);
+    FD_ZERO(&writeset);
+    for (i = 0 ; i < nfds ; i++) {
+        if (fds[i].events & POLLIN) FD_SET(fds[i].fd,&readset);
+        if (fds[i].events & POLLOUT) FD_SET(fds[i].fd,&writeset);
+        if (fds[i].fd > maxfd) maxfd = fds[i].fd;
+    }
     if (timeout >= 0) {
         tv.tv_sec = timeout / 1000;
         tv.tv_usec = (timeout % 1000) * 1000;
@@ -156,11 +219,13 @@ static int poll(struct pollfd fds[], int nfds, int timeout)
     } else {
         ptv = NULL;
     }
-    return select(fds[0].fd + 1, 
-        (fds[0].events & POLLIN) ? &fdset : NULL,
-        (fds[0].events & POLLOUT) ? &fdset : NULL,
-        NULL,
-        ptv);
+    n = select(maxfd + 1, &readset, &writeset, NULL, ptv);
+    for (i = 0 ; i < nfds ; i++) {
+        fds[i].revents = 0;
+        if ((n > 0) && FD_ISSET(fds[i].fd,&readset)) fds[i].revents |= POLLIN;
+        if ((n > 0) && FD_ISSET(fds[i].fd,&writeset)) fds[i].revents |= POLLOUT;
+    }
+    return n;
 }
 #endif
 
@@ -205,6 +270,9 @@ closeConnection(asynUser *pasynUser,ttyController_t *tty,const char *why)
         epicsSocketDestroy(tty->fd);
         tty->fd = INVALID_SOCKET;
     }
+    tty->flags &= ~FLAG_CONNECT_PENDING;
+    if (tty->udpBatch)
+        tty->udpBatch->count = 0;
     if (!(tty->flags & FLAG_CONNECT_PER_TRANSACTION) ||
          (tty->flags & FLAG_SHUTDOWN))
         pasynManager->exceptionDisconnect(pasynUser);
@@ -229,9 +297,23 @@ asynCommonReport(void *drvPvt, FILE *fp, int details)
         fprintf(fp, "                    fd: %d\n", tty->fd);
         fprintf(fp, "    Characters written: %lu\n", tty->nWritten);
         fprintf(fp, "       Characters read: %lu\n", tty->nRead);
+        fprintf(fp, "            Read calls: %lu\n", tty->nReadCalls);
+        fprintf(fp, "           Write calls: %lu\n", tty->nWriteCalls);
+        fprintf(fp, "            Poll calls: %lu\n", tty->nPollCalls);
+        fprintf(fp, "      Setsockopt calls: %lu\n", tty->nSetsockoptCalls);
+        if (tty->socketType == SOCK_DGRAM) {
+            fprintf(fp, "             Datagrams: %lu\n", tty->nDatagrams);
+            fprintf(fp, "   Truncated datagrams: %lu\n", tty->nTruncated);
+            fprintf(fp, "   Datagrams per recv: %.1f\n", tty->nReadCalls ?
+                                (double)tty->nDatagrams / tty->nReadCalls : 0.0);
+        }
     }
 }
 
+#ifdef USE_POLL
+static void stopUdpThread(ttyController_t *tty);
+#endif
+
 /*
  * Clean up a socket on exit
  * This helps reduce problems with vxWorks when the IOC restarts
@@ -243,6 +325,10 @@ cleanup (void *arg)
     ttyController_t *tty = (ttyController_t *)arg;
 
     if (!tty) return;
+#ifdef USE_POLL
+    /* The receive thread takes the port lock, so stop it first */
+    stopUdpThread(tty);
+#endif
     status=pasynManager->lockPort(tty->pasynUser);
     if(status!=asynSuccess)
         asynPrint(tty->pasynUser, ASYN_TRACE_ERROR, "%s: cleanup locking error\n", tty->portName);
@@ -382,14 +468,76 @@ static int parseHostInfo(ttyController_t *tty, const char* hostInfo)
     return 0;
 }
 
+#ifdef USE_POLL
+/*
+ * Wait for a non-blocking connect() to complete
+ */
+static int
+finishConnect(SOCKET fd, int pollmsec)
+{
+    struct pollfd pollfd;
+    int pollstatus;
+    int soError = 0;
+    osiSocklen_t len = sizeof soError;
+
+    pollfd.fd = fd;
+    pollfd.events = POLLOUT;
+    while ((pollstatus = poll(&pollfd, 1, pollmsec)) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    if (pollstatus == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, (void *)&soError, &len) < 0)
+        return -1;
+    if (soError) {
+        errno = soError;
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+/*
+ * Connect to the remote host, giving up after tty->connectTimeout
+ * seconds if that is set. Otherwise connect() can block for minutes
+ * when the host is down, holding up the thread that called us.
+ * If wait is 0 return 1 as soon as the connect() is in progress.
+ */
+static int
+connectWithTimeout(ttyController_t *tty, SOCKET fd, int wait)
+{
+#ifdef USE_POLL
+    int pollmsec = (int)(tty->connectTimeout * 1000.0);
+
+    if (wait && (pollmsec <= 0))
+        return connect(fd, &tty->farAddr.oa.sa, (int)tty->farAddrSize);
+    if (setNonBlock(fd, 1) < 0)
+        return -1;
+    /* connectIt leaves the socket non-blocking anyway when USE_POLL is set */
+    if (connect(fd, &tty->farAddr.oa.sa, (int)tty->farAddrSize) == 0)
+        return 0;
+    if (SOCKERRNO != SOCK_EINPROGRESS && SOCKERRNO != SOCK_EWOULDBLOCK)
+        return -1;
+    if (!wait)
+        return 1;
+    return finishConnect(fd, pollmsec);
+#else
+    return connect(fd, &tty->farAddr.oa.sa, (int)tty->farAddrSize);
+#endif
+}
+
 /*
  * Create a link
+ * If wait is 0 a TCP connect() may still be in progress on return,
+ * and FLAG_CONNECT_PENDING is set.
 */
 static asynStatus
-connectIt(void *drvPvt, asynUser *pasynUser)
+openConnection(ttyController_t *tty, asynUser *pasynUser, int wait)
 {
-    ttyController_t *tty = (ttyController_t *)drvPvt;
     SOCKET fd;
+    int pending = 0;
     int i;
 
     /*
@@ -473,7 +621,7 @@ connectIt(void *drvPvt, asynUser *pasynUser)
          * problem is just that the device has DHCP'd itself an new number.
          */
         if (tty->socketType != SOCK_DGRAM) {
-            if (connect(fd, &tty->farAddr.oa.sa, (int)tty->farAddrSize) < 0) {
+            if ((pending = connectWithTimeout(tty, fd, wait)) < 0) {
                 epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                               "Can't connect to %s: %s",
                               tty->IPDeviceName, strerror(SOCKERRNO));
@@ -505,11 +653,85 @@ connectIt(void *drvPvt, asynUser *pasynUser)
 #endif
 
     asynPrint(pasynUser, ASYN_TRACE_FLOW,
-                          "Opened connection OK to %s\n", tty->IPDeviceName);
+                          "%s connection to %s\n", pending ? "Started" : "Opened",
+                                                     tty->IPDeviceName);
     tty->fd = fd;
+    tty->recvTimeoutMsec = 0;
+    tty->sendTimeoutMsec = 0;
+    if (pending)
+        tty->flags |= FLAG_CONNECT_PENDING;
     return asynSuccess;
 }
 
+static asynStatus
+connectIt(void *drvPvt, asynUser *pasynUser)
+{
+    return openConnection((ttyController_t *)drvPvt, pasynUser, 1);
+}
+
+/*
+ * Check a connect-per-transaction socket before it is used again.
+ * Wait for a connect() started by preConnect to complete and, if
+ * checkPeer is set, close the socket if the peer closed it since the
+ * last transaction, so that a new connection is made instead of the
+ * transaction failing.
+ */
+static void
+checkConnection(ttyController_t *tty, asynUser *pasynUser, int checkPeer)
+{
+#ifdef USE_POLL
+    char c;
+    int n;
+
+    if (!(tty->flags & FLAG_CONNECT_PER_TRANSACTION) || (tty->fd == INVALID_SOCKET))
+        return;
+    if (tty->flags & FLAG_CONNECT_PENDING) {
+        double timeout = (tty->connectTimeout > 0) ? tty->connectTimeout : pasynUser->timeout;
+        int pollmsec = (int)(timeout * 1000.0);
+
+        if (pollmsec == 0) pollmsec = 1;
+        if (pollmsec < 0) pollmsec = -1;
+        tty->flags &= ~FLAG_CONNECT_PENDING;
+        if (finishConnect(tty->fd, pollmsec) < 0) {
+            asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s pre-connect failed: %s\n",
+                      tty->IPDeviceName, strerror(SOCKERRNO));
+            closeConnection(pasynUser, tty, "Pre-connect failed");
+            if (tty->flags & FLAG_DONE_LOOKUP)
+                tty->flags |= FLAG_NEED_LOOKUP;
+        }
+        return;
+    }
+    if (!checkPeer)
+        return;
+    /* The socket is non-blocking, so this returns at once */
+    tty->nReadCalls++;
+    n = recv(tty->fd, &c, 1, MSG_PEEK);
+    if ((n == 0) ||
+        ((n < 0) && (SOCKERRNO != SOCK_EWOULDBLOCK) && (SOCKERRNO != SOCK_EINTR)))
+        closeConnection(pasynUser, tty, "Peer closed connection");
+#endif
+}
+
+/*
+ * Start connecting for the next transaction as soon as the peer has
+ * closed the connection, so that the connect() overlaps whatever the
+ * caller does before the next write.
+ */
+static void
+preConnect(ttyController_t *tty, asynUser *pasynUser)
+{
+#ifdef USE_POLL
+    if (!tty->preConnect || (tty->socketType != SOCK_STREAM) ||
+        !(tty->flags & FLAG_CONNECT_PER_TRANSACTION) ||
+        (tty->flags & FLAG_SHUTDOWN) || (tty->fd != INVALID_SOCKET))
+        return;
+    /* tty->pasynUser has reason 0, so openConnection creates a socket */
+    if (openConnection(tty, tty->pasynUser, 0) != asynSuccess)
+        asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s pre-connect failed: %s\n",
+                  tty->IPDeviceName, tty->pasynUser->errorMessage);
+#endif
+}
+
 static asynStatus
 asynCommonConnect(void *drvPvt, asynUser *pasynUser)
 {
@@ -535,12 +757,85 @@ asynCommonDisconnect(void *drvPvt, asynUser *pasynUser)
     return asynSuccess;
 }
 
+/*
+ * Send as much of the buffers as the socket will take,
+ * starting offset bytes into the first one.
+ * Several buffers go to the kernel in a single sendmsg.
+ */
+static int sendIovec(ttyController_t *tty, const asynOctetIovec *iov,
+    int iovcnt, size_t offset)
+{
+#ifdef HAS_SENDMSG
+    if (iovcnt > 1) {
+        struct iovec vec[ASYN_OCTET_IOV_MAX];
+        struct msghdr msg;
+        int n;
+
+        memset(&msg, 0, sizeof msg);
+        for (n = 0 ; (n < iovcnt) && (n < ASYN_OCTET_IOV_MAX) ; n++) {
+            vec[n].iov_base = (char *)iov[n].data + offset;
+            vec[n].iov_len = iov[n].numchars - offset;
+            offset = 0;
+        }
+        msg.msg_iov = vec;
+        msg.msg_iovlen = n;
+        if (tty->socketType == SOCK_DGRAM) {
+            msg.msg_name = &tty->farAddr.oa.sa;
+            msg.msg_namelen = (socklen_t)tty->farAddrSize;
+        }
+        return (int)sendmsg(tty->fd, &msg, 0);
+    }
+#endif
+    if (tty->socketType == SOCK_DGRAM) {
+        return sendto(tty->fd, (char *)iov->data + offset,
+                      (int)(iov->numchars - offset), 0,
+                      &tty->farAddr.oa.sa, (int)tty->farAddrSize);
+    }
+    return send(tty->fd, (char *)iov->data + offset,
+                (int)(iov->numchars - offset), 0);
+}
+
+#ifdef USE_POLL
+/*
+ * Wait until the socket is ready for events
+ */
+static int pollSocket(ttyController_t *tty, short events, int pollmsec)
+{
+    struct pollfd pollfd;
+
+    pollfd.fd = tty->fd;
+    pollfd.events = events;
+    tty->nPollCalls++;
+    return poll(&pollfd, 1, pollmsec);
+}
+#endif
+
+#ifdef USE_SOCKTIMEOUT
+/*
+ * Set the socket send or receive timeout unless it is already *pmsec
+ */
+static int setSocketTimeout(ttyController_t *tty, int option, int msec, int *pmsec)
+{
+    struct timeval tv;
+
+    if (*pmsec == msec)
+        return 0;
+    tv.tv_sec = msec / 1000;
+    tv.tv_usec = (msec % 1000) * 1000;
+    tty->nSetsockoptCalls++;
+    if (setsockopt(tty->fd, SOL_SOCKET, option, &tv, sizeof tv) < 0)
+        return -1;
+    *pmsec = msec;
+    return 0;
+}
+#endif
+
 /*Beginning of asynOctet methods*/
 /*
- * Write to the TCP port
+ * Write buffers to the TCP port
  */
-static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
-    const char *data, size_t numchars,size_t *nbytesTransfered)
+static asynStatus writevIt(void *drvPvt, asynUser *pasynUser,
+    const asynOctetIovec *iov, int iovcnt,size_t *nbytesTransfered)
 {
     ttyController_t *tty = (ttyController_t *)drvPvt;
     int thisWrite;
@@ -550,13 +845,22 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
     epicsTimeStamp startTime;
     epicsTimeStamp endTime;
     int haveStartTime;
+    size_t numchars = 0;
+    size_t offset = 0;
+    int needPoll = 0;
+    asynOctetIovec dgram;
+    int i;
 
     assert(tty);
+    for (i = 0 ; i < iovcnt ; i++)
+        numchars += iov[i].numchars;
     asynPrint(pasynUser, ASYN_TRACE_FLOW,
               "%s write.\n", tty->IPDeviceName);
-    asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, numchars,
-                "%s write %lu\n", tty->IPDeviceName, (unsigned long)numchars);
+    for (i = 0 ; i < iovcnt ; i++)
+        asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, iov[i].data, iov[i].numchars,
+                "%s write %lu\n", tty->IPDeviceName, (unsigned long)iov[i].numchars);
     *nbytesTransfered = 0;
+    checkConnection(tty, pasynUser, 1);
     if (tty->fd == INVALID_SOCKET) {
         if (tty->flags & FLAG_CONNECT_PER_TRANSACTION) {
             if ((status = connectIt(drvPvt, pasynUser)) != asynSuccess)
@@ -574,52 +878,88 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
     }
     if (numchars == 0)
         return asynSuccess;
+    while (iov->numchars == 0) {
+        iov++;
+        iovcnt--;
+    }
+    /*
+     * All the buffers of a UDP write are one datagram.
+     * sendIovec can only pass ASYN_OCTET_IOV_MAX buffers to one sendmsg,
+     * so copy them into a single buffer if there are more.
+     */
+#ifdef HAS_SENDMSG
+    if ((tty->socketType == SOCK_DGRAM) && (iovcnt > ASYN_OCTET_IOV_MAX)) {
+#else
+    if ((tty->socketType == SOCK_DGRAM) && (iovcnt > 1)) {
+#endif
+        if (tty->dgramBufSize < numchars) {
+            char *buf = realloc(tty->dgramBuf, numchars);
+            if (!buf) {
+                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                              "%s can't allocate %lu byte datagram", tty->IPDeviceName,
+                              (unsigned long)numchars);
+                return asynError;
+            }
+            tty->dgramBuf = buf;
+            tty->dgramBufSize = numchars;
+        }
+        dgram.data = tty->dgramBuf;
+        dgram.numchars = 0;
+        for (i = 0 ; i < iovcnt ; i++) {
+            memcpy(tty->dgramBuf + dgram.numchars, iov[i].data, iov[i].numchars);
+            dgram.numchars += iov[i].numchars;
+        }
+        iov = &dgram;
+        iovcnt = 1;
+    }
     writePollmsec = (int) (pasynUser->timeout * 1000.0);
     if (writePollmsec == 0) writePollmsec = 1;
     if (writePollmsec < 0) writePollmsec = -1;
 #ifdef USE_SOCKTIMEOUT
-    {
-    struct timeval tv;
-    tv.tv_sec = writePollmsec / 1000;
-    tv.tv_usec = (writePollmsec % 1000) * 1000;
-    if (setsockopt(tty->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv) < 0) {
+    if (setSocketTimeout(tty, SO_SNDTIMEO, writePollmsec, &tty->sendTimeoutMsec) < 0) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                       "Can't set %s socket send timeout: %s",
                       tty->IPDeviceName, strerror(SOCKERRNO));
         return asynError;
     }
-    }
 #endif
     haveStartTime = 0;
     for (;;) {
 #ifdef USE_POLL
-        int pollstatus;
-        struct pollfd pollfd;
-        pollfd.fd = tty->fd;
-        pollfd.events = POLLOUT;
-        epicsTimeGetCurrent(&startTime);
-        while ((pollstatus = poll(&pollfd, 1, writePollmsec)) < 0) {
-            if (errno != EINTR) {
-                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                                          "%s poll() failed: %s", tty->IPDeviceName, strerror(errno));
-                return asynError;
+        /*
+         * The socket is non-blocking, so send() is tried first and
+         * poll() is only needed when the socket buffer is full
+         */
+        if (needPoll) {
+            int pollstatus;
+            epicsTimeGetCurrent(&startTime);
+            while ((pollstatus = pollSocket(tty, POLLOUT, writePollmsec)) < 0) {
+                if (errno != EINTR) {
+                    epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                              "%s poll() failed: %s", tty->IPDeviceName, strerror(errno));
+                    return asynError;
+                }
+                epicsTimeGetCurrent(&endTime);
+                if (epicsTimeDiffInSeconds(&endTime, &startTime)*1000 > writePollmsec) break; 
             }
-            epicsTimeGetCurrent(&endTime);
-            if (epicsTimeDiffInSeconds(&endTime, &startTime)*1000 > writePollmsec) break; 
-        }
-        if (pollstatus == 0) {
-            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-                                     "%s poll() timed out", tty->IPDeviceName);
-            return asynTimeout;
+            if (pollstatus == 0) {
+                epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                                         "%s poll() timed out", tty->IPDeviceName);
+                return asynTimeout;
+            }
+            needPoll = 0;
         }
 #endif
         for (;;) {
-            if (tty->socketType == SOCK_DGRAM) {
-                thisWrite = sendto(tty->fd, (char *)data, (int)numchars, 0, &tty->farAddr.oa.sa, (int)tty->farAddrSize);
-            } else {
-                thisWrite = send(tty->fd, (char *)data, (int)numchars, 0);
-            }
+            thisWrite = sendIovec(tty, iov, iovcnt, offset);
+            tty->nWriteCalls++;
             if (thisWrite >= 0) break;
+#ifdef USE_POLL
+            if (SOCKERRNO == SOCK_EWOULDBLOCK) {
+                needPoll = 1;
+                break;
+            }
+#endif
             if (SOCKERRNO == SOCK_EWOULDBLOCK || SOCKERRNO == SOCK_EINTR) {
                 if (!haveStartTime) {
                     epicsTimeStatus = epicsTimeGetCurrent(&startTime);
@@ -637,13 +977,22 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
                 epicsThreadSleep(SEND_RETRY_DELAY);
             } else break;
         }
+#ifdef USE_POLL
+        if (needPoll)
+            continue;
+#endif
         if (thisWrite > 0) {
             tty->nWritten += (unsigned long)thisWrite;
             *nbytesTransfered += thisWrite;
             numchars -= thisWrite;
             if (numchars == 0)
                 break;
-            data += thisWrite;
+            offset += thisWrite;
+            while (offset >= iov->numchars) {
+                offset -= iov->numchars;
+                iov++;
+                iovcnt--;
+            }
         }
         else if (thisWrite == 0) {
             status = asynTimeout;
@@ -668,72 +1017,107 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
 }
 
 /*
- * Read from the TCP port
+ * Write to the TCP port
  */
-static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
-    char *data, size_t maxchars,size_t *nbytesTransfered,int *gotEom)
+static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
+    const char *data, size_t numchars,size_t *nbytesTransfered)
 {
-    ttyController_t *tty = (ttyController_t *)drvPvt;
-    int thisRead;
-    int readPollmsec;
-    int reason = 0;
-    epicsTimeStamp startTime;
-    epicsTimeStamp endTime;
-    asynStatus status = asynSuccess;
+    asynOctetIovec iov;
 
-    assert(tty);
-    asynPrint(pasynUser, ASYN_TRACE_FLOW,
-              "%s read.\n", tty->IPDeviceName);
-    if (tty->fd == INVALID_SOCKET) {
-        if (tty->flags & FLAG_CONNECT_PER_TRANSACTION) {
-            if ((status = connectIt(drvPvt, pasynUser)) != asynSuccess)
-                return status;
-        }
-        else {
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                          "%s disconnected:", tty->IPDeviceName);
-            return asynError;
-        }
-    }
-    if (maxchars <= 0) {
-        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                  "%s maxchars %d. Why <=0?",tty->IPDeviceName,(int)maxchars);
-        return asynError;
+    iov.data = data;
+    iov.numchars = numchars;
+    return writevIt(drvPvt, pasynUser, &iov, 1, nbytesTransfered);
+}
+
+/*
+ * Receive as many waiting datagrams as the batch has room for
+ * Returns the number received, or -1 with SOCKERRNO set.
+ */
+static int fillBatch(ttyController_t *tty)
+{
+    udpBatch_t *pbatch = tty->udpBatch;
+    int i, n;
+#ifdef HAS_RECVMMSG
+    struct mmsghdr msgs[UDP_BATCH_MAX];
+    struct iovec iov[UDP_BATCH_MAX];
+
+    memset(msgs, 0, pbatch->nSlots * sizeof msgs[0]);
+    for (i = 0 ; i < pbatch->nSlots ; i++) {
+        iov[i].iov_base = pbatch->buf + (size_t)i * pbatch->slotSize;
+        iov[i].iov_len = pbatch->slotSize;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &pbatch->from[i].sa;
+        msgs[i].msg_hdr.msg_namelen = sizeof pbatch->from[i];
     }
-    readPollmsec = (int) (pasynUser->timeout * 1000.0);
-    if (readPollmsec == 0) readPollmsec = 1;
-    if (readPollmsec < 0) readPollmsec = -1;
-#ifdef USE_SOCKTIMEOUT
-    {
-    struct timeval tv;
-    tv.tv_sec = readPollmsec / 1000;
-    tv.tv_usec = (readPollmsec % 1000) * 1000;
-    if (setsockopt(tty->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv) < 0) {
-        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                      "Can't set %s socket receive timeout: %s",
-                      tty->IPDeviceName, strerror(SOCKERRNO));
-        status = asynError;
+    tty->nReadCalls++;
+    /* MSG_WAITFORONE only waits for the first datagram */
+    n = recvmmsg(tty->fd, msgs, pbatch->nSlots, MSG_WAITFORONE, NULL);
+    for (i = 0 ; i < n ; i++) {
+        pbatch->len[i] = (int)msgs[i].msg_len;
+        if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+            tty->nTruncated++;
     }
+#else
+    osiSocklen_t addrlen = sizeof pbatch->from[0];
+
+    tty->nReadCalls++;
+    n = recvfrom(tty->fd, pbatch->buf, pbatch->slotSize, 0,
+                 &pbatch->from[0].sa, &addrlen);
+    if (n >= 0) {
+        pbatch->len[0] = n;
+        n = 1;
     }
 #endif
-    if (gotEom) *gotEom = 0;
-#ifdef USE_POLL
-    {
-        struct pollfd pollfd;
-        pollfd.fd = tty->fd;
-        pollfd.events = POLLIN;
-        epicsTimeGetCurrent(&startTime);
-        while (poll(&pollfd, 1, readPollmsec) < 0) {
-            if (errno != EINTR) {
-                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                                          "Poll() failed: %s", strerror(errno));
-                return asynError;
-            }
-            epicsTimeGetCurrent(&endTime);
-            if (epicsTimeDiffInSeconds(&endTime, &startTime)*1000. > readPollmsec) break; 
-        }
+    if (n < 0)
+        return -1;
+    pbatch->next = 0;
+    pbatch->count = n;
+    tty->nDatagrams += n;
+    return n;
+}
+
+/*
+ * Return the next datagram of the batch, receiving a new batch if
+ * it is empty. Datagrams are not split; if maxchars is too small the
+ * rest of the datagram is lost, as with recvfrom().
+ */
+static int recvBatch(ttyController_t *tty, asynUser *pasynUser,
+    char *data, size_t maxchars)
+{
+    udpBatch_t *pbatch = tty->udpBatch;
+    int thisRead;
+
+    if ((pbatch->count == 0) && (fillBatch(tty) < 0))
+        return -1;
+    thisRead = pbatch->len[pbatch->next];
+    if (thisRead > pbatch->slotSize) thisRead = pbatch->slotSize;
+    if (thisRead > (int)maxchars) thisRead = (int)maxchars;
+    memcpy(data, pbatch->buf + (size_t)pbatch->next * pbatch->slotSize, thisRead);
+    if (pasynTrace->getTraceMask(pasynUser) & ASYN_TRACEIO_DRIVER) {
+        char inetBuff[32];
+        ipAddrToDottedIP(&pbatch->from[pbatch->next].ia, inetBuff, sizeof(inetBuff));
+        asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, thisRead,
+                  "%s (from %s) read %d\n",
+                  tty->IPDeviceName, inetBuff, thisRead);
     }
-#endif
+    tty->nRead += (unsigned long)thisRead;
+    pbatch->next++;
+    pbatch->count--;
+    return thisRead;
+}
+
+/*
+ * Receive what is waiting on the socket
+ */
+static int recvData(ttyController_t *tty, asynUser *pasynUser,
+    char *data, size_t maxchars)
+{
+    int thisRead;
+
+    if (tty->udpBatch && (tty->socketType == SOCK_DGRAM))
+        return recvBatch(tty, pasynUser, data, maxchars);
+    tty->nReadCalls++;
     if (tty->socketType == SOCK_DGRAM) {
         /* We use recvfrom() for SOCK_DRAM so we can print the source address with ASYN_TRACEIO_DRIVER */
         osiSockAddr oa;
@@ -748,6 +1132,7 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
                           tty->IPDeviceName, inetBuff, thisRead);
             }
             tty->nRead += (unsigned long)thisRead;
+            tty->nDatagrams++;
         }
     } else {
         thisRead = recv(tty->fd, data, (int)maxchars, 0);
@@ -757,54 +1142,329 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
             tty->nRead += (unsigned long)thisRead;
         }
     }
-    if (thisRead < 0) {
-        int should_disconnect = (((tty->disconnectOnReadTimeout) && (pasynUser->timeout > 0)) ||
-                                 ((SOCKERRNO != SOCK_EWOULDBLOCK) && (SOCKERRNO != SOCK_EINTR)));
-        if (should_disconnect) {
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                          "%s read error: %s",
-                          tty->IPDeviceName, strerror(SOCKERRNO));
-            closeConnection(pasynUser,tty,"Read error");
-            status = asynError;
-        } else {
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                          "%s timeout: %s",
-                          tty->IPDeviceName, strerror(SOCKERRNO));
-            status = asynTimeout;
-        }
-    }
-    /* If recv() returns 0 on a SOCK_STREAM (TCP) socket, the connection has closed */
-    if ((thisRead == 0) && (tty->socketType == SOCK_STREAM)) {
-        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                      "%s connection closed",
-                      tty->IPDeviceName);
-        closeConnection(pasynUser,tty,"Read from broken connection");
-        reason |= ASYN_EOM_END;
-    }
-    if (thisRead < 0)
-        thisRead = 0;
-    *nbytesTransfered = thisRead;
-    /* If there is room add a null byte */
-    if (thisRead < (int) maxchars)
-        data[thisRead] = 0;
-    else
-        reason |= ASYN_EOM_CNT;
-    if (gotEom) *gotEom = reason;
-    return status;
+    return thisRead;
 }
 
 /*
- * Flush pending input
+ * Replace the datagram batch with one of nSlots slots, or none if nSlots is 0
+ * Datagrams that have not been read yet are discarded.
  */
-static asynStatus
-flushIt(void *drvPvt,asynUser *pasynUser)
+static int setUdpBatch(ttyController_t *tty, int nSlots, int slotSize)
 {
-    ttyController_t *tty = (ttyController_t *)drvPvt;
-    int numRecv, numTotal=0;
-    char cbuf[512];
+    udpBatch_t *pbatch = NULL;
+
+    if (nSlots > 0) {
+        pbatch = calloc(1, sizeof *pbatch);
+        if (pbatch) {
+            pbatch->buf = malloc((size_t)nSlots * slotSize);
+            pbatch->len = calloc(nSlots, sizeof *pbatch->len);
+            pbatch->from = calloc(nSlots, sizeof *pbatch->from);
+        }
+        if (!pbatch || !pbatch->buf || !pbatch->len || !pbatch->from) {
+            if (pbatch) {
+                free(pbatch->buf);
+                free(pbatch->len);
+                free(pbatch->from);
+                free(pbatch);
+            }
+            return -1;
+        }
+        pbatch->nSlots = nSlots;
+        pbatch->slotSize = slotSize;
+    }
+    if (tty->udpBatch) {
+        free(tty->udpBatch->buf);
+        free(tty->udpBatch->len);
+        free(tty->udpBatch->from);
+        free(tty->udpBatch);
+    }
+    tty->udpBatch = pbatch;
+    return 0;
+}
+
+#ifdef USE_POLL
+/*
+ * Create the loopback socket that wakes the UDP receive thread
+ */
+static int createUdpWake(ttyController_t *tty)
+{
+    osiSocklen_t addrlen = sizeof tty->udpWakeAddr;
+
+    tty->udpWakeFd = epicsSocketCreate(AF_INET, SOCK_DGRAM, 0);
+    if (tty->udpWakeFd == INVALID_SOCKET)
+        return -1;
+    memset(&tty->udpWakeAddr, 0, sizeof tty->udpWakeAddr);
+    tty->udpWakeAddr.ia.sin_family = AF_INET;
+    tty->udpWakeAddr.ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    tty->udpWakeAddr.ia.sin_port = 0;
+    if ((bind(tty->udpWakeFd, &tty->udpWakeAddr.sa, sizeof tty->udpWakeAddr.ia) < 0) ||
+        (getsockname(tty->udpWakeFd, &tty->udpWakeAddr.sa, &addrlen) < 0) ||
+        (setNonBlock(tty->udpWakeFd, 1) < 0)) {
+        epicsSocketDestroy(tty->udpWakeFd);
+        tty->udpWakeFd = INVALID_SOCKET;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Make the UDP receive thread return from poll() and look at the port again
+ */
+static void wakeUdpThread(ttyController_t *tty)
+{
+    char c = 0;
+
+    sendto(tty->udpWakeFd, &c, 1, 0, &tty->udpWakeAddr.sa, sizeof tty->udpWakeAddr.ia);
+}
+
+/*
+ * With the udpCallbacks option this thread receives the datagrams and
+ * passes each one to the asynOctet interrupt users as soon as it arrives,
+ * instead of them waiting for a read to be queued to the port thread.
+ */
+static void udpReceiveThread(void *drvPvt)
+{
+    ttyController_t *tty = (ttyController_t *)drvPvt;
+    asynUser *pasynUser = tty->pasynUser;
+    int pollmsec = (int)(UDP_THREAD_POLL * 1000);
+
+    for (;;) {
+        struct pollfd pollfd[2];
+        int nfds = 1;
+        SOCKET fd;
+        udpBatch_t *pbatch;
+        ELLLIST *pclientList;
+        interruptNode *pnode;
+        int addr;
+
+        /* Take the socket with the port locked, the port thread may be replacing it */
+        if (pasynManager->lockPort(pasynUser) != asynSuccess) {
+            epicsThreadSleep(UDP_THREAD_POLL);
+            continue;
+        }
+        if (tty->udpThreadExit) {
+            pasynManager->unlockPort(pasynUser);
+            break;
+        }
+        fd = (tty->udpCallbacks && (tty->socketType == SOCK_DGRAM)) ?
+            tty->fd : INVALID_SOCKET;
+        tty->nPollCalls++;
+        pasynManager->unlockPort(pasynUser);
+
+        /* Wait without the port locked, so the port can still write */
+        pollfd[0].fd = tty->udpWakeFd;
+        pollfd[0].events = POLLIN;
+        pollfd[0].revents = 0;
+        if (fd != INVALID_SOCKET) {
+            pollfd[1].fd = fd;
+            pollfd[1].events = POLLIN;
+            pollfd[1].revents = 0;
+            nfds = 2;
+        }
+        if (poll(pollfd, nfds, pollmsec) <= 0)
+            continue;
+        if (pollfd[0].revents & POLLIN) {
+            char c;
+            while (recv(tty->udpWakeFd, &c, 1, 0) > 0)
+                continue;
+        }
+        if ((nfds < 2) || !(pollfd[1].revents & POLLIN))
+            continue;
+        if (pasynManager->lockPort(pasynUser) != asynSuccess)
+            continue;
+        pbatch = tty->udpBatch;
+        /* The socket may have been closed, or even reopened, while we waited */
+        if (!tty->udpThreadExit && tty->udpCallbacks && pbatch && (tty->fd == fd) &&
+            ((pbatch->count > 0) || (fillBatch(tty) > 0))) {
+            /* On a drvAsynIPMultiPort only the users of this address get the data */
+            if (pasynManager->getAddr(pasynUser, &addr) != asynSuccess)
+                addr = -1;
+            pasynManager->interruptStart(tty->octetCallbackPvt, &pclientList);
+            for ( ; pbatch->count > 0 ; pbatch->next++, pbatch->count--) {
+                char *data = pbatch->buf + (size_t)pbatch->next * pbatch->slotSize;
+                size_t len = pbatch->len[pbatch->next];
+
+                if (len > (size_t)pbatch->slotSize) len = pbatch->slotSize;
+                asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, len,
+                            "%s callback %lu\n", tty->IPDeviceName, (unsigned long)len);
+                tty->nRead += (unsigned long)len;
+                for (pnode = (interruptNode *)ellFirst(pclientList) ; pnode ;
+                     pnode = (interruptNode *)ellNext(&pnode->node)) {
+                    asynOctetInterrupt *pinterrupt = pnode->drvPvt;
+                    if (pinterrupt->addr != addr)
+                        continue;
+                    pinterrupt->callback(pinterrupt->userPvt, pinterrupt->pasynUser,
+                                         data, len, ASYN_EOM_END);
+                }
+            }
+            pasynManager->interruptEnd(tty->octetCallbackPvt);
+        }
+        pasynManager->unlockPort(pasynUser);
+    }
+    epicsEventSignal(tty->udpThreadDone);
+}
+
+/*
+ * Start the UDP receive thread
+ */
+static int startUdpThread(ttyController_t *tty)
+{
+    if (createUdpWake(tty) < 0)
+        return -1;
+    tty->udpThreadDone = epicsEventMustCreate(epicsEventEmpty);
+    tty->udpThreadExit = 0;
+    if (!epicsThreadCreate(tty->portName, epicsThreadPriorityHigh,
+                           epicsThreadGetStackSize(epicsThreadStackSmall),
+                           udpReceiveThread, tty)) {
+        epicsEventDestroy(tty->udpThreadDone);
+        epicsSocketDestroy(tty->udpWakeFd);
+        tty->udpWakeFd = INVALID_SOCKET;
+        return -1;
+    }
+    tty->udpThreadStarted = 1;
+    return 0;
+}
+
+/*
+ * Stop the UDP receive thread and wait for it to exit
+ * Must be called without the port locked.
+ */
+static void stopUdpThread(ttyController_t *tty)
+{
+    int locked;
+
+    if (!tty->udpThreadStarted)
+        return;
+    locked = (pasynManager->lockPort(tty->pasynUser) == asynSuccess);
+    tty->udpThreadExit = 1;
+    if (locked)
+        pasynManager->unlockPort(tty->pasynUser);
+    wakeUdpThread(tty);
+    epicsEventMustWait(tty->udpThreadDone);
+    epicsEventDestroy(tty->udpThreadDone);
+    epicsSocketDestroy(tty->udpWakeFd);
+    tty->udpWakeFd = INVALID_SOCKET;
+    tty->udpThreadStarted = 0;
+}
+#endif
+
+/*
+ * Read from the TCP port
+ */
+static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
+    char *data, size_t maxchars,size_t *nbytesTransfered,int *gotEom)
+{
+    ttyController_t *tty = (ttyController_t *)drvPvt;
+    int thisRead;
+    int readPollmsec;
+    int reason = 0;
+    epicsTimeStamp startTime;
+    epicsTimeStamp endTime;
+    asynStatus status = asynSuccess;
+
+    assert(tty);
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+              "%s read.\n", tty->IPDeviceName);
+    checkConnection(tty, pasynUser, 0);
+    if (tty->fd == INVALID_SOCKET) {
+        if (tty->flags & FLAG_CONNECT_PER_TRANSACTION) {
+            if ((status = connectIt(drvPvt, pasynUser)) != asynSuccess)
+                return status;
+        }
+        else {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s disconnected:", tty->IPDeviceName);
+            return asynError;
+        }
+    }
+    if (maxchars <= 0) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                  "%s maxchars %d. Why <=0?",tty->IPDeviceName,(int)maxchars);
+        return asynError;
+    }
+    readPollmsec = (int) (pasynUser->timeout * 1000.0);
+    if (readPollmsec == 0) readPollmsec = 1;
+    if (readPollmsec < 0) readPollmsec = -1;
+#ifdef USE_SOCKTIMEOUT
+    if (setSocketTimeout(tty, SO_RCVTIMEO, readPollmsec, &tty->recvTimeoutMsec) < 0) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                      "Can't set %s socket receive timeout: %s",
+                      tty->IPDeviceName, strerror(SOCKERRNO));
+        status = asynError;
+    }
+#endif
+    if (gotEom) *gotEom = 0;
+    thisRead = recvData(tty, pasynUser, data, maxchars);
+#ifdef USE_POLL
+    /*
+     * The socket is non-blocking, so poll() is only needed
+     * when no input was waiting
+     */
+    if ((thisRead < 0) && (SOCKERRNO == SOCK_EWOULDBLOCK)) {
+        epicsTimeGetCurrent(&startTime);
+        while (pollSocket(tty, POLLIN, readPollmsec) < 0) {
+            if (errno != EINTR) {
+                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                          "Poll() failed: %s", strerror(errno));
+                return asynError;
+            }
+            epicsTimeGetCurrent(&endTime);
+            if (epicsTimeDiffInSeconds(&endTime, &startTime)*1000. > readPollmsec) break; 
+        }
+        thisRead = recvData(tty, pasynUser, data, maxchars);
+    }
+#endif
+    if (thisRead < 0) {
+        int should_disconnect = (((tty->disconnectOnReadTimeout) && (pasynUser->timeout > 0)) ||
+                                 ((SOCKERRNO != SOCK_EWOULDBLOCK) && (SOCKERRNO != SOCK_EINTR)));
+        if (should_disconnect) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s read error: %s",
+                          tty->IPDeviceName, strerror(SOCKERRNO));
+            closeConnection(pasynUser,tty,"Read error");
+            status = asynError;
+        } else {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s timeout: %s",
+                          tty->IPDeviceName, strerror(SOCKERRNO));
+            status = asynTimeout;
+        }
+    }
+    /* If recv() returns 0 on a SOCK_STREAM (TCP) socket, the connection has closed */
+    if ((thisRead == 0) && (tty->socketType == SOCK_STREAM)) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                      "%s connection closed",
+                      tty->IPDeviceName);
+        closeConnection(pasynUser,tty,"Read from broken connection");
+        preConnect(tty, pasynUser);
+        reason |= ASYN_EOM_END;
+    }
+    if (thisRead < 0)
+        thisRead = 0;
+    *nbytesTransfered = thisRead;
+    /* If there is room add a null byte */
+    if (thisRead < (int) maxchars)
+        data[thisRead] = 0;
+    else
+        reason |= ASYN_EOM_CNT;
+    if (gotEom) *gotEom = reason;
+    return status;
+}
+
+/*
+ * Flush pending input
+ */
+static asynStatus
+flushIt(void *drvPvt,asynUser *pasynUser)
+{
+    ttyController_t *tty = (ttyController_t *)drvPvt;
+    int numRecv, numTotal=0;
+    char cbuf[512];
 
     assert(tty);
     asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s flush\n", tty->IPDeviceName);
+    if (tty->udpBatch)
+        tty->udpBatch->count = 0;
     if (tty->fd != INVALID_SOCKET) {
         /*
          * Toss characters until there are none left
@@ -834,8 +1494,13 @@ static void
 ttyCleanup(ttyController_t *tty)
 {
     if (tty) {
+#ifdef USE_POLL
+        stopUdpThread(tty);
+#endif
         if (tty->fd != INVALID_SOCKET)
             epicsSocketDestroy(tty->fd);
+        setUdpBatch(tty, 0, 0);
+        free(tty->dgramBuf);
         free(tty->portName);
         free(tty->IPDeviceName);
         free(tty);
@@ -860,6 +1525,21 @@ getOption(void *drvPvt, asynUser *pasynUser,
     else if (epicsStrCaseCmp(key, "hostInfo") == 0) {
         l = epicsSnprintf(val, valSize, "%s", tty->IPDeviceName);
     }
+    else if (epicsStrCaseCmp(key, "connectTimeout") == 0) {
+        l = epicsSnprintf(val, valSize, "%g", tty->connectTimeout);
+    }
+    else if (epicsStrCaseCmp(key, "preConnect") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", tty->preConnect ? 'Y' : 'N');
+    }
+    else if (epicsStrCaseCmp(key, "udpBatch") == 0) {
+        l = epicsSnprintf(val, valSize, "%d", tty->udpBatchSize);
+    }
+    else if (epicsStrCaseCmp(key, "udpMaxSize") == 0) {
+        l = epicsSnprintf(val, valSize, "%d", tty->udpMaxSize);
+    }
+    else if (epicsStrCaseCmp(key, "udpCallbacks") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", tty->udpCallbacks ? 'Y' : 'N');
+    }
     else {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                                                 "Unsupported key \"%s\"", key);
@@ -899,6 +1579,107 @@ setOption(void *drvPvt, asynUser *pasynUser, const char *key, const char *val)
         int status = parseHostInfo(tty, val);
         if (status) return asynError;
     }
+    else if (epicsStrCaseCmp(key, "connectTimeout") == 0) {
+        double timeout;
+        if ((sscanf(val, "%lf", &timeout) != 1) || (timeout < 0)) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid connectTimeout value.");
+            return asynError;
+        }
+#ifndef USE_POLL
+        if (timeout > 0) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                  "connectTimeout is not supported on this platform.");
+            return asynError;
+        }
+#endif
+        tty->connectTimeout = timeout;
+    }
+    else if (epicsStrCaseCmp(key, "preConnect") == 0) {
+        if (epicsStrCaseCmp(val, "Y") == 0) {
+            tty->preConnect = 1;
+        }
+        else if (epicsStrCaseCmp(val, "N") == 0) {
+            tty->preConnect = 0;
+        }
+        else {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid preConnect value.");
+            return asynError;
+        }
+    }
+    else if ((epicsStrCaseCmp(key, "udpBatch") == 0) ||
+             (epicsStrCaseCmp(key, "udpMaxSize") == 0) ||
+             (epicsStrCaseCmp(key, "udpCallbacks") == 0)) {
+        int batchSize = tty->udpBatchSize;
+        int maxSize = tty->udpMaxSize;
+        int callbacks = tty->udpCallbacks;
+        int nSlots;
+
+        if (epicsStrCaseCmp(key, "udpBatch") == 0) {
+            if ((sscanf(val, "%d", &batchSize) != 1) ||
+                (batchSize < 0) || (batchSize > UDP_BATCH_MAX)) {
+                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                  "Invalid udpBatch value, must be 0 to %d.", UDP_BATCH_MAX);
+                return asynError;
+            }
+        }
+        else if (epicsStrCaseCmp(key, "udpMaxSize") == 0) {
+            if ((sscanf(val, "%d", &maxSize) != 1) ||
+                (maxSize < 1) || (maxSize > UDP_MAX_SIZE)) {
+                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                  "Invalid udpMaxSize value, must be 1 to %d.", UDP_MAX_SIZE);
+                return asynError;
+            }
+        }
+        else if (epicsStrCaseCmp(val, "Y") == 0) {
+#ifdef USE_POLL
+            if (!tty->octetCallbackPvt &&
+                (pasynManager->getInterruptPvt(pasynUser, asynOctetType,
+                                           &tty->octetCallbackPvt) != asynSuccess)) {
+                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                  "%s has no asynOctet interrupt users.", tty->portName);
+                return asynError;
+            }
+            callbacks = 1;
+#else
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                  "udpCallbacks is not supported on this platform.");
+            return asynError;
+#endif
+        }
+        else if (epicsStrCaseCmp(val, "N") == 0) {
+            callbacks = 0;
+        }
+        else {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid udpCallbacks value.");
+            return asynError;
+        }
+        /* The receive thread needs somewhere to put the datagrams */
+        nSlots = ((batchSize == 0) && callbacks) ? 1 : batchSize;
+        if (((tty->udpBatch ? tty->udpBatch->nSlots : 0) != nSlots) ||
+            (maxSize != tty->udpMaxSize)) {
+            if (setUdpBatch(tty, nSlots, maxSize) < 0) {
+                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                  "Can't allocate %d datagrams of %d bytes.", nSlots, maxSize);
+                return asynError;
+            }
+        }
+        tty->udpBatchSize = batchSize;
+        tty->udpMaxSize = maxSize;
+        tty->udpCallbacks = callbacks;
+#ifdef USE_POLL
+        if (callbacks && !tty->udpThreadStarted && (startUdpThread(tty) < 0)) {
+            tty->udpCallbacks = 0;
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                              "Can't start the UDP receive thread.");
+            return asynError;
+        }
+        if (tty->udpThreadStarted)
+            wakeUdpThread(tty);
+#endif
+    }
     else if (epicsStrCaseCmp(key, "") != 0) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                                                 "Unsupported key \"%s\"", key);
@@ -965,7 +1746,9 @@ drvAsynIPPortConfigure(const char *portName,
     pasynOctet = (asynOctet *)(tty+1);
     tty->portName = epicsStrDup(portName);
     tty->fd = INVALID_SOCKET;
+    tty->udpWakeFd = INVALID_SOCKET;
     tty->isCom =  ISCOM_UNKNOWN;
+    tty->udpMaxSize = UDP_MAX_SIZE;
 
     /*
      * Create socket from hostInfo
@@ -1009,6 +1792,9 @@ drvAsynIPPortConfigure(const char *portName,
     }
     pasynOctet->read = readIt;
     pasynOctet->write = writeIt;
+#ifdef HAS_SENDMSG
+    pasynOctet->writev = writevIt;
+#endif
     pasynOctet->flush = flushIt;
     tty->octet.interfaceType = asynOctetType;
     tty->octet.pinterface  = pasynOctet;
@@ -1040,6 +1826,386 @@ drvAsynIPPortConfigure(const char *portName,
     return 0;
 }
 
+/*
+ * A multi-device port has a separate connection for each address.
+ * It is an ASYN_MULTITHREAD port, so a small pool of port threads
+ * serves all the connections instead of one thread per device, and
+ * requests for different addresses run at the same time.
+ */
+typedef struct {
+    char              *portName;
+    int                maxAddr;
+    int                noProcessEos;
+    ttyController_t  **tty;           /* Indexed by address */
+    asynInterface      common;
+    asynInterface      option;
+    asynInterface      octet;
+    void              *octetCallbackPvt;
+} ipMultiPort_t;
+
+/* Connections of a multi-device port give up on connect() after this */
+#ifdef USE_POLL
+#define MULTI_CONNECT_TIMEOUT 2.0
+#else
+#define MULTI_CONNECT_TIMEOUT 0.0
+#endif
+/* asynManager starts this many threads for an ASYN_MULTITHREAD port */
+#define MULTI_DEFAULT_THREADS 4
+/* A multi-device port gets a port thread for each address up to maxThreads,
+ * which defaults to this */
+#define MULTI_MAX_THREADS 16
+
+static ttyController_t *
+multiTty(ipMultiPort_t *pmulti, asynUser *pasynUser)
+{
+    int addr;
+
+    if (pasynManager->getAddr(pasynUser, &addr) != asynSuccess)
+        return NULL;
+    if ((addr < 0) || (addr >= pmulti->maxAddr) || !pmulti->tty[addr]) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                      "%s no device at address %d", pmulti->portName, addr);
+        return NULL;
+    }
+    return pmulti->tty[addr];
+}
+
+static void
+multiReport(void *drvPvt, FILE *fp, int details)
+{
+    ipMultiPort_t *pmulti = (ipMultiPort_t *)drvPvt;
+    int addr, nDevices = 0, nConnected = 0;
+
+    for (addr = 0 ; addr < pmulti->maxAddr ; addr++) {
+        ttyController_t *tty = pmulti->tty[addr];
+        if (!tty) continue;
+        nDevices++;
+        if (tty->fd != INVALID_SOCKET) nConnected++;
+    }
+    fprintf(fp, "    %d devices, %d connected\n", nDevices, nConnected);
+    if (details < 1) return;
+    for (addr = 0 ; addr < pmulti->maxAddr ; addr++) {
+        if (!pmulti->tty[addr]) continue;
+        fprintf(fp, "    addr %d\n", addr);
+        asynCommonReport(pmulti->tty[addr], fp, details);
+    }
+}
+
+static asynStatus
+multiConnect(void *drvPvt, asynUser *pasynUser)
+{
+    ipMultiPort_t *pmulti = (ipMultiPort_t *)drvPvt;
+    ttyController_t *tty;
+    int addr;
+
+    pasynManager->getAddr(pasynUser, &addr);
+    if (addr < 0) {
+        pasynManager->exceptionConnect(pasynUser);
+        return asynSuccess;
+    }
+    if ((tty = multiTty(pmulti, pasynUser)) == NULL)
+        return asynError;
+    return asynCommonConnect(tty, pasynUser);
+}
+
+static asynStatus
+multiDisconnect(void *drvPvt, asynUser *pasynUser)
+{
+    ipMultiPort_t *pmulti = (ipMultiPort_t *)drvPvt;
+    ttyController_t *tty;
+    int addr;
+
+    pasynManager->getAddr(pasynUser, &addr);
+    if (addr < 0) {
+        pasynManager->exceptionDisconnect(pasynUser);
+        return asynSuccess;
+    }
+    if ((tty = multiTty(pmulti, pasynUser)) == NULL)
+        return asynError;
+    return asynCommonDisconnect(tty, pasynUser);
+}
+
+static asynStatus
+multiWritev(void *drvPvt, asynUser *pasynUser,
+    const asynOctetIovec *iov, int iovcnt, size_t *nbytesTransfered)
+{
+    ttyController_t *tty = multiTty((ipMultiPort_t *)drvPvt, pasynUser);
+
+    if (!tty) return asynError;
+    return writevIt(tty, pasynUser, iov, iovcnt, nbytesTransfered);
+}
+
+static asynStatus
+multiWrite(void *drvPvt, asynUser *pasynUser,
+    const char *data, size_t numchars, size_t *nbytesTransfered)
+{
+    ttyController_t *tty = multiTty((ipMultiPort_t *)drvPvt, pasynUser);
+
+    if (!tty) return asynError;
+    return writeIt(tty, pasynUser, data, numchars, nbytesTransfered);
+}
+
+static asynStatus
+multiRead(void *drvPvt, asynUser *pasynUser,
+    char *data, size_t maxchars, size_t *nbytesTransfered, int *gotEom)
+{
+    ttyController_t *tty = multiTty((ipMultiPort_t *)drvPvt, pasynUser);
+
+    if (!tty) return asynError;
+    return readIt(tty, pasynUser, data, maxchars, nbytesTransfered, gotEom);
+}
+
+static asynStatus
+multiFlush(void *drvPvt, asynUser *pasynUser)
+{
+    ttyController_t *tty = multiTty((ipMultiPort_t *)drvPvt, pasynUser);
+
+    if (!tty) return asynError;
+    return flushIt(tty, pasynUser);
+}
+
+/*
+ * asynInterposeEos is interposed for each address, and calls these
+ * directly rather than through asynOctetBase.  The address is kept in
+ * the node so udpReceiveThread only calls the users of its address.
+ */
+static asynStatus
+multiRegisterInterruptUser(void *drvPvt, asynUser *pasynUser,
+        interruptCallbackOctet callback, void *userPvt, void **registrarPvt)
+{
+    ipMultiPort_t *pmulti = (ipMultiPort_t *)drvPvt;
+    interruptNode *pinterruptNode;
+    asynOctetInterrupt *pinterrupt;
+    int addr;
+
+    if (pasynManager->getAddr(pasynUser, &addr) != asynSuccess)
+        return asynError;
+    pinterruptNode = pasynManager->createInterruptNode(pmulti->octetCallbackPvt);
+    pinterrupt = pasynManager->memMalloc(sizeof(asynOctetInterrupt));
+    pinterruptNode->drvPvt = pinterrupt;
+    pinterrupt->pasynUser = pasynManager->duplicateAsynUser(pasynUser, NULL, NULL);
+    pinterrupt->addr = addr;
+    pinterrupt->callback = callback;
+    pinterrupt->userPvt = userPvt;
+    *registrarPvt = pinterruptNode;
+    return pasynManager->addInterruptUser(pasynUser, pinterruptNode);
+}
+
+static asynStatus
+multiCancelInterruptUser(void *drvPvt, asynUser *pasynUser, void *registrarPvt)
+{
+    interruptNode *pinterruptNode = (interruptNode *)registrarPvt;
+    asynOctetInterrupt *pinterrupt = (asynOctetInterrupt *)pinterruptNode->drvPvt;
+    asynStatus status;
+
+    status = pasynManager->removeInterruptUser(pasynUser, pinterruptNode);
+    if (status == asynSuccess)
+        pasynManager->freeInterruptNode(pasynUser, pinterruptNode);
+    pasynManager->freeAsynUser(pinterrupt->pasynUser);
+    pasynManager->memFree(pinterrupt, sizeof(asynOctetInterrupt));
+    return status;
+}
+
+static asynStatus
+multiGetOption(void *drvPvt, asynUser *pasynUser,
+                              const char *key, char *val, int valSize)
+{
+    ttyController_t *tty = multiTty((ipMultiPort_t *)drvPvt, pasynUser);
+
+    if (!tty) return asynError;
+    return getOption(tty, pasynUser, key, val, valSize);
+}
+
+static asynStatus
+multiSetOption(void *drvPvt, asynUser *pasynUser, const char *key, const char *val)
+{
+    ttyController_t *tty = multiTty((ipMultiPort_t *)drvPvt, pasynUser);
+
+    if (!tty) return asynError;
+    return setOption(tty, pasynUser, key, val);
+}
+
+static const struct asynOption multiAsynOption = { multiSetOption, multiGetOption };
+
+static const struct asynCommon multiAsynCommon = {
+    multiReport,
+    multiConnect,
+    multiDisconnect
+};
+
+/*
+ * Configure a drvAsynIPPort with a connection for each address
+ * Connections are added with drvAsynIPMultiPortAdd
+ */
+epicsShareFunc int
+drvAsynIPMultiPortConfigure(const char *portName,
+                            int maxAddr,
+                            unsigned int priority,
+                            int noAutoConnect,
+                            int noProcessEos,
+                            int maxThreads)
+{
+    ipMultiPort_t *pmulti;
+    asynOctet *pasynOctet;
+    asynUser *pasynUser;
+    asynStatus status;
+    int nThreads;
+
+    if (portName == NULL) {
+        printf("Port name missing.\n");
+        return -1;
+    }
+    if (maxAddr <= 0) {
+        printf("drvAsynIPMultiPortConfigure: maxAddr must be > 0.\n");
+        return -1;
+    }
+    if (osiSockAttach() == 0) {
+        printf("drvAsynIPMultiPortConfigure: osiSockAttach failed\n");
+        return -1;
+    }
+    pmulti = callocMustSucceed(1, sizeof(*pmulti) + sizeof(asynOctet),
+                               "drvAsynIPMultiPortConfigure()");
+    pasynOctet = (asynOctet *)(pmulti+1);
+    pmulti->portName = epicsStrDup(portName);
+    pmulti->maxAddr = maxAddr;
+    pmulti->noProcessEos = noProcessEos;
+    pmulti->tty = callocMustSucceed(maxAddr, sizeof(ttyController_t *),
+                                    "drvAsynIPMultiPortConfigure()");
+    pmulti->common.interfaceType = asynCommonType;
+    pmulti->common.pinterface  = (void *)&multiAsynCommon;
+    pmulti->common.drvPvt = pmulti;
+    pmulti->option.interfaceType = asynOptionType;
+    pmulti->option.pinterface  = (void *)&multiAsynOption;
+    pmulti->option.drvPvt = pmulti;
+    if (pasynManager->registerPort(pmulti->portName,
+                        ASYN_MULTIDEVICE|ASYN_CANBLOCK|ASYN_MULTITHREAD,
+                        !noAutoConnect, priority, 0) != asynSuccess) {
+        printf("drvAsynIPMultiPortConfigure: Can't register myself.\n");
+        return -1;
+    }
+    /* Each read or write that is waiting for its device holds a port thread */
+    if (maxThreads <= 0) maxThreads = MULTI_MAX_THREADS;
+    nThreads = (maxAddr < maxThreads) ? maxAddr : maxThreads;
+    if (nThreads < MULTI_DEFAULT_THREADS) nThreads = MULTI_DEFAULT_THREADS;
+    if (nThreads > MULTI_DEFAULT_THREADS) {
+        pasynUser = pasynManager->createAsynUser(0,0);
+        status = pasynManager->connectDevice(pasynUser, pmulti->portName, -1);
+        if (status == asynSuccess)
+            status = pasynManager->setPortThreads(pasynUser, nThreads);
+        if (status != asynSuccess) {
+            printf("drvAsynIPMultiPortConfigure: %s\n", pasynUser->errorMessage);
+            nThreads = MULTI_DEFAULT_THREADS;
+        }
+        pasynManager->freeAsynUser(pasynUser);
+    }
+    if (maxAddr > nThreads)
+        printf("drvAsynIPMultiPortConfigure: %s has %d addresses and %d port threads. "
+               "Only %d devices can wait for I/O at once, maxThreads or asynSetPortThreads "
+               "adds more.\n",
+               pmulti->portName, maxAddr, nThreads, nThreads);
+#ifndef USE_POLL
+    printf("drvAsynIPMultiPortConfigure: connectTimeout is not supported on this platform, "
+           "connecting to a device that is down holds a port thread until connect() fails.\n");
+#endif
+    status = pasynManager->registerInterface(pmulti->portName,&pmulti->common);
+    if(status != asynSuccess) {
+        printf("drvAsynIPMultiPortConfigure: Can't register common.\n");
+        return -1;
+    }
+    status = pasynManager->registerInterface(pmulti->portName,&pmulti->option);
+    if(status != asynSuccess) {
+        printf("drvAsynIPMultiPortConfigure: Can't register option.\n");
+        return -1;
+    }
+    pasynOctet->read = multiRead;
+    pasynOctet->write = multiWrite;
+#ifdef HAS_SENDMSG
+    pasynOctet->writev = multiWritev;
+#endif
+    pasynOctet->flush = multiFlush;
+    pasynOctet->registerInterruptUser = multiRegisterInterruptUser;
+    pasynOctet->cancelInterruptUser = multiCancelInterruptUser;
+    pmulti->octet.interfaceType = asynOctetType;
+    pmulti->octet.pinterface  = pasynOctet;
+    pmulti->octet.drvPvt = pmulti;
+    status = pasynOctetBase->initialize(pmulti->portName,&pmulti->octet, 0, 0, 0);
+    if(status != asynSuccess) {
+        printf("drvAsynIPMultiPortConfigure: pasynOctetBase->initialize failed.\n");
+        return -1;
+    }
+    status = pasynManager->registerInterruptSource(pmulti->portName, &pmulti->octet,
+                                                   &pmulti->octetCallbackPvt);
+    if(status != asynSuccess) {
+        printf("drvAsynIPMultiPortConfigure: registerInterruptSource failed.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Add the connection for one address of a multi-device port
+ */
+epicsShareFunc int
+drvAsynIPMultiPortAdd(const char *portName, int addr, const char *hostInfo)
+{
+    ipMultiPort_t *pmulti;
+    ttyController_t *tty;
+    asynInterface *pasynInterface;
+    asynUser *pasynUser;
+    asynStatus status;
+
+    if ((portName == NULL) || (hostInfo == NULL)) {
+        printf("Usage: drvAsynIPMultiPortAdd port addr host:port [protocol]\n");
+        return -1;
+    }
+    pasynUser = pasynManager->createAsynUser(0,0);
+    status = pasynManager->connectDevice(pasynUser, portName, addr);
+    if (status != asynSuccess) {
+        printf("drvAsynIPMultiPortAdd: %s\n", pasynUser->errorMessage);
+        pasynManager->freeAsynUser(pasynUser);
+        return -1;
+    }
+    pasynInterface = pasynManager->findInterface(pasynUser, asynCommonType, 0);
+    if (!pasynInterface || (pasynInterface->pinterface != (void *)&multiAsynCommon)) {
+        printf("drvAsynIPMultiPortAdd: %s is not a drvAsynIPMultiPort\n", portName);
+        pasynManager->freeAsynUser(pasynUser);
+        return -1;
+    }
+    pmulti = (ipMultiPort_t *)pasynInterface->drvPvt;
+    if ((addr < 0) || (addr >= pmulti->maxAddr) || pmulti->tty[addr]) {
+        printf("drvAsynIPMultiPortAdd: address %d is invalid or in use\n", addr);
+        pasynManager->freeAsynUser(pasynUser);
+        return -1;
+    }
+    tty = (ttyController_t *)callocMustSucceed(1, sizeof(*tty),
+                                               "drvAsynIPMultiPortAdd()");
+    tty->portName = epicsStrDup(portName);
+    tty->fd = INVALID_SOCKET;
+    tty->udpWakeFd = INVALID_SOCKET;
+    tty->isCom = ISCOM_UNKNOWN;
+    tty->udpMaxSize = UDP_MAX_SIZE;
+    tty->connectTimeout = MULTI_CONNECT_TIMEOUT;
+    tty->pasynUser = pasynUser;
+    tty->octetCallbackPvt = pmulti->octetCallbackPvt;
+    if (parseHostInfo(tty, hostInfo)) {
+        pasynManager->freeAsynUser(pasynUser);
+        ttyCleanup(tty);
+        return -1;
+    }
+    if (tty->isCom) {
+        /* asynInterposeCOM works on the whole port */
+        printf("drvAsynIPMultiPortAdd: COM protocol is not supported\n");
+        pasynManager->freeAsynUser(pasynUser);
+        ttyCleanup(tty);
+        return -1;
+    }
+    pmulti->tty[addr] = tty;
+    if (!pmulti->noProcessEos)
+        asynInterposeEosConfig(portName, addr, 1, 1);
+    epicsAtExit(cleanup, tty);
+    return 0;
+}
+
 /*
  * IOC shell command registration
  */
@@ -1064,12 +2230,45 @@ static void drvAsynIPPortConfigureCallFunc(const iocshArgBuf *args)
  * This routine is called before multitasking has started, so there's
  * no race condition in the test/set of firstTime.
  */
+static const iocshArg drvAsynIPMultiPortConfigureArg0 = { "port name",iocshArgString};
+static const iocshArg drvAsynIPMultiPortConfigureArg1 = { "max addresses",iocshArgInt};
+static const iocshArg drvAsynIPMultiPortConfigureArg2 = { "priority",iocshArgInt};
+static const iocshArg drvAsynIPMultiPortConfigureArg3 = { "disable auto-connect",iocshArgInt};
+static const iocshArg drvAsynIPMultiPortConfigureArg4 = { "noProcessEos",iocshArgInt};
+static const iocshArg drvAsynIPMultiPortConfigureArg5 = { "max threads",iocshArgInt};
+static const iocshArg *drvAsynIPMultiPortConfigureArgs[] = {
+    &drvAsynIPMultiPortConfigureArg0, &drvAsynIPMultiPortConfigureArg1,
+    &drvAsynIPMultiPortConfigureArg2, &drvAsynIPMultiPortConfigureArg3,
+    &drvAsynIPMultiPortConfigureArg4, &drvAsynIPMultiPortConfigureArg5};
+static const iocshFuncDef drvAsynIPMultiPortConfigureFuncDef =
+            {"drvAsynIPMultiPortConfigure",6,drvAsynIPMultiPortConfigureArgs};
+static void drvAsynIPMultiPortConfigureCallFunc(const iocshArgBuf *args)
+{
+    drvAsynIPMultiPortConfigure(args[0].sval, args[1].ival, args[2].ival,
+                                args[3].ival, args[4].ival, args[5].ival);
+}
+
+static const iocshArg drvAsynIPMultiPortAddArg0 = { "port name",iocshArgString};
+static const iocshArg drvAsynIPMultiPortAddArg1 = { "addr",iocshArgInt};
+static const iocshArg drvAsynIPMultiPortAddArg2 = { "host:port [protocol]",iocshArgString};
+static const iocshArg *drvAsynIPMultiPortAddArgs[] = {
+    &drvAsynIPMultiPortAddArg0, &drvAsynIPMultiPortAddArg1,
+    &drvAsynIPMultiPortAddArg2};
+static const iocshFuncDef drvAsynIPMultiPortAddFuncDef =
+                      {"drvAsynIPMultiPortAdd",3,drvAsynIPMultiPortAddArgs};
+static void drvAsynIPMultiPortAddCallFunc(const iocshArgBuf *args)
+{
+    drvAsynIPMultiPortAdd(args[0].sval, args[1].ival, args[2].sval);
+}
+
 static void
 drvAsynIPPortRegisterCommands(void)
 {
     static int firstTime = 1;
     if (firstTime) {
         iocshRegister(&drvAsynIPPortConfigureFuncDef,drvAsynIPPortConfigureCallFunc);
+        iocshRegister(&drvAsynIPMultiPortConfigureFuncDef,drvAsynIPMultiPortConfigureCallFunc);
+        iocshRegister(&drvAsynIPMultiPortAddFuncDef,drvAsynIPMultiPortAddCallFunc);
         firstTime = 0;
     }
 }
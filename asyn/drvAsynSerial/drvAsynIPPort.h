@@ -24,6 +24,14 @@ epicsShareFunc int drvAsynIPPortConfigure(const char *portName,
                                           unsigned int priority,
                                           int noAutoConnect,
                                           int userFlags);
+epicsShareFunc int drvAsynIPMultiPortConfigure(const char *portName,
+                                               int maxAddr,
+                                               unsigned int priority,
+                                               int noAutoConnect,
+                                               int noProcessEos,
+                                               int maxThreads);
+epicsShareFunc int drvAsynIPMultiPortAdd(const char *portName, int addr,
+                                         const char *hostInfo);
 
 #ifdef __cplusplus
 }
@@ -14,6 +14,11 @@
  * $Id: drvAsynIPServerPort.c,v 1.8 2013/05/15 13:09:45 zimoch Exp $
  */
 
+/* recvmmsg() needs _GNU_SOURCE */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE
+#endif
+
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>
@@ -26,6 +31,8 @@
 #include <iocsh.h>
 #include <epicsExit.h>
 #include <epicsAssert.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
 #include <epicsStdio.h>
 #include <epicsString.h>
 #include <epicsThread.h>
@@ -42,6 +49,36 @@
 #include "drvAsynIPServerPort.h"
 #include "drvAsynIPPort.h"
 
+#if defined(__linux__)
+# define HAS_RECVMMSG 1
+#endif
+
+/* Multi-device mode needs an event loop over all the client sockets */
+#if defined(__linux__)
+# define USE_EPOLL
+# include <sys/epoll.h>
+#endif
+#if !defined(_WIN32) && !defined(vxWorks) && !defined(__rtems__)
+# define HAS_REACTOR
+# include <sys/poll.h>
+#endif
+
+#define THEORETICAL_UDP_MAX_SIZE 65507
+/* Datagrams kept for readIt */
+#define UDP_SLOTS 8
+/* Datagrams dropped at once when nobody is reading them */
+#define UDP_DROP (UDP_SLOTS / 2)
+/* Input buffered for read() for each client in multi-device mode */
+#define CLIENT_BUFFER_SIZE 8192
+/* Largest recv() done by the reactor thread */
+#define CLIENT_RECV_SIZE 4096
+#define REACTOR_EVENTS 64
+/* How often the reactor checks that the listening socket still exists */
+#define REACTOR_POLL_MSEC 1000
+/* Reactor slots of the listening socket and of the wake-up pipe */
+#define LISTEN_SLOT(tty) ((tty)->maxClients)
+#define WAKE_SLOT(tty) ((tty)->maxClients + 1)
+
 /* This structure holds the information for an IP port created by the listener */
 typedef struct {
     char               *portName;
@@ -49,6 +86,36 @@ typedef struct {
     asynUser          *pasynUser;
 } portList_t;
 
+/*
+ * This structure holds a client of a multi-device listener port.
+ * The reactor thread owns fd.  A write in progress holds busy, so
+ * if the client goes away during the write the writer closes fd.
+ * The reactor stops waiting for input from a client whose buffer is
+ * full, and read() wakes it up again once there is room.  A client whose
+ * address has asynOctet interrupt users is never stopped, its oldest
+ * input is dropped instead.  A new client is not read from until the
+ * asynOctet layers of its address have been flushed.
+ */
+typedef struct {
+    int                fd;
+    int                busy;
+    int                closing;
+    int                armed;          /* Reactor waits for input, only used by the reactor */
+    int                flushQueued;    /* The flush for a new client has not run yet */
+    int                nInterruptUsers;
+    asynUser          *pasynUser;      /* Connected to the client's address */
+    asynUser          *pasynUserFlush; /* Queues the flush for a new client */
+    epicsEventId       readEvent;
+    char              *inBuffer;       /* Ring of CLIENT_BUFFER_SIZE characters */
+    size_t             inHead;
+    size_t             inCount;
+    unsigned long      nRead;
+    unsigned long      nWritten;
+    unsigned long      nFull;          /* Times input stopped because the buffer was full */
+    unsigned long      nDropped;       /* Characters dropped from a full buffer */
+    unsigned long      nConnects;
+} serverClient_t;
+
 /*
  * This structure holds the hardware-specific information for a single IP listener port.
  */
@@ -74,13 +141,39 @@ typedef struct {
     int                flags;
     unsigned long      nRead;
     unsigned long      nWritten;
-    char               *UDPbuffer;
-    int                UDPbufferSize;
-    int                UDPbufferPos;
+    /*
+     * Ring of datagrams received by connectionListener for readIt.
+     * Only the listener writes to the free slots, and only readIt
+     * reads the full ones, so UDPlock just protects the indices.
+     */
+    char               *UDPbuffer;      /* UDP_SLOTS buffers of THEORETICAL_UDP_MAX_SIZE */
+    int                UDPlen[UDP_SLOTS];
+    int                UDPhead;         /* Oldest datagram not yet read */
+    int                UDPcount;        /* Datagrams not yet read */
+    int                UDPpos;          /* Characters of UDPhead already read */
+    epicsMutexId       UDPlock;
+    epicsEventId       UDPevent;
+    unsigned long      nDatagrams;
+    unsigned long      nDropped;
+    /*
+     * Multi-device mode.  clientLock protects the fd, busy, closing
+     * and input buffer fields of the clients, the free list and
+     * listenGeneration.
+     */
+    int                multiDevice;
+    int                listenGeneration; /* Changed when fd is closed or created */
+    int                wakeFd[2];      /* Pipe that wakes the reactor */
+    serverClient_t    *clients;        /* Indexed by address */
+    int               *freeSlots;      /* Stack of addresses with no client */
+    int                nFree;
+    epicsMutexId       clientLock;
+    char              *recvBuffer;
+    void              *int32CallbackPvt;
+#ifdef USE_EPOLL
+    int                epollFd;
+#endif
 } ttyController_t;
 
-#define THEORETICAL_UDP_MAX_SIZE 65507
-
 /* Function prototypes */
 static void serialBaseInit(void);
 static void closeConnection(asynUser *pasynUser, ttyController_t *tty);
@@ -89,6 +182,9 @@ static void report(void *drvPvt, FILE *fp, int details);
 static asynStatus connectIt(void *drvPvt, asynUser *pasynUser);
 static asynStatus disconnect(void *drvPvt, asynUser *pasynUser);
 static void ttyCleanup(void *tty);
+#ifdef HAS_REACTOR
+static void multiReport(ttyController_t *tty, FILE *fp, int details);
+#endif
 int drvAsynIPServerPortConfigure(const char *portName,
         const char *serverInfo,
         unsigned int maxClients,
@@ -146,6 +242,19 @@ timeoutHandler(void *p) {
     tty->timeoutFlag = 1;
 }
 
+/*
+ * Tell the reactor that the listening socket has been closed or replaced.
+ * The new socket can have the same number as the old one.
+ */
+static void newListenGeneration(ttyController_t *tty)
+{
+    if (!tty->clientLock)
+        return;
+    epicsMutexMustLock(tty->clientLock);
+    tty->listenGeneration++;
+    epicsMutexUnlock(tty->clientLock);
+}
+
 /*
  * Close a connection
  */
@@ -154,8 +263,15 @@ static void closeConnection(asynUser *pasynUser, ttyController_t *tty)
     if (tty->fd >= 0) {
         asynPrint(pasynUser, ASYN_TRACE_FLOW,
                 "drvAsynIPServerPort: close %s connection on port %d.\n", tty->portName, tty->portNumber);
+        /* The reactor may be in poll() on the listening socket, which keeps
+         * it listening after close(), so a new one could not be bound */
+#ifdef HAS_REACTOR
+        if (tty->multiDevice)
+            shutdown(tty->fd, SHUT_RDWR);
+#endif
         epicsSocketDestroy(tty->fd);
         tty->fd = INVALID_SOCKET;
+        newListenGeneration(tty);
         pasynManager->exceptionDisconnect(pasynUser);
     }
 }
@@ -167,9 +283,7 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
         char *data, size_t maxchars, size_t *nbytesTransfered, int *gotEom) {
     ttyController_t *tty = (ttyController_t *) drvPvt;
     int thisRead;
-    int readPollmsec;
     int reason = 0;
-    int x;
     asynStatus status = asynSuccess;
 
     assert(tty);
@@ -181,51 +295,45 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
                 "%s maxchars %d. Why <=0?\n", tty->IPDeviceName, (int) maxchars);
         return asynError;
     }
-    readPollmsec = (int) (pasynUser->timeout * 1000.0);
-    if (readPollmsec == 0) readPollmsec = 1;
-    if (readPollmsec < 0) readPollmsec = -1;
     if (gotEom) *gotEom = 0;
     if (tty->fd < 0) return asynDisconnected;
-    if ((tty->UDPbufferPos == 0) && (tty->UDPbufferSize == 0)) {
-
-        epicsThreadSleep(.001);
-        thisRead = 0;
-    } else {
+    epicsMutexMustLock(tty->UDPlock);
+    while (tty->UDPcount == 0) {
+        epicsEventStatus waitStatus;
 
-        for (x = 0; x < (int)maxchars - 1; x++) {
-            data[x] = tty->UDPbuffer[x + tty->UDPbufferPos];
-        }
-        thisRead = (int)maxchars - 1;
-        tty->UDPbufferPos = tty->UDPbufferPos + (int)maxchars;
-        if (tty->UDPbufferSize <= tty->UDPbufferPos) {
-            tty->UDPbufferPos = 0;
-            tty->UDPbufferSize = 0;
-            reason |= ASYN_EOM_END;
-        }else{
-          reason |= ASYN_EOM_CNT;
+        epicsMutexUnlock(tty->UDPlock);
+        if (pasynUser->timeout < 0)
+            waitStatus = epicsEventWait(tty->UDPevent);
+        else
+            waitStatus = epicsEventWaitWithTimeout(tty->UDPevent, pasynUser->timeout);
+        if (waitStatus != epicsEventWaitOK) {
+            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                    "%s timeout", tty->portName);
+            *nbytesTransfered = 0;
+            return asynTimeout;
         }
+        epicsMutexMustLock(tty->UDPlock);
     }
+    /* A datagram longer than maxchars is returned by several reads */
+    thisRead = tty->UDPlen[tty->UDPhead] - tty->UDPpos;
+    if (thisRead > (int)maxchars) thisRead = (int)maxchars;
+    memcpy(data, tty->UDPbuffer + (size_t)tty->UDPhead * THEORETICAL_UDP_MAX_SIZE + tty->UDPpos,
+           thisRead);
+    tty->UDPpos += thisRead;
+    if (tty->UDPpos >= tty->UDPlen[tty->UDPhead]) {
+        tty->UDPhead = (tty->UDPhead + 1) % UDP_SLOTS;
+        tty->UDPcount--;
+        tty->UDPpos = 0;
+        reason |= ASYN_EOM_END;
+    } else {
+        reason |= ASYN_EOM_CNT;
+    }
+    epicsMutexUnlock(tty->UDPlock);
     if (thisRead > 0) {
         asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, thisRead,
                 "%s read %d\n", tty->IPDeviceName, thisRead);
         tty->nRead += thisRead;
     }
-    if (thisRead < 0) {
-        if ((SOCKERRNO != SOCK_EINTR)) {
-            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-                    "%s read error: %s",
-                    tty->IPDeviceName, strerror(SOCKERRNO));
-            closeConnection(pasynUser, tty);
-            status = asynError;
-        } else {
-            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-                    "%s timeout: %s",
-                    tty->IPDeviceName, strerror(SOCKERRNO));
-            status = asynTimeout;
-        }
-    }
-    if (thisRead < 0)
-        thisRead = 0;
     *nbytesTransfered = thisRead;
     /* If there is room add a null byte */
     if (thisRead < (int) maxchars)
@@ -240,8 +348,14 @@ static asynStatus
 flushIt(void *drvPvt, asynUser *pasynUser) {
     ttyController_t *tty = (ttyController_t *) drvPvt;
     assert(tty);
-    tty->UDPbufferPos = 0;
-    tty->UDPbufferSize = 0;
+    if (tty->UDPlock) {
+        /* connectionListener may be receiving into the slot after the last one */
+        epicsMutexMustLock(tty->UDPlock);
+        tty->UDPhead = (tty->UDPhead + tty->UDPcount) % UDP_SLOTS;
+        tty->UDPcount = 0;
+        tty->UDPpos = 0;
+        epicsMutexUnlock(tty->UDPlock);
+    }
     return asynSuccess;
 }
 
@@ -268,6 +382,16 @@ static void report(void *drvPvt, FILE *fp, int details)
     if (details >= 1) {
         fprintf(fp, "            fd: %d\n", tty->fd);
         fprintf(fp, "  Max. clients: %d\n", tty->maxClients);
+        if (tty->socketType == SOCK_DGRAM) {
+            fprintf(fp, "     Datagrams: %lu\n", tty->nDatagrams);
+            fprintf(fp, "       Dropped: %lu\n", tty->nDropped);
+        }
+#ifdef HAS_REACTOR
+        if (tty->multiDevice) {
+            multiReport(tty, fp, details);
+            return;
+        }
+#endif
         for (i=0; i<tty->maxClients; i++) {
             pl = &tty->portList[i];
             pasynManager->isConnected(pl->pasynUser, &connected);
@@ -276,6 +400,69 @@ static void report(void *drvPvt, FILE *fp, int details)
     }
 }
 
+/*
+ * Receive as many UDP datagrams as are waiting and fit in the free
+ * slots following the last one received, waiting for the first.
+ * If readIt is not keeping up the oldest datagrams are dropped, so
+ * that the interrupt users still get every new datagram.  A datagram
+ * that readIt has partly returned is kept.
+ * Returns the number received and the first slot used.
+ */
+static int receiveDatagrams(ttyController_t *tty, int *pfirst)
+{
+    int first, nFree, n;
+#ifdef HAS_RECVMMSG
+    struct mmsghdr msgs[UDP_SLOTS];
+    struct iovec iov[UDP_SLOTS];
+    int i;
+#endif
+
+    epicsMutexMustLock(tty->UDPlock);
+    if (tty->UDPcount == UDP_SLOTS) {
+        int head = (tty->UDPhead + UDP_DROP) % UDP_SLOTS;
+
+        /* Keep a datagram readIt has started on and drop the ones after it */
+        if (tty->UDPpos > 0) {
+            memcpy(tty->UDPbuffer + (size_t)head * THEORETICAL_UDP_MAX_SIZE,
+                   tty->UDPbuffer + (size_t)tty->UDPhead * THEORETICAL_UDP_MAX_SIZE,
+                   tty->UDPlen[tty->UDPhead]);
+            tty->UDPlen[head] = tty->UDPlen[tty->UDPhead];
+        }
+        tty->UDPhead = head;
+        tty->UDPcount -= UDP_DROP;
+        tty->nDropped += UDP_DROP;
+    }
+    first = (tty->UDPhead + tty->UDPcount) % UDP_SLOTS;
+    nFree = UDP_SLOTS - tty->UDPcount;
+    if (first + nFree > UDP_SLOTS)
+        nFree = UDP_SLOTS - first;
+    epicsMutexUnlock(tty->UDPlock);
+    *pfirst = first;
+#ifdef HAS_RECVMMSG
+    memset(msgs, 0, sizeof msgs);
+    for (i = 0 ; i < nFree ; i++) {
+        iov[i].iov_base = tty->UDPbuffer + (size_t)(first + i) * THEORETICAL_UDP_MAX_SIZE;
+        iov[i].iov_len = THEORETICAL_UDP_MAX_SIZE;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    /* MSG_WAITFORONE only waits for the first datagram */
+    n = recvmmsg(tty->fd, msgs, nFree, MSG_WAITFORONE, NULL);
+    for (i = 0 ; i < n ; i++)
+        tty->UDPlen[first + i] = (int)msgs[i].msg_len;
+#else
+    n = recvfrom(tty->fd, tty->UDPbuffer + (size_t)first * THEORETICAL_UDP_MAX_SIZE,
+                 THEORETICAL_UDP_MAX_SIZE, 0, NULL, NULL);
+    if (n >= 0) {
+        tty->UDPlen[first] = n;
+        n = 1;
+    }
+#endif
+    if (n > 0)
+        tty->nDatagrams += n;
+    return n;
+}
+
 /*
  * This is the thread that listens for new connection requests, and issues asynOctet callbacks with the
  * port name when they occur.
@@ -306,21 +493,36 @@ static void connectionListener(void *drvPvt)
             tty->portName, tty->serverInfo);
     while (1) {
         if (tty->socketType == SOCK_DGRAM) {
-            if ((tty->UDPbufferPos == 0) && (tty->UDPbufferSize == 0)) {
-                tty->UDPbufferSize = recvfrom(tty->fd, tty->UDPbuffer, THEORETICAL_UDP_MAX_SIZE , 0, NULL, NULL);
-                pasynManager->interruptStart(tty->octetCallbackPvt, &pclientList);
+            int first, n;
+
+            n = receiveDatagrams(tty, &first);
+            if (n < 0) {
+                if (SOCKERRNO != SOCK_EINTR) {
+                    asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                            "drvAsynIPServerPort: recv error on %s: %s\n",
+                            tty->serverInfo, strerror(SOCKERRNO));
+                    epicsThreadSleep(.1);
+                }
+                continue;
+            }
+            /* Every datagram goes to the interrupt users, whether or not it is read */
+            pasynManager->interruptStart(tty->octetCallbackPvt, &pclientList);
+            for (i = first ; i < first + n ; i++) {
                 pnode = (interruptNode *) ellFirst(pclientList);
                 while (pnode) {
                     pinterrupt = pnode->drvPvt;
                     pinterrupt->callback(pinterrupt->userPvt, pinterrupt->pasynUser,
-                            tty->UDPbuffer, tty->UDPbufferSize, ASYN_EOM_END);
+                            tty->UDPbuffer + (size_t)i * THEORETICAL_UDP_MAX_SIZE,
+                            tty->UDPlen[i], ASYN_EOM_END);
                     pnode = (interruptNode *) ellNext(&pnode->node);
                 }
-                pasynManager->interruptEnd(tty->octetCallbackPvt);
-            }else{
-              epicsThreadSleep(.001);
             }
-
+            pasynManager->interruptEnd(tty->octetCallbackPvt);
+            /* Now readIt can have them */
+            epicsMutexMustLock(tty->UDPlock);
+            tty->UDPcount += n;
+            epicsMutexUnlock(tty->UDPlock);
+            epicsEventSignal(tty->UDPevent);
         } else {
             clientFd = epicsSocketAccept(tty->fd, (struct sockaddr *) &clientAddr, &clientLen);
             asynPrint(pasynUser, ASYN_TRACE_FLOW,
@@ -426,8 +628,11 @@ int createServerSocket(ttyController_t *tty) {
                 return -1;
             }
         } else {
-            tty->UDPbuffer = malloc(THEORETICAL_UDP_MAX_SIZE);
+            if (!tty->UDPbuffer)
+                tty->UDPbuffer = callocMustSucceed(UDP_SLOTS, THEORETICAL_UDP_MAX_SIZE,
+                                                   "drvAsynIPServerPort");
         }
+        newListenGeneration(tty);
     }
     return 0;
 }
@@ -482,15 +687,798 @@ static void ttyCleanup(void *pPvt)
     free(tty);
 }
 
+/*
+ * Multi-device mode
+ *
+ * drvAsynIPServerMultiPortConfigure creates a single ASYN_MULTIDEVICE port
+ * with one address for each client, instead of maxClients drvAsynIPPort
+ * ports with a port thread each.  One reactor thread accepts connections
+ * and receives from all the clients with epoll() (poll() on other
+ * platforms).  New clients take an address from a stack of free ones.
+ * Received data is passed to the asynOctet interrupt users of the client's
+ * address and kept for read().  Writes are done by the port threads.
+ */
+#ifdef HAS_REACTOR
+static serverClient_t *
+multiClient(ttyController_t *tty, asynUser *pasynUser)
+{
+    int addr;
+
+    if (pasynManager->getAddr(pasynUser, &addr) != asynSuccess)
+        return NULL;
+    if ((addr < 0) || (addr >= tty->maxClients)) {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                "%s no client address %d", tty->portName, addr);
+        return NULL;
+    }
+    return &tty->clients[addr];
+}
+
+/*
+ * Start or stop waiting for input from fd.  A stopped fd is taken out of
+ * the epoll set, because epoll reports a hang-up even when no events are
+ * asked for.  Without epoll() the reactor builds the poll() list from the
+ * armed clients each time round, so there is nothing to do.
+ */
+static void
+reactorCtl(ttyController_t *tty, int fd, int slot, int input)
+{
+#ifdef USE_EPOLL
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof ev);
+    ev.events = EPOLLIN;
+    ev.data.u32 = slot;
+    if (epoll_ctl(tty->epollFd, input ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, fd, &ev) < 0)
+        asynPrint(tty->pasynUser, ASYN_TRACE_ERROR,
+                "drvAsynIPServerPort: %s epoll_ctl failed: %s\n",
+                tty->portName, strerror(errno));
+#endif
+}
+
+static void
+reactorAdd(ttyController_t *tty, int fd, int slot)
+{
+    reactorCtl(tty, fd, slot, 1);
+}
+
+/*
+ * Make the reactor look at the clients again.  Called by read() and
+ * flush() when they make room in a full input buffer.
+ */
+static void
+wakeReactor(ttyController_t *tty)
+{
+    char c = 0;
+
+    if (write(tty->wakeFd[1], &c, 1) < 0 && errno != EAGAIN)
+        asynPrint(tty->pasynUser, ASYN_TRACE_ERROR,
+                "drvAsynIPServerPort: %s can't wake reactor: %s\n",
+                tty->portName, strerror(errno));
+}
+
+/*
+ * Wait for input from the clients that were stopped because their buffer
+ * was full and now have room, and from new clients once their address has
+ * been flushed.  Only called by the reactor.
+ */
+static void
+resumeClients(ttyController_t *tty)
+{
+    serverClient_t *pc;
+    int i, resume;
+
+    for (i = 0 ; i < tty->maxClients ; i++) {
+        pc = &tty->clients[i];
+        if (pc->armed || (pc->fd == INVALID_SOCKET))
+            continue;
+        epicsMutexMustLock(tty->clientLock);
+        resume = !pc->closing && !pc->flushQueued &&
+                 ((pc->inCount < CLIENT_BUFFER_SIZE) || (pc->nInterruptUsers > 0));
+        epicsMutexUnlock(tty->clientLock);
+        if (resume) {
+            reactorCtl(tty, pc->fd, i, 1);
+            pc->armed = 1;
+        }
+    }
+}
+
+/*
+ * Append input for read().  If there is not enough room the oldest input
+ * is dropped, which only happens when the address has interrupt users.
+ * Called with clientLock held.
+ */
+static void
+bufferInput(serverClient_t *pc, const char *data, size_t n)
+{
+    size_t tail, chunk, drop;
+
+    assert(n <= CLIENT_BUFFER_SIZE);
+    if (pc->inCount + n > CLIENT_BUFFER_SIZE) {
+        drop = pc->inCount + n - CLIENT_BUFFER_SIZE;
+        pc->inHead = (pc->inHead + drop) % CLIENT_BUFFER_SIZE;
+        pc->inCount -= drop;
+        pc->nDropped += drop;
+    }
+    tail = (pc->inHead + pc->inCount) % CLIENT_BUFFER_SIZE;
+    chunk = CLIENT_BUFFER_SIZE - tail;
+    if (chunk > n) chunk = n;
+    memcpy(pc->inBuffer + tail, data, chunk);
+    memcpy(pc->inBuffer, data + chunk, n - chunk);
+    pc->inCount += n;
+}
+
+/*
+ * Close the socket and make the address available again
+ */
+static void
+releaseClient(ttyController_t *tty, int slot, int fd)
+{
+    serverClient_t *pc = &tty->clients[slot];
+
+    asynPrint(pc->pasynUser, ASYN_TRACE_FLOW,
+            "drvAsynIPServerPort: %s close client %d\n", tty->portName, slot);
+    epicsSocketDestroy(fd);
+    pasynManager->exceptionDisconnect(pc->pasynUser);
+    epicsEventSignal(pc->readEvent);
+    epicsMutexMustLock(tty->clientLock);
+    tty->freeSlots[tty->nFree++] = slot;
+    epicsMutexUnlock(tty->clientLock);
+}
+
+/*
+ * Only called by the reactor thread
+ */
+static void
+closeClient(ttyController_t *tty, int slot)
+{
+    serverClient_t *pc = &tty->clients[slot];
+    int fd = INVALID_SOCKET;
+
+    if (pc->armed)
+        reactorCtl(tty, pc->fd, slot, 0);
+    pc->armed = 0;
+    epicsMutexMustLock(tty->clientLock);
+    pc->closing = 1;
+    if (pc->busy) {
+        /* The writer releases it when it is done */
+        shutdown(pc->fd, SHUT_RDWR);
+    } else {
+        fd = pc->fd;
+        pc->fd = INVALID_SOCKET;
+    }
+    epicsMutexUnlock(tty->clientLock);
+    if (fd != INVALID_SOCKET)
+        releaseClient(tty, slot, fd);
+}
+
+static void
+acceptClient(ttyController_t *tty)
+{
+    struct sockaddr_in clientAddr;
+    osiSocklen_t clientLen = sizeof (clientAddr);
+    serverClient_t *pc;
+    ELLLIST *pclientList;
+    interruptNode *pnode;
+    asynInt32Interrupt *pinterrupt;
+    int fd, slot, flags, queueFlush;
+    int oneVal = 1;
+
+    fd = epicsSocketAccept(tty->fd, (struct sockaddr *) &clientAddr, &clientLen);
+    if (fd < 0) {
+        if ((SOCKERRNO != SOCK_EWOULDBLOCK) && (SOCKERRNO != SOCK_EINTR))
+            asynPrint(tty->pasynUser, ASYN_TRACE_ERROR,
+                    "drvAsynIPServerPort: accept error on %s: %s\n",
+                    tty->serverInfo, strerror(SOCKERRNO));
+        return;
+    }
+    epicsMutexMustLock(tty->clientLock);
+    slot = (tty->nFree > 0) ? tty->freeSlots[--tty->nFree] : -1;
+    epicsMutexUnlock(tty->clientLock);
+    if (slot < 0) {
+        asynPrint(tty->pasynUser, ASYN_TRACE_ERROR,
+                "drvAsynIPServerPort: %s: too many clients\n", tty->portName);
+        epicsSocketDestroy(fd);
+        return;
+    }
+    /* The reactor must never block on a client */
+    if (((flags = fcntl(fd, F_GETFL, 0)) < 0) ||
+        (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)) {
+        asynPrint(tty->pasynUser, ASYN_TRACE_ERROR,
+                "drvAsynIPServerPort: %s can't make socket non-blocking: %s\n",
+                tty->portName, strerror(errno));
+        epicsSocketDestroy(fd);
+        epicsMutexMustLock(tty->clientLock);
+        tty->freeSlots[tty->nFree++] = slot;
+        epicsMutexUnlock(tty->clientLock);
+        return;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const void *)&oneVal, sizeof oneVal);
+    pc = &tty->clients[slot];
+    epicsMutexMustLock(tty->clientLock);
+    pc->fd = fd;
+    pc->closing = 0;
+    pc->inHead = 0;
+    pc->inCount = 0;
+    pc->nConnects++;
+    /* A flush that is still queued for the previous client will do */
+    queueFlush = !pc->flushQueued;
+    pc->flushQueued = 1;
+    epicsMutexUnlock(tty->clientLock);
+    /* resumeClients starts receiving once the address has been flushed */
+    pc->armed = 0;
+    asynPrint(tty->pasynUser, ASYN_TRACE_FLOW,
+            "drvAsynIPServerPort: new connection, socket=%d on %s is client %d\n",
+            fd, tty->serverInfo, slot);
+    pasynManager->exceptionConnect(pc->pasynUser);
+    /* asynInterposeEos may still hold part of a message of the previous client */
+    if (queueFlush && (pasynManager->queueRequest(pc->pasynUserFlush,
+            asynQueuePriorityConnect, 0.0) != asynSuccess)) {
+        asynPrint(pc->pasynUser, ASYN_TRACE_ERROR,
+                "drvAsynIPServerPort: %s can't queue flush for client %d: %s\n",
+                tty->portName, slot, pc->pasynUserFlush->errorMessage);
+        epicsMutexMustLock(tty->clientLock);
+        pc->flushQueued = 0;
+        epicsMutexUnlock(tty->clientLock);
+        reactorCtl(tty, fd, slot, 1);
+        pc->armed = 1;
+    }
+
+    /* Tell the asynInt32 interrupt users the address of the new client */
+    pasynManager->interruptStart(tty->int32CallbackPvt, &pclientList);
+    pnode = (interruptNode *) ellFirst(pclientList);
+    while (pnode) {
+        pinterrupt = pnode->drvPvt;
+        pinterrupt->callback(pinterrupt->userPvt, pinterrupt->pasynUser, slot);
+        pnode = (interruptNode *) ellNext(&pnode->node);
+    }
+    pasynManager->interruptEnd(tty->int32CallbackPvt);
+}
+
+static void
+receiveClient(ttyController_t *tty, int slot)
+{
+    serverClient_t *pc = &tty->clients[slot];
+    ELLLIST *pclientList;
+    interruptReasonNode *pnode;
+    asynOctetInterrupt *pinterrupt;
+    size_t room;
+    int n, full, dropOld;
+
+    if ((pc->fd == INVALID_SOCKET) || pc->closing || !pc->armed)
+        return;
+    /*
+     * Interrupt users must get all the input, so for them the oldest input
+     * kept for read() is dropped.  Otherwise never receive more than read()
+     * has room for, the rest waits in the socket.
+     */
+    epicsMutexMustLock(tty->clientLock);
+    room = CLIENT_BUFFER_SIZE - pc->inCount;
+    dropOld = (pc->nInterruptUsers > 0);
+    epicsMutexUnlock(tty->clientLock);
+    if (dropOld || (room > CLIENT_RECV_SIZE)) room = CLIENT_RECV_SIZE;
+    if (room == 0) {
+        full = 1;
+        goto stopInput;
+    }
+    n = recv(pc->fd, tty->recvBuffer, room, 0);
+    if ((n < 0) && ((SOCKERRNO == SOCK_EWOULDBLOCK) || (SOCKERRNO == SOCK_EINTR)))
+        return;
+    if (n <= 0) {
+        if (n < 0)
+            asynPrint(pc->pasynUser, ASYN_TRACE_ERROR,
+                    "drvAsynIPServerPort: %s client %d read error: %s\n",
+                    tty->portName, slot, strerror(SOCKERRNO));
+        closeClient(tty, slot);
+        return;
+    }
+    asynPrintIO(pc->pasynUser, ASYN_TRACEIO_DRIVER, tty->recvBuffer, n,
+            "%s client %d read %d\n", tty->portName, slot, n);
+    /* Only the users registered for this address */
+    pasynManager->interruptStartReason(tty->octetCallbackPvt, 0, slot, &pclientList);
+    pnode = (interruptReasonNode *) ellFirst(pclientList);
+    while (pnode) {
+        pinterrupt = pnode->pinterruptNode->drvPvt;
+        pinterrupt->callback(pinterrupt->userPvt, pinterrupt->pasynUser,
+                tty->recvBuffer, n, 0);
+        pnode = (interruptReasonNode *) ellNext(&pnode->node);
+    }
+    pasynManager->interruptEnd(tty->octetCallbackPvt);
+    epicsMutexMustLock(tty->clientLock);
+    bufferInput(pc, tty->recvBuffer, n);
+    pc->nRead += n;
+    full = (pc->inCount == CLIENT_BUFFER_SIZE) && (pc->nInterruptUsers == 0);
+    epicsMutexUnlock(tty->clientLock);
+    epicsEventSignal(pc->readEvent);
+stopInput:
+    if (full) {
+        /* The client is slowed down by TCP flow control until read() makes room */
+        reactorCtl(tty, pc->fd, slot, 0);
+        pc->armed = 0;
+        pc->nFull++;
+        asynPrint(pc->pasynUser, ASYN_TRACE_FLOW,
+                "%s client %d input buffer full\n", tty->portName, slot);
+    }
+}
+
+static void
+reactorEvent(ttyController_t *tty, int slot)
+{
+    if (slot == LISTEN_SLOT(tty)) {
+        acceptClient(tty);
+    } else if (slot == WAKE_SLOT(tty)) {
+        char buffer[16];
+        while (read(tty->wakeFd[0], buffer, sizeof buffer) > 0)
+            continue;
+        resumeClients(tty);
+    } else {
+        receiveClient(tty, slot);
+    }
+}
+
+/*
+ * The single thread that accepts and receives for all the clients
+ */
+static void clientReactor(void *drvPvt)
+{
+    ttyController_t *tty = (ttyController_t *) drvPvt;
+    int listenFd = INVALID_SOCKET;
+    int listenGeneration = 0;
+    int i, n, flags, generation, fd;
+#ifdef USE_EPOLL
+    struct epoll_event events[REACTOR_EVENTS];
+#else
+    struct pollfd *pfd;
+    int *pfdSlot;
+
+    pfd = callocMustSucceed(tty->maxClients + 2, sizeof(*pfd), "clientReactor");
+    pfdSlot = callocMustSucceed(tty->maxClients + 2, sizeof(*pfdSlot), "clientReactor");
+#endif
+
+    asynPrint(tty->pasynUser, ASYN_TRACE_FLOW,
+            "drvAsynIPServerPort: %s started listening for connections on %s\n",
+            tty->portName, tty->serverInfo);
+    while (1) {
+        /* connectIt creates a new listening socket after a disconnect,
+         * which can get the same number as the old one */
+        epicsMutexMustLock(tty->clientLock);
+        generation = tty->listenGeneration;
+        fd = tty->fd;
+        epicsMutexUnlock(tty->clientLock);
+        if (generation != listenGeneration) {
+            listenGeneration = generation;
+            listenFd = fd;
+            if (listenFd != INVALID_SOCKET) {
+                if ((flags = fcntl(listenFd, F_GETFL, 0)) >= 0)
+                    fcntl(listenFd, F_SETFL, flags | O_NONBLOCK);
+                reactorAdd(tty, listenFd, LISTEN_SLOT(tty));
+            }
+        }
+#ifdef USE_EPOLL
+        n = epoll_wait(tty->epollFd, events, REACTOR_EVENTS, REACTOR_POLL_MSEC);
+        for (i = 0 ; i < n ; i++)
+            reactorEvent(tty, (int)events[i].data.u32);
+#else
+        /* Only the reactor changes the client sockets, so no lock is needed */
+        n = 0;
+        pfd[n].fd = tty->wakeFd[0];
+        pfd[n].events = POLLIN;
+        pfdSlot[n++] = WAKE_SLOT(tty);
+        if (listenFd != INVALID_SOCKET) {
+            pfd[n].fd = listenFd;
+            pfd[n].events = POLLIN;
+            pfdSlot[n++] = LISTEN_SLOT(tty);
+        }
+        for (i = 0 ; i < tty->maxClients ; i++) {
+            if ((tty->clients[i].fd == INVALID_SOCKET) || tty->clients[i].closing ||
+                !tty->clients[i].armed)
+                continue;
+            pfd[n].fd = tty->clients[i].fd;
+            pfd[n].events = POLLIN;
+            pfdSlot[n++] = i;
+        }
+        if (poll(pfd, n, REACTOR_POLL_MSEC) <= 0)
+            continue;
+        for (i = 0 ; i < n ; i++) {
+            if (pfd[i].revents)
+                reactorEvent(tty, pfdSlot[i]);
+        }
+#endif
+    }
+}
+
+static asynStatus
+multiConnect(void *drvPvt, asynUser *pasynUser)
+{
+    ttyController_t *tty = (ttyController_t *) drvPvt;
+    int addr;
+
+    pasynManager->getAddr(pasynUser, &addr);
+    if (addr < 0)
+        return connectIt(drvPvt, pasynUser);
+    /* Clients are connected by the reactor thread when they arrive */
+    epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+            "%s no client at address %d", tty->portName, addr);
+    return asynError;
+}
+
+static asynStatus
+multiDisconnect(void *drvPvt, asynUser *pasynUser)
+{
+    ttyController_t *tty = (ttyController_t *) drvPvt;
+    serverClient_t *pc;
+    int addr;
+
+    pasynManager->getAddr(pasynUser, &addr);
+    if (addr < 0)
+        return disconnect(drvPvt, pasynUser);
+    if ((pc = multiClient(tty, pasynUser)) == NULL)
+        return asynError;
+    /* The reactor thread sees the end of file and closes the socket */
+    epicsMutexMustLock(tty->clientLock);
+    if ((pc->fd != INVALID_SOCKET) && !pc->closing)
+        shutdown(pc->fd, SHUT_RDWR);
+    epicsMutexUnlock(tty->clientLock);
+    return asynSuccess;
+}
+
+static asynStatus
+multiRead(void *drvPvt, asynUser *pasynUser,
+        char *data, size_t maxchars, size_t *nbytesTransfered, int *gotEom)
+{
+    ttyController_t *tty = (ttyController_t *) drvPvt;
+    serverClient_t *pc;
+    size_t thisRead, chunk;
+    epicsTimeStamp start, now;
+    double wait = pasynUser->timeout;
+    int wasFull;
+
+    *nbytesTransfered = 0;
+    if (gotEom) *gotEom = 0;
+    if ((pc = multiClient(tty, pasynUser)) == NULL)
+        return asynError;
+    if (maxchars <= 0) {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                "%s maxchars %d. Why <=0?\n", tty->portName, (int) maxchars);
+        return asynError;
+    }
+    epicsTimeGetCurrent(&start);
+    epicsMutexMustLock(tty->clientLock);
+    while (pc->inCount == 0) {
+        epicsEventStatus waitStatus;
+
+        if (pc->fd == INVALID_SOCKET) {
+            epicsMutexUnlock(tty->clientLock);
+            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                    "%s client %d closed connection", tty->portName,
+                    (int)(pc - tty->clients));
+            return asynError;
+        }
+        epicsMutexUnlock(tty->clientLock);
+        if (pasynUser->timeout < 0) {
+            waitStatus = epicsEventWait(pc->readEvent);
+        } else {
+            epicsTimeGetCurrent(&now);
+            wait = pasynUser->timeout - epicsTimeDiffInSeconds(&now, &start);
+            waitStatus = (wait > 0) ? epicsEventWaitWithTimeout(pc->readEvent, wait)
+                                    : epicsEventWaitTimeout;
+        }
+        if (waitStatus != epicsEventWaitOK) {
+            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                    "%s client %d timeout", tty->portName, (int)(pc - tty->clients));
+            return asynTimeout;
+        }
+        epicsMutexMustLock(tty->clientLock);
+    }
+    wasFull = (pc->inCount == CLIENT_BUFFER_SIZE);
+    thisRead = pc->inCount;
+    if (thisRead > maxchars) thisRead = maxchars;
+    chunk = CLIENT_BUFFER_SIZE - pc->inHead;
+    if (chunk > thisRead) chunk = thisRead;
+    memcpy(data, pc->inBuffer + pc->inHead, chunk);
+    memcpy(data + chunk, pc->inBuffer, thisRead - chunk);
+    pc->inHead = (pc->inHead + thisRead) % CLIENT_BUFFER_SIZE;
+    pc->inCount -= thisRead;
+    epicsMutexUnlock(tty->clientLock);
+    /* The reactor stopped receiving from this client when the buffer filled */
+    if (wasFull)
+        wakeReactor(tty);
+    *nbytesTransfered = thisRead;
+    /* If there is room add a null byte */
+    if (thisRead < maxchars)
+        data[thisRead] = 0;
+    else if (gotEom)
+        *gotEom = ASYN_EOM_CNT;
+    return asynSuccess;
+}
+
+static asynStatus
+multiWrite(void *drvPvt, asynUser *pasynUser,
+        const char *data, size_t numchars, size_t *nbytesTransfered)
+{
+    ttyController_t *tty = (ttyController_t *) drvPvt;
+    serverClient_t *pc;
+    struct pollfd pfd;
+    epicsTimeStamp start, now;
+    asynStatus status = asynSuccess;
+    int fd = INVALID_SOCKET;
+    int slot, n, pollmsec, release = 0;
+
+    *nbytesTransfered = 0;
+    if ((pc = multiClient(tty, pasynUser)) == NULL)
+        return asynError;
+    slot = (int)(pc - tty->clients);
+    epicsMutexMustLock(tty->clientLock);
+    if (!pc->closing && (pc->fd != INVALID_SOCKET)) {
+        fd = pc->fd;
+        pc->busy++;
+    }
+    epicsMutexUnlock(tty->clientLock);
+    if (fd == INVALID_SOCKET) {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                "%s client %d not connected", tty->portName, slot);
+        return asynDisconnected;
+    }
+    epicsTimeGetCurrent(&start);
+    while (numchars > 0) {
+        /* The socket is non-blocking, so only poll() when it is full */
+        n = send(fd, data, numchars, 0);
+        if (n > 0) {
+            asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, n,
+                    "%s client %d write %d\n", tty->portName, slot, n);
+            data += n;
+            numchars -= n;
+            *nbytesTransfered += n;
+            continue;
+        }
+        if ((n < 0) && (SOCKERRNO == SOCK_EINTR))
+            continue;
+        if ((n == 0) || (SOCKERRNO != SOCK_EWOULDBLOCK)) {
+            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                    "%s client %d write error: %s", tty->portName, slot,
+                    strerror(SOCKERRNO));
+            status = asynError;
+            break;
+        }
+        pollmsec = -1;
+        if (pasynUser->timeout >= 0) {
+            epicsTimeGetCurrent(&now);
+            pollmsec = (int)((pasynUser->timeout -
+                              epicsTimeDiffInSeconds(&now, &start)) * 1000.0);
+            if (pollmsec <= 0) {
+                epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                        "%s client %d write timeout", tty->portName, slot);
+                status = asynTimeout;
+                break;
+            }
+        }
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        poll(&pfd, 1, pollmsec);
+    }
+    epicsMutexMustLock(tty->clientLock);
+    pc->nWritten += (unsigned long)*nbytesTransfered;
+    if ((--pc->busy == 0) && pc->closing) {
+        pc->fd = INVALID_SOCKET;
+        release = 1;
+    }
+    epicsMutexUnlock(tty->clientLock);
+    if (release)
+        releaseClient(tty, slot, fd);
+    return status;
+}
+
+static asynStatus
+multiFlush(void *drvPvt, asynUser *pasynUser)
+{
+    ttyController_t *tty = (ttyController_t *) drvPvt;
+    serverClient_t *pc;
+
+    int wasFull;
+
+    if ((pc = multiClient(tty, pasynUser)) == NULL)
+        return asynError;
+    epicsMutexMustLock(tty->clientLock);
+    wasFull = (pc->inCount == CLIENT_BUFFER_SIZE);
+    pc->inHead = 0;
+    pc->inCount = 0;
+    epicsMutexUnlock(tty->clientLock);
+    if (wasFull)
+        wakeReactor(tty);
+    return asynSuccess;
+}
+
+/*
+ * asynInterposeEos is interposed for each address, and calls these
+ * directly rather than through asynOctetBase
+ */
+static asynStatus
+multiRegisterInterruptUser(void *drvPvt, asynUser *pasynUser,
+        interruptCallbackOctet callback, void *userPvt, void **registrarPvt)
+{
+    ttyController_t *tty = (ttyController_t *) drvPvt;
+    interruptNode *pinterruptNode;
+    asynOctetInterrupt *pinterrupt;
+    asynStatus status;
+    int addr;
+
+    if (pasynManager->getAddr(pasynUser, &addr) != asynSuccess)
+        return asynError;
+    pinterruptNode = pasynManager->createInterruptNode(tty->octetCallbackPvt);
+    pinterrupt = pasynManager->memMalloc(sizeof(asynOctetInterrupt));
+    pinterruptNode->drvPvt = pinterrupt;
+    pinterrupt->pasynUser = pasynManager->duplicateAsynUser(pasynUser, NULL, NULL);
+    pinterrupt->addr = addr;
+    pinterrupt->callback = callback;
+    pinterrupt->userPvt = userPvt;
+    *registrarPvt = pinterruptNode;
+    status = pasynManager->addInterruptUser(pasynUser, pinterruptNode);
+    if ((status == asynSuccess) && (addr >= 0) && (addr < tty->maxClients)) {
+        serverClient_t *pc = &tty->clients[addr];
+        int wasFull;
+
+        /* A client that was stopped because its buffer was full must resume */
+        epicsMutexMustLock(tty->clientLock);
+        pc->nInterruptUsers++;
+        wasFull = (pc->inCount == CLIENT_BUFFER_SIZE);
+        epicsMutexUnlock(tty->clientLock);
+        if (wasFull)
+            wakeReactor(tty);
+    }
+    return status;
+}
+
+static asynStatus
+multiCancelInterruptUser(void *drvPvt, asynUser *pasynUser, void *registrarPvt)
+{
+    ttyController_t *tty = (ttyController_t *) drvPvt;
+    interruptNode *pinterruptNode = (interruptNode *) registrarPvt;
+    asynOctetInterrupt *pinterrupt = (asynOctetInterrupt *) pinterruptNode->drvPvt;
+    int addr = pinterrupt->addr;
+    asynStatus status;
+
+    status = pasynManager->removeInterruptUser(pasynUser, pinterruptNode);
+    if (status == asynSuccess) {
+        pasynManager->freeInterruptNode(pasynUser, pinterruptNode);
+        if ((addr >= 0) && (addr < tty->maxClients)) {
+            epicsMutexMustLock(tty->clientLock);
+            tty->clients[addr].nInterruptUsers--;
+            epicsMutexUnlock(tty->clientLock);
+        }
+    }
+    pasynManager->freeAsynUser(pinterrupt->pasynUser);
+    pasynManager->memFree(pinterrupt, sizeof(asynOctetInterrupt));
+    return status;
+}
+
+static void
+multiReport(ttyController_t *tty, FILE *fp, int details)
+{
+    serverClient_t *pc;
+    int i;
+
+    fprintf(fp, "       Clients: %d connected\n", tty->maxClients - tty->nFree);
+    for (i = 0 ; i < tty->maxClients ; i++) {
+        pc = &tty->clients[i];
+        if ((pc->fd == INVALID_SOCKET) && ((details < 2) || (pc->nConnects == 0)))
+            continue;
+        fprintf(fp, "    Client %d fd: %d", i, pc->fd);
+        if (details >= 2)
+            fprintf(fp, " connects: %lu read: %lu written: %lu buffer full: %lu"
+                    " dropped: %lu",
+                    pc->nConnects, pc->nRead, pc->nWritten, pc->nFull,
+                    pc->nDropped);
+        fprintf(fp, "\n");
+    }
+}
+
+static asynCommon drvAsynIPServerMultiPortCommon = {
+    report,
+    multiConnect,
+    multiDisconnect
+};
+
+static asynOctet drvAsynIPServerMultiPortOctet = {
+   multiWrite,
+   multiRead,
+   multiFlush,
+   multiRegisterInterruptUser,
+   multiCancelInterruptUser
+};
+
+/*
+ * Flush the asynOctet layers of the address of a new client.  Runs on a
+ * port thread with the address locked, so asynInterposeEos is not in the
+ * middle of a read.  The reactor starts receiving from the client after.
+ */
+static void
+flushClient(asynUser *pasynUser)
+{
+    ttyController_t *tty = (ttyController_t *) pasynUser->userPvt;
+    serverClient_t *pc;
+    asynInterface *pasynInterface;
+    asynOctet *pasynOctet;
+
+    if ((pc = multiClient(tty, pasynUser)) == NULL)
+        return;
+    pasynInterface = pasynManager->findInterface(pasynUser, asynOctetType, 1);
+    if (pasynInterface) {
+        pasynOctet = (asynOctet *) pasynInterface->pinterface;
+        pasynOctet->flush(pasynInterface->drvPvt, pasynUser);
+    }
+    epicsMutexMustLock(tty->clientLock);
+    pc->flushQueued = 0;
+    epicsMutexUnlock(tty->clientLock);
+    wakeReactor(tty);
+}
+
+/*
+ * Create the clients and start the reactor thread
+ */
+static int
+multiPortStart(ttyController_t *tty)
+{
+    serverClient_t *pc;
+    int i;
+
+    if ((pipe(tty->wakeFd) < 0) ||
+        (fcntl(tty->wakeFd[0], F_SETFL, O_NONBLOCK) < 0) ||
+        (fcntl(tty->wakeFd[1], F_SETFL, O_NONBLOCK) < 0)) {
+        printf("drvAsynIPServerMultiPortConfigure: can't create pipe: %s\n",
+                strerror(errno));
+        return -1;
+    }
+#ifdef USE_EPOLL
+    if ((tty->epollFd = epoll_create(tty->maxClients + 2)) < 0) {
+        printf("drvAsynIPServerMultiPortConfigure: epoll_create failed: %s\n",
+                strerror(errno));
+        return -1;
+    }
+    reactorAdd(tty, tty->wakeFd[0], WAKE_SLOT(tty));
+#endif
+    for (i = 0 ; i < tty->maxClients ; i++) {
+        pc = &tty->clients[i];
+        pc->fd = INVALID_SOCKET;
+        pc->readEvent = epicsEventMustCreate(epicsEventEmpty);
+        pc->inBuffer = callocMustSucceed(1, CLIENT_BUFFER_SIZE,
+                                         "drvAsynIPServerMultiPortConfigure");
+        pc->pasynUser = pasynManager->createAsynUser(0, 0);
+        if (pasynManager->connectDevice(pc->pasynUser, tty->portName, i) != asynSuccess) {
+            printf("drvAsynIPServerMultiPortConfigure: connectDevice failed %s\n",
+                    pc->pasynUser->errorMessage);
+            return -1;
+        }
+        pc->pasynUserFlush = pasynManager->createAsynUser(flushClient, 0);
+        pc->pasynUserFlush->userPvt = tty;
+        if (pasynManager->connectDevice(pc->pasynUserFlush, tty->portName, i) != asynSuccess) {
+            printf("drvAsynIPServerMultiPortConfigure: connectDevice failed %s\n",
+                    pc->pasynUserFlush->errorMessage);
+            return -1;
+        }
+        /* Address 0 is handed out first */
+        tty->freeSlots[i] = tty->maxClients - 1 - i;
+        if (!tty->noProcessEos)
+            asynInterposeEosConfig(tty->portName, i, 1, 1);
+    }
+    tty->nFree = tty->maxClients;
+    epicsThreadCreate(tty->portName,
+            epicsThreadPriorityHigh,
+            epicsThreadGetStackSize(epicsThreadStackSmall),
+            (EPICSTHREADFUNC) clientReactor, tty);
+    return 0;
+}
+#endif /* HAS_REACTOR */
+
 /*
  * Configure and register an IP port listener
  */
-int drvAsynIPServerPortConfigure(const char *portName,
+static int serverPortConfigure(const char *portName,
         const char *serverInfo,
         unsigned int maxClients,
         unsigned int priority,
         int noAutoConnect,
-        int noProcessEos) {
+        int noProcessEos,
+        int multiDevice) {
     ttyController_t *tty;
     asynStatus status;
     int i;
@@ -511,6 +1499,12 @@ int drvAsynIPServerPortConfigure(const char *portName,
         printf("No clients.\n");
         return -1;
     }
+#ifndef HAS_REACTOR
+    if (multiDevice) {
+        printf("drvAsynIPServerMultiPortConfigure is not supported on this platform.\n");
+        return -1;
+    }
+#endif
 
     /*
      * Perform some one-time-only initializations
@@ -535,10 +1529,18 @@ int drvAsynIPServerPortConfigure(const char *portName,
     tty->priority = priority;
     tty->noAutoConnect = noAutoConnect;
     tty->noProcessEos = noProcessEos;
-    tty->portList = callocMustSucceed(tty->maxClients, sizeof (portList_t), "drvAsynIPServerPortConfig");
+    tty->multiDevice = multiDevice;
+    if (multiDevice) {
+        tty->clients = callocMustSucceed(tty->maxClients, sizeof (serverClient_t), "drvAsynIPServerPortConfig");
+        tty->freeSlots = callocMustSucceed(tty->maxClients, sizeof (int), "drvAsynIPServerPortConfig");
+        tty->recvBuffer = callocMustSucceed(1, CLIENT_RECV_SIZE, "drvAsynIPServerPortConfig");
+        tty->clientLock = epicsMutexMustCreate();
+    } else {
+        tty->portList = callocMustSucceed(tty->maxClients, sizeof (portList_t), "drvAsynIPServerPortConfig");
+    }
     tty->UDPbuffer = NULL;
-    tty->UDPbufferSize = 0;
-    tty->UDPbufferPos = 0;
+    tty->UDPlock = epicsMutexMustCreate();
+    tty->UDPevent = epicsEventMustCreate(epicsEventEmpty);
     /*
      * Parse configuration parameters
      */
@@ -562,6 +1564,11 @@ int drvAsynIPServerPortConfigure(const char *portName,
         ttyCleanup(tty);
         return -1;
     }
+    if (multiDevice && (tty->socketType != SOCK_STREAM)) {
+        printf("drvAsynIPServerMultiPortConfigure: only TCP is supported.\n");
+        ttyCleanup(tty);
+        return -1;
+    }
     /*
      *  Create the Server Socket
      */
@@ -586,8 +1593,12 @@ int drvAsynIPServerPortConfigure(const char *portName,
     tty->common.interfaceType = asynCommonType;
     tty->common.pinterface = &drvAsynIPServerPortCommon;
     tty->common.drvPvt = tty;
+#ifdef HAS_REACTOR
+    if (multiDevice)
+        tty->common.pinterface = &drvAsynIPServerMultiPortCommon;
+#endif
     if (pasynManager->registerPort(tty->portName,
-            ASYN_CANBLOCK,
+            multiDevice ? ASYN_MULTIDEVICE|ASYN_CANBLOCK|ASYN_MULTITHREAD : ASYN_CANBLOCK,
             !noAutoConnect,
             priority,
             0) != asynSuccess) {
@@ -611,6 +1622,15 @@ int drvAsynIPServerPortConfigure(const char *portName,
             ttyCleanup(tty);
             return -1;
         }
+        if (multiDevice) {
+            status = pasynManager->registerInterruptSource(tty->portName, &tty->int32,
+                    &tty->int32CallbackPvt);
+            if (status != asynSuccess) {
+                printf("drvAsynIPServerPortConfigure registerInterruptSource failed\n");
+                ttyCleanup(tty);
+                return -1;
+            }
+        }
     }
     tty->octet.interfaceType = asynOctetType;
     if (tty->socketType == SOCK_DGRAM) {
@@ -619,6 +1639,10 @@ int drvAsynIPServerPortConfigure(const char *portName,
         drvAsynIPServerPortOctet.flush = &flushIt;
     }
     tty->octet.pinterface = &drvAsynIPServerPortOctet;
+#ifdef HAS_REACTOR
+    if (multiDevice)
+        tty->octet.pinterface = &drvAsynIPServerMultiPortOctet;
+#endif
     tty->octet.drvPvt = tty;
     status = pasynOctetBase->initialize(tty->portName, &tty->octet, 0, 0, 0);
     if (status != asynSuccess) {
@@ -642,6 +1666,17 @@ int drvAsynIPServerPortConfigure(const char *portName,
         return -1;
     }
 
+#ifdef HAS_REACTOR
+    if (multiDevice) {
+        if (multiPortStart(tty)) {
+            ttyCleanup(tty);
+            return -1;
+        }
+        epicsAtExit(ttyCleanup, tty);
+        return 0;
+    }
+#endif
+
     /* Create drvAsynIPPort drivers for maxClients ports */
     for (i=0; i<tty->maxClients; i++) {
         /* Create a new asyn port with a unique name */
@@ -685,6 +1720,29 @@ int drvAsynIPServerPortConfigure(const char *portName,
     return 0;
 }
 
+int drvAsynIPServerPortConfigure(const char *portName,
+        const char *serverInfo,
+        unsigned int maxClients,
+        unsigned int priority,
+        int noAutoConnect,
+        int noProcessEos) {
+    return serverPortConfigure(portName, serverInfo, maxClients, priority,
+                               noAutoConnect, noProcessEos, 0);
+}
+
+/*
+ * Configure a listener port with an address for each client
+ */
+int drvAsynIPServerMultiPortConfigure(const char *portName,
+        const char *serverInfo,
+        unsigned int maxClients,
+        unsigned int priority,
+        int noAutoConnect,
+        int noProcessEos) {
+    return serverPortConfigure(portName, serverInfo, maxClients, priority,
+                               noAutoConnect, noProcessEos, 1);
+}
+
 /*
  * IOC shell command registration
  */
@@ -707,6 +1765,13 @@ static void drvAsynIPServerPortConfigureCallFunc(const iocshArgBuf *args) {
             args[3].ival, args[4].ival, args[5].ival);
 }
 
+static const iocshFuncDef drvAsynIPServerMultiPortConfigureFuncDef = {"drvAsynIPServerMultiPortConfigure", 6, drvAsynIPServerPortConfigureArgs};
+
+static void drvAsynIPServerMultiPortConfigureCallFunc(const iocshArgBuf *args) {
+    drvAsynIPServerMultiPortConfigure(args[0].sval, args[1].sval, args[2].ival,
+            args[3].ival, args[4].ival, args[5].ival);
+}
+
 /*
  * This routine is called before multitasking has started, so there's
  * no race condition in the test/set of firstTime.
@@ -717,6 +1782,7 @@ drvAsynIPServerPortRegisterCommands(void)
     static int firstTime = 1;
     if (firstTime) {
         iocshRegister(&drvAsynIPServerPortConfigureFuncDef, drvAsynIPServerPortConfigureCallFunc);
+        iocshRegister(&drvAsynIPServerMultiPortConfigureFuncDef, drvAsynIPServerMultiPortConfigureCallFunc);
         firstTime = 0;
     }
 }
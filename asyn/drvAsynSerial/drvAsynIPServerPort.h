@@ -20,6 +20,9 @@ extern "C" {
 int drvAsynIPServerPortConfigure(const char *portName, const char *serverInfo,
                                  unsigned int maxClients, unsigned int priority, 
                                  int noAutoConnect, int noProcessEos);
+int drvAsynIPServerMultiPortConfigure(const char *portName, const char *serverInfo,
+                                      unsigned int maxClients, unsigned int priority,
+                                      int noAutoConnect, int noProcessEos);
 
 #ifdef __cplusplus
 }
@@ -48,9 +48,31 @@
 # define CSTOPB STOPB
 #else
 # include <termios.h>
+# include <sys/uio.h>
 #endif
 
 #include "serial_rs485.h"
+#include "serial_termios2.h"
+
+/*
+ * USB serial adapters (e.g. FTDI) wait up to 16 ms before returning
+ * received characters unless low latency mode is set.
+ */
+#if defined(TIOCSSERIAL) && defined(ASYNC_LOW_LATENCY)
+# define ASYN_LOW_LATENCY_SUPPORTED
+#endif
+
+/*
+ * On Linux the line is left non-blocking and poll() provides the read
+ * and write timeouts with millisecond resolution.  VTIME only has 0.1
+ * second resolution, is limited to 25.5 seconds, and needs a tcsetattr()
+ * whenever the timeout changes.  poll() does not work on terminals on
+ * some other systems (e.g. Darwin), so they still use VTIME.
+ */
+#if defined(__linux__)
+# define USE_POLL
+# include <poll.h>
+#endif
 
 #ifdef vxWorks
 /*
@@ -77,6 +99,8 @@ typedef struct {
     struct serial_rs485  rs485;
 #endif
     int                baud;
+    int                baudOther;
+    int                lowLatency;
     double             readTimeout;
     double             writeTimeout;
     epicsTimerId       timer;
@@ -124,10 +148,48 @@ applyOptions(asynUser *pasynUser, ttyController_t *tty)
                                    "tcsetattr failed: %s", strerror(errno));
         return asynError;
     }
+#ifdef ASYN_TERMIOS2_SUPPORTED
+    /*
+     * tcsetattr can only set rates that have a Bxxx code,
+     * so replace the rate that it set
+     */
+    if (tty->baudOther && (asynSerialSetBaudOther(tty->fd, tty->baud) < 0)) {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                        "ioctl TCSETS2 %d baud failed: %s", tty->baud, strerror(errno));
+        return asynError;
+    }
 #endif
+#endif
+
+    return asynSuccess;
+}
+
+#ifdef ASYN_LOW_LATENCY_SUPPORTED
+/*
+ * Set or clear the kernel low latency flag
+ */
+static asynStatus
+applyLowLatency(asynUser *pasynUser, ttyController_t *tty)
+{
+    struct serial_struct serial;
 
+    if (ioctl(tty->fd, TIOCGSERIAL, &serial) < 0) {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                               "ioctl TIOCGSERIAL failed: %s", strerror(errno));
+        return asynError;
+    }
+    if (tty->lowLatency)
+        serial.flags |= ASYNC_LOW_LATENCY;
+    else
+        serial.flags &= ~ASYNC_LOW_LATENCY;
+    if (ioctl(tty->fd, TIOCSSERIAL, &serial) < 0) {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                               "ioctl TIOCSSERIAL failed: %s", strerror(errno));
+        return asynError;
+    }
     return asynSuccess;
 }
+#endif
 
 /*
  * asynOption methods
@@ -216,6 +278,11 @@ getOption(void *drvPvt, asynUser *pasynUser,
     else if (epicsStrCaseCmp(key, "rs485_delay_rts_after_send") == 0) {
         l = epicsSnprintf(val, valSize, "%u", tty->rs485.delay_rts_after_send);
     }
+#endif
+#ifdef ASYN_LOW_LATENCY_SUPPORTED
+    else if (epicsStrCaseCmp(key, "low_latency") == 0) {
+        l = epicsSnprintf(val, valSize, "%c",  tty->lowLatency ? 'Y' : 'N');
+    }
 #endif
     else {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
@@ -236,10 +303,15 @@ setOption(void *drvPvt, asynUser *pasynUser, const char *key, const char *val)
     ttyController_t *tty = (ttyController_t *)drvPvt;
     struct termios termiosPrev;
     int baudPrev;
+    int baudOtherPrev;
 #ifdef ASYN_RS485_SUPPORTED
     struct serial_rs485 rs485Prev;
     int rs485_changed = 0;
 #endif
+#ifdef ASYN_LOW_LATENCY_SUPPORTED
+    int lowLatencyPrev;
+    int lowLatency_changed = 0;
+#endif
 
     assert(tty);
     asynPrint(pasynUser, ASYN_TRACE_FLOW,
@@ -248,9 +320,13 @@ setOption(void *drvPvt, asynUser *pasynUser, const char *key, const char *val)
     /* Make a copy of tty->termios and tty->baud so we can restore them in case of errors */                
     termiosPrev = tty->termios;
     baudPrev = tty->baud;
+    baudOtherPrev = tty->baudOther;
 #ifdef ASYN_RS485_SUPPORTED
     rs485Prev = tty->rs485;
 #endif
+#ifdef ASYN_LOW_LATENCY_SUPPORTED
+    lowLatencyPrev = tty->lowLatency;
+#endif
 
     if (epicsStrCaseCmp(key, "baud") == 0) {
         int baud;
@@ -262,6 +338,7 @@ setOption(void *drvPvt, asynUser *pasynUser, const char *key, const char *val)
 #ifndef vxWorks         
         {
         speed_t baudCode;
+        int baudOther = 0;
 /* On this system is the baud code the actual baud rate?  
  * If so use it directly, else compare against known baud codes */
 #if (defined(B300) && (B300 == 300) && defined(B9600) && (B9600 == 9600))
@@ -332,21 +409,32 @@ setOption(void *drvPvt, asynUser *pasynUser, const char *key, const char *val)
             case 4000000: baudCode = B4000000 ; break;
 #endif
             default:
+#ifdef ASYN_TERMIOS2_SUPPORTED
+                /* applyOptions sets the rate with termios2 */
+                if (baud > 0) {
+                    baudCode = B0;
+                    baudOther = 1;
+                    break;
+                }
+#endif
                 epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
                                       "Unsupported data rate (%d baud)", baud);
                 return asynError;
         }
 #endif /* Baudcode is baud */
-        if(cfsetispeed(&tty->termios,baudCode) < 0 ) {
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                "cfsetispeed returned %s",strerror(errno));
-            return asynError;
-        }
-        if(cfsetospeed(&tty->termios,baudCode) < 0 ) {
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                "cfsetospeed returned %s",strerror(errno));
-            return asynError;
+        if (!baudOther) {
+            if(cfsetispeed(&tty->termios,baudCode) < 0 ) {
+                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                    "cfsetispeed returned %s",strerror(errno));
+                return asynError;
+            }
+            if(cfsetospeed(&tty->termios,baudCode) < 0 ) {
+                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                    "cfsetospeed returned %s",strerror(errno));
+                return asynError;
+            }
         }
+        tty->baudOther = baudOther;
         }
 #endif /* vxWorks */
         tty->baud = baud;
@@ -535,7 +623,7 @@ setOption(void *drvPvt, asynUser *pasynUser, const char *key, const char *val)
         }
         else {
             epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                                                    "Invalid rs485_rts_on_send value.");
+                                                    "Invalid rs485_rts_after_send value.");
             return asynError;
         }
         rs485_changed = 1;
@@ -560,6 +648,22 @@ setOption(void *drvPvt, asynUser *pasynUser, const char *key, const char *val)
         tty->rs485.delay_rts_after_send = delay;
         rs485_changed = 1;
     }
+#endif
+#ifdef ASYN_LOW_LATENCY_SUPPORTED
+    else if (epicsStrCaseCmp(key, "low_latency") == 0) {
+        if (epicsStrCaseCmp(val, "Y") == 0) {
+            tty->lowLatency = 1;
+        }
+        else if (epicsStrCaseCmp(val, "N") == 0) {
+            tty->lowLatency = 0;
+        }
+        else {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid low_latency value.");
+            return asynError;
+        }
+        lowLatency_changed = 1;
+    }
 #endif
     else if (epicsStrCaseCmp(key, "") != 0) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
@@ -570,6 +674,7 @@ setOption(void *drvPvt, asynUser *pasynUser, const char *key, const char *val)
         if (applyOptions(pasynUser, tty) != asynSuccess) {
             /* Restore previous values of tty->baud and tty->termios */
             tty->baud = baudPrev;
+            tty->baudOther = baudOtherPrev;
             tty->termios = termiosPrev;
             return asynError;
         }
@@ -582,6 +687,12 @@ setOption(void *drvPvt, asynUser *pasynUser, const char *key, const char *val)
                 return asynError;
             }
         }
+#endif
+#ifdef ASYN_LOW_LATENCY_SUPPORTED
+        if (lowLatency_changed && (applyLowLatency(pasynUser, tty) != asynSuccess)) {
+            tty->lowLatency = lowLatencyPrev;
+            return asynError;
+        }
 #endif
     }
 
@@ -630,6 +741,47 @@ timeoutHandler(void *p)
 }
 
 
+#ifdef USE_POLL
+/*
+ * Wait until the line is ready or timeout seconds after start.
+ * A negative timeout waits for ever.
+ * Returns 1 if ready, 0 on timeout, -1 on error.
+ */
+static int
+waitLine(ttyController_t *tty, short events, double timeout,
+         const epicsTimeStamp *start)
+{
+    struct pollfd pfd;
+    epicsTimeStamp now;
+    double left;
+    int pollmsec, n;
+
+    pfd.fd = tty->fd;
+    pfd.events = events;
+    for (;;) {
+        pollmsec = -1;
+        if (timeout >= 0) {
+            epicsTimeGetCurrent(&now);
+            left = timeout - epicsTimeDiffInSeconds(&now, start);
+            if (left <= 0)
+                return 0;
+            /* Round up so that we never give up early */
+            pollmsec = (left < 1e6) ? (int)(left * 1000.0 + 0.999) : 1000000000;
+        }
+        n = poll(&pfd, 1, pollmsec);
+        if (n > 0) {
+            if (pfd.revents & events)
+                return 1;
+            /* Hangup or error with nothing to transfer */
+            errno = EIO;
+            return -1;
+        }
+        if ((n < 0) && (errno != EINTR))
+            return -1;
+    }
+}
+#endif
+
 /*
  * Report link parameters
  */
@@ -691,11 +843,31 @@ connectIt(void *drvPvt, asynUser *pasynUser)
     }
 #endif
     applyOptions(pasynUser, tty);
+#ifdef ASYN_RS485_SUPPORTED
+    /* Settings made while disconnected, or lost when a USB adapter was replugged */
+    if ((tty->rs485.flags & SER_RS485_ENABLED)
+     && (ioctl(tty->fd, TIOCSRS485, &tty->rs485) < 0)) {
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s ioctl TIOCSRS485 failed: %s\n",
+                  tty->serialDeviceName, strerror(errno));
+    }
+#endif
+#ifdef ASYN_LOW_LATENCY_SUPPORTED
+    if (tty->lowLatency && (applyLowLatency(pasynUser, tty) != asynSuccess)) {
+        asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s %s\n",
+                  tty->serialDeviceName, pasynUser->errorMessage);
+    }
+#endif
    
+#ifdef USE_POLL
+    /*
+     * Stay in non-blocking mode, readIt and writevIt wait with poll()
+     */
+    tcflush(tty->fd, TCIOFLUSH);
+#elif !defined(vxWorks)
     /*
      * Turn off non-blocking mode
      */
-#ifndef vxWorks
     tcflush(tty->fd, TCIOFLUSH);
     tty->readTimeout = -1e-99;
     tty->writeTimeout = -1e-99;
@@ -730,22 +902,56 @@ disconnect(void *drvPvt, asynUser *pasynUser)
 
 
 /*
- * Write to the serial line
+ * Write as much of the buffers as the line will take,
+ * starting offset bytes into the first one.
  */
-static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
-    const char *data, size_t numchars,size_t *nbytesTransfered)
+static int writeIovec(ttyController_t *tty, const asynOctetIovec *iov,
+    int iovcnt, size_t offset)
+{
+#ifndef vxWorks
+    if (iovcnt > 1) {
+        struct iovec vec[ASYN_OCTET_IOV_MAX];
+        int n;
+
+        for (n = 0 ; (n < iovcnt) && (n < ASYN_OCTET_IOV_MAX) ; n++) {
+            vec[n].iov_base = (char *)iov[n].data + offset;
+            vec[n].iov_len = iov[n].numchars - offset;
+            offset = 0;
+        }
+        return writev(tty->fd, vec, n);
+    }
+#endif
+    return write(tty->fd, (char *)iov->data + offset, iov->numchars - offset);
+}
+
+/*
+ * Write buffers to the serial line
+ */
+static asynStatus writevIt(void *drvPvt, asynUser *pasynUser,
+    const asynOctetIovec *iov, int iovcnt,size_t *nbytesTransfered)
 {
     ttyController_t *tty = (ttyController_t *)drvPvt;
     int thisWrite;
-    int nleft = numchars;
-    int timerStarted = 0;
+    size_t numchars = 0;
+    size_t nleft;
+    size_t offset = 0;
     asynStatus status = asynSuccess;
+    int i;
+#ifdef USE_POLL
+    epicsTimeStamp startTime;
+    int waitStatus;
+#else
+    int timerStarted = 0;
+#endif
 
     assert(tty);
+    for (i = 0 ; i < iovcnt ; i++)
+        numchars += iov[i].numchars;
     asynPrint(pasynUser, ASYN_TRACE_FLOW,
                             "%s write.\n", tty->serialDeviceName);
-    asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, numchars,
-                            "%s write %lu\n", tty->serialDeviceName, (unsigned long)numchars);
+    for (i = 0 ; i < iovcnt ; i++)
+        asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, iov[i].data, iov[i].numchars,
+                            "%s write %lu\n", tty->serialDeviceName, (unsigned long)iov[i].numchars);
     if (tty->fd < 0) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                                 "%s disconnected:", tty->serialDeviceName);
@@ -755,6 +961,56 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
         *nbytesTransfered = 0;
         return asynSuccess;
     }
+    while (iov->numchars == 0) {
+        iov++;
+        iovcnt--;
+    }
+#ifdef USE_POLL
+    tty->timeoutFlag = 0;
+    nleft = numchars;
+    epicsTimeGetCurrent(&startTime);
+    for (;;) {
+        thisWrite = writeIovec(tty, iov, iovcnt, offset);
+        if (thisWrite > 0) {
+            tty->nWritten += thisWrite;
+            nleft -= thisWrite;
+            if (nleft == 0)
+                break;
+            offset += thisWrite;
+            while (offset >= iov->numchars) {
+                offset -= iov->numchars;
+                iov++;
+                iovcnt--;
+            }
+            continue;
+        }
+        if ((thisWrite < 0) && (errno == EINTR))
+            continue;
+        if ((thisWrite < 0) && (errno != EWOULDBLOCK) && (errno != EAGAIN)) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                "%s write error: %s",
+                                        tty->serialDeviceName, strerror(errno));
+            closeConnection(pasynUser,tty);
+            status = asynError;
+            break;
+        }
+        waitStatus = waitLine(tty, POLLOUT, pasynUser->timeout, &startTime);
+        if (waitStatus == 0) {
+            /* Discard the rest, as the timeout handler does */
+            tcflush(tty->fd, TCOFLUSH);
+            status = asynTimeout;
+            break;
+        }
+        if (waitStatus < 0) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                "%s write error: %s",
+                                        tty->serialDeviceName, strerror(errno));
+            closeConnection(pasynUser,tty);
+            status = asynError;
+            break;
+        }
+    }
+#else
     if (tty->writeTimeout != pasynUser->timeout) {
 #ifndef vxWorks
         /*
@@ -786,13 +1042,18 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
         timerStarted = 1;
         }
     for (;;) {
-        thisWrite = write(tty->fd, (char *)data, nleft);
+        thisWrite = writeIovec(tty, iov, iovcnt, offset);
         if (thisWrite > 0) {
             tty->nWritten += thisWrite;
             nleft -= thisWrite;
             if (nleft == 0)
                 break;
-            data += thisWrite;
+            offset += thisWrite;
+            while (offset >= iov->numchars) {
+                offset -= iov->numchars;
+                iov++;
+                iovcnt--;
+            }
         }
         if (tty->timeoutFlag || (tty->writeTimeout == 0)) {
             status = asynTimeout;
@@ -810,6 +1071,7 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
         }
     }
     if (timerStarted) epicsTimerCancel(tty->timer);
+#endif
     *nbytesTransfered = numchars - nleft;
     asynPrint(pasynUser, ASYN_TRACE_FLOW, "wrote %lu to %s, return %s\n",
                                             (unsigned long)*nbytesTransfered,
@@ -818,6 +1080,19 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
     return status;
 }
 
+/*
+ * Write to the serial line
+ */
+static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
+    const char *data, size_t numchars,size_t *nbytesTransfered)
+{
+    asynOctetIovec iov;
+
+    iov.data = data;
+    iov.numchars = numchars;
+    return writevIt(drvPvt, pasynUser, &iov, 1, nbytesTransfered);
+}
+
 /*
  * Read from the serial line
  */
@@ -829,6 +1104,10 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
     int nRead = 0;
     int timerStarted = 0;
     asynStatus status = asynSuccess;
+#ifdef USE_POLL
+    epicsTimeStamp startTime;
+    int waitStatus;
+#endif
 
     assert(tty);
     asynPrint(pasynUser, ASYN_TRACE_FLOW,
@@ -843,6 +1122,10 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
             "%s maxchars %d Why <=0?",tty->serialDeviceName,(int)maxchars);
         return asynError;
     }
+#ifdef USE_POLL
+    /* VMIN and VTIME stay 0, the line is non-blocking */
+    epicsTimeGetCurrent(&startTime);
+#else
     if (tty->readTimeout != pasynUser->timeout) {
 #ifndef vxWorks
         /*
@@ -888,6 +1171,7 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
 #endif
         tty->readTimeout = pasynUser->timeout;
     }
+#endif
     tty->timeoutFlag = 0;
     if (gotEom) *gotEom = 0;
     for (;;) {
@@ -907,10 +1191,12 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
             }
         }
 #endif
+#ifndef USE_POLL
         if (!timerStarted && (tty->readTimeout > 0)) {
             epicsTimerStartDelay(tty->timer, tty->readTimeout);
             timerStarted = 1;
         }
+#endif
         thisRead = read(tty->fd, data, maxchars);
         if (thisRead > 0) {
             asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, thisRead,
@@ -930,8 +1216,24 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
                 status = asynError;
                 break;
             }
+#ifdef USE_POLL
+            if ((thisRead < 0) && (errno == EINTR))
+                continue;
+            waitStatus = waitLine(tty, POLLIN, pasynUser->timeout, &startTime);
+            if (waitStatus == 0)
+                tty->timeoutFlag = 1;
+            else if (waitStatus < 0) {
+                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                "%s read error: %s",
+                                        tty->serialDeviceName, strerror(errno));
+                closeConnection(pasynUser,tty);
+                status = asynError;
+                break;
+            }
+#else
             if (tty->readTimeout == 0)
                 tty->timeoutFlag = 1;
+#endif
         }
         if (tty->timeoutFlag)
             break;
@@ -970,7 +1272,11 @@ flushIt(void *drvPvt,asynUser *pasynUser)
     return asynSuccess;
 }
 
-static asynOctet asynOctetMethods = { writeIt, readIt, flushIt };
+static asynOctet asynOctetMethods = {
+    writeIt, readIt, flushIt,
+    0, 0, 0, 0, 0, 0,
+    writevIt
+};
 
 /*
  * Clean up a ttyController
@@ -0,0 +1,37 @@
+/**********************************************************************
+* Set data rates that have no Bxxx code on Linux                      *
+**********************************************************************/
+/***********************************************************************
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+* National Laboratory.
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/*
+ * This file must not include <termios.h>, which declares a struct
+ * termios that conflicts with the kernel's.
+ */
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+
+#include "serial_termios2.h"
+
+#ifdef ASYN_TERMIOS2_SUPPORTED
+/*
+ * Set the input and output rate of fd to baud.
+ * Returns 0, or -1 with errno set.
+ */
+int asynSerialSetBaudOther(int fd, int baud)
+{
+    struct termios2 t2;
+
+    if (ioctl(fd, TCGETS2, &t2) < 0)
+        return -1;
+    t2.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    t2.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    t2.c_ispeed = baud;
+    t2.c_ospeed = baud;
+    return ioctl(fd, TCSETS2, &t2);
+}
+#endif
@@ -0,0 +1,15 @@
+#ifndef SERIAL_TERMIOS2
+#define SERIAL_TERMIOS2
+
+#include <sys/ioctl.h>
+
+/* Linux can set any data rate with struct termios2 and BOTHER.
+ * struct termios2 can't be declared in a file that includes <termios.h>,
+ * so serial_termios2.c does the work.  Some architectures (e.g. PowerPC)
+ * don't have termios2. */
+#ifdef TCSETS2
+  #define ASYN_TERMIOS2_SUPPORTED   1
+  int asynSerialSetBaudOther(int fd, int baud);
+#endif
+
+#endif
@@ -0,0 +1,4 @@
+#ifndef SERIAL_TERMIOS2
+#define SERIAL_TERMIOS2
+
+#endif
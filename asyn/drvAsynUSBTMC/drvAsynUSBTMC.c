@@ -8,6 +8,7 @@
  ***************************************************************************
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include <errlog.h>
 #include <epicsStdio.h>
@@ -16,6 +17,7 @@
 #include <epicsMessageQueue.h>
 #include <epicsMutex.h>
 #include <epicsThread.h>
+#include <epicsTime.h>
 #include <epicsExport.h>
 #include <cantProceed.h>
 #include <iocsh.h>
@@ -23,7 +25,7 @@
 #include <asynDrvUser.h>
 #include <asynOctet.h>
 #include <asynInt32.h>
-#include <libusb-1.0/libusb.h>
+#include "drvAsynUSBTMC.h"
 
 #define USBTMC_INTERFACE_CLASS    0xFE
 #define USBTMC_INTERFACE_SUBCLASS 0x03
@@ -36,6 +38,19 @@
 #define BULK_IO_PAYLOAD_CAPACITY 4096
 #define IDSTRING_CAPACITY        100
 
+/*
+ * Reads larger than BULK_IO_PAYLOAD_CAPACITY are done with a single
+ * REQUEST_DEV_DEP_MSG_IN and several asynchronous bulk-in transfers in
+ * flight.  The transfer size must be a multiple of the endpoint's
+ * wMaxPacketSize, so it is rounded to a multiple of 1024.
+ */
+#define PIPELINE_DEFAULT_TRANSFERS 4
+#define PIPELINE_MAX_TRANSFERS     32
+#define PIPELINE_DEFAULT_SIZE      65536
+#define PIPELINE_MAX_SIZE          (16*1024*1024)
+#define PIPELINE_SIZE_QUANTUM      1024
+#define PIPELINE_MAX_REQUEST       0x7FFF0000
+
 #define ASYN_REASON_SRQ 4345
 #define ASYN_REASON_STB 4346
 #define ASYN_REASON_REN 4347
@@ -44,6 +59,12 @@
 # error "You need to get a newer version of libsb-1.0 (16 at the very least)"
 #endif
 
+typedef struct bulkInTransfer {
+    struct libusb_transfer *transfer;
+    unsigned char          *buf;
+    int                     done;
+} bulkInTransfer;
+
 typedef struct drvPvt {
     /*
      * Used to find matching device
@@ -74,6 +95,7 @@ typedef struct drvPvt {
     /*
      * Libusb hooks
      */
+    const usbtmcTransferLayer *layer;
     libusb_context        *usb;
     libusb_device_handle  *handle;
     int                    bInterfaceNumber;
@@ -112,6 +134,13 @@ typedef struct drvPvt {
     const unsigned char   *bufp;
     unsigned char          bulkInPacketFlags;
 
+    /*
+     * Pipelined bulk-in transfers
+     */
+    int                    pipelineCount;
+    int                    pipelineSize;
+    bulkInTransfer        *pipeline;
+
     /*
      * Statistics
      */
@@ -119,6 +148,8 @@ typedef struct drvPvt {
     size_t                 interruptCount;
     size_t                 bytesSentCount;
     size_t                 bytesReceivedCount;
+    size_t                 pipelinedReadCount;
+    size_t                 bulkInTransferCount;
 } drvPvt;
 
 static asynStatus disconnect(void *pvt, asynUser *pasynUser);
@@ -135,7 +166,7 @@ interruptThread(void *arg)
     int s;
 
     for (;;) {
-        s =  libusb_interrupt_transfer (pdpvt->handle,
+        s =  pdpvt->layer->interruptTransfer(pdpvt->handle,
                                         pdpvt->interruptEndpointAddress,
                                         cbuf,
                                         sizeof cbuf,
@@ -321,11 +352,17 @@ report(void *pvt, FILE *fp, int details)
         showCount(fp, "Interrupt", pdpvt->interruptCount);
         showCount(fp, "Send", pdpvt->bytesSentCount);
         showCount(fp, "Receive", pdpvt->bytesReceivedCount);
+        if (pdpvt->pipelineCount) {
+            fprintf(fp, "%28s: %d x %d bytes\n", "Pipelined bulk-in transfers",
+                                    pdpvt->pipelineCount, pdpvt->pipelineSize);
+            showCount(fp, "Pipelined read", pdpvt->pipelinedReadCount);
+            showCount(fp, "Bulk-in transfer", pdpvt->bulkInTransferCount);
+        }
     }
     if (details >= 100) {
         int l = details % 100;
         fprintf(fp, "==== Set libusb debug level %d ====\n", l);
-        libusb_set_debug(pdpvt->usb, l);
+        pdpvt->layer->setDebug(pdpvt->usb, l);
     }
 }
 
@@ -337,7 +374,7 @@ getDeviceString(drvPvt *pdpvt, int i, char *dest)
 {
     ssize_t n;
 
-    n = libusb_get_string_descriptor_ascii(pdpvt->handle, i,
+    n = pdpvt->layer->getStringDescriptorAscii(pdpvt->handle, i,
                                             pdpvt->buf, sizeof pdpvt->buf);
     if (n < 0) {
         *dest = '\0';
@@ -398,7 +435,7 @@ findDevice(drvPvt *pdpvt, asynUser *pasynUser, libusb_device **list, int n)
         struct libusb_device_descriptor desc;
         struct libusb_config_descriptor *config;
 
-        int s = libusb_get_device_descriptor(dev, &desc);
+        int s = pdpvt->layer->getDeviceDescriptor(dev, &desc);
         if (s != 0) {
             epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
                 "libusb_get_device_descriptor failed: %s", libusb_strerror(s));
@@ -406,8 +443,8 @@ findDevice(drvPvt *pdpvt, asynUser *pasynUser, libusb_device **list, int n)
         }
         if (desc.bDeviceClass != LIBUSB_CLASS_PER_INTERFACE)
             continue;
-        if ((libusb_get_active_config_descriptor(dev, &config) < 0)
-         && (libusb_get_config_descriptor(dev, 0, &config) < 0))
+        if ((pdpvt->layer->getActiveConfigDescriptor(dev, &config) < 0)
+         && (pdpvt->layer->getConfigDescriptor(dev, 0, &config) < 0))
             continue;
         if (config == NULL)
             continue;
@@ -422,7 +459,7 @@ findDevice(drvPvt *pdpvt, asynUser *pasynUser, libusb_device **list, int n)
                  && ((pdpvt->productId==0) || (pdpvt->productId==desc.idProduct))) {
                     pdpvt->bInterfaceNumber = iface_desc->bInterfaceNumber;
                     pdpvt->bInterfaceProtocol = iface_desc->bInterfaceProtocol;
-                    s = libusb_open(dev, &pdpvt->handle);
+                    s = pdpvt->layer->open(dev, &pdpvt->handle);
                     if (s == 0) {
                         pdpvt->deviceVendorId = desc.idVendor;
                         pdpvt->deviceProductId = desc.idProduct;
@@ -431,11 +468,11 @@ findDevice(drvPvt *pdpvt, asynUser *pasynUser, libusb_device **list, int n)
                          || (strcmp(pdpvt->serialNumber,
                              pdpvt->deviceSerialString) == 0)) {
                             getEndpoints(pdpvt, iface_desc);
-                            libusb_free_config_descriptor(config);
+                            pdpvt->layer->freeConfigDescriptor(config);
                             pasynUser->errorMessage[0] = '\0';
                             return asynSuccess;
                         }
-                        libusb_close(pdpvt->handle);
+                        pdpvt->layer->close(pdpvt->handle);
                     }
                     else {
                         epicsSnprintf(pasynUser->errorMessage,
@@ -446,7 +483,7 @@ findDevice(drvPvt *pdpvt, asynUser *pasynUser, libusb_device **list, int n)
                 }
             }
         }
-        libusb_free_config_descriptor(config);
+        pdpvt->layer->freeConfigDescriptor(config);
     }
     return asynError;
 }
@@ -505,7 +542,7 @@ getCapabilities(drvPvt *pdpvt, asynUser *pasynUser)
     int s;
     asynStatus status;
 
-    s = libusb_control_transfer(pdpvt->handle,
+    s = pdpvt->layer->controlTransfer(pdpvt->handle,
                 0xA1, // bmRequestType: Dir=IN, Type=CLASS, Recipient=INTERFACE
                 0x07, // bRequest: USBTMC GET_CAPABILITIES
                 0x0000,                  // wValue
@@ -537,7 +574,7 @@ clearBuffers(drvPvt *pdpvt, asynUser *pasynUser)
     int pass = 0;
     unsigned char cbuf[2];
 
-    s = libusb_control_transfer(pdpvt->handle,
+    s = pdpvt->layer->controlTransfer(pdpvt->handle,
                 0xA1, // bmRequestType: Dir=IN, Type=CLASS, Recipient=INTERFACE
                 0x05, // bRequest: USBTMC INITIATE_CLEAR
                 0x0000,                  // wValue
@@ -551,7 +588,7 @@ clearBuffers(drvPvt *pdpvt, asynUser *pasynUser)
         return status;
     for (;;) {
         epicsThreadSleep(0.01); // I don't know why this is necessary, but without some delay here the CHECK_CLEAR_STATUS seems to be stuck at STATUS_PENDING
-        s = libusb_control_transfer(pdpvt->handle,
+        s = pdpvt->layer->controlTransfer(pdpvt->handle,
                 0xA1, // bmRequestType: Dir=IN, Type=CLASS, Recipient=INTERFACE
                 0x06, // bRequest: USBTMC CHECK_CLEAR_STATUS
                 0x0000,                  // wValue
@@ -564,8 +601,8 @@ clearBuffers(drvPvt *pdpvt, asynUser *pasynUser)
         if (status != asynSuccess)
             return asynError;
         if (cbuf[0] != 2) {
-            libusb_clear_halt(pdpvt->handle, pdpvt->bulkInEndpointAddress);
-            libusb_clear_halt(pdpvt->handle, pdpvt->bulkOutEndpointAddress);
+            pdpvt->layer->clearHalt(pdpvt->handle, pdpvt->bulkInEndpointAddress);
+            pdpvt->layer->clearHalt(pdpvt->handle, pdpvt->bulkOutEndpointAddress);
             if (cbuf[0] == 1)
                 return asynSuccess;
             epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
@@ -575,7 +612,7 @@ clearBuffers(drvPvt *pdpvt, asynUser *pasynUser)
         switch (++pass) {
         case 5:
             asynPrint(pasynUser, ASYN_TRACE_ERROR, "Note -- RESET DEVICE.\n");
-            s = libusb_reset_device(pdpvt->handle);
+            s = pdpvt->layer->resetDevice(pdpvt->handle);
             if (s != 0) {
                 epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
                     "libusb_reset_device() failed: %s", libusb_strerror(s));
@@ -605,7 +642,7 @@ connect(void *pvt, asynUser *pasynUser)
         ssize_t n;
         int s;
 
-        n = libusb_get_device_list(pdpvt->usb, &list);
+        n = pdpvt->layer->getDeviceList(pdpvt->usb, &list);
         if (n < 0) {
             s = n;
             epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
@@ -613,28 +650,28 @@ connect(void *pvt, asynUser *pasynUser)
             return asynError;
         }
         status = findDevice(pdpvt, pasynUser, list, n);
-        libusb_free_device_list(list, 1);
+        pdpvt->layer->freeDeviceList(list, 1);
         if (status != asynSuccess)
             return asynError;
-         s = libusb_claim_interface(pdpvt->handle, pdpvt->bInterfaceNumber);
+         s = pdpvt->layer->claimInterface(pdpvt->handle, pdpvt->bInterfaceNumber);
          if (s == LIBUSB_ERROR_BUSY) {
-             libusb_detach_kernel_driver(pdpvt->handle, pdpvt->bInterfaceNumber);
-             s = libusb_claim_interface(pdpvt->handle, pdpvt->bInterfaceNumber);
+             pdpvt->layer->detachKernelDriver(pdpvt->handle, pdpvt->bInterfaceNumber);
+             s = pdpvt->layer->claimInterface(pdpvt->handle, pdpvt->bInterfaceNumber);
          }
          if (s) {
-            libusb_close(pdpvt->handle);
+            pdpvt->layer->close(pdpvt->handle);
             epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
                     "libusb_claim_interface failed: %s", libusb_strerror(s));
             return asynError;
          }
          if (getCapabilities(pdpvt, pasynUser) != asynSuccess) {
-            libusb_close(pdpvt->handle);
+            pdpvt->layer->close(pdpvt->handle);
             epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
                     "Can't get device capabilities: %s", pasynUser->errorMessage);
             return asynError;
         }
          if (clearBuffers(pdpvt, pasynUser) != asynSuccess) {
-            libusb_close(pdpvt->handle);
+            pdpvt->layer->close(pdpvt->handle);
             epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
                             "Can't clear buffers: %s", pasynUser->errorMessage);
             return asynError;
@@ -675,7 +712,7 @@ disconnect(void *pvt, asynUser *pasynUser)
              * Send signal then force an Interrupt-In message
              */
             epicsEventSignal(pdpvt->pleaseTerminate);
-            libusb_control_transfer(pdpvt->handle,
+            pdpvt->layer->controlTransfer(pdpvt->handle,
                 0xA1, // bmRequestType: Dir=IN, Type=CLASS, Recipient=INTERFACE
                 128,  // bRequest: READ_STATUS_BYTE
                 127,                     // wValue (bTag)
@@ -685,7 +722,7 @@ disconnect(void *pvt, asynUser *pasynUser)
                 100);                    // timeout (ms)
             epicsEventWaitWithTimeout(pdpvt->didTerminate, 2.0);
         }
-        libusb_close(pdpvt->handle);
+        pdpvt->layer->close(pdpvt->handle);
     }
     pdpvt->isConnected = 0;
     pasynManager->exceptionDisconnect(pasynUser);
@@ -743,7 +780,7 @@ asynOctetWrite(void *pvt, asynUser *pasynUser,
             pdpvt->buf[pkSend++] = 0;
         asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, (const char *)pdpvt->buf,
                                                     pkSend, "Send %d: ", pkSend);
-        s = libusb_bulk_transfer(pdpvt->handle, pdpvt->bulkOutEndpointAddress,
+        s = pdpvt->layer->bulkTransfer(pdpvt->handle, pdpvt->bulkOutEndpointAddress,
                                       pdpvt->buf, pkSend, &pkSent, timeout);
         if (s) {
             disconnectIfGone(pdpvt, pasynUser, s);
@@ -764,6 +801,284 @@ asynOctetWrite(void *pvt, asynUser *pasynUser,
     return asynSuccess;
 }
 
+/*
+ * Send a REQUEST_DEV_DEP_MSG_IN
+ */
+static asynStatus
+requestBulkIn(drvPvt *pdpvt, asynUser *pasynUser, size_t transferSize,
+              int timeout, unsigned char *bTag)
+{
+    int s;
+    int ioCount;
+
+    pdpvt->bulkInPacketFlags = 0;
+    pdpvt->buf[0] = MESSAGE_ID_REQUEST_DEV_DEP_MSG_IN;
+    pdpvt->buf[1] = pdpvt->bTag;
+    pdpvt->buf[2] = ~pdpvt->bTag;
+    pdpvt->buf[3] = 0;
+    pdpvt->buf[4] = transferSize & 0xFF;
+    pdpvt->buf[5] = (transferSize >> 8) & 0xFF;
+    pdpvt->buf[6] = (transferSize >> 16) & 0xFF;
+    pdpvt->buf[7] = (transferSize >> 24) & 0xFF;
+    if (pdpvt->termChar >= 0) {
+        pdpvt->buf[8] = 2;
+        pdpvt->buf[9] = pdpvt->termChar;
+    }
+    else {
+        pdpvt->buf[8] = 0;
+        pdpvt->buf[9] = 0;
+    }
+    pdpvt->buf[10] = 0;
+    pdpvt->buf[11] = 0;
+    *bTag = pdpvt->bTag;
+    pdpvt->bTag = (pdpvt->bTag == 0xFF) ? 0x1 : pdpvt->bTag + 1;
+    asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, (const char *)pdpvt->buf,
+                            BULK_IO_HEADER_SIZE,
+                            "Request %d, command: ", (int)transferSize);
+    s = pdpvt->layer->bulkTransfer(pdpvt->handle, pdpvt->bulkOutEndpointAddress,
+                      pdpvt->buf, BULK_IO_HEADER_SIZE, &ioCount, timeout);
+    if (s) {
+        disconnectIfGone(pdpvt, pasynUser, s);
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                    "Bulk transfer request failed: %s", libusb_strerror(s));
+        return asynError;
+    }
+    return asynSuccess;
+}
+
+/*
+ * Check the header of a DEV_DEP_MSG_IN
+ */
+static asynStatus
+checkBulkInHeader(asynUser *pasynUser, const unsigned char *buf, int ioCount,
+                  unsigned char bTag, size_t transferSize, size_t *payloadSize)
+{
+    if (ioCount < BULK_IO_HEADER_SIZE) {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                        "Incomplete packet header (read only %d)", ioCount);
+        return asynError;
+    }
+    if ((buf[0] != MESSAGE_ID_DEV_DEP_MSG_IN)
+     || (buf[1] != bTag)
+     || (buf[2] != (unsigned char)~bTag)) {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                        "Packet header corrupt %x %x %x (btag %x)",
+                                            buf[0], buf[1], buf[2], bTag);
+        return asynError;
+    }
+    *payloadSize = (size_t)buf[4]         |
+                  ((size_t)buf[5] << 8)  |
+                  ((size_t)buf[6] << 16) |
+                  ((size_t)buf[7] << 24);
+    if (*payloadSize > transferSize) {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                "Packet header claims %lu sent, but requested only %lu",
+                        (unsigned long)*payloadSize, (unsigned long)transferSize);
+        return asynError;
+    }
+    return asynSuccess;
+}
+
+/*
+ * Pipelined bulk-in transfers
+ */
+static void LIBUSB_CALL
+bulkInCallback(struct libusb_transfer *transfer)
+{
+    bulkInTransfer *pbit = (bulkInTransfer *)transfer->user_data;
+
+    pbit->done = 1;
+}
+
+static int
+submitBulkIn(drvPvt *pdpvt, bulkInTransfer *pbit)
+{
+    libusb_fill_bulk_transfer(pbit->transfer, pdpvt->handle,
+                              pdpvt->bulkInEndpointAddress,
+                              pbit->buf, pdpvt->pipelineSize,
+                              bulkInCallback, pbit, 0);
+    pbit->done = 0;
+    return pdpvt->layer->submitTransfer(pbit->transfer);
+}
+
+/*
+ * Wait for a bulk-in transfer to complete.
+ * Events are handled here or by whichever thread is in libusb.
+ * A negative timeout waits for ever.
+ */
+static int
+waitBulkIn(drvPvt *pdpvt, bulkInTransfer *pbit, double timeout)
+{
+    epicsTimeStamp start, now;
+    struct timeval tv;
+    double left = 1.0;
+    int s;
+
+    epicsTimeGetCurrent(&start);
+    while (!pbit->done) {
+        if (timeout >= 0) {
+            epicsTimeGetCurrent(&now);
+            left = timeout - epicsTimeDiffInSeconds(&now, &start);
+            if (left <= 0)
+                return LIBUSB_ERROR_TIMEOUT;
+        }
+        tv.tv_sec = (long)left;
+        tv.tv_usec = (long)((left - tv.tv_sec) * 1e6);
+        s = pdpvt->layer->handleEventsTimeoutCompleted(pdpvt->usb, &tv, &pbit->done);
+        if ((s < 0) && (s != LIBUSB_ERROR_INTERRUPTED))
+            return s;
+    }
+    return 0;
+}
+
+static int
+transferStatusError(enum libusb_transfer_status status)
+{
+    switch (status) {
+    case LIBUSB_TRANSFER_COMPLETED: return 0;
+    case LIBUSB_TRANSFER_TIMED_OUT: return LIBUSB_ERROR_TIMEOUT;
+    case LIBUSB_TRANSFER_STALL:     return LIBUSB_ERROR_PIPE;
+    case LIBUSB_TRANSFER_NO_DEVICE: return LIBUSB_ERROR_NO_DEVICE;
+    case LIBUSB_TRANSFER_OVERFLOW:  return LIBUSB_ERROR_OVERFLOW;
+    case LIBUSB_TRANSFER_CANCELLED: return LIBUSB_ERROR_INTERRUPTED;
+    default:                        return LIBUSB_ERROR_IO;
+    }
+}
+
+/*
+ * Cancel transfers first through last-1 and wait for them to finish
+ */
+static void
+cancelBulkIn(drvPvt *pdpvt, size_t first, size_t last)
+{
+    size_t i;
+
+    for (i = first ; i < last ; i++)
+        pdpvt->layer->cancelTransfer(pdpvt->pipeline[i % pdpvt->pipelineCount].transfer);
+    for (i = first ; i < last ; i++) {
+        if (waitBulkIn(pdpvt, &pdpvt->pipeline[i % pdpvt->pipelineCount], 2.0)) {
+            /*
+             * libusb still owns the transfer so it can't be used again
+             */
+            errlogPrintf("----- WARNING ----- "
+                         "Can't cancel bulk-in transfer.  "
+                         "Pipelined reads for ASYN port \"%s\" disabled.\n",
+                                                            pdpvt->portName);
+            pdpvt->pipelineCount = 0;
+            pdpvt->pipeline = NULL;
+            return;
+        }
+    }
+}
+
+/*
+ * Read a message with a single REQUEST_DEV_DEP_MSG_IN and several bulk-in
+ * transfers in flight.  The transfers complete in the order they were
+ * submitted and a short transfer marks the end of the message.  The
+ * payload is copied to the caller's buffer as each transfer completes.
+ */
+static asynStatus
+readPipelined(drvPvt *pdpvt, asynUser *pasynUser,
+              char *data, size_t maxchars, size_t *nRead)
+{
+    size_t transferSize = maxchars;
+    size_t nNeeded, nSubmitted = 0, nCompleted = 0;
+    size_t payloadSize = 0, nCopied = 0, n;
+    const unsigned char *cp;
+    bulkInTransfer *pbit;
+    unsigned char bTag;
+    asynStatus status;
+    int gotShort = 0;
+    int s = 0;
+    int timeout = pasynUser->timeout * 1000;
+    if (timeout == 0) timeout = 1;
+
+    *nRead = 0;
+    if (transferSize > PIPELINE_MAX_REQUEST)
+        transferSize = PIPELINE_MAX_REQUEST;
+    status = requestBulkIn(pdpvt, pasynUser, transferSize, timeout, &bTag);
+    if (status != asynSuccess)
+        return status;
+
+    /*
+     * Enough transfers for the header, payload, alignment bytes and
+     * the short packet that ends the message
+     */
+    nNeeded = (BULK_IO_HEADER_SIZE + transferSize + 3) / pdpvt->pipelineSize + 1;
+    while ((nSubmitted < nNeeded)
+        && (nSubmitted < (size_t)pdpvt->pipelineCount)) {
+        s = submitBulkIn(pdpvt, &pdpvt->pipeline[nSubmitted]);
+        if (s)
+            break;
+        nSubmitted++;
+    }
+    while ((s == 0) && (nCompleted < nSubmitted)) {
+        pbit = &pdpvt->pipeline[nCompleted % pdpvt->pipelineCount];
+        s = waitBulkIn(pdpvt, pbit, pasynUser->timeout);
+        if (s)
+            break;
+        nCompleted++;
+        s = transferStatusError(pbit->transfer->status);
+        if (s)
+            break;
+        pdpvt->bulkInTransferCount++;
+        cp = pbit->buf;
+        n = pbit->transfer->actual_length;
+        asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, (const char *)cp, n,
+                                                        "Read %d: ", (int)n);
+        if (nCompleted == 1) {
+            status = checkBulkInHeader(pasynUser, cp, n, bTag,
+                                                    transferSize, &payloadSize);
+            if (status != asynSuccess)
+                break;
+            pdpvt->bulkInPacketFlags = cp[8];
+            cp += BULK_IO_HEADER_SIZE;
+            n -= BULK_IO_HEADER_SIZE;
+        }
+        if (n > (payloadSize - nCopied))
+            n = payloadSize - nCopied;
+        memcpy(data + nCopied, cp, n);
+        nCopied += n;
+        if (pbit->transfer->actual_length < pdpvt->pipelineSize) {
+            gotShort = 1;
+            break;
+        }
+        if (nSubmitted < nNeeded) {
+            s = submitBulkIn(pdpvt, pbit);
+            if (s)
+                break;
+            nSubmitted++;
+        }
+    }
+    cancelBulkIn(pdpvt, nCompleted, nSubmitted);
+    if (s) {
+        pdpvt->bulkInPacketFlags = 0;
+        disconnectIfGone(pdpvt, pasynUser, s);
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                                "Bulk read failed: %s", libusb_strerror(s));
+        return asynError;
+    }
+    if (status != asynSuccess)
+        return status;
+    if (!gotShort) {
+        pdpvt->bulkInPacketFlags = 0;
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                "Device sent more than the %lu bytes requested",
+                                                (unsigned long)transferSize);
+        return asynError;
+    }
+    if (nCopied < payloadSize) {
+        pdpvt->bulkInPacketFlags = 0;
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+            "Packet header claims %lu sent, but packet contains only %lu",
+                        (unsigned long)payloadSize, (unsigned long)nCopied);
+        return asynError;
+    }
+    pdpvt->pipelinedReadCount++;
+    *nRead = nCopied;
+    return asynSuccess;
+}
+
 static asynStatus
 asynOctetRead(void *pvt, asynUser *pasynUser,
               char *data, size_t maxchars, size_t *nbytesTransfered,
@@ -772,8 +1087,10 @@ asynOctetRead(void *pvt, asynUser *pasynUser,
     drvPvt *pdpvt = (drvPvt *)pvt;
     unsigned char bTag;
     int s;
-    int nCopy, ioCount, payloadSize;
+    int nCopy, ioCount;
+    size_t payloadSize;
     int eom = 0;
+    asynStatus status;
     int timeout = pasynUser->timeout * 1000;
     if (timeout == 0) timeout = 1;
 
@@ -814,45 +1131,34 @@ asynOctetRead(void *pvt, asynUser *pasynUser,
         }
 
         /*
-         * Request another chunk
+         * Large reads go straight to the caller's buffer
          */
-        pdpvt->bulkInPacketFlags = 0;
-        pdpvt->buf[0] = MESSAGE_ID_REQUEST_DEV_DEP_MSG_IN;
-        pdpvt->buf[1] = pdpvt->bTag;
-        pdpvt->buf[2] = ~pdpvt->bTag;
-        pdpvt->buf[3] = 0;
-        pdpvt->buf[4] = BULK_IO_PAYLOAD_CAPACITY & 0xFF;
-        pdpvt->buf[5] = (BULK_IO_PAYLOAD_CAPACITY >> 8) & 0xFF;
-        pdpvt->buf[6] = (BULK_IO_PAYLOAD_CAPACITY >> 16) & 0xFF;
-        pdpvt->buf[7] = (BULK_IO_PAYLOAD_CAPACITY >> 24) & 0xFF;
-        if (pdpvt->termChar >= 0) {
-            pdpvt->buf[8] = 2;
-            pdpvt->buf[9] = pdpvt->termChar;
-        }
-        else {
-            pdpvt->buf[8] = 0;
-            pdpvt->buf[9] = 0;
-        }
-        pdpvt->buf[10] = 0;
-        pdpvt->buf[11] = 0;
-        bTag = pdpvt->bTag;
-        pdpvt->bTag = (pdpvt->bTag == 0xFF) ? 0x1 : pdpvt->bTag + 1;
-        asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, (const char *)pdpvt->buf,
-                            BULK_IO_HEADER_SIZE,
-                            "Request %d, command: ", BULK_IO_PAYLOAD_CAPACITY);
-        s = libusb_bulk_transfer(pdpvt->handle, pdpvt->bulkOutEndpointAddress,
-                          pdpvt->buf, BULK_IO_HEADER_SIZE, &ioCount, timeout);
-        if (s) {
-            disconnectIfGone(pdpvt, pasynUser, s);
-            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-                        "Bulk transfer request failed: %s", libusb_strerror(s));
-            return asynError;
+        if (pdpvt->pipelineCount && (maxchars > BULK_IO_PAYLOAD_CAPACITY)) {
+            size_t nRead;
+            status = readPipelined(pdpvt, pasynUser, data, maxchars, &nRead);
+            if (status != asynSuccess)
+                return status;
+            data += nRead;
+            maxchars -= nRead;
+            *nbytesTransfered += nRead;
+            pdpvt->bytesReceivedCount += nRead;
+            if (maxchars == 0)
+                eom |= ASYN_EOM_CNT;
+            continue;
         }
 
+        /*
+         * Request another chunk
+         */
+        status = requestBulkIn(pdpvt, pasynUser, BULK_IO_PAYLOAD_CAPACITY,
+                                                                timeout, &bTag);
+        if (status != asynSuccess)
+            return status;
+
         /*
          * Read back
          */
-        s = libusb_bulk_transfer(pdpvt->handle, pdpvt->bulkInEndpointAddress, pdpvt->buf,
+        s = pdpvt->layer->bulkTransfer(pdpvt->handle, pdpvt->bulkInEndpointAddress, pdpvt->buf,
                                             sizeof pdpvt->buf, &ioCount, timeout);
         if (s) {
             disconnectIfGone(pdpvt, pasynUser, s);
@@ -866,33 +1172,14 @@ asynOctetRead(void *pvt, asynUser *pasynUser,
         /*
          * Sanity check on transfer
          */
-        if (ioCount < BULK_IO_HEADER_SIZE) {
-            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-                            "Incomplete packet header (read only %d)", ioCount);
-            return asynError;
-        }
-        if ((pdpvt->buf[0] != MESSAGE_ID_REQUEST_DEV_DEP_MSG_IN)
-         || (pdpvt->buf[1] != bTag)
-         || (pdpvt->buf[2] != (unsigned char)~bTag)) {
-            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-                            "Packet header corrupt %x %x %x (btag %x)",
-                        pdpvt->buf[0], pdpvt->buf[1], pdpvt->buf[2], bTag);
-            return asynError;
-        }
-        payloadSize = pdpvt->buf[4]        |
-                     (pdpvt->buf[5] << 8)  |
-                     (pdpvt->buf[6] << 16) |
-                     (pdpvt->buf[7] << 24);
-        if (payloadSize > (ioCount - BULK_IO_HEADER_SIZE)) {
+        status = checkBulkInHeader(pasynUser, pdpvt->buf, ioCount, bTag,
+                                        BULK_IO_PAYLOAD_CAPACITY, &payloadSize);
+        if (status != asynSuccess)
+            return status;
+        if (payloadSize > (size_t)(ioCount - BULK_IO_HEADER_SIZE)) {
             epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
                 "Packet header claims %d sent, but packet contains only %d",
-                            payloadSize, ioCount - BULK_IO_HEADER_SIZE);
-            return asynError;
-        }
-        if (payloadSize > BULK_IO_PAYLOAD_CAPACITY) {
-            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-                    "Packet header claims %d sent, but requested only %d",
-                                    payloadSize, BULK_IO_PAYLOAD_CAPACITY);
+                            (int)payloadSize, ioCount - BULK_IO_HEADER_SIZE);
             return asynError;
         }
         pdpvt->bufCount = payloadSize;
@@ -1005,7 +1292,7 @@ asynInt32Write(void *pvt, asynUser *pasynUser, epicsInt32 value)
                                 "Device does not support REN operations.");
             return asynError;
         }
-        s = libusb_control_transfer(pdpvt->handle,
+        s = pdpvt->layer->controlTransfer(pdpvt->handle,
                 0xA1, // bmRequestType: Dir=IN, Type=CLASS, Recipient=INTERFACE
                 160,  // bRequest: USBTMC REN_CONTROL
                 (value != 0),            // wValue
@@ -1040,7 +1327,7 @@ asynInt32Read(void *pvt, asynUser *pasynUser, epicsInt32 *value)
             /* Flush queue */
             epicsMessageQueueTryReceive(pdpvt->statusByteMessageQueue, cbuf, 1);
         }
-        s = libusb_control_transfer(pdpvt->handle,
+        s = pdpvt->layer->controlTransfer(pdpvt->handle,
                 0xA1, // bmRequestType: Dir=IN, Type=CLASS, Recipient=INTERFACE
                 128,  // bRequest: USBTMC READ_STATUS_BYTE
                 2,                       // wValue (bTag)
@@ -1067,7 +1354,7 @@ asynInt32Read(void *pvt, asynUser *pasynUser, epicsInt32 *value)
             /*
              * 2 - Read status here
              */
-            s =  libusb_interrupt_transfer (pdpvt->handle,
+            s =  pdpvt->layer->interruptTransfer(pdpvt->handle,
                                             pdpvt->interruptEndpointAddress,
                                             cbuf,
                                             2,
@@ -1161,13 +1448,84 @@ static asynDrvUser drvUserMethods = {
     .destroy = asynDrvUserDestroy,
 };
 
+/*
+ * The real thing
+ */
+static const usbtmcTransferLayer libusbTransferLayer = {
+    .init                         = libusb_init,
+    .setDebug                     = libusb_set_debug,
+    .getDeviceList                = libusb_get_device_list,
+    .freeDeviceList               = libusb_free_device_list,
+    .getDeviceDescriptor          = libusb_get_device_descriptor,
+    .getActiveConfigDescriptor    = libusb_get_active_config_descriptor,
+    .getConfigDescriptor          = libusb_get_config_descriptor,
+    .freeConfigDescriptor         = libusb_free_config_descriptor,
+    .open                         = libusb_open,
+    .close                        = libusb_close,
+    .getStringDescriptorAscii     = libusb_get_string_descriptor_ascii,
+    .claimInterface               = libusb_claim_interface,
+    .detachKernelDriver           = libusb_detach_kernel_driver,
+    .resetDevice                  = libusb_reset_device,
+    .clearHalt                    = libusb_clear_halt,
+    .controlTransfer              = libusb_control_transfer,
+    .bulkTransfer                 = libusb_bulk_transfer,
+    .interruptTransfer            = libusb_interrupt_transfer,
+    .allocTransfer                = libusb_alloc_transfer,
+    .freeTransfer                 = libusb_free_transfer,
+    .submitTransfer               = libusb_submit_transfer,
+    .cancelTransfer               = libusb_cancel_transfer,
+    .handleEventsTimeoutCompleted = libusb_handle_events_timeout_completed,
+};
+
+/*
+ * Set up pipelined bulk-in transfers.
+ * If a transfer can't be allocated reads are not pipelined.
+ */
+static void
+createPipeline(drvPvt *pdpvt, int transferSize, int transferCount)
+{
+    int i;
+
+    if (transferSize <= 0)
+        transferSize = PIPELINE_DEFAULT_SIZE;
+    if (transferSize > PIPELINE_MAX_SIZE)
+        transferSize = PIPELINE_MAX_SIZE;
+    transferSize = (transferSize + PIPELINE_SIZE_QUANTUM - 1) /
+                            PIPELINE_SIZE_QUANTUM * PIPELINE_SIZE_QUANTUM;
+    if (transferCount <= 0)
+        transferCount = PIPELINE_DEFAULT_TRANSFERS;
+    if (transferCount > PIPELINE_MAX_TRANSFERS)
+        transferCount = PIPELINE_MAX_TRANSFERS;
+    pdpvt->pipeline = callocMustSucceed(transferCount,
+                                        sizeof *pdpvt->pipeline, pdpvt->portName);
+    for (i = 0 ; i < transferCount ; i++) {
+        pdpvt->pipeline[i].transfer = pdpvt->layer->allocTransfer(0);
+        if (pdpvt->pipeline[i].transfer == NULL) {
+            printf("Can't allocate bulk-in transfer!  "
+                   "Reads for ASYN port \"%s\" will not be pipelined.\n",
+                                                            pdpvt->portName);
+            while (i-- > 0) {
+                pdpvt->layer->freeTransfer(pdpvt->pipeline[i].transfer);
+                free(pdpvt->pipeline[i].buf);
+            }
+            free(pdpvt->pipeline);
+            pdpvt->pipeline = NULL;
+            return;
+        }
+        pdpvt->pipeline[i].buf = mallocMustSucceed(transferSize, pdpvt->portName);
+    }
+    pdpvt->pipelineSize = transferSize;
+    pdpvt->pipelineCount = transferCount;
+}
+
 /*
  * Device configuration
  */
 void
-usbtmcConfigure(const char *portName,
+usbtmcConfigureTransferLayer(const char *portName,
                 int vendorId, int productId, const char *serialNumber,
-                int priority, int flags)
+                int priority, int flags, int transferSize, int transferCount,
+                const usbtmcTransferLayer *layer)
 {
     drvPvt *pdpvt;
     int s;
@@ -1177,11 +1535,12 @@ usbtmcConfigure(const char *portName,
      * Set up local storage
      */
     pdpvt = (drvPvt *)callocMustSucceed(1, sizeof(drvPvt), portName);
+    pdpvt->layer = layer;
     pdpvt->portName = epicsStrDup(portName);
     pdpvt->interruptThreadName = callocMustSucceed(1, strlen(portName)+5, portName);
     epicsSnprintf(pdpvt->interruptThreadName, sizeof pdpvt->interruptThreadName, "%sIntr", portName);
     if (priority == 0) priority = epicsThreadPriorityMedium;
-    s = libusb_init(&pdpvt->usb);
+    s = pdpvt->layer->init(&pdpvt->usb);
     if (s != 0) {
         printf("libusb_init() failed: %s\n", libusb_strerror(s));
         return;
@@ -1213,6 +1572,9 @@ usbtmcConfigure(const char *portName,
         return;
     }
 
+    if ((flags & 0x2) == 0)
+        createPipeline(pdpvt, transferSize, transferCount);
+
     /*
      * Create our port
      */
@@ -1272,6 +1634,16 @@ usbtmcConfigure(const char *portName,
     }
 }
 
+void
+usbtmcConfigure(const char *portName,
+                int vendorId, int productId, const char *serialNumber,
+                int priority, int flags, int transferSize, int transferCount)
+{
+    usbtmcConfigureTransferLayer(portName, vendorId, productId, serialNumber,
+                                 priority, flags, transferSize, transferCount,
+                                 &libusbTransferLayer);
+}
+
 /*
  * IOC shell command registration
  */
@@ -1281,18 +1653,23 @@ static const iocshArg usbtmcConfigureArg2 = {"product ID number", iocshArgInt};
 static const iocshArg usbtmcConfigureArg3 = {"serial string", iocshArgString};
 static const iocshArg usbtmcConfigureArg4 = {"priority", iocshArgInt};
 static const iocshArg usbtmcConfigureArg5 = {"flags", iocshArgInt};
+static const iocshArg usbtmcConfigureArg6 = {"bulk-in transfer size", iocshArgInt};
+static const iocshArg usbtmcConfigureArg7 = {"bulk-in transfers in flight", iocshArgInt};
 static const iocshArg *usbtmcConfigureArgs[] = {&usbtmcConfigureArg0,
                                                 &usbtmcConfigureArg1,
                                                 &usbtmcConfigureArg2,
                                                 &usbtmcConfigureArg3,
                                                 &usbtmcConfigureArg4,
-                                                &usbtmcConfigureArg5};
-static const iocshFuncDef usbtmcConfigureFuncDef = {"usbtmcConfigure",6,usbtmcConfigureArgs};
+                                                &usbtmcConfigureArg5,
+                                                &usbtmcConfigureArg6,
+                                                &usbtmcConfigureArg7};
+static const iocshFuncDef usbtmcConfigureFuncDef = {"usbtmcConfigure",8,usbtmcConfigureArgs};
 static void usbtmcConfigureCallFunc(const iocshArgBuf *args)
 {
     usbtmcConfigure (args[0].sval,
                      args[1].ival, args[2].ival, args[3].sval,
-                     args[4].ival, args[5].ival);
+                     args[4].ival, args[5].ival,
+                     args[6].ival, args[7].ival);
 }
 
 /*
@@ -0,0 +1,82 @@
+/*
+ * ASYN support for USBTMC (Test & Measurement Class) devices
+ *
+ ***************************************************************************
+ * Copyright (c) 2013 W. Eric Norum <wenorum@lbl.gov>                      *
+ * This file is distributed subject to a Software License Agreement found  *
+ * in the file LICENSE that is included with this distribution.            *
+ ***************************************************************************
+ */
+
+#ifndef DRVASYNUSBTMC_H
+#define DRVASYNUSBTMC_H
+
+#include <shareLib.h>
+#include <libusb-1.0/libusb.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+/*
+ * The driver makes all its libusb calls through one of these tables.
+ * Each entry has the arguments of the libusb function it is named after.
+ * usbtmcConfigure uses libusb itself, usbtmcConfigureTransferLayer can
+ * be given a table that simulates a device, so the driver can be tested
+ * without USB hardware.
+ */
+typedef struct usbtmcTransferLayer {
+    int     (LIBUSB_CALL *init)(libusb_context **ctx);
+    void    (LIBUSB_CALL *setDebug)(libusb_context *ctx, int level);
+    ssize_t (LIBUSB_CALL *getDeviceList)(libusb_context *ctx, libusb_device ***list);
+    void    (LIBUSB_CALL *freeDeviceList)(libusb_device **list, int unrefDevices);
+    int     (LIBUSB_CALL *getDeviceDescriptor)(libusb_device *dev,
+                                    struct libusb_device_descriptor *desc);
+    int     (LIBUSB_CALL *getActiveConfigDescriptor)(libusb_device *dev,
+                                    struct libusb_config_descriptor **config);
+    int     (LIBUSB_CALL *getConfigDescriptor)(libusb_device *dev, uint8_t index,
+                                    struct libusb_config_descriptor **config);
+    void    (LIBUSB_CALL *freeConfigDescriptor)(struct libusb_config_descriptor *config);
+    int     (LIBUSB_CALL *open)(libusb_device *dev, libusb_device_handle **handle);
+    void    (LIBUSB_CALL *close)(libusb_device_handle *handle);
+    int     (LIBUSB_CALL *getStringDescriptorAscii)(libusb_device_handle *handle,
+                                    uint8_t index, unsigned char *data, int length);
+    int     (LIBUSB_CALL *claimInterface)(libusb_device_handle *handle, int interfaceNumber);
+    int     (LIBUSB_CALL *detachKernelDriver)(libusb_device_handle *handle, int interfaceNumber);
+    int     (LIBUSB_CALL *resetDevice)(libusb_device_handle *handle);
+    int     (LIBUSB_CALL *clearHalt)(libusb_device_handle *handle, unsigned char endpoint);
+    int     (LIBUSB_CALL *controlTransfer)(libusb_device_handle *handle,
+                                    uint8_t requestType, uint8_t request,
+                                    uint16_t value, uint16_t index,
+                                    unsigned char *data, uint16_t length,
+                                    unsigned int timeout);
+    int     (LIBUSB_CALL *bulkTransfer)(libusb_device_handle *handle,
+                                    unsigned char endpoint, unsigned char *data,
+                                    int length, int *actualLength, unsigned int timeout);
+    int     (LIBUSB_CALL *interruptTransfer)(libusb_device_handle *handle,
+                                    unsigned char endpoint, unsigned char *data,
+                                    int length, int *actualLength, unsigned int timeout);
+    struct libusb_transfer *(LIBUSB_CALL *allocTransfer)(int isoPackets);
+    void    (LIBUSB_CALL *freeTransfer)(struct libusb_transfer *transfer);
+    int     (LIBUSB_CALL *submitTransfer)(struct libusb_transfer *transfer);
+    int     (LIBUSB_CALL *cancelTransfer)(struct libusb_transfer *transfer);
+    int     (LIBUSB_CALL *handleEventsTimeoutCompleted)(libusb_context *ctx,
+                                    struct timeval *tv, int *completed);
+} usbtmcTransferLayer;
+
+epicsShareFunc void usbtmcConfigure(const char *portName,
+                                    int vendorId, int productId,
+                                    const char *serialNumber,
+                                    int priority, int flags,
+                                    int transferSize, int transferCount);
+epicsShareFunc void usbtmcConfigureTransferLayer(const char *portName,
+                                    int vendorId, int productId,
+                                    const char *serialNumber,
+                                    int priority, int flags,
+                                    int transferSize, int transferCount,
+                                    const usbtmcTransferLayer *layer);
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+#endif  /* DRVASYNUSBTMC_H */
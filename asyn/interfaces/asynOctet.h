@@ -31,6 +31,12 @@ typedef struct asynOctetInterrupt {
     void *userPvt;
 }asynOctetInterrupt;
 
+/* One buffer of a gathered write. See asynOctet:writev */
+typedef struct asynOctetIovec {
+    const char *data;
+    size_t     numchars;
+}asynOctetIovec;
+#define ASYN_OCTET_IOV_MAX 16 /*Buffers an interpose layer passes on the stack*/
 
 #define asynOctetType "asynOctet"
 typedef struct asynOctet{
@@ -53,6 +59,12 @@ typedef struct asynOctet{
                     const char *eos,int eoslen);
     asynStatus (*getOutputEos)(void *drvPvt,asynUser *pasynUser,
                     char *eos, int eossize, int *eoslen);
+    /* writev is optional. It writes the buffers as if they had been
+       concatenated and passed to a single write. Callers that want to use it
+       should call asynOctetBase:writeGather, which falls back to write */
+    asynStatus (*writev)(void *drvPvt,asynUser *pasynUser,
+                    const asynOctetIovec *iov,int iovcnt,
+                    size_t *nbytesTransfered);
 }asynOctet;
 
 /* asynOctetBase does the following:
@@ -61,6 +73,8 @@ typedef struct asynOctet{
    Provides default implementations of all methods.
    registerInterruptUser and cancelInterruptUser can be called
    directly rather than via queueRequest.
+   writeGather calls pasynOctet->writev if it is implemented. Otherwise it
+   copies the buffers into one and calls pasynOctet->write.
 */
 
 #define asynOctetBaseType "asynOctetBase"
@@ -70,6 +84,9 @@ typedef struct asynOctetBase {
         int processEosIn,int processEosOut,int interruptProcess);
     void       (*callInterruptUsers)(asynUser *pasynUser,void *pasynPvt,
         char *data,size_t *nbytesTransfered,int *eomReason);
+    asynStatus (*writeGather)(asynOctet *pasynOctet,void *drvPvt,
+        asynUser *pasynUser,const asynOctetIovec *iov,int iovcnt,
+        size_t *nbytesTransfered);
 } asynOctetBase;
 epicsShareExtern asynOctetBase *pasynOctetBase;
 
@@ -50,8 +50,11 @@ static asynStatus initialize(const char *portName,
            int interruptProcess);
 static void callInterruptUsers(asynUser *pasynUser,void *pasynPvt,
     char *data,size_t *nbytesTransfered,int *eomReason);
+static asynStatus writeGather(asynOctet *pasynOctet,void *drvPvt,
+    asynUser *pasynUser,const asynOctetIovec *iov,int iovcnt,
+    size_t *nbytesTransfered);
 
-static asynOctetBase octetBase = {initialize,callInterruptUsers};
+static asynOctetBase octetBase = {initialize,callInterruptUsers,writeGather};
 epicsShareDef asynOctetBase *pasynOctetBase = &octetBase;
 
 static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
@@ -63,6 +66,8 @@ static asynStatus registerInterruptUser(void *drvPvt,asynUser *pasynUser,
        interruptCallbackOctet callback, void *userPvt, void **registrarPvt);
 static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
        void *registrarPvt);
+static asynStatus writevIt(void *drvPvt, asynUser *pasynUser,
+    const asynOctetIovec *iov,int iovcnt,size_t *nbytesTransfered);
 static asynStatus setInputEos(void *drvPvt,asynUser *pasynUser,
                         const char *eos,int eoslen);
 static asynStatus getInputEos(void *drvPvt,asynUser *pasynUser,
@@ -75,7 +80,8 @@ static asynStatus getOutputEos(void *drvPvt,asynUser *pasynUser,
 static asynOctet octet = {
     writeIt,readIt,flushIt,
     registerInterruptUser,cancelInterruptUser,
-    setInputEos,getInputEos,setOutputEos,getOutputEos
+    setInputEos,getInputEos,setOutputEos,getOutputEos,
+    writevIt
 };
 /*Implementation to replace null methods*/
 static asynStatus writeFail(void *drvPvt, asynUser *pasynUser,
@@ -213,6 +219,37 @@ static void callInterruptUsers(asynUser *pasynUser,void *pasynPvt,
     pasynManager->interruptEnd(pasynPvt);
 }
 
+static asynStatus writeGather(asynOctet *pasynOctet,void *drvPvt,
+    asynUser *pasynUser,const asynOctetIovec *iov,int iovcnt,
+    size_t *nbytesTransfered)
+{
+    asynStatus status;
+    size_t     numchars = 0;
+    char       *buffer;
+    char       *pnext;
+    int        i;
+
+    if(pasynOctet->writev) {
+        return pasynOctet->writev(drvPvt,pasynUser,
+                          iov,iovcnt,nbytesTransfered);
+    }
+    if(iovcnt==1) {
+        return pasynOctet->write(drvPvt,pasynUser,
+                          iov[0].data,iov[0].numchars,nbytesTransfered);
+    }
+    for(i=0; i<iovcnt; i++) numchars += iov[i].numchars;
+    buffer = pasynManager->memMalloc(numchars ? numchars : 1);
+    pnext = buffer;
+    for(i=0; i<iovcnt; i++) {
+        memcpy(pnext,iov[i].data,iov[i].numchars);
+        pnext += iov[i].numchars;
+    }
+    status = pasynOctet->write(drvPvt,pasynUser,
+                          buffer,numchars,nbytesTransfered);
+    pasynManager->memFree(buffer,numchars ? numchars : 1);
+    return status;
+}
+
 static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
     const char *data,size_t numchars,size_t *nbytesTransfered)
 {
@@ -223,6 +260,15 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
                       data,numchars,nbytesTransfered);
 }
 
+static asynStatus writevIt(void *drvPvt, asynUser *pasynUser,
+    const asynOctetIovec *iov,int iovcnt,size_t *nbytesTransfered)
+{
+    octetPvt  *poctetPvt = (octetPvt *)drvPvt;
+
+    return writeGather(poctetPvt->pasynOctet,poctetPvt->drvPvt,pasynUser,
+                      iov,iovcnt,nbytesTransfered);
+}
+
 static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
     char *data,size_t maxchars,size_t *nbytesTransfered,int *eomReason)
 {
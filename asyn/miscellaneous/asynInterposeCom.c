@@ -59,6 +59,28 @@
 #define CPO_SERVER_NOTIFY_LINESTATE  106
 #define CPO_SERVER_NOTIFY_MODEMSTATE 107
 
+/*
+ * Most buffers passed down by one write.
+ * Messages with more IAC characters than this are stuffed into xBuf.
+ */
+#define COM_IOV_MAX  64
+
+/*
+ * Receive decoder states.
+ * A TELNET sequence can be split across reads, so readIt
+ * remembers where it was between calls.
+ */
+typedef enum {
+    RX_DATA,        /* Ordinary data */
+    RX_IAC,         /* After IAC */
+    RX_OPTION,      /* After IAC WILL/WONT/DO/DONT */
+    RX_SB,          /* In a subnegotiation */
+    RX_SB_IAC       /* After IAC in a subnegotiation */
+} rxState;
+
+/* Enough of a subnegotiation to recognize NOTIFY-LINESTATE/MODEMSTATE */
+#define SB_BUF_SIZE  4
+
 /*
  * Interposed layer private storage
  */
@@ -80,6 +102,10 @@ typedef struct interposePvt {
 
     char          *xBuf;          /* Buffer for transmit IAC stuffing */ 
     size_t         xBufCapacity;
+
+    rxState        rxState;        /* Receive decoder */
+    unsigned char  sbBuf[SB_BUF_SIZE];
+    size_t         sbLen;
 } interposePvt;
 
 /*
@@ -126,117 +152,271 @@ expectChar(interposePvt *pinterposePvt, asynUser *pasynUser, int expect)
  */
 
 /*
- * Double up IAC characters.
- * We assume that memchr and memcpy are nicely optimized so we're better off
- * using them than looking at and copying the characters one at a time ourselves.
+ * Copy the buffers into xBuf, doubling up IAC characters.
+ * Only used when a message has too many IACs to pass down in place.
  */
 static asynStatus
-writeIt(void *ppvt, asynUser *pasynUser,
-    const char *data, size_t numchars, size_t *nbytesTransfered)
+writeStuffed(interposePvt *pinterposePvt, asynUser *pasynUser,
+    const asynOctetIovec *iov, int iovcnt, size_t *nbytesTransfered)
 {
-    interposePvt *pinterposePvt = (interposePvt *)ppvt;
-    const char *iac;
-    char *dst = pinterposePvt->xBuf;
+    size_t numchars = 0;
     size_t nIAC = 0;
+    char *dst;
     asynStatus status;
+    int i;
 
-    if ((iac = memchr(data, C_IAC, numchars)) != NULL) {
-        size_t nLeft = numchars;
-        size_t nCopy = iac - data + 1;
-        for (;;) {
-            size_t nNew = nCopy + 1;
-            char *np;
-            if (nNew > pinterposePvt->xBufCapacity) {
-                /*
-                 * Try to strike a balance between too many
-                 * realloc calls and too much wasted space.
-                 */
-                size_t newSize = pinterposePvt->xBufCapacity + 1024;
-                if (newSize < numchars)
-                    newSize = numchars + 1024;
-                if (newSize < nNew)
-                    newSize = nNew + 1024;
-                np = realloc(pinterposePvt->xBuf, newSize);
-                if (np == NULL) {
-                    epicsSnprintf(pasynUser->errorMessage,
-                                  pasynUser->errorMessageSize, "Out of memory");
-                    return asynError;
-                }
-                dst = np + (dst - pinterposePvt->xBuf);
-                pinterposePvt->xBuf = np;
-                pinterposePvt->xBufCapacity = newSize;
-            }
+    for (i = 0 ; i < iovcnt ; i++) {
+        const char *p = iov[i].data;
+        const char *end = p + iov[i].numchars;
+        while ((p = memchr(p, C_IAC, end - p)) != NULL) {
+            nIAC++;
+            p++;
+        }
+        numchars += iov[i].numchars;
+    }
+    if (numchars + nIAC > pinterposePvt->xBufCapacity) {
+        /*
+         * Try to strike a balance between too many
+         * realloc calls and too much wasted space.
+         */
+        size_t newSize = numchars + nIAC + 1024;
+        char *np = realloc(pinterposePvt->xBuf, newSize);
+        if (np == NULL) {
+            epicsSnprintf(pasynUser->errorMessage,
+                          pasynUser->errorMessageSize, "Out of memory");
+            return asynError;
+        }
+        pinterposePvt->xBuf = np;
+        pinterposePvt->xBufCapacity = newSize;
+    }
+    dst = pinterposePvt->xBuf;
+    for (i = 0 ; i < iovcnt ; i++) {
+        const char *data = iov[i].data;
+        size_t nLeft = iov[i].numchars;
+        const char *iac;
+        while ((iac = memchr(data, C_IAC, nLeft)) != NULL) {
+            size_t nCopy = iac - data + 1;
             memcpy(dst, data, nCopy);
             dst += nCopy;
-            if (iac != NULL) {
-                *dst++ = C_IAC;
-                nIAC++;
-            }
-            nLeft -= nCopy;
-            if (nLeft == 0)
-                break;
+            *dst++ = C_IAC;
             data += nCopy;
-            if ((iac = memchr(data, C_IAC, nLeft)) != NULL)
-                nCopy = iac - data + 1;
-            else
-                nCopy = nLeft;
+            nLeft -= nCopy;
         }
-        numchars += nIAC;
-        data = pinterposePvt->xBuf;
+        memcpy(dst, data, nLeft);
+        dst += nLeft;
     }
     status =  pinterposePvt->pasynOctetDrv->write(pinterposePvt->drvOctetPvt,
-                                pasynUser, data, numchars, nbytesTransfered);
-    if (*nbytesTransfered == numchars)
+                pasynUser, pinterposePvt->xBuf, numchars + nIAC, nbytesTransfered);
+    if (*nbytesTransfered == numchars + nIAC)
         *nbytesTransfered -= nIAC;
     return status;
 }
 
+/*
+ * Double up IAC characters.
+ * Each IAC ends one buffer and starts the next, so it goes out twice
+ * without the message being copied.
+ * We assume that memchr is nicely optimized so we're better off
+ * using it than looking at the characters one at a time ourselves.
+ */
+static asynStatus
+writevIt(void *ppvt, asynUser *pasynUser,
+    const asynOctetIovec *iov, int iovcnt, size_t *nbytesTransfered)
+{
+    interposePvt *pinterposePvt = (interposePvt *)ppvt;
+    asynOctetIovec xIov[COM_IOV_MAX];
+    int nIov = 0;
+    size_t numchars = 0;
+    size_t nIAC = 0;
+    asynStatus status;
+    int i;
+
+    for (i = 0 ; i < iovcnt ; i++) {
+        const char *seg = iov[i].data;
+        const char *end = seg + iov[i].numchars;
+        const char *p = seg;
+        const char *iac;
+        while ((iac = memchr(p, C_IAC, end - p)) != NULL) {
+            if (nIov == COM_IOV_MAX)
+                return writeStuffed(pinterposePvt, pasynUser,
+                                    iov, iovcnt, nbytesTransfered);
+            xIov[nIov].data = seg;
+            xIov[nIov].numchars = iac - seg + 1;
+            nIov++;
+            nIAC++;
+            seg = iac;
+            p = iac + 1;
+        }
+        if (end > seg) {
+            if (nIov == COM_IOV_MAX)
+                return writeStuffed(pinterposePvt, pasynUser,
+                                    iov, iovcnt, nbytesTransfered);
+            xIov[nIov].data = seg;
+            xIov[nIov].numchars = end - seg;
+            nIov++;
+        }
+        numchars += iov[i].numchars;
+    }
+    status = pasynOctetBase->writeGather(pinterposePvt->pasynOctetDrv,
+                                pinterposePvt->drvOctetPvt, pasynUser,
+                                xIov, nIov, nbytesTransfered);
+    if (*nbytesTransfered == numchars + nIAC)
+        *nbytesTransfered -= nIAC;
+    return status;
+}
+
+static asynStatus
+writeIt(void *ppvt, asynUser *pasynUser,
+    const char *data, size_t numchars, size_t *nbytesTransfered)
+{
+    asynOctetIovec iov;
+
+    iov.data = data;
+    iov.numchars = numchars;
+    return writevIt(ppvt, pasynUser, &iov, 1, nbytesTransfered);
+}
+
+/*
+ * A complete subnegotiation has been received.
+ * The server may send NOTIFY-LINESTATE and NOTIFY-MODEMSTATE at any time,
+ * even with the masks cleared, so these are just traced.
+ */
+static void
+subnegotiation(interposePvt *pinterposePvt, asynUser *pasynUser)
+{
+    unsigned char *sb = pinterposePvt->sbBuf;
+
+    if ((pinterposePvt->sbLen >= 3) && (sb[0] == SB_COM_PORT_OPTION)
+     && ((sb[1] == CPO_SERVER_NOTIFY_LINESTATE)
+      || (sb[1] == CPO_SERVER_NOTIFY_MODEMSTATE))) {
+        asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s %s %#x\n",
+            pinterposePvt->portName,
+            (sb[1] == CPO_SERVER_NOTIFY_LINESTATE) ?
+                        "NOTIFY-LINESTATE" : "NOTIFY-MODEMSTATE", sb[2]);
+        return;
+    }
+    asynPrintIO(pasynUser, ASYN_TRACE_FLOW, (char *)sb, pinterposePvt->sbLen,
+        "%s ignoring subnegotiation\n", pinterposePvt->portName);
+}
+
+/*
+ * Remove TELNET sequences from the n characters in buf.
+ * Data is compacted in place, so each character is moved at most once,
+ * and the runs between IAC characters are found with memchr.
+ * Returns the number of data characters left.
+ */
+static size_t
+decode(interposePvt *pinterposePvt, asynUser *pasynUser, char *buf, size_t n)
+{
+    char *src = buf;
+    char *dst = buf;
+    char *end = buf + n;
+    int c;
+
+    while (src < end) {
+        switch (pinterposePvt->rxState) {
+        case RX_DATA: {
+            char *iac = memchr(src, C_IAC, end - src);
+            size_t run = (iac ? iac : end) - src;
+            if (dst != src)
+                memmove(dst, src, run);
+            dst += run;
+            src += run;
+            if (iac) {
+                src++;
+                pinterposePvt->rxState = RX_IAC;
+            }
+            break;
+        }
+        case RX_IAC:
+            c = *src++ & 0xFF;
+            switch (c) {
+            case C_IAC:
+                *dst++ = C_IAC;
+                pinterposePvt->rxState = RX_DATA;
+                break;
+            case C_WILL:
+            case C_WONT:
+            case C_DO:
+            case C_DONT:
+                pinterposePvt->rxState = RX_OPTION;
+                break;
+            case C_SB:
+                pinterposePvt->sbLen = 0;
+                pinterposePvt->rxState = RX_SB;
+                break;
+            default:
+                asynPrint(pasynUser, ASYN_TRACE_FLOW,
+                    "%s ignoring TELNET command %#x\n",
+                    pinterposePvt->portName, c);
+                pinterposePvt->rxState = RX_DATA;
+                break;
+            }
+            break;
+        case RX_OPTION:
+            asynPrint(pasynUser, ASYN_TRACE_FLOW,
+                "%s ignoring TELNET option %#x\n",
+                pinterposePvt->portName, *src & 0xFF);
+            src++;
+            pinterposePvt->rxState = RX_DATA;
+            break;
+        case RX_SB:
+            c = *src++ & 0xFF;
+            if (c == C_IAC) {
+                pinterposePvt->rxState = RX_SB_IAC;
+            }
+            else if (pinterposePvt->sbLen < SB_BUF_SIZE) {
+                pinterposePvt->sbBuf[pinterposePvt->sbLen++] = c;
+            }
+            break;
+        case RX_SB_IAC:
+            c = *src++ & 0xFF;
+            if (c == C_SE) {
+                subnegotiation(pinterposePvt, pasynUser);
+                pinterposePvt->rxState = RX_DATA;
+            }
+            else if (c == C_IAC) {
+                if (pinterposePvt->sbLen < SB_BUF_SIZE)
+                    pinterposePvt->sbBuf[pinterposePvt->sbLen++] = c;
+                pinterposePvt->rxState = RX_SB;
+            }
+            else {
+                asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                    "%s IAC %#x in subnegotiation\n",
+                    pinterposePvt->portName, c);
+                pinterposePvt->rxState = RX_DATA;
+            }
+            break;
+        }
+    }
+    return dst - buf;
+}
+
 static asynStatus
 readIt(void *ppvt, asynUser *pasynUser,
     char *data, size_t maxchars, size_t *nbytesTransfered, int *eomReason)
 {
     interposePvt *pinterposePvt = (interposePvt *)ppvt;
     int eom;
-    size_t nRead, nCheck;
-    char *iac;
-    char *base = data;
-    int unstuffed = 0;
+    size_t nRead, nData;
     asynStatus status;
     
-    status = pinterposePvt->pasynOctetDrv->read(pinterposePvt->drvOctetPvt,
+    /* Read again if everything received was TELNET commands */
+    do {
+        status = pinterposePvt->pasynOctetDrv->read(pinterposePvt->drvOctetPvt,
                                     pasynUser, data, maxchars, &nRead, &eom);
-    if (status != asynSuccess)
-        return status;
-    nCheck = nRead;
-    while ((iac = memchr(data, C_IAC, nCheck)) != NULL) {
-        int c;
-        unstuffed = 1;
+        if (status != asynSuccess)
+            return status;
+        nData = decode(pinterposePvt, pasynUser, data, nRead);
+    } while ((nRead > 0) && (nData == 0) && !(eom & ASYN_EOM_END));
+    if (nData != nRead) {
+        asynPrintIO(pasynUser, ASYN_TRACEIO_FILTER, data, nData,
+                                "nRead %d after IAC unstuffing", (int)nData);
         eom &= ~ASYN_EOM_CNT;
-        if (iac == data + nCheck - 1) {
-            c = nextChar(pinterposePvt, pasynUser);
-            iac--;
-        }
-        else {
-            c = *(iac + 1) & 0xFF;
-            nRead--;
-        }
-        if (c != C_IAC) {
-            epicsSnprintf(pasynUser->errorMessage,
-                          pasynUser->errorMessageSize, "Missing IAC");
-            return asynError;
-        }
-        nCheck -= (iac - data) + 2;
-        data = iac + 1;
-        if (nCheck == 0)
-            break;
-        memmove(data, data + 1, nCheck);
     }
-    if (unstuffed)
-        asynPrintIO(pasynUser, ASYN_TRACEIO_FILTER, base, nRead,
-                                "nRead %d after IAC unstuffing", (int)nRead);
-    if (nRead == maxchars)
+    if (nData == maxchars)
         eom |= ASYN_EOM_CNT;
-    *nbytesTransfered = nRead;
+    *nbytesTransfered = nData;
     if (eomReason) *eomReason = eom;
     return asynSuccess;
 }
@@ -308,7 +488,8 @@ getOutputEos(void *ppvt, asynUser *pasynUser, char *eos, int eossize, int *eosle
 static asynOctet octetMethods = {
     writeIt, readIt, flushIt,
     registerInterruptUser, cancelInterruptUser,
-    setInputEos, getInputEos, setOutputEos, getOutputEos
+    setInputEos, getInputEos, setOutputEos, getOutputEos,
+    writevIt
 };
 
 /*
@@ -719,6 +900,7 @@ exceptionHandler(asynUser *pasynUser, asynException exception)
     interposePvt *pinterposePvt = (interposePvt *)pasynUser->userPvt;
 
     if (exception == asynExceptionConnect) {
+        pinterposePvt->rxState = RX_DATA;
         if (restoreSettings(pinterposePvt, pasynUser) != asynSuccess)
             asynPrint(pasynUser, ASYN_TRACE_ERROR,
                             "Unable to restore parameters for port %s: %s\n",
@@ -7,19 +7,44 @@
  * Author: Dirk Zimoch
  */
 
+#include <stdlib.h>
+#include <math.h>
+
 #include <cantProceed.h>
 #include <epicsStdio.h>
 #include <epicsString.h>
+#include <epicsMutex.h>
 #include <epicsThread.h>
+#include <epicsTime.h>
 #include <iocsh.h>
 
 #include <epicsExport.h>
 #include "asynDriver.h"
 #include "asynOctet.h"
 #include "asynOption.h"
+#include "asynInterposeDelay.h"
 #include <epicsExport.h>
 
+#if defined(__linux__)
+#include <time.h>
+#include <errno.h>
+#define HAS_CLOCK_NANOSLEEP
+#endif
+
+/* Most characters sent with one write in clock pacing */
+#define MAX_BURST 64
+
+typedef enum {
+    pacingSleep,  /* epicsThreadSleep(delay) after each character */
+    pacingClock   /* Absolute deadlines, bursts below the timer latency */
+} pacingMode;
+
 typedef struct interposePvt {
+    int           addr;
+    int           perAddress;     /* Interposed for one address, not the port */
+    asynInterface common;
+    asynCommon    *pasynCommonDrv;
+    void          *commonPvt;
     asynInterface octet;
     asynOctet     *pasynOctetDrv;
     void          *octetPvt;
@@ -27,27 +52,170 @@ typedef struct interposePvt {
     asynOption    *pasynOptionDrv;
     void          *optionPvt;
     double        delay;
+    pacingMode    pacing;
+    int           burst;          /* 0 means choose from timerLatency */
+    double        timerLatency;   /* How late a wakeup can be */
+    double        nextTime;       /* When the next character may be sent */
+    /* Statistics for the report, written with the port locked but read by
+     * report, so they are guarded by statsLock */
+    epicsMutexId  statsLock;
+    unsigned long nChars;
+    unsigned long nWrites;
+    unsigned long nIntervals;
+    double        sumInterval;
+    double        minInterval;
+    double        maxInterval;
 }interposePvt;
 
+/* Time in seconds from an arbitrary start, monotonic if possible */
+static double pacingNow(void)
+{
+#ifdef HAS_CLOCK_NANOSLEEP
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    static epicsTimeStamp start;
+    epicsTimeStamp now;
+
+    if (start.secPastEpoch == 0) epicsTimeGetCurrent(&start);
+    epicsTimeGetCurrent(&now);
+    return epicsTimeDiffInSeconds(&now, &start);
+#endif
+}
+
+static void sleepUntil(double deadline)
+{
+#ifdef HAS_CLOCK_NANOSLEEP
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)deadline;
+    ts.tv_nsec = (long)((deadline - ts.tv_sec) * 1e9);
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+#else
+    double wait = deadline - pacingNow();
+
+    if (wait > 0) epicsThreadSleep(wait);
+#endif
+}
+
+/* Measure how late sleepUntil typically wakes up */
+#define LATENCY_SAMPLES 9
+static double measureTimerLatency(void)
+{
+#ifdef HAS_CLOCK_NANOSLEEP
+    double late[LATENCY_SAMPLES];
+    int i, j;
+
+    for (i = 0; i < LATENCY_SAMPLES; i++) {
+        double deadline = pacingNow() + 1e-6;
+        double t;
+        sleepUntil(deadline);
+        t = pacingNow() - deadline;
+        /* Insertion sort, the median ignores the odd long wakeup */
+        for (j = i; j > 0 && late[j-1] > t; j--) late[j] = late[j-1];
+        late[j] = t;
+    }
+    return late[LATENCY_SAMPLES/2];
+#else
+    return epicsThreadSleepQuantum();
+#endif
+}
+
+static int burstSize(interposePvt *pvt)
+{
+    double n;
+
+    if (pvt->burst > 0) return pvt->burst;
+    if (pvt->delay <= 0 || pvt->timerLatency <= pvt->delay) return 1;
+    n = ceil(pvt->timerLatency / pvt->delay);
+    return (n > MAX_BURST) ? MAX_BURST : (int)n;
+}
+
+static void resetStatistics(interposePvt *pvt)
+{
+    epicsMutexMustLock(pvt->statsLock);
+    pvt->nChars = 0;
+    pvt->nWrites = 0;
+    pvt->nIntervals = 0;
+    pvt->sumInterval = 0;
+    pvt->minInterval = 0;
+    pvt->maxInterval = 0;
+    epicsMutexUnlock(pvt->statsLock);
+}
+
+/* Called before each lower level write, lastN characters after the last */
+static void countWrite(interposePvt *pvt, double *lastTime, size_t lastN,
+    size_t n)
+{
+    double now = pacingNow();
+
+    epicsMutexMustLock(pvt->statsLock);
+    if (lastN > 0) {
+        double interval = (now - *lastTime) / lastN;
+        if (pvt->nIntervals == 0 || interval < pvt->minInterval)
+            pvt->minInterval = interval;
+        if (interval > pvt->maxInterval) pvt->maxInterval = interval;
+        pvt->sumInterval += now - *lastTime;
+        pvt->nIntervals += (unsigned long)lastN;
+    }
+    pvt->nWrites++;
+    pvt->nChars += (unsigned long)n;
+    epicsMutexUnlock(pvt->statsLock);
+    *lastTime = now;
+}
+
 /* asynOctet methods */
 static asynStatus writeIt(void *ppvt, asynUser *pasynUser,
     const char *data, size_t numchars, size_t *nbytesTransfered)
 {
     interposePvt *pvt = (interposePvt *)ppvt;
-    size_t n;
+    size_t n = 0;
     size_t transfered = 0;
     asynStatus status = asynSuccess;
+    double lastTime = 0;
+    double deadline;
+    size_t burst;
     
+    if (pvt->pacing == pacingSleep) {
+        while (transfered < numchars) {
+            /* write one char at a time */
+            countWrite(pvt, &lastTime, n, 1);
+            status = pvt->pasynOctetDrv->write(pvt->octetPvt,
+                pasynUser, data, 1, &n);
+            if (status != asynSuccess) break;
+            /* delay */
+            epicsThreadSleep(pvt->delay);
+            transfered+=n;
+            data+=n;
+        }
+        *nbytesTransfered = transfered;
+        return status;
+    }
+    /* Each write is due a multiple of delay after the first, and the first
+     * is due delay after the end of the previous message, so one late
+     * wakeup does not push back the characters that follow */
+    burst = burstSize(pvt);
+    deadline = pacingNow();
+    if (pvt->nextTime > deadline) deadline = pvt->nextTime;
     while (transfered < numchars) {
-        /* write one char at a time */
+        size_t nchars = numchars - transfered;
+        if (nchars > burst) nchars = burst;
+        sleepUntil(deadline);
+        countWrite(pvt, &lastTime, n, nchars);
         status = pvt->pasynOctetDrv->write(pvt->octetPvt,
-            pasynUser, data, 1, &n);
+            pasynUser, data, nchars, &n);
         if (status != asynSuccess) break;
-        /* delay */
-        epicsThreadSleep(pvt->delay);
+        deadline += n * pvt->delay;
         transfered+=n;
         data+=n;
     }
+    pvt->nextTime = deadline;
     *nbytesTransfered = transfered;
     return status;
 }
@@ -129,6 +297,55 @@ static asynOctet octet = {
     setInputEos, getInputEos, setOutputEos, getOutputEos
 };
 
+/* asynCommon methods */
+static void reportIt(void *ppvt, FILE *fp, int details)
+{
+    interposePvt *pvt = (interposePvt *)ppvt;
+    unsigned long nChars, nWrites, nIntervals;
+    double sumInterval, minInterval, maxInterval;
+
+    /* For an address asynManager has already reported the port */
+    if (!pvt->perAddress)
+        pvt->pasynCommonDrv->report(pvt->commonPvt, fp, details);
+    if (details < 1) return;
+    fprintf(fp, "    asynInterposeDelay addr %d pacing %s delay %g burst %d"
+        " timerLatency %g\n", pvt->addr,
+        (pvt->pacing == pacingClock) ? "clock" : "sleep",
+        pvt->delay, (pvt->pacing == pacingClock) ? burstSize(pvt) : 1,
+        pvt->timerLatency);
+    epicsMutexMustLock(pvt->statsLock);
+    nChars = pvt->nChars;
+    nWrites = pvt->nWrites;
+    nIntervals = pvt->nIntervals;
+    sumInterval = pvt->sumInterval;
+    minInterval = pvt->minInterval;
+    maxInterval = pvt->maxInterval;
+    epicsMutexUnlock(pvt->statsLock);
+    fprintf(fp, "        characters %lu writes %lu", nChars, nWrites);
+    if (nIntervals > 0)
+        fprintf(fp, " interval requested %g achieved mean %g min %g max %g",
+            pvt->delay, sumInterval / nIntervals, minInterval, maxInterval);
+    fprintf(fp, "\n");
+}
+
+static asynStatus connectIt(void *ppvt, asynUser *pasynUser)
+{
+    interposePvt *pvt = (interposePvt *)ppvt;
+
+    return pvt->pasynCommonDrv->connect(pvt->commonPvt, pasynUser);
+}
+
+static asynStatus disconnectIt(void *ppvt, asynUser *pasynUser)
+{
+    interposePvt *pvt = (interposePvt *)ppvt;
+
+    return pvt->pasynCommonDrv->disconnect(pvt->commonPvt, pasynUser);
+}
+
+static asynCommon common = {
+    reportIt, connectIt, disconnectIt
+};
+
 /* asynOption methods */
 
 static asynStatus
@@ -140,6 +357,15 @@ getOption(void *ppvt, asynUser *pasynUser,
         epicsSnprintf(val, valSize, "%g", pvt->delay);
         return asynSuccess;
     }
+    if (epicsStrCaseCmp(key, "pacing") == 0) {
+        epicsSnprintf(val, valSize, "%s",
+            (pvt->pacing == pacingClock) ? "clock" : "sleep");
+        return asynSuccess;
+    }
+    if (epicsStrCaseCmp(key, "burst") == 0) {
+        epicsSnprintf(val, valSize, "%d", pvt->burst);
+        return asynSuccess;
+    }
     if (pvt->pasynOptionDrv)
         return pvt->pasynOptionDrv->getOption(pvt->optionPvt,
             pasynUser, key, val, valSize);
@@ -157,6 +383,32 @@ setOption(void *ppvt, asynUser *pasynUser, const char *key, const char *val)
                 "Bad number %s", val);
             return asynError;
         }
+        resetStatistics(pvt);
+        return asynSuccess;
+    }
+    if (epicsStrCaseCmp(key, "pacing") == 0) {
+        if (epicsStrCaseCmp(val, "sleep") == 0) {
+            pvt->pacing = pacingSleep;
+        } else if (epicsStrCaseCmp(val, "clock") == 0) {
+            pvt->pacing = pacingClock;
+            pvt->nextTime = 0;
+        } else {
+            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                "Bad pacing %s, must be sleep or clock", val);
+            return asynError;
+        }
+        resetStatistics(pvt);
+        return asynSuccess;
+    }
+    if (epicsStrCaseCmp(key, "burst") == 0) {
+        int burst;
+        if(sscanf(val, "%d", &burst) != 1 || burst < 0 || burst > MAX_BURST) {
+            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                "Bad burst %s, must be 0 to %d", val, MAX_BURST);
+            return asynError;
+        }
+        pvt->burst = burst;
+        resetStatistics(pvt);
         return asynSuccess;
     }
     if (pvt->pasynOptionDrv)
@@ -177,17 +429,63 @@ asynInterposeDelay(const char *portName, int addr, double delay)
 {
     interposePvt *pvt;
     asynStatus status;
+    asynUser *pasynUser;
+    int isMulti;
+    asynInterface *pcommonasynInterface;
     asynInterface *poctetasynInterface;
     asynInterface *poptionasynInterface;
 
+    pasynUser = pasynManager->createAsynUser(0, 0);
+    status = pasynManager->isMultiDevice(pasynUser, portName, &isMulti);
+    if (status != asynSuccess) {
+        printf("%s\n", pasynUser->errorMessage);
+        pasynManager->freeAsynUser(pasynUser);
+        return -1;
+    }
+    /* An interface without a lower level could not be removed again */
+    status = pasynManager->connectDevice(pasynUser, portName, addr);
+    if ((status != asynSuccess)
+    || !pasynManager->findInterface(pasynUser, asynCommonType, 1)
+    || !pasynManager->findInterface(pasynUser, asynOctetType, 1)) {
+        printf("%s has no asynCommon and asynOctet to interpose.\n", portName);
+        pasynManager->freeAsynUser(pasynUser);
+        return -1;
+    }
+    pasynManager->disconnect(pasynUser);
+    pasynManager->freeAsynUser(pasynUser);
     pvt = callocMustSucceed(1, sizeof(interposePvt), "asynInterposeDelay");
+    pvt->addr = addr;
+    /* interposeInterface ignores addr unless the port is multi-device */
+    pvt->perAddress = isMulti && (addr >= 0);
+    pvt->statsLock = epicsMutexMustCreate();
+
+    /* asynCommon is interposed only to add the timing to the report.
+     * It is interposed first, so a failure with asynOctet can put it back
+     * before asynOctet is changed */
+    pvt->common.interfaceType = asynCommonType;
+    pvt->common.pinterface = &common;
+    pvt->common.drvPvt = pvt;
+    status = pasynManager->interposeInterface(portName, addr,
+        &pvt->common, &pcommonasynInterface);
+    if ((status!=asynSuccess) || !pcommonasynInterface) {
+        printf("%s interposeInterface asynCommonType failed.\n", portName);
+        epicsMutexDestroy(pvt->statsLock);
+        free(pvt);
+        return -1;
+    }
+    pvt->pasynCommonDrv = (asynCommon *)pcommonasynInterface->pinterface;
+    pvt->commonPvt = pcommonasynInterface->drvPvt;
+
     pvt->octet.interfaceType = asynOctetType;
     pvt->octet.pinterface = &octet;
     pvt->octet.drvPvt = pvt;
     status = pasynManager->interposeInterface(portName, addr,
         &pvt->octet, &poctetasynInterface);
     if ((status!=asynSuccess) || !poctetasynInterface) {
-	printf("%s interposeInterface asynOctetType failed.\n", portName);
+        printf("%s interposeInterface asynOctetType failed.\n", portName);
+        pasynManager->interposeInterface(portName, addr,
+            pcommonasynInterface, 0);
+        epicsMutexDestroy(pvt->statsLock);
         free(pvt);
         return -1;
     }
@@ -206,8 +504,10 @@ asynInterposeDelay(const char *portName, int addr, double delay)
         }
     } else {
         pvt->pasynOptionDrv = (asynOption *)poptionasynInterface->pinterface;
+        pvt->optionPvt = poptionasynInterface->drvPvt;
     }
     pvt->delay = delay;
+    pvt->timerLatency = measureTimerLatency();
     return 0;
 }
 
@@ -0,0 +1,23 @@
+/*asynInterposeDelay.h*/
+/***********************************************************************
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+#ifndef asynInterposeDelay_H
+#define asynInterposeDelay_H
+
+#include <shareLib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+epicsShareFunc int asynInterposeDelay(
+    const char *portName,int addr, double delay);
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+#endif /* asynInterposeDelay_H */
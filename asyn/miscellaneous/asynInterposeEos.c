@@ -28,10 +28,12 @@
 #include <epicsExport.h>
 #include "asynDriver.h"
 #include "asynOctet.h"
+#include "asynOption.h"
 #include "asynInterposeEos.h"
 
-#define START_OUTPUT_SIZE 100
 #define INPUT_SIZE        2048
+#define INPUT_SIZE_MAX    (16*1024*1024)
+#define EOS_MAX_LEN       32
 
 typedef struct eosPvt {
     char          *portName;
@@ -39,18 +41,23 @@ typedef struct eosPvt {
     asynOctet     *poctet;  /* The methods we're overriding */
     void          *octetPvt;
     asynUser      *pasynUser;     /* For connect/disconnect reporting */
+    asynInterface optionInterface;
+    asynOption    *poption; /* asynOption of the lower level, if any */
+    void          *optionPvt;
+    asynInterface peekInterface;
     int           processEosIn;
     size_t        inBufSize;
     char          *inBuf;
     unsigned int  inBufHead;
     unsigned int  inBufTail;
-    char          eosIn[2];
+    char          eosIn[EOS_MAX_LEN];
+    int           eosInNext[EOS_MAX_LEN]; /* Match length after a mismatch */
     int           eosInLen;
     int           eosInMatch;
+    size_t        peekData;     /* Bytes before the EOS found by the last peek */
+    size_t        peekEosEnd;   /* Bytes through the end of that EOS, 0 if none */
     int           processEosOut;
-    size_t        outBufSize;
-    char          *outBuf;
-    char          eosOut[2];
+    char          eosOut[EOS_MAX_LEN];
     int           eosOutLen;
 }eosPvt;
     
@@ -75,17 +82,56 @@ static asynStatus setOutputEos(void *ppvt,asynUser *pasynUser,
     const char *eos,int eoslen);
 static asynStatus getOutputEos(void *ppvt,asynUser *pasynUser,
     char *eos,int eossize,int *eoslen);
+static asynStatus writevIt(void *ppvt,asynUser *pasynUser,
+    const asynOctetIovec *iov,int iovcnt,size_t *nbytesTransfered);
 static asynOctet octet = {
     writeIt,readIt,flushIt,
     registerInterruptUser, cancelInterruptUser,
-    setInputEos,getInputEos,setOutputEos,getOutputEos
+    setInputEos,getInputEos,setOutputEos,getOutputEos,
+    writevIt
 };
+
+/* asynOption methods */
+static asynStatus setOption(void *ppvt,asynUser *pasynUser,
+    const char *key,const char *val);
+static asynStatus getOption(void *ppvt,asynUser *pasynUser,
+    const char *key,char *val,int valSize);
+static asynOption option = { setOption, getOption };
+
+/* asynOctetPeek methods */
+static asynStatus peekIt(void *ppvt,asynUser *pasynUser,size_t minchars,
+    const char **data,size_t *navailable,int *eomReason);
+static asynStatus consumeIt(void *ppvt,asynUser *pasynUser,size_t nchars);
+static asynOctetPeek octetPeek = { peekIt, consumeIt };
 
+/*
+ * Called when an interposeInterface after the first one fails.
+ * The asynOctet and asynOption of the lower level are put back, but an
+ * interface that had no lower level can't be removed again, so peosPvt is
+ * kept and from now on only passes calls down.
+ */
+static void undoInterpose(eosPvt *peosPvt,int addr,
+    asynInterface *plowerOctet,asynInterface *plowerOption)
+{
+    peosPvt->processEosIn = 0;
+    peosPvt->processEosOut = 0;
+    if(plowerOctet) {
+        pasynManager->interposeInterface(peosPvt->portName,addr,plowerOctet,0);
+    }
+    if(plowerOption) {
+        pasynManager->interposeInterface(peosPvt->portName,addr,plowerOption,0);
+    }
+    pasynManager->exceptionCallbackRemove(peosPvt->pasynUser);
+    pasynManager->freeAsynUser(peosPvt->pasynUser);
+    peosPvt->pasynUser = 0;
+}
+
 epicsShareFunc int asynInterposeEosConfig(const char *portName,int addr,
     int processEosIn,int processEosOut)
 {
     eosPvt        *peosPvt;
-    asynInterface *plowerLevelInterface;
+    asynInterface *plowerOctet;
+    asynInterface *plowerOption = 0;
     asynStatus    status;
     asynUser      *pasynUser;
     size_t        len;
@@ -114,27 +160,50 @@ epicsShareFunc int asynInterposeEosConfig(const char *portName,int addr,
         free(peosPvt);
         return -1;
     }
+    peosPvt->processEosIn = processEosIn;
+    if(processEosIn) {
+        peosPvt->inBuf = callocMustSucceed(1,INPUT_SIZE,
+            "asynInterposeEosConfig");
+        peosPvt->inBufSize = INPUT_SIZE;
+    }
+    peosPvt->processEosOut = processEosOut;
     status = pasynManager->interposeInterface(portName,addr,
-       &peosPvt->eosInterface,&plowerLevelInterface);
+       &peosPvt->eosInterface,&plowerOctet);
     if(status!=asynSuccess) {
         printf("%s interposeInterface failed\n",portName);
         pasynManager->exceptionCallbackRemove(pasynUser);
         pasynManager->freeAsynUser(pasynUser);
+        free(peosPvt->inBuf);
         free(peosPvt);
         return -1;
     }
-    peosPvt->poctet = (asynOctet *)plowerLevelInterface->pinterface;
-    peosPvt->octetPvt = plowerLevelInterface->drvPvt;
-    peosPvt->processEosIn = processEosIn;
-    if(processEosIn) {
-        peosPvt->inBuf = callocMustSucceed(1,INPUT_SIZE,
-            "asynInterposeEosConfig");
-        peosPvt->inBufSize = INPUT_SIZE;
+    peosPvt->poctet = (asynOctet *)plowerOctet->pinterface;
+    peosPvt->octetPvt = plowerOctet->drvPvt;
+    if(!processEosIn) return(0);
+    /* asynOption handles readAheadSize and passes other keys down */
+    peosPvt->optionInterface.interfaceType = asynOptionType;
+    peosPvt->optionInterface.pinterface = &option;
+    peosPvt->optionInterface.drvPvt = peosPvt;
+    status = pasynManager->interposeInterface(portName,addr,
+       &peosPvt->optionInterface,&plowerOption);
+    if(status!=asynSuccess) {
+        printf("%s interposeInterface failed for asynOption\n",portName);
+        undoInterpose(peosPvt,addr,plowerOctet,0);
+        return -1;
     }
-    peosPvt->processEosOut = processEosOut;
-    if(processEosOut) {
-        peosPvt->outBuf = pasynManager->memMalloc(START_OUTPUT_SIZE);
-        peosPvt->outBufSize = START_OUTPUT_SIZE;
+    if(plowerOption) {
+        peosPvt->poption = (asynOption *)plowerOption->pinterface;
+        peosPvt->optionPvt = plowerOption->drvPvt;
+    }
+    peosPvt->peekInterface.interfaceType = asynOctetPeekType;
+    peosPvt->peekInterface.pinterface = &octetPeek;
+    peosPvt->peekInterface.drvPvt = peosPvt;
+    status = pasynManager->interposeInterface(portName,addr,
+       &peosPvt->peekInterface,0);
+    if(status!=asynSuccess) {
+        printf("%s interposeInterface failed for asynOctetPeek\n",portName);
+        undoInterpose(peosPvt,addr,plowerOctet,plowerOption);
+        return -1;
     }
     return(0);
 }
@@ -147,39 +216,116 @@ static void eosInExceptionHandler(asynUser *pasynUser,asynException exception)
         peosPvt->inBufHead = 0;
         peosPvt->inBufTail = 0;
         peosPvt->eosInMatch = 0;
+        peosPvt->peekEosEnd = 0;
     }
 }
 
 /* asynOctet methods */
-static asynStatus writeIt(void *ppvt,asynUser *pasynUser,
-    const char *data,size_t numchars,size_t *nbytesTransfered)
+/*
+ * The output EOS is passed down as one more buffer so that the
+ * message itself is never copied.
+ */
+static asynStatus writevIt(void *ppvt,asynUser *pasynUser,
+    const asynOctetIovec *iov,int iovcnt,size_t *nbytesTransfered)
 {
-    eosPvt     *peosPvt = (eosPvt *)ppvt;
-    asynStatus status;
-    size_t     nbytesActual = 0;
+    eosPvt         *peosPvt = (eosPvt *)ppvt;
+    asynOctetIovec localIov[ASYN_OCTET_IOV_MAX];
+    asynOctetIovec *piov = localIov;
+    asynStatus     status;
+    size_t         numchars = 0;
+    size_t         nbytesActual = 0;
+    size_t         nleft;
+    int            n, i;
 
     if(!peosPvt->processEosOut) {
-        return peosPvt->poctet->write(peosPvt->octetPvt,
-            pasynUser,data,numchars,nbytesTransfered);
+        return pasynOctetBase->writeGather(peosPvt->poctet,peosPvt->octetPvt,
+            pasynUser,iov,iovcnt,nbytesTransfered);
+    }
+    if(iovcnt>=ASYN_OCTET_IOV_MAX) {
+        piov = pasynManager->memMalloc((iovcnt+1)*sizeof(asynOctetIovec));
     }
-    if(peosPvt->outBufSize<(numchars + peosPvt->eosOutLen)) {
-        pasynManager->memFree(peosPvt->outBuf,peosPvt->outBufSize);
-        peosPvt->outBufSize = numchars + peosPvt->eosOutLen;
-        peosPvt->outBuf = pasynManager->memMalloc(peosPvt->outBufSize);
+    for(n=0; n<iovcnt; n++) {
+        piov[n] = iov[n];
+        numchars += iov[n].numchars;
     }
-    memcpy(peosPvt->outBuf,data,numchars);
     if(peosPvt->eosOutLen>0) {
-        memcpy(&peosPvt->outBuf[numchars],peosPvt->eosOut,peosPvt->eosOutLen);
+        piov[n].data = peosPvt->eosOut;
+        piov[n].numchars = peosPvt->eosOutLen;
+        n++;
     }
-    status = peosPvt->poctet->write(peosPvt->octetPvt, pasynUser,
-         peosPvt->outBuf,(numchars + peosPvt->eosOutLen),&nbytesActual);
-    if (status!=asynError)
-        asynPrintIO(pasynUser,ASYN_TRACEIO_FILTER,peosPvt->outBuf,nbytesActual,
+    status = pasynOctetBase->writeGather(peosPvt->poctet,peosPvt->octetPvt,
+        pasynUser,piov,n,&nbytesActual);
+    if (status!=asynError) {
+        nleft = nbytesActual;
+        for(i=0; i<n && nleft>0; i++) {
+            size_t nprint = (piov[i].numchars<nleft) ? piov[i].numchars : nleft;
+            asynPrintIO(pasynUser,ASYN_TRACEIO_FILTER,piov[i].data,nprint,
                 "%s wrote\n",peosPvt->portName);
+            nleft -= nprint;
+        }
+    }
+    if(piov!=localIov) {
+        pasynManager->memFree(piov,(iovcnt+1)*sizeof(asynOctetIovec));
+    }
     *nbytesTransfered = (nbytesActual>numchars) ? numchars : nbytesActual;
     return status;
 }
 
+static asynStatus writeIt(void *ppvt,asynUser *pasynUser,
+    const char *data,size_t numchars,size_t *nbytesTransfered)
+{
+    eosPvt         *peosPvt = (eosPvt *)ppvt;
+    asynOctetIovec iov;
+
+    if(!peosPvt->processEosOut) {
+        return peosPvt->poctet->write(peosPvt->octetPvt,
+            pasynUser,data,numchars,nbytesTransfered);
+    }
+    iov.data = data;
+    iov.numchars = numchars;
+    return writevIt(ppvt,pasynUser,&iov,1,nbytesTransfered);
+}
+
+/*
+ * Look for the input EOS in the next n buffered characters.
+ * peosPvt->eosInMatch carries a partial match over from earlier characters,
+ * and eosInNext handles EOS strings like "eef" in input like "eeef".
+ * Sets *nScan to the number of characters up to and including the end of
+ * the EOS and returns 1, or sets it to n and returns 0 if there is no
+ * complete EOS.
+ */
+static int findEos(eosPvt *peosPvt,const char *buf,size_t n,size_t *nScan)
+{
+    const char *eos = peosPvt->eosIn;
+    int        match = peosPvt->eosInMatch;
+    size_t     i = 0;
+
+    while(i<n) {
+        if(match==0) {
+            /* memchr finds the next possible start much faster than a loop */
+            const char *pfirst = memchr(buf+i,eos[0],n-i);
+            if(!pfirst) {
+                i = n;
+                break;
+            }
+            i = pfirst - buf + 1;
+            match = 1;
+        } else {
+            char c = buf[i++];
+            while(match>0 && c!=eos[match]) match = peosPvt->eosInNext[match];
+            if(c==eos[match]) match++;
+        }
+        if(match==peosPvt->eosInLen) {
+            peosPvt->eosInMatch = 0;
+            *nScan = i;
+            return 1;
+        }
+    }
+    peosPvt->eosInMatch = match;
+    *nScan = n;
+    return 0;
+}
+
 static asynStatus readIt(void *ppvt,asynUser *pasynUser,
     char *data,size_t maxchars,size_t *nbytesTransfered,int *eomReason)
 {
@@ -192,34 +338,29 @@ static asynStatus readIt(void *ppvt,asynUser *pasynUser,
         return peosPvt->poctet->read(peosPvt->octetPvt,
             pasynUser,data,maxchars,nbytesTransfered,eomReason);
     }
+    peosPvt->peekEosEnd = 0;
     for (;;) {
         if ((peosPvt->inBufTail != peosPvt->inBufHead)) {
-            char c = *data++ = peosPvt->inBuf[peosPvt->inBufTail++];
-            nRead++;
-            if (peosPvt->eosInLen > 0) {
-                if (c == peosPvt->eosIn[peosPvt->eosInMatch]) {
-                    if (++peosPvt->eosInMatch == peosPvt->eosInLen) {
-                        peosPvt->eosInMatch = 0;
-                        nRead -= peosPvt->eosInLen;
-                        data -= peosPvt->eosInLen;
-                        *(data+1) = 0;
-                        eom |= ASYN_EOM_EOS;
-                        break;
-                    }
-                } else {
-                    /*
-                     * Resynchronize the search.  Since the driver
-                     * allows a maximum two-character EOS it doesn't
-                     * have to worry about cases like:
-                     *    End-of-string is "eeef"
-                     *    Input stream so far is "eeeeeeeee"
-                     */
-                    if (c == peosPvt->eosIn[0]) {
-                        peosPvt->eosInMatch = 1;
-                    } else {
-                        peosPvt->eosInMatch = 0;
-                    }
-                }
+            const char *pbuf = &peosPvt->inBuf[peosPvt->inBufTail];
+            size_t     n = peosPvt->inBufHead - peosPvt->inBufTail;
+            int        gotEos = 0;
+
+            /* Copy whole runs up to the EOS or maxchars */
+            if (n > maxchars - nRead) n = maxchars - nRead;
+            if (peosPvt->eosInLen > 0)
+                gotEos = findEos(peosPvt,pbuf,n,&n);
+            memcpy(data,pbuf,n);
+            peosPvt->inBufTail += (unsigned int)n;
+            data += n;
+            nRead += n;
+            if (gotEos) {
+                /* Part of the EOS may have been returned by an earlier read */
+                size_t nEos = peosPvt->eosInLen;
+                if (nEos > nRead) nEos = nRead;
+                nRead -= nEos;
+                data -= nEos;
+                eom |= ASYN_EOM_EOS;
+                break;
             }
             if (nRead >= maxchars)  {
                 eom = ASYN_EOM_CNT;
@@ -264,6 +405,7 @@ static asynStatus flushIt(void *ppvt,asynUser *pasynUser)
     peosPvt->inBufHead = 0;
     peosPvt->inBufTail = 0;
     peosPvt->eosInMatch = 0;
+    peosPvt->peekEosEnd = 0;
     return peosPvt->poctet->flush(peosPvt->octetPvt,pasynUser);
 }
 
@@ -296,17 +438,26 @@ static asynStatus setInputEos(void *ppvt,asynUser *pasynUser,
     }
     asynPrintIO(pasynUser,ASYN_TRACE_FLOW,eos,eoslen,
             "%s set Eos %d\n",peosPvt->portName, eoslen);
-    switch (eoslen) {
-    default:
+    if(eoslen<0 || eoslen>EOS_MAX_LEN) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                         "%s illegal eoslen %d", peosPvt->portName,eoslen);
         return asynError;
-    case 2: peosPvt->eosIn[1] = eos[1]; /* fall through to case 1 */
-    case 1: peosPvt->eosIn[0] = eos[0]; break;
-    case 0: break;
+    }
+    memcpy(peosPvt->eosIn,eos,eoslen);
+    /* eosInNext[i] is the length of the longest EOS prefix that is also a
+     * proper suffix of eosIn[0..i-1], i.e. where to resume after a mismatch */
+    if(eoslen>0) {
+        int i, k = 0;
+        peosPvt->eosInNext[0] = 0;
+        for(i=1; i<eoslen; i++) {
+            peosPvt->eosInNext[i] = k;
+            while(k>0 && eos[i]!=eos[k]) k = peosPvt->eosInNext[k];
+            if(eos[i]==eos[k]) k++;
+        }
     }
     peosPvt->eosInLen = eoslen;
     peosPvt->eosInMatch = 0;
+    peosPvt->peekEosEnd = 0;
     return asynSuccess;
 }
 
@@ -325,15 +476,7 @@ static asynStatus getInputEos(void *ppvt,asynUser *pasynUser,
                                 peosPvt->portName,eossize,peosPvt->eosInLen);
         return(asynError);
     }
-    switch (peosPvt->eosInLen) {
-    default:
-        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-            "%s illegal peosPvt->eosInLen %d", peosPvt->portName,peosPvt->eosInLen);
-        return asynError;
-    case 2: eos[1] = peosPvt->eosIn[1]; /* fall through to case 1 */
-    case 1: eos[0] = peosPvt->eosIn[0]; break;
-    case 0: break;
-    }
+    memcpy(eos,peosPvt->eosIn,peosPvt->eosInLen);
     *eoslen = peosPvt->eosInLen;
     if(peosPvt->eosInLen<eossize) eos[peosPvt->eosInLen] = 0;
     asynPrintIO(pasynUser, ASYN_TRACE_FLOW, eos, *eoslen,
@@ -349,15 +492,12 @@ static asynStatus setOutputEos(void *ppvt,asynUser *pasynUser,
     assert(peosPvt);
     asynPrintIO(pasynUser,ASYN_TRACE_FLOW,eos,eoslen,
             "%s set Eos %d\n",peosPvt->portName, eoslen);
-    switch (eoslen) {
-    default:
+    if(eoslen<0 || eoslen>EOS_MAX_LEN) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                         "%s illegal eoslen %d", peosPvt->portName,eoslen);
         return asynError;
-    case 2: peosPvt->eosOut[1] = eos[1]; /* fall through to case 1 */
-    case 1: peosPvt->eosOut[0] = eos[0]; break;
-    case 0: break;
     }
+    memcpy(peosPvt->eosOut,eos,eoslen);
     peosPvt->eosOutLen = eoslen;
     return asynSuccess;
 }
@@ -374,21 +514,204 @@ static asynStatus getOutputEos(void *ppvt,asynUser *pasynUser,
                                 peosPvt->portName,eossize,peosPvt->eosOutLen);
         return(asynError);
     }
-    switch (peosPvt->eosOutLen) {
-    default:
-        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-            "%s illegal peosPvt->eosOutLen %d", peosPvt->portName,peosPvt->eosOutLen);
-        return asynError;
-    case 2: eos[1] = peosPvt->eosOut[1]; /* fall through to case 1 */
-    case 1: eos[0] = peosPvt->eosOut[0]; break;
-    case 0: break;
-    }
+    memcpy(eos,peosPvt->eosOut,peosPvt->eosOutLen);
     *eoslen = peosPvt->eosOutLen;
     asynPrintIO(pasynUser, ASYN_TRACE_FLOW, eos, *eoslen,
             "%s get Eos %d\n", peosPvt->portName, *eoslen);
     return asynSuccess;
 }
 
+/* asynOctetPeek methods */
+/*
+ * Unlike readIt this keeps the bytes that are already buffered and reads
+ * behind them, so a parser can wait for a complete token.
+ * Like readIt it stops at the input EOS, which is not part of the bytes
+ * returned. The buffered bytes are searched without changing eosInMatch,
+ * since they are not taken until consumeIt.
+ */
+static asynStatus peekIt(void *ppvt,asynUser *pasynUser,size_t minchars,
+    const char **data,size_t *navailable,int *eomReason)
+{
+    eosPvt     *peosPvt = (eosPvt *)ppvt;
+    asynStatus status = asynSuccess;
+    size_t     thisRead;
+    size_t     nbuffered;
+    size_t     nScan = 0;
+    int        match = peosPvt->eosInMatch;
+    int        gotEos = 0;
+    int        eom = 0;
+
+    if(!peosPvt->processEosIn) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "%s does not process the input EOS",peosPvt->portName);
+        return asynError;
+    }
+    if(minchars==0) minchars = 1;
+    if(minchars>peosPvt->inBufSize) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "%s peek of %llu bytes exceeds readAheadSize %llu",
+            peosPvt->portName,(epicsUInt64)minchars,
+            (epicsUInt64)peosPvt->inBufSize);
+        return asynError;
+    }
+    for(;;) {
+        nbuffered = peosPvt->inBufHead - peosPvt->inBufTail;
+        /* nScan bytes after inBufTail have already been searched */
+        if(peosPvt->eosInLen>0 && nScan<nbuffered) {
+            size_t n;
+            gotEos = findEos(peosPvt,&peosPvt->inBuf[peosPvt->inBufTail+nScan],
+                nbuffered-nScan,&n);
+            nScan += n;
+            if(gotEos) break;
+        }
+        if(nbuffered>=minchars || eom) break;
+        if(peosPvt->inBufTail>0) {
+            memmove(peosPvt->inBuf,&peosPvt->inBuf[peosPvt->inBufTail],nbuffered);
+            peosPvt->inBufHead -= peosPvt->inBufTail;
+            peosPvt->inBufTail = 0;
+        }
+        status = peosPvt->poctet->read(peosPvt->octetPvt,pasynUser,
+            &peosPvt->inBuf[peosPvt->inBufHead],
+            peosPvt->inBufSize - peosPvt->inBufHead,&thisRead,&eom);
+        if(status==asynSuccess) {
+            asynPrintIO(pasynUser,ASYN_TRACEIO_FILTER,
+                &peosPvt->inBuf[peosPvt->inBufHead],thisRead,
+                "%s read %llu bytes eom=%d\n",peosPvt->portName,
+                (epicsUInt64)thisRead, eom);
+            eom &= ~ASYN_EOM_CNT;
+        } else {
+           asynPrint(pasynUser, ASYN_TRACE_WARNING, "%s read from low-level driver returned %d\n",
+               peosPvt->portName, status);
+        }
+        if(status!=asynSuccess || thisRead==0) break;
+        peosPvt->inBufHead += (unsigned int)thisRead;
+    }
+    peosPvt->eosInMatch = match;
+    if(gotEos) {
+        /* Part of the EOS may have been returned by an earlier read */
+        peosPvt->peekData = (nScan>(size_t)peosPvt->eosInLen) ?
+            nScan - peosPvt->eosInLen : 0;
+        peosPvt->peekEosEnd = nScan;
+        eom |= ASYN_EOM_EOS;
+    } else {
+        peosPvt->peekData = peosPvt->inBufHead - peosPvt->inBufTail;
+        peosPvt->peekEosEnd = 0;
+    }
+    *data = &peosPvt->inBuf[peosPvt->inBufTail];
+    *navailable = peosPvt->peekData;
+    if(eomReason) *eomReason = eom;
+    return status;
+}
+
+/*
+ * Taking all the bytes before the EOS found by the last peek also
+ * discards the EOS, so the next peek or read starts with the next message.
+ */
+static asynStatus consumeIt(void *ppvt,asynUser *pasynUser,size_t nchars)
+{
+    eosPvt *peosPvt = (eosPvt *)ppvt;
+    size_t nScan = 0;
+    size_t n;
+
+    if(nchars > peosPvt->inBufHead - peosPvt->inBufTail) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "%s consume %llu bytes but only %u are buffered",
+            peosPvt->portName,(epicsUInt64)nchars,
+            peosPvt->inBufHead - peosPvt->inBufTail);
+        return asynError;
+    }
+    if(peosPvt->peekEosEnd>0 && nchars==peosPvt->peekData) {
+        peosPvt->inBufTail += (unsigned int)peosPvt->peekEosEnd;
+        peosPvt->eosInMatch = 0;
+    } else {
+        /* Keep the partial EOS match at the end of the bytes taken */
+        while(peosPvt->eosInLen>0 && nScan<nchars) {
+            findEos(peosPvt,&peosPvt->inBuf[peosPvt->inBufTail+nScan],
+                nchars-nScan,&n);
+            nScan += n;
+        }
+        peosPvt->inBufTail += (unsigned int)nchars;
+    }
+    peosPvt->peekEosEnd = 0;
+    return asynSuccess;
+}
+
+/* asynOption methods */
+static asynStatus setReadAheadSize(eosPvt *peosPvt,asynUser *pasynUser,
+    const char *val)
+{
+    unsigned int nbuffered = peosPvt->inBufHead - peosPvt->inBufTail;
+    unsigned long size;
+    char *inBuf;
+
+    if(!peosPvt->processEosIn) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "%s does not process the input EOS",peosPvt->portName);
+        return asynError;
+    }
+    if(sscanf(val,"%lu",&size)!=1 || size<1 || size>INPUT_SIZE_MAX) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "Bad readAheadSize \"%s\"",val);
+        return asynError;
+    }
+    if(size<nbuffered) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "readAheadSize %lu is less than the %u bytes buffered",
+            size,nbuffered);
+        return asynError;
+    }
+    inBuf = callocMustSucceed(1,size,"asynInterposeEos:setOption");
+    memcpy(inBuf,&peosPvt->inBuf[peosPvt->inBufTail],nbuffered);
+    free(peosPvt->inBuf);
+    peosPvt->inBuf = inBuf;
+    peosPvt->inBufSize = size;
+    peosPvt->inBufTail = 0;
+    peosPvt->inBufHead = nbuffered;
+    asynPrint(pasynUser,ASYN_TRACE_FLOW,"%s readAheadSize %lu\n",
+        peosPvt->portName,size);
+    return asynSuccess;
+}
+
+static asynStatus setOption(void *ppvt,asynUser *pasynUser,
+    const char *key,const char *val)
+{
+    eosPvt *peosPvt = (eosPvt *)ppvt;
+
+    if(epicsStrCaseCmp(key,"readAheadSize")==0) {
+        return setReadAheadSize(peosPvt,pasynUser,val);
+    }
+    if(peosPvt->poption) {
+        return peosPvt->poption->setOption(peosPvt->optionPvt,
+            pasynUser,key,val);
+    }
+    epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+        "Can't handle option \"%s\"",key);
+    return asynError;
+}
+
+static asynStatus getOption(void *ppvt,asynUser *pasynUser,
+    const char *key,char *val,int valSize)
+{
+    eosPvt *peosPvt = (eosPvt *)ppvt;
+
+    if(epicsStrCaseCmp(key,"readAheadSize")==0) {
+        if(epicsSnprintf(val,valSize,"%llu",
+                (epicsUInt64)peosPvt->inBufSize)>=valSize) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                "Value buffer for key '%s' is too small.",key);
+            return asynError;
+        }
+        return asynSuccess;
+    }
+    if(peosPvt->poption) {
+        return peosPvt->poption->getOption(peosPvt->optionPvt,
+            pasynUser,key,val,valSize);
+    }
+    epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+        "Unsupported key \"%s\"",key);
+    return asynError;
+}
+
 /* register asynInterposeEosConfig*/
 static const iocshArg asynInterposeEosConfigArg0 =
     { "portName", iocshArgString };
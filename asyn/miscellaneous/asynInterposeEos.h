@@ -18,11 +18,31 @@
 #define asynInterposeEos_H
 
 #include <shareLib.h>
+#include "asynDriver.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif  /* __cplusplus */
 
+/*
+ * asynOctetPeek is registered by asynInterposeEos when it processes the
+ * input EOS.  It lets a caller look at the buffered input in place instead
+ * of copying it out with read.  The pointer returned by peek is valid until
+ * the next read, peek, consume or flush on the port, so the caller must hold
+ * the port (e.g. from a queueRequest callback or lockPort).
+ * peek reads from the lower level driver until at least minchars bytes are
+ * buffered or the input EOS is found. As with read, the bytes returned stop
+ * before the EOS and eomReason has ASYN_EOM_EOS set if it was found.
+ * consume discards nchars of the bytes returned by peek. Consuming all of the
+ * bytes before an EOS also discards the EOS.
+ */
+#define asynOctetPeekType "asynOctetPeek"
+typedef struct asynOctetPeek {
+    asynStatus (*peek)(void *drvPvt,asynUser *pasynUser,size_t minchars,
+                       const char **data,size_t *navailable,int *eomReason);
+    asynStatus (*consume)(void *drvPvt,asynUser *pasynUser,size_t nchars);
+}asynOctetPeek;
+
 epicsShareFunc int asynInterposeEosConfig(const char *portName,int addr,
                                          int processEosIn,int processEosOut);
 
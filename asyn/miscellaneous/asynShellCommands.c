@@ -1270,6 +1270,38 @@ static void asynSetQueueLockPortTimeoutCall(const iocshArgBuf * args) {
     asynSetQueueLockPortTimeout(portName,timeout);
 }
 
+static const iocshArg asynSetPortThreadsArg0 = {"portName", iocshArgString};
+static const iocshArg asynSetPortThreadsArg1 = {"nThreads", iocshArgInt};
+static const iocshArg *const asynSetPortThreadsArgs[] = {
+    &asynSetPortThreadsArg0,&asynSetPortThreadsArg1};
+static const iocshFuncDef asynSetPortThreadsDef =
+    {"asynSetPortThreads", 2, asynSetPortThreadsArgs};
+epicsShareFunc int
+ asynSetPortThreads(const char *portName, int nThreads)
+{
+    asynUser *pasynUser;
+    asynStatus status;
+
+    pasynUser = pasynManager->createAsynUser(0,0);
+    status = pasynManager->connectDevice(pasynUser,portName,-1);
+    if(status!=asynSuccess) {
+        printf("%s\n",pasynUser->errorMessage);
+        pasynManager->freeAsynUser(pasynUser);
+        return -1;
+    }
+    status = pasynManager->setPortThreads(pasynUser,nThreads);
+    if(status!=asynSuccess) {
+        printf("%s\n",pasynUser->errorMessage);
+    }
+    pasynManager->freeAsynUser(pasynUser);
+    return (status==asynSuccess) ? 0 : -1;
+}
+static void asynSetPortThreadsCall(const iocshArgBuf * args) {
+    const char *portName = args[0].sval;
+    int nThreads = args[1].ival;
+    asynSetPortThreads(portName,nThreads);
+}
+
 static void asynRegister(void)
 {
     static int firstTime = 1;
@@ -1286,6 +1318,7 @@ static void asynRegister(void)
     iocshRegister(&asynEnableDef,asynEnableCall);
     iocshRegister(&asynAutoConnectDef,asynAutoConnectCall);
     iocshRegister(&asynSetQueueLockPortTimeoutDef,asynSetQueueLockPortTimeoutCall);
+    iocshRegister(&asynSetPortThreadsDef,asynSetPortThreadsCall);
     iocshRegister(&asynOctetConnectDef,asynOctetConnectCall);
     iocshRegister(&asynOctetDisconnectDef,asynOctetDisconnectCall);
     iocshRegister(&asynOctetReadDef,asynOctetReadCall);
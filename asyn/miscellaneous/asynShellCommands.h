@@ -69,6 +69,8 @@ epicsShareFunc int
  asynSetMinTimerPeriod(double period);
 epicsShareFunc int
  asynSetQueueLockPortTimeout(const char *portName, double timeout);
+epicsShareFunc int
+ asynSetPortThreads(const char *portName, int nThreads);
 
 #ifdef __cplusplus
 }
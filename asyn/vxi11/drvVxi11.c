@@ -56,13 +56,42 @@
 #define FLAG_RECOVER_WITH_IFC   0x1
 #define FLAG_LOCK_DEVICES       0x2
 #define FLAG_NO_SRQ             0x4
+#define FLAG_CLIENT_PER_LINK    0x8
 
 #define DEFAULT_RPC_TIMEOUT 4
+
+/* Upper limits of the RPC latency histogram bins, in seconds */
+static const double rpcLatencyLimit[] = {
+    100e-6, 300e-6, 1e-3, 3e-3, 10e-3, 30e-3, 100e-3, 300e-3, 1.0};
+#define NUM_RPC_LATENCY_BINS \
+    ((int)(sizeof(rpcLatencyLimit)/sizeof(rpcLatencyLimit[0])) + 1)
+
+typedef struct vxiStats {
+    unsigned long rpcCount;
+    unsigned long rpcFailCount;
+    unsigned long readRpcCount;
+    unsigned long writeRpcCount;
+    double        bytesRead;
+    double        bytesWritten;
+    double        rpcSeconds;
+    unsigned long rpcLatency[NUM_RPC_LATENCY_BINS];
+}vxiStats;
+
+/*
+ * Reply to device_read that is decoded straight into the caller's buffer.
+ * bufSize is the room left in the buffer.
+ */
+typedef struct vxiReadResp {
+    Device_ReadResp devReadR;
+    u_int           bufSize;
+}vxiReadResp;
 
 typedef struct devLink {
     Device_Link lid;
     BOOL        connected;
     int         eos;
+    CLIENT      *rpcClient; /* own client if clientPerLink, else NULL */
+    vxiStats    *pstats;    /* allocated by the first RPC for the link */
 }devLink;
 typedef struct linkPrimary {
     devLink primary;
@@ -98,7 +127,13 @@ typedef struct vxiPort {
     BOOL          singleLinkInterrupt; /*Is there an unhandled interrupt */
     struct in_addr inAddr; /* ip address of gateway */
     CLIENT        *rpcClient; /* returned by clnttcp_create() */
+    BOOL          clientPerLink; /* each device link has its own rpcClient */
+    BOOL          portClientFailed; /* rpcClient failed in a device thread */
+    epicsMutexId  rpcLock;  /* rpcClient is shared by the port threads */
+    epicsMutexId  statsLock;
     unsigned long maxRecvSize; /* max. # of bytes accepted by link */
+    unsigned long readSize;  /* max. # of bytes per device_read, 0=no limit */
+    unsigned short serverPort;  /* 0 means ask the portmapper */
     unsigned short abortPort;   /* TCP port for abort channel */
     double        defTimeout;
     devLink       server;
@@ -121,18 +156,24 @@ static char *vxiError(Device_ErrorCode error);
 static unsigned long getIoTimeout(asynUser *pasynUser,vxiPort *ppvxiPort);
 static BOOL vxiIsPortConnected(vxiPort * pvxiPort,asynUser *pasynUser);
 static void vxiDisconnectException(vxiPort *pvxiPort,int addr);
-static BOOL vxiCreateDeviceLink(vxiPort * pvxiPort,
+static CLIENT *vxiCreateClient(vxiPort *pvxiPort);
+static BOOL vxiCreateDeviceLink(vxiPort * pvxiPort,CLIENT *rpcClient,
     char *devName,Device_Link *pDevice_Link);
-static BOOL vxiCreateDevLink(vxiPort * pvxiPort,int addr,Device_Link *plid);
+static BOOL vxiCreateDevLink(vxiPort * pvxiPort,int addr,devLink *pdevLink);
 static devLink *vxiGetDevLink(vxiPort * pvxiPort, asynUser *pasynUser,int addr);
-static BOOL vxiDestroyDevLink(vxiPort * pvxiPort, Device_Link devLink);
+static void vxiFreeLinkClient(devLink *pdevLink);
+static BOOL vxiDestroyDevLink(vxiPort * pvxiPort, devLink *pdevLink);
+static void vxiLinkException(vxiPort *pvxiPort,asynUser *pasynUser,
+    devLink *pdevLink);
 static int vxiWriteAddressed(vxiPort * pvxiPort,asynUser *pasynUser,
     Device_Link lid,char *buffer,int length,double timeout);
 static int vxiWriteCmd(vxiPort * pvxiPort,asynUser *pasynUser,
     char *buffer, int length);
-static enum clnt_stat clientCall(vxiPort * pvxiPort,
+static CLIENT *vxiLinkClient(vxiPort *pvxiPort,devLink *pdevLink);
+static enum clnt_stat clientCall(vxiPort * pvxiPort,devLink *pdevLink,
     u_long req,xdrproc_t proc1, caddr_t addr1,xdrproc_t proc2, caddr_t addr2);
-static enum clnt_stat clientIoCall(vxiPort * pvxiPort,asynUser *pasynUser,
+static enum clnt_stat clientIoCall(vxiPort * pvxiPort,devLink *pdevLink,
+    asynUser *pasynUser,
     u_long req,xdrproc_t proc1, caddr_t addr1,xdrproc_t proc2, caddr_t addr2);
 static asynStatus vxiBusStatus(vxiPort * pvxiPort, int request,
     double timeout,int *status);
@@ -271,7 +312,24 @@ static void vxiDisconnectException(vxiPort *pvxiPort,int addr)
     assert(status==asynSuccess);
 }
 
-static BOOL vxiCreateDeviceLink(vxiPort * pvxiPort,
+/*
+ * Open a TCP connection to the server at inAddr.
+ * The caller reports failures with clnt_spcreateerror.
+ */
+static CLIENT *vxiCreateClient(vxiPort *pvxiPort)
+{
+    struct sockaddr_in vxiServer;
+    int                sock = -1;
+
+    memset((void *)&vxiServer, 0, sizeof vxiServer);
+    vxiServer.sin_family = AF_INET;
+    vxiServer.sin_port = htons(pvxiPort->serverPort);
+    vxiServer.sin_addr = pvxiPort->inAddr;
+    return clnttcp_create(&vxiServer,
+                                DEVICE_CORE, DEVICE_CORE_VERSION, &sock, 0, 0);
+}
+
+static BOOL vxiCreateDeviceLink(vxiPort * pvxiPort,CLIENT *rpcClient,
     char *devName,Device_Link *pDevice_Link)
 {
     enum clnt_stat   clntStat;
@@ -280,21 +338,21 @@ static BOOL vxiCreateDeviceLink(vxiPort * pvxiPort,
     BOOL             rtnVal = FALSE;
     asynUser         *pasynUser = pvxiPort->pasynUser;
 
-    crLinkP.clientId = (long) pvxiPort->rpcClient;
+    crLinkP.clientId = (long) rpcClient;
     crLinkP.lockDevice = (pvxiPort->lockDevices != 0); 
     crLinkP.lock_timeout = 0;/* if device is locked, forget it */
     crLinkP.device = devName;
     /* initialize crLinkR */
     memset((char *) &crLinkR, 0, sizeof(Create_LinkResp));
     /* RPC call */
-    clntStat = clnt_call(pvxiPort->rpcClient, create_link,
+    clntStat = clnt_call(rpcClient, create_link,
         (xdrproc_t)xdr_Create_LinkParms,(caddr_t)&crLinkP,
         (xdrproc_t)xdr_Create_LinkResp, (caddr_t)&crLinkR,
         pvxiPort->vxiRpcTimeout);
     if(clntStat != RPC_SUCCESS) {
         asynPrint(pasynUser,ASYN_TRACE_ERROR,
             "%s vxiCreateDeviceLink RPC error %s\n",
-            devName,clnt_sperror(pvxiPort->rpcClient,""));
+            devName,clnt_sperror(rpcClient,""));
     } else if(crLinkR.error != VXI_OK) {
         asynPrint(pasynUser,ASYN_TRACE_ERROR,
             "%s vxiCreateDeviceLink error %s\n",
@@ -321,10 +379,11 @@ static BOOL vxiCreateDeviceLink(vxiPort * pvxiPort,
     return rtnVal;
 }
 
-static BOOL vxiCreateDevLink(vxiPort * pvxiPort,int addr,Device_Link *plid)
+static BOOL vxiCreateDevLink(vxiPort * pvxiPort,int addr,devLink *pdevLink)
 {
     int         primary,secondary;
     char        devName[40];
+    CLIENT      *rpcClient = pvxiPort->rpcClient;
 
     if(addr<100) {
         primary = addr; secondary = 0;
@@ -338,7 +397,29 @@ static BOOL vxiCreateDevLink(vxiPort * pvxiPort,int addr,Device_Link *plid)
     } else {
         sprintf(devName, "%s,%d,%d", pvxiPort->vxiName, primary, secondary);
     }
-    return vxiCreateDeviceLink(pvxiPort,devName,plid);
+    /* A client left behind by a failed link is replaced */
+    vxiFreeLinkClient(pdevLink);
+    if(pvxiPort->clientPerLink) {
+        if(rpcTaskInit() == -1) {
+            asynPrint(pvxiPort->pasynUser,ASYN_TRACE_ERROR,
+                "%s vxiCreateDevLink Can't init RPC\n",devName);
+            return FALSE;
+        }
+        rpcClient = vxiCreateClient(pvxiPort);
+        if(!rpcClient) {
+            asynPrint(pvxiPort->pasynUser,ASYN_TRACE_ERROR,
+                "%s vxiCreateDevLink error %s\n",
+                devName,clnt_spcreateerror(pvxiPort->hostName));
+            return FALSE;
+        }
+    }
+    if(!vxiCreateDeviceLink(pvxiPort,rpcClient,devName,&pdevLink->lid)) {
+        if(pvxiPort->clientPerLink) clnt_destroy(rpcClient);
+        return FALSE;
+    }
+    if(pvxiPort->clientPerLink) pdevLink->rpcClient = rpcClient;
+    pdevLink->connected = TRUE;
+    return TRUE;
 }
 
 static devLink *vxiGetDevLink(vxiPort *pvxiPort, asynUser *pasynUser,int addr)
@@ -377,22 +458,36 @@ static devLink *vxiGetDevLink(vxiPort *pvxiPort, asynUser *pasynUser,int addr)
     }
 }
 
-static BOOL vxiDestroyDevLink(vxiPort * pvxiPort, Device_Link devLink)
+static void vxiFreeLinkClient(devLink *pdevLink)
+{
+    if(!pdevLink->rpcClient) return;
+    clnt_destroy(pdevLink->rpcClient);
+    pdevLink->rpcClient = 0;
+}
+
+static BOOL vxiDestroyDevLink(vxiPort * pvxiPort, devLink *pdevLink)
 {
     enum clnt_stat clntStat;
     Device_Error   devErr;
     asynUser       *pasynUser = pvxiPort->pasynUser;
+    CLIENT         *rpcClient = vxiLinkClient(pvxiPort,pdevLink);
     int            status = TRUE;
 
-    clntStat = clnt_call(pvxiPort->rpcClient, destroy_link,
-        (xdrproc_t) xdr_Device_Link,(caddr_t) &devLink,
+    if(pvxiPort->clientPerLink && rpcTaskInit() == -1) {
+        asynPrint(pasynUser,ASYN_TRACE_ERROR,
+            "%s vxiDestroyDevLink Can't init RPC\n",pvxiPort->portName);
+        vxiFreeLinkClient(pdevLink);
+        return FALSE;
+    }
+    clntStat = clnt_call(rpcClient, destroy_link,
+        (xdrproc_t) xdr_Device_Link,(caddr_t) &pdevLink->lid,
         (xdrproc_t) xdr_Device_Error, (caddr_t) &devErr,
         pvxiPort->vxiRpcTimeout);
     if(clntStat != RPC_SUCCESS) {
         status = FALSE;
         asynPrint(pasynUser,ASYN_TRACE_ERROR,
             "%s vxiDestroyDevLink RPC error %s\n",
-             pvxiPort->portName,clnt_sperror(pvxiPort->rpcClient,""));
+             pvxiPort->portName,clnt_sperror(rpcClient,""));
     } else if(devErr.error != VXI_OK) {
         status = FALSE;
         asynPrint(pasynUser,ASYN_TRACE_ERROR,
@@ -400,8 +495,22 @@ static BOOL vxiDestroyDevLink(vxiPort * pvxiPort, Device_Link devLink)
             pvxiPort->portName,vxiError(devErr.error));
     }
     xdr_free((const xdrproc_t) xdr_Device_Error, (char *) &devErr);
+    vxiFreeLinkClient(pdevLink);
     return status;
 }
+
+/*
+ * With a client per link a device link whose client failed is only marked
+ * not connected.  The device is then disconnected so that autoConnect
+ * creates a new link, without disturbing the other addresses.
+ */
+static void vxiLinkException(vxiPort *pvxiPort,asynUser *pasynUser,
+    devLink *pdevLink)
+{
+    if(!pvxiPort->clientPerLink || pdevLink->connected) return;
+    if(!pvxiPort->server.connected) return;
+    pasynManager->exceptionDisconnect(pasynUser);
+}
 
 /*write with ATN true */
 static int vxiWriteAddressed(vxiPort *pvxiPort,asynUser *pasynUser,
@@ -427,7 +536,7 @@ static int vxiWriteAddressed(vxiPort *pvxiPort,asynUser *pasynUser,
     /* initialize devDocmdR */
     memset((char *) &devDocmdR, 0, sizeof(Device_DocmdResp));
     /* RPC call */
-    clntStat = clientCall(pvxiPort, device_docmd,
+    clntStat = clientCall(pvxiPort, 0, device_docmd,
         (const xdrproc_t) xdr_Device_DocmdParms,(void *) &devDocmdP,
         (const xdrproc_t) xdr_Device_DocmdResp,(void *) &devDocmdR);
     if(clntStat != RPC_SUCCESS) {
@@ -514,7 +623,7 @@ static asynStatus vxiBusStatus(vxiPort * pvxiPort, int request,
         /* initialize devDocmdR */
         memset((char *) &devDocmdR, 0, sizeof(Device_DocmdResp));
         /* RPC call */
-        clntStat = clientCall(pvxiPort, device_docmd,
+        clntStat = clientCall(pvxiPort, 0, device_docmd,
             (const xdrproc_t) xdr_Device_DocmdParms,(void *) &devDocmdP,
             (const xdrproc_t) xdr_Device_DocmdResp, (void *) &devDocmdR);
         if(clntStat != RPC_SUCCESS) {
@@ -543,29 +652,121 @@ static asynStatus vxiBusStatus(vxiPort * pvxiPort, int request,
     return asynSuccess;
 }
 
-static enum clnt_stat clientCall(vxiPort * pvxiPort,
+/*
+ * Statistics of a device link.  RPCs that are not for a device link
+ * count for the server link.  Called with statsLock held.
+ */
+static vxiStats *vxiLinkStats(vxiPort *pvxiPort,devLink *pdevLink)
+{
+    if(!pdevLink) pdevLink = &pvxiPort->server;
+    if(!pdevLink->pstats)
+        pdevLink->pstats = callocMustSucceed(1,sizeof(vxiStats),"drvVxi11");
+    return pdevLink->pstats;
+}
+
+static void vxiRpcDone(vxiPort *pvxiPort,devLink *pdevLink,
+    const epicsTimeStamp *startTime,enum clnt_stat stat)
+{
+    vxiStats       *pstats;
+    epicsTimeStamp endTime;
+    double         seconds;
+    int            bin;
+
+    epicsTimeGetCurrent(&endTime);
+    seconds = epicsTimeDiffInSeconds(&endTime,startTime);
+    for(bin=0; bin<NUM_RPC_LATENCY_BINS-1; bin++)
+        if(seconds<rpcLatencyLimit[bin]) break;
+    epicsMutexMustLock(pvxiPort->statsLock);
+    pstats = vxiLinkStats(pvxiPort,pdevLink);
+    pstats->rpcLatency[bin]++;
+    pstats->rpcSeconds += seconds;
+    pstats->rpcCount++;
+    if(stat!=RPC_SUCCESS) pstats->rpcFailCount++;
+    epicsMutexUnlock(pvxiPort->statsLock);
+}
+
+static CLIENT *vxiLinkClient(vxiPort *pvxiPort,devLink *pdevLink)
+{
+    if(pdevLink && pdevLink->rpcClient) return pdevLink->rpcClient;
+    return pvxiPort->rpcClient;
+}
+
+/*
+ * With a client per link the port threads run concurrently.  They share
+ * the port client, so it is locked, and on RTEMS each one needs its own
+ * RPC task variables.  Returns 0, without locking, if those can't be set up.
+ */
+static CLIENT *vxiLockClient(vxiPort *pvxiPort,devLink *pdevLink)
+{
+    if(!pvxiPort->clientPerLink) return pvxiPort->rpcClient;
+    if(rpcTaskInit() == -1) {
+        asynPrint(pvxiPort->pasynUser,ASYN_TRACE_ERROR,
+            "%s Can't init RPC\n",pvxiPort->portName);
+        return 0;
+    }
+    if(pdevLink && pdevLink->rpcClient) return pdevLink->rpcClient;
+    epicsMutexMustLock(pvxiPort->rpcLock);
+    return pvxiPort->rpcClient;
+}
+
+static void vxiUnlockClient(vxiPort *pvxiPort,devLink *pdevLink)
+{
+    if(!pvxiPort->clientPerLink) return;
+    if(pdevLink && pdevLink->rpcClient) return;
+    epicsMutexUnlock(pvxiPort->rpcLock);
+}
+
+/*
+ * An RPC failed with something other than a timeout.  The client of a
+ * device link only takes that link down.  Other port threads may be
+ * using the port client, so with a client per link the port is only
+ * disconnected here and the links are destroyed by the next vxiConnect.
+ */
+static void vxiClientFailed(vxiPort *pvxiPort,devLink *pdevLink)
+{
+    if(pdevLink && pdevLink->rpcClient) {
+        pdevLink->connected = FALSE;
+    } else if(pvxiPort->clientPerLink) {
+        if(pvxiPort->portClientFailed) return;
+        pvxiPort->portClientFailed = TRUE;
+        pasynManager->exceptionDisconnect(pvxiPort->pasynUser);
+    } else {
+        vxiDisconnectPort(pvxiPort);
+    }
+}
+
+static enum clnt_stat clientCall(vxiPort * pvxiPort,devLink *pdevLink,
     u_long req,xdrproc_t proc1, caddr_t addr1,xdrproc_t proc2, caddr_t addr2)
 {
     enum clnt_stat stat;
     asynUser *pasynUser = pvxiPort->pasynUser;
+    CLIENT   *rpcClient = vxiLockClient(pvxiPort,pdevLink);
+    epicsTimeStamp startTime;
 
-    stat = clnt_call(pvxiPort->rpcClient,
+    if(!rpcClient) return RPC_SYSTEMERROR;
+    epicsTimeGetCurrent(&startTime);
+    stat = clnt_call(rpcClient,
         req, proc1, addr1, proc2, addr2, pvxiPort->vxiRpcTimeout);
+    vxiRpcDone(pvxiPort,pdevLink,&startTime,stat);
     if(stat!=RPC_SUCCESS) {
         asynPrint(pasynUser,ASYN_TRACE_ERROR,
             "%s vxi11 clientCall errno %s clnt_stat %d\n",
             pvxiPort->portName,strerror(errno),stat);
-        if(stat!=RPC_TIMEDOUT) vxiDisconnectPort(pvxiPort);
+        if(stat!=RPC_TIMEDOUT) vxiClientFailed(pvxiPort,pdevLink);
     }
+    vxiUnlockClient(pvxiPort,pdevLink);
     return stat;
 }
 
-static enum clnt_stat clientIoCall(vxiPort * pvxiPort,asynUser *pasynUser,
+static enum clnt_stat clientIoCall(vxiPort * pvxiPort,devLink *pdevLink,
+    asynUser *pasynUser,
     u_long req,xdrproc_t proc1, caddr_t addr1,xdrproc_t proc2, caddr_t addr2)
 {
     enum clnt_stat stat;
     struct timeval rpcTimeout;
     double timeout = pasynUser->timeout;
+    CLIENT *rpcClient;
+    epicsTimeStamp startTime;
 
     rpcTimeout.tv_usec = 0;
     if(timeout<0.0) {
@@ -575,17 +776,22 @@ static enum clnt_stat clientIoCall(vxiPort * pvxiPort,asynUser *pasynUser,
     } else {
         rpcTimeout.tv_sec = (unsigned long)(timeout+1.0);
     }
+    rpcClient = vxiLockClient(pvxiPort,pdevLink);
+    if(!rpcClient) return RPC_SYSTEMERROR;
     while(TRUE) {
-        stat = clnt_call(pvxiPort->rpcClient,
+        epicsTimeGetCurrent(&startTime);
+        stat = clnt_call(rpcClient,
             req, proc1, addr1, proc2, addr2, rpcTimeout);
+        vxiRpcDone(pvxiPort,pdevLink,&startTime,stat);
         if(timeout>=0.0 || stat!=RPC_TIMEDOUT) break;
     }
     if(stat!=RPC_SUCCESS) {
         asynPrint(pasynUser,ASYN_TRACE_ERROR,
             "%s vxi11 clientIoCall errno %s clnt_stat %d\n",
             pvxiPort->portName,strerror(errno),stat);
-        if(stat!=RPC_TIMEDOUT) vxiDisconnectPort(pvxiPort);
+        if(stat!=RPC_TIMEDOUT) vxiClientFailed(pvxiPort,pdevLink);
     }
+    vxiUnlockClient(pvxiPort,pdevLink);
     return stat;
 }
 
@@ -711,7 +917,7 @@ static void vxiCreateIrqChannel(vxiPort *pvxiPort,asynUser *pasynUser)
     devRemF.progVers = DEVICE_INTR_VERSION;
     devRemF.progFamily = DEVICE_TCP;
     memset((char *) &devErr, 0, sizeof(Device_Error));
-    clntStat = clientCall(pvxiPort,  create_intr_chan,
+    clntStat = clientCall(pvxiPort, 0, create_intr_chan,
         (const xdrproc_t) xdr_Device_RemoteFunc, (void *) &devRemF,
         (const xdrproc_t) xdr_Device_Error, (void *) &devErr);
     if(clntStat != RPC_SUCCESS) {
@@ -878,9 +1084,7 @@ static asynStatus vxiConnectPort(vxiPort *pvxiPort,asynUser *pasynUser)
 {
     int         isController;
     Device_Link link;
-    int         sock = -1;
     asynStatus  status;
-    struct sockaddr_in vxiServer;
 
     /* Previously this pasynUser was created and connected to the port in vxi11Configure 
      * after calling pasynGpib->registerPort
@@ -918,17 +1122,13 @@ static asynStatus vxiConnectPort(vxiPort *pvxiPort,asynUser *pasynUser)
      * but clnt_create often makes use of the non-thread-safe gethostbyname()
      * routine.
      */
-    memset((void *)&vxiServer, 0, sizeof vxiServer);
-    vxiServer.sin_family = AF_INET;
-    vxiServer.sin_port = htons(0);
-    if (hostToIPAddr(pvxiPort->hostName, &vxiServer.sin_addr) < 0) {
+    if (hostToIPAddr(pvxiPort->hostName, &pvxiPort->inAddr) < 0) {
         reportConnectStatus(pvxiPort, vxiConnectResolveName,
             "%s can't get IP address of %s\n",
             pvxiPort->portName, pvxiPort->hostName);
         return asynError;
     }
-    pvxiPort->rpcClient = clnttcp_create(&vxiServer, 
-                                DEVICE_CORE, DEVICE_CORE_VERSION, &sock, 0, 0);
+    pvxiPort->rpcClient = vxiCreateClient(pvxiPort);
     if(!pvxiPort->rpcClient) {
         reportConnectStatus(pvxiPort, vxiConnectClientCreate,
             "%s vxiConnectPort error %s\n",
@@ -937,7 +1137,8 @@ static asynStatus vxiConnectPort(vxiPort *pvxiPort,asynUser *pasynUser)
     }
     /* now establish a link to the gateway (for docmds etc.) */
     pvxiPort->abortPort = 0;
-    if(!vxiCreateDeviceLink(pvxiPort,pvxiPort->vxiName,&link)) return asynError;
+    if(!vxiCreateDeviceLink(pvxiPort,pvxiPort->rpcClient,pvxiPort->vxiName,&link))
+        return asynError;
     pvxiPort->server.lid = link;
     pvxiPort->server.connected = TRUE;
     pvxiPort->ctrlAddr = -1;
@@ -1015,34 +1216,84 @@ static asynStatus vxiDisconnectPort(vxiPort *pvxiPort)
         pdevLink = &pvxiPort->primary[addr].primary;
         if(pdevLink->connected) {
             if(addr!=pvxiPort->ctrlAddr) {
-                vxiDestroyDevLink(pvxiPort, pdevLink->lid);
+                vxiDestroyDevLink(pvxiPort, pdevLink);
                 vxiDisconnectException(pvxiPort,addr);
             }
             pdevLink->lid = 0;
             pdevLink->connected = FALSE;
         }
+        vxiFreeLinkClient(pdevLink);
         for(secondary = 0; secondary < NUM_GPIB_ADDRESSES; secondary++) {
             pdevLink = &pvxiPort->primary[addr].secondary[secondary];
             if(pdevLink->connected) {
-                vxiDestroyDevLink(pvxiPort, pdevLink->lid);
+                vxiDestroyDevLink(pvxiPort, pdevLink);
                 vxiDisconnectException(pvxiPort,(addr*100 + secondary));
                 pdevLink->lid = 0;
                 pdevLink->connected = FALSE;
             }
+            vxiFreeLinkClient(pdevLink);
         }
     }
     vxiDestroyIrqChannel(pvxiPort);
-    vxiDestroyDevLink(pvxiPort, pvxiPort->server.lid);
+    vxiDestroyDevLink(pvxiPort, &pvxiPort->server);
     pvxiPort->server.connected = FALSE;
     pvxiPort->server.lid = 0;
+    pvxiPort->portClientFailed = FALSE;
     clnt_destroy(pvxiPort->rpcClient);
     pasynManager->exceptionDisconnect(pvxiPort->pasynUser);
     return asynSuccess;
 }
 
+static void vxiReportStats(FILE *fd,const char *indent,const vxiStats *pstats)
+{
+    int bin;
+
+    fprintf(fd,"%sRPCs:%lu failed:%lu", indent,
+        pstats->rpcCount, pstats->rpcFailCount);
+    fprintf(fd," mean latency:%.3f ms\n", pstats->rpcCount ?
+        pstats->rpcSeconds*1e3/pstats->rpcCount : 0.0);
+    fprintf(fd,"%sdevice_read RPCs:%lu bytes:%.0f", indent,
+        pstats->readRpcCount, pstats->bytesRead);
+    fprintf(fd," device_write RPCs:%lu bytes:%.0f\n",
+        pstats->writeRpcCount, pstats->bytesWritten);
+    fprintf(fd,"%sRPC latency", indent);
+    for(bin=0; bin<NUM_RPC_LATENCY_BINS-1; bin++)
+        fprintf(fd," <%gms:%lu", rpcLatencyLimit[bin]*1e3,
+            pstats->rpcLatency[bin]);
+    fprintf(fd," more:%lu\n", pstats->rpcLatency[bin]);
+}
+
+static void vxiAddStats(vxiStats *ptotal,const devLink *pdevLink)
+{
+    const vxiStats *pstats = pdevLink->pstats;
+    int bin;
+
+    if(!pstats) return;
+    ptotal->rpcCount += pstats->rpcCount;
+    ptotal->rpcFailCount += pstats->rpcFailCount;
+    ptotal->readRpcCount += pstats->readRpcCount;
+    ptotal->writeRpcCount += pstats->writeRpcCount;
+    ptotal->bytesRead += pstats->bytesRead;
+    ptotal->bytesWritten += pstats->bytesWritten;
+    ptotal->rpcSeconds += pstats->rpcSeconds;
+    for(bin=0; bin<NUM_RPC_LATENCY_BINS; bin++)
+        ptotal->rpcLatency[bin] += pstats->rpcLatency[bin];
+}
+
+static void vxiReportLink(FILE *fd,const devLink *pdevLink,int addr)
+{
+    if(!pdevLink->pstats) return;
+    if(addr<0) fprintf(fd,"    server link\n");
+    else fprintf(fd,"    addr %d\n", addr);
+    vxiReportStats(fd,"      ",pdevLink->pstats);
+}
+
 static void vxiReport(void *drvPvt,FILE *fd,int details)
 {
     vxiPort *pvxiPort = (vxiPort *)drvPvt;
+    vxiStats total;
+    int     addr, secondary;
+
     assert(pvxiPort);
     fprintf(fd,"    vxi11, host name: %s\n", pvxiPort->hostName);
     if(details > 1) {
@@ -1055,6 +1306,32 @@ static void vxiReport(void *drvPvt,FILE *fd,int details)
         fprintf(fd," isSingleLink:%s isGpibLink:%s\n",
             ((pvxiPort->isSingleLink) ? "yes" : "no"),
             ((pvxiPort->isGpibLink) ? "yes" : "no"));
+        if(pvxiPort->serverPort)
+            fprintf(fd,"    server port:%u\n", pvxiPort->serverPort);
+        if(pvxiPort->clientPerLink)
+            fprintf(fd,"    RPC client per device link%s\n",
+                pvxiPort->portClientFailed ? ", port client failed" : "");
+        fprintf(fd,"    readSize:%lu\n", pvxiPort->readSize);
+        /* Totals for the port, then each device link that made RPCs */
+        memset(&total,0,sizeof(total));
+        epicsMutexMustLock(pvxiPort->statsLock);
+        vxiAddStats(&total,&pvxiPort->server);
+        for(addr = 0; addr < NUM_GPIB_ADDRESSES; addr++) {
+            vxiAddStats(&total,&pvxiPort->primary[addr].primary);
+            for(secondary = 0; secondary < NUM_GPIB_ADDRESSES; secondary++)
+                vxiAddStats(&total,&pvxiPort->primary[addr].secondary[secondary]);
+        }
+        epicsMutexUnlock(pvxiPort->statsLock);
+        vxiReportStats(fd,"    ",&total);
+        epicsMutexMustLock(pvxiPort->statsLock);
+        vxiReportLink(fd,&pvxiPort->server,-1);
+        for(addr = 0; addr < NUM_GPIB_ADDRESSES; addr++) {
+            vxiReportLink(fd,&pvxiPort->primary[addr].primary,addr);
+            for(secondary = 0; secondary < NUM_GPIB_ADDRESSES; secondary++)
+                vxiReportLink(fd,&pvxiPort->primary[addr].secondary[secondary],
+                    addr*100 + secondary);
+        }
+        epicsMutexUnlock(pvxiPort->statsLock);
     }
 }
 
@@ -1071,6 +1348,8 @@ static asynStatus vxiConnect(void *drvPvt,asynUser *pasynUser)
     if(!pdevLink) return asynError;
     asynPrint(pasynUser,ASYN_TRACE_FLOW,
         "%s addr %d vxiConnect\n",pvxiPort->portName,addr);
+    /* All devices are locked now so the failed port client can go */
+    if(addr==-1 && pvxiPort->portClientFailed) vxiDisconnectPort(pvxiPort);
     if(pdevLink->connected) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
             "%s addr %d vxiConnect request but already connected",
@@ -1083,16 +1362,12 @@ static asynStatus vxiConnect(void *drvPvt,asynUser *pasynUser)
     }
     if(addr==-1) return vxiConnectPort(pvxiPort,pasynUser);
     if(!pdevLink->connected) {
-        Device_Link lid;
-
-        if(!vxiCreateDevLink(pvxiPort,addr,&lid)) {
+        if(!vxiCreateDevLink(pvxiPort,addr,pdevLink)) {
             asynPrint(pasynUser,ASYN_TRACE_ERROR,
                 "%s vxiCreateDevLink failed for addr %d\n",
                 pvxiPort->portName,addr);
             return asynError;
         }
-        pdevLink->lid = lid;
-        pdevLink->connected = TRUE;
     }
     pasynManager->exceptionConnect(pasynUser);
     return asynSuccess;
@@ -1112,13 +1387,14 @@ static asynStatus vxiDisconnect(void *drvPvt,asynUser *pasynUser)
     asynPrint(pasynUser,ASYN_TRACE_FLOW,
         "%s addr %d vxiDisconnect\n",pvxiPort->portName,addr);
     if(!pdevLink->connected) {
+        if(addr!=-1) vxiFreeLinkClient(pdevLink);
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
             "%s addr %d vxiDisconnect request but not connected",
             pvxiPort->portName,addr);
         return asynError;
     }
     if(addr==-1) return vxiDisconnectPort(pvxiPort);
-    if(!vxiDestroyDevLink(pvxiPort,pdevLink->lid)) {
+    if(!vxiDestroyDevLink(pvxiPort,pdevLink)) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
             "%s vxiDestroyDevLink failed for addr %d",pvxiPort->portName,addr);
         status = asynError;
@@ -1129,6 +1405,23 @@ static asynStatus vxiDisconnect(void *drvPvt,asynUser *pasynUser)
     return status;
 }
 
+/*
+ * Like xdr_Device_ReadResp, but data.data_val must point to a buffer
+ * with room for bufSize bytes.  xdr_bytes only allocates memory when
+ * data_val is NULL, so the data goes straight into the caller's buffer.
+ * A reply with more than bufSize bytes fails to decode.
+ */
+static bool_t xdrReadRespInto(XDR *xdrs, vxiReadResp *preadResp)
+{
+    Device_ReadResp *objp = &preadResp->devReadR;
+
+    if(xdrs->x_op == XDR_FREE) return TRUE; /* the buffer is not ours */
+    if(!xdr_Device_ErrorCode(xdrs, &objp->error)) return FALSE;
+    if(!xdr_long(xdrs, &objp->reason)) return FALSE;
+    return xdr_bytes(xdrs, &objp->data.data_val, &objp->data.data_len,
+        preadResp->bufSize);
+}
+
 static asynStatus vxiRead(void *drvPvt,asynUser *pasynUser,
     char *data,int maxchars,int *nbytesTransfered,int *eomReason)
 {
@@ -1138,8 +1431,12 @@ static asynStatus vxiRead(void *drvPvt,asynUser *pasynUser,
     devLink *pdevLink;
     enum clnt_stat   clntStat;
     Device_ReadParms devReadP;
-    Device_ReadResp  devReadR;
+    vxiReadResp      readResp;
+    Device_ReadResp  *pdevReadR = &readResp.devReadR;
+    unsigned long    requestSize;
+    BOOL             sizeLimited;
     asynStatus       status = asynSuccess;
+    vxiStats         *pstats;
 
     status = pasynManager->getAddr(pasynUser,&addr);
     if(status!=asynSuccess) return status;
@@ -1153,13 +1450,21 @@ static asynStatus vxiRead(void *drvPvt,asynUser *pasynUser,
     if(!vxiIsPortConnected(pvxiPort,pasynUser) || !pdevLink->connected) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
             "%s port is not connected",pvxiPort->portName);
+        vxiLinkException(pvxiPort,pasynUser,pdevLink);
         return asynError;
     }
     devReadP.lid = pdevLink->lid;
     /* device link is created; do the read */
     do {
         thisRead = -1;
-        devReadP.requestSize = maxchars;
+        /* readSize splits large reads into several device_read RPCs */
+        requestSize = maxchars;
+        sizeLimited = FALSE;
+        if(pvxiPort->readSize && requestSize>pvxiPort->readSize) {
+            requestSize = pvxiPort->readSize;
+            sizeLimited = TRUE;
+        }
+        devReadP.requestSize = requestSize;
         devReadP.io_timeout = getIoTimeout(pasynUser,pvxiPort);
         devReadP.lock_timeout = 0;
         devReadP.flags = 0;
@@ -1167,47 +1472,57 @@ static asynStatus vxiRead(void *drvPvt,asynUser *pasynUser,
             devReadP.flags |= VXI_TERMCHRSET;
             devReadP.termChar = pdevLink->eos;
         }
-        /* initialize devReadR */
-        memset((char *) &devReadR, 0, sizeof(Device_ReadResp));
+        /* initialize readResp so that the data is decoded into data */
+        memset((char *) &readResp, 0, sizeof(readResp));
+        pdevReadR->data.data_val = data;
+        readResp.bufSize = maxchars;
         /* RPC call */
         while(TRUE) { /*Allow for very long or infinite timeout*/
-            clntStat = clientIoCall(pvxiPort, pasynUser, device_read,
+            clntStat = clientIoCall(pvxiPort, pdevLink, pasynUser, device_read,
                 (const xdrproc_t) xdr_Device_ReadParms,(void *) &devReadP,
-                (const xdrproc_t) xdr_Device_ReadResp,(void *) &devReadR);
+                (const xdrproc_t) xdrReadRespInto,(void *) &readResp);
             if(devReadP.io_timeout!=UINT_MAX
-            || devReadR.error!=VXI_IOTIMEOUT
-            || devReadR.data.data_len>0) break;
+            || pdevReadR->error!=VXI_IOTIMEOUT
+            || pdevReadR->data.data_len>0) break;
         }
+        epicsMutexMustLock(pvxiPort->statsLock);
+        pstats = vxiLinkStats(pvxiPort,pdevLink);
+        pstats->readRpcCount++;
+        if(clntStat == RPC_SUCCESS && pdevReadR->error == VXI_OK)
+            pstats->bytesRead += pdevReadR->data.data_len;
+        epicsMutexUnlock(pvxiPort->statsLock);
         if(clntStat != RPC_SUCCESS) {
             epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                 "%s RPC failed",pvxiPort->portName);
+            vxiLinkException(pvxiPort,pasynUser,pdevLink);
             status = asynError;
             break;
-        } else if(devReadR.error != VXI_OK) {
-            if((devReadR.error == VXI_IOTIMEOUT) && (pvxiPort->recoverWithIFC))
+        } else if(pdevReadR->error != VXI_OK) {
+            if((pdevReadR->error == VXI_IOTIMEOUT) && (pvxiPort->recoverWithIFC))
                 vxiIfc(drvPvt, pasynUser);
             epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                 "%s read request failed",pvxiPort->portName);
-            status = (devReadR.error==VXI_IOTIMEOUT) ? asynTimeout : asynError;
+            status = (pdevReadR->error==VXI_IOTIMEOUT) ? asynTimeout : asynError;
             break;
         } 
-        thisRead = devReadR.data.data_len;
+        thisRead = pdevReadR->data.data_len;
         if(thisRead>0) {
             asynPrintIO(pasynUser,ASYN_TRACEIO_DRIVER,
-                devReadR.data.data_val,devReadR.data.data_len,
+                data,thisRead,
                 "%s %d vxiRead\n",pvxiPort->portName,addr);
-            memcpy(data, devReadR.data.data_val, thisRead);
             nRead += thisRead;
             data += thisRead;
             maxchars -= thisRead;
         }
-        xdr_free((const xdrproc_t) xdr_Device_ReadResp, (char *) &devReadR);
-    } while(!devReadR.reason && thisRead>0);
+        /* The data is in the caller's buffer so there is nothing to free */
+    } while(thisRead>0 && maxchars>0 && (!pdevReadR->reason
+        || (sizeLimited && pdevReadR->reason==VXI_REQCNT)));
     if(eomReason) {
         *eomReason = 0;
-        if(devReadR.reason & VXI_REQCNT) *eomReason |= ASYN_EOM_CNT;
-        if(devReadR.reason & VXI_CHR) *eomReason |= ASYN_EOM_EOS;
-        if(devReadR.reason & VXI_ENDR) *eomReason |= ASYN_EOM_END;
+        if(pdevReadR->reason & VXI_REQCNT) *eomReason |= ASYN_EOM_CNT;
+        if(pdevReadR->reason & VXI_CHR) *eomReason |= ASYN_EOM_EOS;
+        if(pdevReadR->reason & VXI_ENDR) *eomReason |= ASYN_EOM_END;
+        if(status==asynSuccess && maxchars==0) *eomReason |= ASYN_EOM_CNT;
     }
     *nbytesTransfered = nRead;
     return status;
@@ -1225,6 +1540,7 @@ static asynStatus vxiWrite(void *drvPvt,asynUser *pasynUser,
     enum clnt_stat    clntStat;
     Device_WriteParms devWriteP;
     Device_WriteResp  devWriteR;
+    vxiStats          *pstats;
 
     status = pasynManager->getAddr(pasynUser,&addr);
     if(status!=asynSuccess) return status;
@@ -1240,6 +1556,7 @@ static asynStatus vxiWrite(void *drvPvt,asynUser *pasynUser,
     if(!vxiIsPortConnected(pvxiPort,pasynUser) || !pdevLink->connected) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
             "%s port is not connected",pvxiPort->portName);
+        vxiLinkException(pvxiPort,pasynUser,pdevLink);
         return asynError;
     }
     devWriteP.lid = pdevLink->lid;;
@@ -1259,12 +1576,19 @@ static asynStatus vxiWrite(void *drvPvt,asynUser *pasynUser,
         /* initialize devWriteR */
         memset((char *) &devWriteR, 0, sizeof(Device_WriteResp));
         /* RPC call */
-        clntStat = clientIoCall(pvxiPort, pasynUser, device_write,
+        clntStat = clientIoCall(pvxiPort, pdevLink, pasynUser, device_write,
             (const xdrproc_t) xdr_Device_WriteParms,(void *) &devWriteP,
             (const xdrproc_t) xdr_Device_WriteResp,(void *) &devWriteR);
+        epicsMutexMustLock(pvxiPort->statsLock);
+        pstats = vxiLinkStats(pvxiPort,pdevLink);
+        pstats->writeRpcCount++;
+        if(clntStat == RPC_SUCCESS && devWriteR.error == VXI_OK)
+            pstats->bytesWritten += devWriteR.size;
+        epicsMutexUnlock(pvxiPort->statsLock);
         if(clntStat != RPC_SUCCESS) {
             epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                 "%s RPC failed",pvxiPort->portName);
+            vxiLinkException(pvxiPort,pasynUser,pdevLink);
             status = asynError;
             break;
         } else if(devWriteR.error != VXI_OK) {
@@ -1449,7 +1773,7 @@ static asynStatus vxiIfc(void *drvPvt, asynUser *pasynUser)
     /* initialize devDocmdR */
     memset((char *) &devDocmdR, 0, sizeof(Device_DocmdResp));
     /* RPC call */
-    clntStat = clientCall(pvxiPort, device_docmd,
+    clntStat = clientCall(pvxiPort, 0, device_docmd,
         (const xdrproc_t) xdr_Device_DocmdParms,(void *) &devDocmdP,
         (const xdrproc_t) xdr_Device_DocmdResp, (void *) &devDocmdR);
     if(clntStat != RPC_SUCCESS) {
@@ -1498,7 +1822,7 @@ static asynStatus vxiRen(void *drvPvt,asynUser *pasynUser, int onOff)
     /* initialize devDocmdR */
     memset((char *) &devDocmdR, 0, sizeof(Device_DocmdResp));
     /* RPC call */
-    clntStat = clientCall(pvxiPort, device_docmd,
+    clntStat = clientCall(pvxiPort, 0, device_docmd,
         (const xdrproc_t) xdr_Device_DocmdParms,(void *) &devDocmdP,
         (const xdrproc_t) xdr_Device_DocmdResp, (void *) &devDocmdR);
     if(clntStat != RPC_SUCCESS) {
@@ -1566,7 +1890,7 @@ static asynStatus vxiSrqEnable(void *drvPvt, int onOff)
     /* initialize devErr */
     memset((char *) &devErr, 0, sizeof(Device_Error));
     /* RPC call */
-    clntStat = clientCall(pvxiPort, device_enable_srq,
+    clntStat = clientCall(pvxiPort, 0, device_enable_srq,
         (const xdrproc_t) xdr_Device_EnableSrqParms,(void *) &devEnSrqP,
         (const xdrproc_t) xdr_Device_Error, (void *) &devErr);
     if(clntStat != RPC_SUCCESS) {
@@ -1607,14 +1931,11 @@ static asynStatus vxiSerialPoll(void *drvPvt, int addr,
     pdevLink = vxiGetDevLink(pvxiPort,0,addr);
     if(!pdevLink) return asynError;
     if(!pdevLink->connected) {
-        Device_Link lid;
-        if(!vxiCreateDevLink(pvxiPort,addr,&lid)) {
+        if(!vxiCreateDevLink(pvxiPort,addr,pdevLink)) {
             printf("%s vxiCreateDevLink failed for addr %d\n",
                 pvxiPort->portName,addr);
             return asynError;
         }
-        pdevLink->lid = lid;
-    	pdevLink->connected = TRUE;
     }
     devGenP.lid = pdevLink->lid;
     devGenP.flags = 0; /* no timeout on a locked gateway */
@@ -1622,12 +1943,13 @@ static asynStatus vxiSerialPoll(void *drvPvt, int addr,
     devGenP.lock_timeout = 0;
     /* initialize devGenR */
     memset((char *) &devGenR, 0, sizeof(Device_ReadStbResp));
-    clntStat = clientCall(pvxiPort, device_readstb,
+    clntStat = clientCall(pvxiPort, pdevLink, device_readstb,
         (const xdrproc_t) xdr_Device_GenericParms, (void *) &devGenP,
         (const xdrproc_t) xdr_Device_ReadStbResp, (void *) &devGenR);
     if(clntStat != RPC_SUCCESS) {
         printf("%s vxiSerialPoll %d RPC error %s\n",
-            pvxiPort->portName, addr, clnt_sperror(pvxiPort->rpcClient,""));
+            pvxiPort->portName, addr,
+            clnt_sperror(vxiLinkClient(pvxiPort,pdevLink),""));
         return asynError;
     } else if(devGenR.error != VXI_OK) {
         if(devGenR.error == VXI_IOTIMEOUT) {
@@ -1659,6 +1981,19 @@ static asynStatus vxiSetPortOption(void *drvPvt,
     int     seconds,microseconds;
     int     nitems;
 
+    if(epicsStrCaseCmp(key, "readsize") == 0) {
+        unsigned long readSize;
+        char          *end;
+
+        readSize = strtoul(val,&end,0);
+        if(end==val || *end || val[0]=='-') {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                "Illegal value \"%s\"", val);
+            return asynError;
+        }
+        pvxiPort->readSize = readSize;
+        return asynSuccess;
+    }
     if(epicsStrCaseCmp(key, "rpctimeout") != 0) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
             "Unsupported key \"%s\"", key);
@@ -1683,6 +2018,10 @@ static asynStatus vxiGetPortOption(void *drvPvt,
     vxiPort *pvxiPort = (vxiPort *)drvPvt;
     double  timeout;
 
+    if(epicsStrCaseCmp(key, "readsize") == 0) {
+        epicsSnprintf(val,valSize,"%lu",pvxiPort->readSize);
+        return asynSuccess;
+    }
     if(epicsStrCaseCmp(key, "rpctimeout") != 0) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
             "Unsupported key \"%s\"", key);
@@ -1744,16 +2083,30 @@ int vxi11Configure(char *dn, char *hostName, int flags,
     if(flags & FLAG_RECOVER_WITH_IFC) pvxiPort->recoverWithIFC = TRUE;
     if(flags & FLAG_LOCK_DEVICES) pvxiPort->lockDevices = TRUE;
     if(!(flags & FLAG_NO_SRQ)) pvxiPort->hasSRQ = TRUE;
+    if(flags & FLAG_CLIENT_PER_LINK) pvxiPort->clientPerLink = TRUE;
+    pvxiPort->statsLock = epicsMutexMustCreate();
     pvxiPort->inAddr = inAddr;
     pvxiPort->hostName = (char *)callocMustSucceed(1,strlen(hostName)+1,
         "vxi11Configure");
+    strcpy(pvxiPort->hostName, hostName);
+    /* A host:port name bypasses the portmapper */
+    pvxiPort->serverPort = ntohs(ip.sin_port);
+    if(pvxiPort->serverPort) {
+        char *colon = strrchr(pvxiPort->hostName, ':');
+        if(colon) *colon = 0;
+    }
     if(epicsStrnCaseCmp("gpib", vxiName, 4) == 0) pvxiPort->isGpibLink = 1;
     if(epicsStrnCaseCmp("hpib", vxiName, 4) == 0) pvxiPort->isGpibLink = 1;
     if(epicsStrnCaseCmp("inst", vxiName, 4) == 0) pvxiPort->isSingleLink = 1;
     if(epicsStrnCaseCmp("com", vxiName, 3) == 0) pvxiPort->isSingleLink = 1;
-    strcpy(pvxiPort->hostName, hostName);
     attributes = ASYN_CANBLOCK;
     if(!pvxiPort->isSingleLink) attributes |= ASYN_MULTIDEVICE;
+    /* A single link has nothing to run concurrently */
+    if(pvxiPort->isSingleLink) pvxiPort->clientPerLink = FALSE;
+    if(pvxiPort->clientPerLink) {
+        pvxiPort->rpcLock = epicsMutexMustCreate();
+        attributes |= ASYN_MULTITHREAD;
+    }
     pvxiPort->asynGpibPvt = pasynGpib->registerPort(pvxiPort->portName,
         attributes, !noAutoConnect, &vxi11,pvxiPort,priority,0);
     if(!pvxiPort->asynGpibPvt) {
@@ -1784,7 +2137,7 @@ int vxi11Configure(char *dn, char *hostName, int flags,
 #include <iocsh.h>
 static const iocshArg vxi11ConfigureArg0 = { "portName",iocshArgString};
 static const iocshArg vxi11ConfigureArg1 = { "host name",iocshArgString};
-static const iocshArg vxi11ConfigureArg2 = { "flags (no SRQ : lock devices : recover with IFC)",iocshArgInt};
+static const iocshArg vxi11ConfigureArg2 = { "flags (client per link : no SRQ : lock devices : recover with IFC)",iocshArgInt};
 static const iocshArg vxi11ConfigureArg3 = { "default timeout",iocshArgString};
 static const iocshArg vxi11ConfigureArg4 = { "vxiName",iocshArgString};
 static const iocshArg vxi11ConfigureArg5 = { "priority",iocshArgInt};
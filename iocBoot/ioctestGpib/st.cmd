@@ -15,6 +15,12 @@ dbLoadRecords("../../db/asynRecord.db","P=asyn,R=Record,PORT=L0,ADDR=3,OMAX=0,IM
 #The following two commands are for the E5810
 #E5810Reboot("164.54.8.129",0)
 #vxi11Configure("L0","164.54.8.129",0,"0.0","gpib0",0,0)
+#With flags 0x8 each GPIB address has its own connection to the E5810
+#vxi11Configure("L0","164.54.8.129",0x8,"0.0","gpib0",0,0)
+
+#vxi11Loopback(messageSize,nReads) tests large reads against a VXI-11 server
+#that runs in this IOC, so no instrument is needed
+#vxi11Loopback(1000000,10)
 
 #The following is for a TDS5054B
 vxi11Configure("L0","164.54.9.21",0,"0.0","inst0",0,0)
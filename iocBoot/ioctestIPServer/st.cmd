@@ -16,5 +16,12 @@ dbLoadRecords("../../db/testIPServer.db", "P=testIPServer:")
 iocInit()
 
 ipEchoServer("P5001")
+# Measure the rate of line oriented reads through the echo server
+#drvAsynIPPortConfigure("BENCH","localhost:5001",0,0,0)
+#ipEchoBench("BENCH",100000,64)
+# Test a drvAsynIPMultiPort with 8 addresses
+#ipMultiPortTest(8)
+# Test a drvAsynIPServerMultiPort on port 5010 with 4 clients
+#ipServerMultiTest(5010,4)
 seq("ipSNCServer", "P=testIPServer:, PORT=P5002")
 
@@ -14,10 +14,13 @@ testUSBTMC_registerRecordDeviceDriver pdbbase
 
 ###############################################################################
 # Configure hardware
-# usbtmcConfigure(port, vendorNum, productNum, serialNumberStr, priority, flags)
+# usbtmcConfigure(port, vendorNum, productNum, serialNumberStr, priority, flags,
+#                 transferSize, transferCount)
 usbtmcConfigure("usbtmc1")
 asynSetTraceIOMask("usbtmc1",0,0x2)
 asynSetTraceMask("usbtmc1",0,0x03)
+# Check the pipelined reads against a simulated device with 4 transfers
+#testUsbtmcPipeline(4)
 
 ###############################################################################
 # Load record instances
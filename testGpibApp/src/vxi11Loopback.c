@@ -0,0 +1,566 @@
+/* vxi11Loopback.c */
+/***********************************************************************
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+* National Laboratory.
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+/* Loopback test for drvVxi11.  A stand-in VXI-11 core server, built from
+ * the XDR routines in vxi11/rpc/vxi11core_xdr.c, runs in a thread of this
+ * IOC.  It is not registered with the portmapper, so the vxi11 port is
+ * configured with host name localhost:port.
+ *
+ * The server answers a write of "DATA n" with a message of n bytes.
+ * device_read returns at most requestSize bytes of it, sets reason END
+ * on the last part and REQCNT on the others, just as an instrument does.
+ *
+ * Requests from different TCP connections are handed to a pool of worker
+ * threads, so that a port with a client per device link can be checked
+ * for concurrency.  The RPC server library is not thread safe, so every
+ * svc call, and the link data, is protected by the server lock.  The only
+ * thing done without it is the wait of the link to address SLOW_ADDR of
+ * gateway "gw0", which answers device_read after SLOW_READ seconds.
+ *
+ * The ports are disconnected and disabled at the end, so that they do
+ * not try to reconnect to a server that is gone.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsMessageQueue.h>
+#include <epicsTime.h>
+#include <epicsStdio.h>
+#include <cantProceed.h>
+#include <asynDriver.h>
+#include <asynOctet.h>
+#include <asynOctetSyncIO.h>
+#include <asynOptionSyncIO.h>
+#include <asynCommonSyncIO.h>
+#include <drvVxi11.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/select.h>
+#include "osiRpc.h"
+#include "vxi11core.h"
+
+#define TIMEOUT 5.0
+/* drvVxi11 flags */
+#define FLAG_NO_SRQ          0x4
+#define FLAG_CLIENT_PER_LINK 0x8
+#define SERVER_MAX_RECV_SIZE 65536
+#define NUM_LINKS   32
+#define NUM_WORKERS 4
+#define SLOW_ADDR   5
+#define FAST_ADDR   12
+#define SLOW_READ   1.0
+
+/* lid 0 is the gateway or inst0, lid n is address n */
+typedef struct loopLink {
+    char         *message;
+    u_long       messageSize;
+    u_long       messagePos;
+}loopLink;
+
+typedef struct loopServer {
+    SVCXPRT      *xprt;
+    int          stop;
+    epicsEventId done;
+    loopLink     link[NUM_LINKS];
+    unsigned long nReads;
+    epicsMutexId lock;    /* for svc calls, link, nReads, busy and stop */
+    fd_set       busy;    /* connections that a worker is serving */
+    int          wakeFd[2];
+    epicsMessageQueueId workQueue;
+    epicsEventId workerDone;
+}loopServer;
+
+/* svc_register has no user pointer, and there is only one server at a time */
+static loopServer *pserver;
+
+/* loopDispatch is called by svc_getreqset with the server lock held */
+
+static char patternByte(u_long i)
+{
+    return (char)('!' + i % 94);
+}
+
+static loopLink *findLink(loopServer *ps, Device_Link lid)
+{
+    return &ps->link[(lid < NUM_LINKS) ? lid : 0];
+}
+
+static void newMessage(loopLink *plink, const char *cmd, u_int len)
+{
+    char  buffer[40];
+    u_long i;
+
+    if(len >= sizeof(buffer)) len = sizeof(buffer) - 1;
+    memcpy(buffer, cmd, len);
+    buffer[len] = 0;
+    if(strncmp(buffer, "DATA ", 5) != 0) return;
+    plink->messageSize = strtoul(buffer + 5, NULL, 0);
+    plink->messagePos = 0;
+    free(plink->message);
+    plink->message = mallocMustSucceed(plink->messageSize + 1, "vxi11Loopback");
+    for(i = 0; i < plink->messageSize; i++) plink->message[i] = patternByte(i);
+}
+
+static void loopDispatch(struct svc_req *rqstp, SVCXPRT *xprt)
+{
+    loopServer *ps = pserver;
+
+    switch(rqstp->rq_proc) {
+    case NULLPROC:
+        svc_sendreply(xprt, (xdrproc_t)xdr_void, NULL);
+        return;
+    case create_link: {
+        Create_LinkParms parms;
+        Create_LinkResp  resp;
+
+        memset(&parms, 0, sizeof(parms));
+        if(!svc_getargs(xprt, (xdrproc_t)xdr_Create_LinkParms, (caddr_t)&parms)) {
+            svcerr_decode(xprt);
+            return;
+        }
+        memset(&resp, 0, sizeof(resp));
+        if(parms.device && strchr(parms.device, ','))
+            resp.lid = atoi(strchr(parms.device, ',') + 1) % NUM_LINKS;
+        svc_freeargs(xprt, (xdrproc_t)xdr_Create_LinkParms, (caddr_t)&parms);
+        resp.maxRecvSize = SERVER_MAX_RECV_SIZE;
+        svc_sendreply(xprt, (xdrproc_t)xdr_Create_LinkResp, (caddr_t)&resp);
+        return;
+    }
+    case device_write: {
+        Device_WriteParms parms;
+        Device_WriteResp  resp;
+
+        memset(&parms, 0, sizeof(parms));
+        if(!svc_getargs(xprt, (xdrproc_t)xdr_Device_WriteParms, (caddr_t)&parms)) {
+            svcerr_decode(xprt);
+            return;
+        }
+        newMessage(findLink(ps, parms.lid), parms.data.data_val,
+            parms.data.data_len);
+        resp.error = 0;
+        resp.size = parms.data.data_len;
+        svc_freeargs(xprt, (xdrproc_t)xdr_Device_WriteParms, (caddr_t)&parms);
+        svc_sendreply(xprt, (xdrproc_t)xdr_Device_WriteResp, (caddr_t)&resp);
+        return;
+    }
+    case device_read: {
+        Device_ReadParms parms;
+        Device_ReadResp  resp;
+        loopLink         *plink;
+        u_long           n;
+
+        memset(&parms, 0, sizeof(parms));
+        if(!svc_getargs(xprt, (xdrproc_t)xdr_Device_ReadParms, (caddr_t)&parms)) {
+            svcerr_decode(xprt);
+            return;
+        }
+        plink = findLink(ps, parms.lid);
+        if(parms.lid == SLOW_ADDR) {
+            /* Let the other connections be served meanwhile */
+            epicsMutexUnlock(ps->lock);
+            epicsThreadSleep(SLOW_READ);
+            epicsMutexMustLock(ps->lock);
+        }
+        memset(&resp, 0, sizeof(resp));
+        ps->nReads++;
+        n = plink->messageSize - plink->messagePos;
+        if(!plink->message) {
+            resp.error = 15; /* I/O timeout */
+        } else if(n > parms.requestSize) {
+            n = parms.requestSize;
+            resp.reason = 1; /* REQCNT */
+        } else {
+            resp.reason = 4; /* END */
+        }
+        if(plink->message) {
+            resp.data.data_len = n;
+            resp.data.data_val = plink->message + plink->messagePos;
+            plink->messagePos += n;
+        }
+        svc_sendreply(xprt, (xdrproc_t)xdr_Device_ReadResp, (caddr_t)&resp);
+        if(plink->message && plink->messagePos == plink->messageSize) {
+            free(plink->message);
+            plink->message = NULL;
+        }
+        return;
+    }
+    case device_docmd: {
+        /* Bus status requests of a gateway, with no SRQ */
+        Device_DocmdParms parms;
+        Device_DocmdResp  resp;
+        char              result[2] = {0, 0};
+
+        memset(&parms, 0, sizeof(parms));
+        if(!svc_getargs(xprt, (xdrproc_t)xdr_Device_DocmdParms, (caddr_t)&parms)) {
+            svcerr_decode(xprt);
+            return;
+        }
+        svc_freeargs(xprt, (xdrproc_t)xdr_Device_DocmdParms, (caddr_t)&parms);
+        memset(&resp, 0, sizeof(resp));
+        resp.data_out.data_out_len = sizeof(result);
+        resp.data_out.data_out_val = result;
+        svc_sendreply(xprt, (xdrproc_t)xdr_Device_DocmdResp, (caddr_t)&resp);
+        return;
+    }
+    case destroy_link:
+    case device_clear:
+    case device_remote:
+    case device_local:
+    case device_lock:
+    case device_unlock:
+    case device_enable_srq: {
+        Device_Error resp;
+
+        resp.error = 0;
+        svc_sendreply(xprt, (xdrproc_t)xdr_Device_Error, (caddr_t)&resp);
+        return;
+    }
+    default:
+        svcerr_noproc(xprt);
+        return;
+    }
+}
+
+static void serveFd(loopServer *ps, int fd)
+{
+    fd_set readfds;
+
+    FD_ZERO(&readfds);
+    FD_SET(fd, &readfds);
+    epicsMutexMustLock(ps->lock);
+    svc_getreqset(&readfds);
+    epicsMutexUnlock(ps->lock);
+}
+
+static void loopWorkerThread(loopServer *ps)
+{
+    int fd;
+
+    while(epicsMessageQueueReceive(ps->workQueue, &fd, sizeof(fd)) == sizeof(fd)
+    && fd >= 0) {
+        serveFd(ps, fd);
+        epicsMutexMustLock(ps->lock);
+        FD_CLR(fd, &ps->busy);
+        epicsMutexUnlock(ps->lock);
+        if(write(ps->wakeFd[1], "", 1) != 1) break;
+    }
+    epicsEventSignal(ps->workerDone);
+}
+
+/* Accepts connections and hands each request to a worker */
+static void loopServerThread(loopServer *ps)
+{
+    fd_set         readfds;
+    struct timeval tv;
+    char           drain[16];
+    int            fd, stop;
+
+    for(;;) {
+        epicsMutexMustLock(ps->lock);
+        stop = ps->stop;
+        readfds = svc_fdset;
+        for(fd = 0; fd < FD_SETSIZE; fd++)
+            if(FD_ISSET(fd, &ps->busy)) FD_CLR(fd, &readfds);
+        epicsMutexUnlock(ps->lock);
+        if(stop) break;
+        FD_SET(ps->wakeFd[0], &readfds);
+        tv.tv_sec = 0;
+        tv.tv_usec = 100000;
+        if(select(FD_SETSIZE, &readfds, NULL, NULL, &tv) <= 0) continue;
+        if(FD_ISSET(ps->wakeFd[0], &readfds)) {
+            if(read(ps->wakeFd[0], drain, sizeof(drain)) < 0) break;
+            FD_CLR(ps->wakeFd[0], &readfds);
+        }
+        for(fd = 0; fd < FD_SETSIZE; fd++) {
+            if(!FD_ISSET(fd, &readfds)) continue;
+            if(fd == ps->xprt->xp_fd) {
+                serveFd(ps, fd);
+                continue;
+            }
+            epicsMutexMustLock(ps->lock);
+            FD_SET(fd, &ps->busy);
+            epicsMutexUnlock(ps->lock);
+            epicsMessageQueueSend(ps->workQueue, &fd, sizeof(fd));
+        }
+    }
+    epicsEventSignal(ps->done);
+}
+
+static int checkPattern(const char *buffer, size_t n, u_long offset)
+{
+    size_t i;
+
+    for(i = 0; i < n; i++)
+        if(buffer[i] != patternByte(offset + i)) return 0;
+    return 1;
+}
+
+static int readMessage(asynUser *pasynUser, size_t messageSize,
+    size_t bufferSize, int nLoops, double *seconds)
+{
+    char           command[40];
+    char           *buffer;
+    size_t         nwrite, nread, nTotal;
+    int            eomReason;
+    asynStatus     status;
+    epicsTimeStamp startTime, endTime;
+    int            nBad = 0;
+    int            i;
+
+    buffer = mallocMustSucceed(bufferSize, "vxi11Loopback");
+    epicsSnprintf(command, sizeof(command), "DATA %lu", (unsigned long)messageSize);
+    epicsTimeGetCurrent(&startTime);
+    for(i = 0; i < nLoops; i++) {
+        status = pasynOctetSyncIO->write(pasynUser, command, strlen(command),
+            TIMEOUT, &nwrite);
+        if(status != asynSuccess) {
+            printf("    write failed: %s\n", pasynUser->errorMessage);
+            nBad++;
+            break;
+        }
+        nTotal = 0;
+        do {
+            status = pasynOctetSyncIO->read(pasynUser, buffer, bufferSize,
+                TIMEOUT, &nread, &eomReason);
+            if(status != asynSuccess) {
+                printf("    read failed: %s\n", pasynUser->errorMessage);
+                break;
+            }
+            if(!checkPattern(buffer, nread, nTotal)) status = asynError;
+            nTotal += nread;
+        } while(status == asynSuccess && !(eomReason & ASYN_EOM_END));
+        if(status != asynSuccess || nTotal != messageSize) nBad++;
+    }
+    epicsTimeGetCurrent(&endTime);
+    *seconds = epicsTimeDiffInSeconds(&endTime, &startTime);
+    free(buffer);
+    return nBad;
+}
+
+/* Closes the connections of a port and keeps it from reconnecting */
+static void closePort(const char *portName)
+{
+    asynUser *pasynUser;
+
+    if(pasynCommonSyncIO->connect(portName, -1, &pasynUser, NULL) != asynSuccess)
+        return;
+    pasynManager->autoConnect(pasynUser, 0);
+    pasynCommonSyncIO->disconnectDevice(pasynUser);
+    pasynManager->enable(pasynUser, 0);
+    pasynCommonSyncIO->disconnect(pasynUser);
+}
+
+typedef struct slowRead {
+    asynUser     *pasynUser;
+    epicsEventId done;
+    int          nBad;
+}slowRead;
+
+static void slowReadThread(slowRead *pslow)
+{
+    double seconds;
+
+    pslow->nBad = readMessage(pslow->pasynUser, 10, 10, 1, &seconds);
+    epicsEventSignal(pslow->done);
+}
+
+/* Times reads from FAST_ADDR while a read from SLOW_ADDR is in progress */
+static int gatewayTest(const char *hostName, int flags, int nLoops)
+{
+    static int  portNumber;
+    char        portName[40];
+    asynUser    *pasynUserSlow;
+    asynUser    *pasynUserFast;
+    slowRead    slow;
+    double      seconds;
+    int         nBad;
+
+    epicsSnprintf(portName, sizeof(portName), "vxi11Gw%d", portNumber++);
+    vxi11Configure(portName, (char *)hostName, flags, "0.0", "gw0", 0, 0);
+    if(pasynOctetSyncIO->connect(portName, SLOW_ADDR, &pasynUserSlow, NULL)
+    || pasynOctetSyncIO->connect(portName, FAST_ADDR, &pasynUserFast, NULL)) {
+        printf("    can't connect to %s\n", portName);
+        closePort(portName);
+        return 1;
+    }
+    /* The fast link is created before it is timed */
+    nBad = readMessage(pasynUserFast, 100, 100, 1, &seconds);
+    slow.pasynUser = pasynUserSlow;
+    slow.done = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadCreate("vxi11Slow", epicsThreadPriorityMedium,
+        epicsThreadGetStackSize(epicsThreadStackMedium),
+        (EPICSTHREADFUNC)slowReadThread, &slow);
+    epicsThreadSleep(0.1);
+    nBad += readMessage(pasynUserFast, 100, 100, nLoops, &seconds);
+    epicsEventMustWait(slow.done);
+    epicsEventDestroy(slow.done);
+    nBad += slow.nBad;
+    printf("    %-15s  %9.3f  %3d\n",
+        (flags & FLAG_CLIENT_PER_LINK) ? "client per link" : "shared client",
+        seconds, nBad);
+    if((flags & FLAG_CLIENT_PER_LINK) && seconds > SLOW_READ / 2) {
+        printf("    addr %d was stalled by addr %d\n", FAST_ADDR, SLOW_ADDR);
+        nBad++;
+    }
+    pasynOctetSyncIO->disconnect(pasynUserFast);
+    pasynOctetSyncIO->disconnect(pasynUserSlow);
+    closePort(portName);
+    return nBad;
+}
+
+static void vxi11Loopback(int messageSize, int nLoops)
+{
+    static const char *readSizes[] = {"0", "65536", "4096"};
+    static int   portNumber;
+    loopServer   server;
+    char         portName[40];
+    char         hostName[40];
+    asynUser     *pasynUser;
+    asynUser     *pasynUserOption;
+    double       seconds;
+    int          nBad, nFail = 0;
+    int          i;
+
+    if(messageSize <= 0) messageSize = 1000000;
+    if(nLoops <= 0) nLoops = 10;
+    if(pserver) {
+        printf("vxi11Loopback: already running\n");
+        return;
+    }
+    memset(&server, 0, sizeof(server));
+    server.xprt = svctcp_create(RPC_ANYSOCK, 0, 0);
+    if(!server.xprt) {
+        printf("vxi11Loopback: svctcp_create failed\n");
+        return;
+    }
+    /* protocol 0 so that the portmapper is not used */
+    if(!svc_register(server.xprt, DEVICE_CORE, DEVICE_CORE_VERSION,
+                     loopDispatch, 0)) {
+        printf("vxi11Loopback: svc_register failed\n");
+        svc_destroy(server.xprt);
+        return;
+    }
+    if(pipe(server.wakeFd) < 0) {
+        printf("vxi11Loopback: pipe failed\n");
+        svc_unregister(DEVICE_CORE, DEVICE_CORE_VERSION);
+        svc_destroy(server.xprt);
+        return;
+    }
+    pserver = &server;
+    server.lock = epicsMutexMustCreate();
+    server.done = epicsEventMustCreate(epicsEventEmpty);
+    server.workerDone = epicsEventMustCreate(epicsEventEmpty);
+    server.workQueue = epicsMessageQueueCreate(FD_SETSIZE, sizeof(int));
+    for(i = 0; i < NUM_WORKERS; i++)
+        epicsThreadCreate("vxi11LoopWork", epicsThreadPriorityMedium,
+            epicsThreadGetStackSize(epicsThreadStackMedium),
+            (EPICSTHREADFUNC)loopWorkerThread, &server);
+    epicsThreadCreate("vxi11Loopback", epicsThreadPriorityMedium,
+        epicsThreadGetStackSize(epicsThreadStackMedium),
+        (EPICSTHREADFUNC)loopServerThread, &server);
+
+    epicsSnprintf(portName, sizeof(portName), "vxi11Loop%d", portNumber++);
+    epicsSnprintf(hostName, sizeof(hostName), "127.0.0.1:%u",
+        (unsigned)server.xprt->xp_port);
+    vxi11Configure(portName, hostName, FLAG_NO_SRQ, "0.0", "inst0", 0, 0);
+    if(pasynOctetSyncIO->connect(portName, 0, &pasynUser, NULL)
+    || pasynOptionSyncIO->connect(portName, 0, &pasynUserOption, NULL)) {
+        printf("vxi11Loopback: can't connect to %s\n", portName);
+        closePort(portName);
+        nFail++;
+        goto done;
+    }
+    printf("vxi11Loopback: %s on %s, %d reads of %d bytes\n",
+        portName, hostName, nLoops, messageSize);
+    printf("    readsize  buffer  device_reads/message  MB/second  bad\n");
+    for(i = 0; i < (int)(sizeof(readSizes)/sizeof(readSizes[0])); i++) {
+        unsigned long nReads;
+
+        epicsMutexMustLock(server.lock);
+        nReads = server.nReads;
+        epicsMutexUnlock(server.lock);
+        pasynOptionSyncIO->setOption(pasynUserOption, "readsize", readSizes[i],
+            TIMEOUT);
+        nBad = readMessage(pasynUser, messageSize, messageSize, nLoops, &seconds);
+        epicsMutexMustLock(server.lock);
+        nReads = server.nReads - nReads;
+        epicsMutexUnlock(server.lock);
+        printf("    %8s  %6s  %20.1f  %9.1f  %3d\n", readSizes[i], "whole",
+            (double)nReads / nLoops,
+            (double)messageSize * nLoops / seconds / 1e6, nBad);
+        nFail += nBad;
+    }
+    /* A buffer smaller than the message */
+    pasynOptionSyncIO->setOption(pasynUserOption, "readsize", "0", TIMEOUT);
+    nBad = readMessage(pasynUser, messageSize, 10000, 1, &seconds);
+    printf("    %8s  %6d  %20s  %9s  %3d\n", "0", 10000, "", "", nBad);
+    nFail += nBad;
+    pasynManager->report(stdout, 2, portName);
+    pasynOptionSyncIO->disconnect(pasynUserOption);
+    pasynOctetSyncIO->disconnect(pasynUser);
+    closePort(portName);
+    printf("    gateway gw0, addr %d answers after %.1f s\n", SLOW_ADDR, SLOW_READ);
+    printf("    device links     addr %d seconds  bad\n", FAST_ADDR);
+    nFail += gatewayTest(hostName, FLAG_NO_SRQ, nLoops);
+    nFail += gatewayTest(hostName, FLAG_NO_SRQ|FLAG_CLIENT_PER_LINK, nLoops);
+done:
+    printf("vxi11Loopback: %s\n", nFail ? "FAILED" : "all tests passed");
+    epicsMutexMustLock(server.lock);
+    server.stop = 1;
+    epicsMutexUnlock(server.lock);
+    epicsEventMustWait(server.done);
+    for(i = 0; i < NUM_WORKERS; i++) {
+        int fd = -1;
+
+        epicsMessageQueueSend(server.workQueue, &fd, sizeof(fd));
+        epicsEventMustWait(server.workerDone);
+    }
+    epicsEventDestroy(server.done);
+    epicsEventDestroy(server.workerDone);
+    epicsMessageQueueDestroy(server.workQueue);
+    epicsMutexDestroy(server.lock);
+    close(server.wakeFd[0]);
+    close(server.wakeFd[1]);
+    svc_unregister(DEVICE_CORE, DEVICE_CORE_VERSION);
+    svc_destroy(server.xprt);
+    for(i = 0; i < NUM_LINKS; i++) free(server.link[i].message);
+    pserver = NULL;
+}
+#else
+static void vxi11Loopback(int messageSize, int nLoops)
+{
+    printf("vxi11Loopback: VXI-11 is not supported on Windows\n");
+}
+#endif
+
+static const iocshArg vxi11LoopbackArg0 = {"message size", iocshArgInt};
+static const iocshArg vxi11LoopbackArg1 = {"number of reads", iocshArgInt};
+static const iocshArg *const vxi11LoopbackArgs[] = {
+    &vxi11LoopbackArg0,
+    &vxi11LoopbackArg1};
+static const iocshFuncDef vxi11LoopbackDef =
+    {"vxi11Loopback", 2, vxi11LoopbackArgs};
+static void vxi11LoopbackCall(const iocshArgBuf * args)
+{
+    vxi11Loopback(args[0].ival, args[1].ival);
+}
+
+static void vxi11LoopbackRegister(void)
+{
+    static int firstTime = 1;
+    if(!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&vxi11LoopbackDef,vxi11LoopbackCall);
+}
+epicsExportRegistrar(vxi11LoopbackRegister);
@@ -0,0 +1,122 @@
+/* ipEchoBench.c */
+/***********************************************************************
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+* National Laboratory.
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/*
+ * Throughput test for line oriented reads through asynInterposeEos.
+ * Sends lines to an ipEchoServer, reads the echoed lines back and prints
+ * the rate.  The client port is normally created with
+ *     drvAsynIPPortConfigure("BENCH","localhost:5001",0,0,0)
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cantProceed.h>
+#include <epicsTime.h>
+#include <asynDriver.h>
+#include <asynOctet.h>
+#include <asynOctetSyncIO.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+/* ipEchoServer reads at most 80 characters */
+#define MAX_LINE_LEN  78
+/* Lines sent before reading the replies */
+#define LINES_PER_BATCH 64
+#define TIMEOUT 5.0
+
+static void ipEchoBench(const char *portName, int nLines, int lineLen)
+{
+    asynUser       *pasynUser;
+    asynStatus     status;
+    char           *batch;
+    char           reply[MAX_LINE_LEN + 3];
+    size_t         batchLen, nwrite, nread;
+    int            eomReason;
+    int            i, j, nBatch, nDone = 0, nBad = 0;
+    epicsTimeStamp start, end;
+    double         elapsed;
+
+    if (!portName || !*portName) {
+        printf("Usage: ipEchoBench port nLines lineLen\n");
+        return;
+    }
+    if (nLines <= 0) nLines = 100000;
+    if (lineLen <= 0) lineLen = 64;
+    if (lineLen > MAX_LINE_LEN) lineLen = MAX_LINE_LEN;
+    status = pasynOctetSyncIO->connect(portName, 0, &pasynUser, NULL);
+    if (status) {
+        printf("ipEchoBench: unable to connect to port %s\n", portName);
+        return;
+    }
+    pasynOctetSyncIO->setInputEos(pasynUser, "\r\n", 2);
+    pasynOctetSyncIO->setOutputEos(pasynUser, "", 0);
+    batch = callocMustSucceed(LINES_PER_BATCH, lineLen + 2, "ipEchoBench");
+    for (i = 0; i < LINES_PER_BATCH; i++) {
+        char *line = batch + i * (lineLen + 2);
+        for (j = 0; j < lineLen; j++) line[j] = 'A' + (i + j) % 26;
+        line[lineLen] = '\r';
+        line[lineLen + 1] = '\n';
+    }
+    epicsTimeGetCurrent(&start);
+    while (nDone < nLines) {
+        nBatch = nLines - nDone;
+        if (nBatch > LINES_PER_BATCH) nBatch = LINES_PER_BATCH;
+        batchLen = nBatch * (lineLen + 2);
+        status = pasynOctetSyncIO->write(pasynUser, batch, batchLen,
+                                         TIMEOUT, &nwrite);
+        if (status) {
+            printf("ipEchoBench: write error %s\n", pasynUser->errorMessage);
+            goto done;
+        }
+        for (i = 0; i < nBatch; i++) {
+            status = pasynOctetSyncIO->read(pasynUser, reply, sizeof(reply),
+                                            TIMEOUT, &nread, &eomReason);
+            if (status) {
+                printf("ipEchoBench: read error %s\n", pasynUser->errorMessage);
+                goto done;
+            }
+            if ((nread != (size_t)lineLen) || !(eomReason & ASYN_EOM_EOS)
+             || memcmp(reply, batch + i * (lineLen + 2), lineLen)) nBad++;
+        }
+        nDone += nBatch;
+    }
+done:
+    epicsTimeGetCurrent(&end);
+    elapsed = epicsTimeDiffInSeconds(&end, &start);
+    if (elapsed <= 0) elapsed = 1e-9;
+    printf("ipEchoBench: %d lines of %d bytes in %.3f seconds, %d bad\n",
+           nDone, lineLen, elapsed, nBad);
+    printf("    %.0f lines/second, %.3f MB/second\n", nDone / elapsed,
+           (double)nDone * (lineLen + 2) / elapsed / 1e6);
+    free(batch);
+    pasynOctetSyncIO->disconnect(pasynUser);
+}
+
+static const iocshArg ipEchoBenchArg0 = {"port", iocshArgString};
+static const iocshArg ipEchoBenchArg1 = {"number of lines", iocshArgInt};
+static const iocshArg ipEchoBenchArg2 = {"line length", iocshArgInt};
+static const iocshArg *const ipEchoBenchArgs[] = {
+    &ipEchoBenchArg0,
+    &ipEchoBenchArg1,
+    &ipEchoBenchArg2};
+static const iocshFuncDef ipEchoBenchDef = {"ipEchoBench", 3, ipEchoBenchArgs};
+static void ipEchoBenchCall(const iocshArgBuf * args)
+{
+    ipEchoBench(args[0].sval, args[1].ival, args[2].ival);
+}
+
+static void ipEchoBenchRegister(void)
+{
+    static int firstTime = 1;
+    if(!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&ipEchoBenchDef,ipEchoBenchCall);
+}
+epicsExportRegistrar(ipEchoBenchRegister);
@@ -0,0 +1,234 @@
+/* ipMultiPortTest.c */
+/***********************************************************************
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+* National Laboratory.
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/*
+ * Test of drvAsynIPMultiPortConfigure.  Starts an echo server for each
+ * address, which waits before each reply, then checks that every address
+ * of a multi-device port talks to its own server and that the addresses
+ * are served at the same time by the port threads.
+ *     ipMultiPortTest nAddr
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cantProceed.h>
+#include <osiSock.h>
+#include <epicsStdio.h>
+#include <epicsEvent.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsUnitTest.h>
+#include <asynDriver.h>
+#include <asynOctetSyncIO.h>
+#include <asynOptionSyncIO.h>
+#include <drvAsynIPPort.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#define MAX_ADDR 16
+#define REPLY_DELAY 0.1
+#define TIMEOUT 2.0
+#define NTESTS 10
+
+typedef struct echoServer {
+    SOCKET      listenFd;
+    int         port;
+}echoServer;
+
+typedef struct echoClient {
+    const char   *portName;
+    int          addr;
+    int          ok;
+    epicsEventId done;
+}echoClient;
+
+/* Echoes each line REPLY_DELAY seconds after it arrives, one client at a time */
+static void echoServerThread(void *arg)
+{
+    echoServer *pserver = (echoServer *)arg;
+    char       buffer[80];
+    int        n;
+
+    for (;;) {
+        SOCKET fd = epicsSocketAccept(pserver->listenFd, NULL, NULL);
+
+        if (fd == INVALID_SOCKET) {
+            epicsThreadSleep(1.0);
+            continue;
+        }
+        while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            epicsThreadSleep(REPLY_DELAY);
+            if (send(fd, buffer, n, 0) != n) break;
+        }
+        epicsSocketDestroy(fd);
+    }
+}
+
+static int startEchoServer(void)
+{
+    echoServer    *pserver;
+    osiSockAddr   addr;
+    osiSocklen_t  addrLen = sizeof(addr.ia);
+
+    pserver = callocMustSucceed(1, sizeof(*pserver), "ipMultiPortTest");
+    pserver->listenFd = epicsSocketCreate(AF_INET, SOCK_STREAM, 0);
+    if (pserver->listenFd == INVALID_SOCKET) {
+        free(pserver);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.ia.sin_port = 0;
+    if ((bind(pserver->listenFd, &addr.sa, sizeof(addr.ia)) < 0) ||
+        (getsockname(pserver->listenFd, &addr.sa, &addrLen) < 0) ||
+        (listen(pserver->listenFd, 1) < 0)) {
+        epicsSocketDestroy(pserver->listenFd);
+        free(pserver);
+        return -1;
+    }
+    pserver->port = ntohs(addr.ia.sin_port);
+    /* The server runs until the IOC exits */
+    epicsThreadCreate("ipMultiEcho", epicsThreadPriorityMedium,
+                      epicsThreadGetStackSize(epicsThreadStackSmall),
+                      echoServerThread, pserver);
+    return pserver->port;
+}
+
+/* Sends a line naming the address and checks the reply */
+static int echoAddr(const char *portName, int addr)
+{
+    asynUser   *pasynUser;
+    char       message[40], reply[40];
+    size_t     nwrite, nread;
+    int        eomReason;
+    asynStatus status;
+
+    if (pasynOctetSyncIO->connect(portName, addr, &pasynUser, NULL) != asynSuccess)
+        return 0;
+    pasynOctetSyncIO->setInputEos(pasynUser, "\n", 1);
+    pasynOctetSyncIO->setOutputEos(pasynUser, "\n", 1);
+    epicsSnprintf(message, sizeof(message), "address %d", addr);
+    status = pasynOctetSyncIO->writeRead(pasynUser, message, strlen(message),
+        reply, sizeof(reply), TIMEOUT, &nwrite, &nread, &eomReason);
+    pasynOctetSyncIO->disconnect(pasynUser);
+    return (status == asynSuccess) && (strcmp(reply, message) == 0);
+}
+
+static void echoClientThread(void *arg)
+{
+    echoClient *pclient = (echoClient *)arg;
+
+    pclient->ok = echoAddr(pclient->portName, pclient->addr);
+    epicsEventSignal(pclient->done);
+}
+
+static void ipMultiPortTest(int nAddr)
+{
+    static int     portNumber;
+    char           portName[40];
+    char           hostInfo[40];
+    char           value[40];
+    echoClient     client[MAX_ADDR];
+    asynUser       *pasynUserOption;
+    epicsTimeStamp startTime, endTime;
+    double         elapsed;
+    int            addr, port, allOk;
+
+    if ((nAddr <= 0) || (nAddr > MAX_ADDR)) nAddr = 4;
+    epicsSnprintf(portName, sizeof(portName), "ipMultiPortTest%d", portNumber++);
+    testPlan(NTESTS);
+    testDiag("%s %d addresses", portName, nAddr);
+    /* The last address has no device */
+    testOk(drvAsynIPMultiPortConfigure(portName, nAddr+1, 0, 0, 0, 0) == 0,
+        "configure");
+    allOk = 1;
+    for (addr = 0; addr < nAddr; addr++) {
+        port = startEchoServer();
+        epicsSnprintf(hostInfo, sizeof(hostInfo), "127.0.0.1:%d", port);
+        if ((port < 0) || (drvAsynIPMultiPortAdd(portName, addr, hostInfo) != 0))
+            allOk = 0;
+    }
+    testOk(allOk, "add a device for each address");
+    if (!allOk) {
+        testSkip(NTESTS-2, "no devices");
+        testDone();
+        return;
+    }
+    testOk(drvAsynIPMultiPortAdd(portName, 0, hostInfo) != 0,
+        "an address can only be added once");
+    testOk(drvAsynIPMultiPortAdd(portName, nAddr+1, hostInfo) != 0,
+        "an address beyond maxAddr is rejected");
+
+    allOk = 1;
+    for (addr = 0; addr < nAddr; addr++)
+        if (!echoAddr(portName, addr)) allOk = 0;
+    testOk(allOk, "each address talks to its own device");
+    testOk(!echoAddr(portName, nAddr),
+        "an address without a device fails");
+
+    /* Every server waits REPLY_DELAY, so the requests only finish in
+     * about REPLY_DELAY if they run at the same time */
+    epicsTimeGetCurrent(&startTime);
+    for (addr = 0; addr < nAddr; addr++) {
+        client[addr].portName = portName;
+        client[addr].addr = addr;
+        client[addr].ok = 0;
+        client[addr].done = epicsEventMustCreate(epicsEventEmpty);
+        epicsThreadCreate("ipMultiClient", epicsThreadPriorityMedium,
+                          epicsThreadGetStackSize(epicsThreadStackSmall),
+                          echoClientThread, &client[addr]);
+    }
+    allOk = 1;
+    for (addr = 0; addr < nAddr; addr++) {
+        epicsEventMustWait(client[addr].done);
+        epicsEventDestroy(client[addr].done);
+        if (!client[addr].ok) allOk = 0;
+    }
+    epicsTimeGetCurrent(&endTime);
+    elapsed = epicsTimeDiffInSeconds(&endTime, &startTime);
+    testDiag("%d concurrent requests took %f s", nAddr, elapsed);
+    testOk(allOk, "concurrent requests all succeed");
+    testOk(elapsed < (nAddr > 1 ? nAddr * REPLY_DELAY * 0.75 : 2 * REPLY_DELAY),
+        "concurrent requests run at the same time");
+
+    if (pasynOptionSyncIO->connect(portName, 0, &pasynUserOption, NULL) == asynSuccess) {
+        value[0] = 0;
+        pasynOptionSyncIO->getOption(pasynUserOption, "connectTimeout",
+            value, sizeof(value), TIMEOUT);
+        testOk(atof(value) == 2.0,
+            "connectTimeout defaults to 2 seconds");
+        testOk(pasynOptionSyncIO->setOption(
+            pasynUserOption, "connectTimeout", "-1", TIMEOUT) != asynSuccess,
+            "connectTimeout -1 is rejected");
+        pasynOptionSyncIO->disconnect(pasynUserOption);
+    } else {
+        testFail("connect asynOption");
+        testSkip(1, "no asynOption");
+    }
+    testDone();
+}
+
+static const iocshArg ipMultiPortTestArg0 = {"nAddr", iocshArgInt};
+static const iocshArg *const ipMultiPortTestArgs[] = {&ipMultiPortTestArg0};
+static const iocshFuncDef ipMultiPortTestDef = {"ipMultiPortTest", 1, ipMultiPortTestArgs};
+static void ipMultiPortTestCall(const iocshArgBuf * args)
+{
+    ipMultiPortTest(args[0].ival);
+}
+
+static void ipMultiPortTestRegister(void)
+{
+    static int firstTime = 1;
+    if (!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&ipMultiPortTestDef, ipMultiPortTestCall);
+}
+epicsExportRegistrar(ipMultiPortTestRegister);
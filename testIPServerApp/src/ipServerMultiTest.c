@@ -0,0 +1,384 @@
+/* ipServerMultiTest.c */
+/***********************************************************************
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+* National Laboratory.
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/*
+ * Test of drvAsynIPServerMultiPortConfigure.  Connects TCP clients to a
+ * multi-device server port on localhost and checks that each one gets
+ * its own address and that the port echoes what they send.  It then
+ * checks that input is never lost when nobody reads for a while, that
+ * interrupt users get all the input of a client that nobody reads, that
+ * an address is reused after its client goes away without passing on
+ * what the old client sent, and that clients are still accepted after
+ * the listening socket is closed and reopened.
+ *     ipServerMultiTest port nClients
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cantProceed.h>
+#include <osiSock.h>
+#include <epicsStdio.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsUnitTest.h>
+#include <asynDriver.h>
+#include <asynOctet.h>
+#include <asynOctetSyncIO.h>
+#include <asynCommonSyncIO.h>
+#include <drvAsynIPServerPort.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#define MAX_CLIENTS 16
+#define TIMEOUT 2.0
+#define NTESTS 13
+/* Several times the input buffer the port keeps for each client */
+#define BULK_SIZE 65536
+
+typedef struct bulkSender {
+    SOCKET       fd;
+    int          ok;
+    epicsEventId done;
+}bulkSender;
+
+typedef struct interruptCount {
+    epicsMutexId lock;
+    size_t       total;
+    int          ok;
+}interruptCount;
+
+static SOCKET connectClient(int port)
+{
+    SOCKET        fd;
+    osiSockAddr   addr;
+    struct timeval tv;
+
+    fd = epicsSocketCreate(AF_INET, SOCK_STREAM, 0);
+    if (fd == INVALID_SOCKET)
+        return fd;
+    memset(&addr, 0, sizeof(addr));
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.ia.sin_port = htons(port);
+    tv.tv_sec = (long)TIMEOUT;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (const void *)&tv, sizeof(tv));
+    if (connect(fd, &addr.sa, sizeof(addr.ia)) < 0) {
+        epicsSocketDestroy(fd);
+        return INVALID_SOCKET;
+    }
+    return fd;
+}
+
+/* Waits for the port to see the client at addr connect or go away */
+static int waitConnected(const char *portName, int addr, int connected)
+{
+    asynUser *pasynUser = pasynManager->createAsynUser(0, 0);
+    int      yesNo = !connected;
+    int      i;
+
+    if (pasynManager->connectDevice(pasynUser, portName, addr) == asynSuccess) {
+        for (i = 0; i < 100; i++) {
+            pasynManager->isConnected(pasynUser, &yesNo);
+            if (yesNo == connected) break;
+            epicsThreadSleep(TIMEOUT / 100);
+        }
+    }
+    pasynManager->freeAsynUser(pasynUser);
+    return yesNo == connected;
+}
+
+/* The client sends a line, the port reads it and sends a reply */
+static int echoClient(const char *portName, int addr, SOCKET fd)
+{
+    asynUser   *pasynUser;
+    char       message[40], reply[40], buffer[40];
+    size_t     nwrite, nread, len;
+    int        eomReason, n;
+    asynStatus status;
+
+    if (pasynOctetSyncIO->connect(portName, addr, &pasynUser, NULL) != asynSuccess)
+        return 0;
+    pasynOctetSyncIO->setInputEos(pasynUser, "\n", 1);
+    pasynOctetSyncIO->setOutputEos(pasynUser, "\n", 1);
+    epicsSnprintf(message, sizeof(message), "client %d", addr);
+    len = strlen(message);
+    message[len] = '\n';
+    status = (send(fd, message, (int)len + 1, 0) == (int)len + 1) ? asynSuccess : asynError;
+    message[len] = 0;
+    if (status == asynSuccess)
+        status = pasynOctetSyncIO->read(pasynUser, buffer, sizeof(buffer),
+            TIMEOUT, &nread, &eomReason);
+    if ((status == asynSuccess) && (strcmp(buffer, message) != 0))
+        status = asynError;
+    epicsSnprintf(reply, sizeof(reply), "reply %d", addr);
+    if (status == asynSuccess)
+        status = pasynOctetSyncIO->write(pasynUser, reply, strlen(reply),
+            TIMEOUT, &nwrite);
+    pasynOctetSyncIO->disconnect(pasynUser);
+    if (status != asynSuccess)
+        return 0;
+    for (len = 0; len < strlen(reply) + 1; len += n) {
+        n = recv(fd, buffer + len, (int)(strlen(reply) + 1 - len), 0);
+        if (n <= 0) return 0;
+    }
+    return (memcmp(buffer, reply, strlen(reply)) == 0) && (buffer[len-1] == '\n');
+}
+
+static void bulkSenderThread(void *arg)
+{
+    bulkSender *psender = (bulkSender *)arg;
+    char       *data = mallocMustSucceed(BULK_SIZE, "ipServerMultiTest");
+    int        i, n;
+
+    for (i = 0; i < BULK_SIZE; i++)
+        data[i] = (char)('a' + (i % 26));
+    psender->ok = 1;
+    for (i = 0; i < BULK_SIZE; i += n) {
+        n = send(psender->fd, data + i, BULK_SIZE - i, 0);
+        if (n <= 0) {
+            psender->ok = 0;
+            break;
+        }
+    }
+    free(data);
+    epicsEventSignal(psender->done);
+}
+
+/* Sends BULK_SIZE characters while nobody reads, then reads them all */
+static int bulkClient(const char *portName, int addr, SOCKET fd)
+{
+    asynUser   *pasynUser;
+    bulkSender sender;
+    char       buffer[1000];
+    size_t     nread, nwant, total = 0, i;
+    int        eomReason, ok = 1;
+
+    if (pasynOctetSyncIO->connect(portName, addr, &pasynUser, NULL) != asynSuccess)
+        return 0;
+    pasynOctetSyncIO->setInputEos(pasynUser, "", 0);
+    sender.fd = fd;
+    sender.done = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadCreate("ipServerBulk", epicsThreadPriorityMedium,
+                      epicsThreadGetStackSize(epicsThreadStackSmall),
+                      bulkSenderThread, &sender);
+    /* Let the port fill the client's input buffer */
+    epicsThreadSleep(0.5);
+    while (ok && (total < BULK_SIZE)) {
+        /* Without an EOS a read waits until it has all it asked for */
+        nwant = BULK_SIZE - total;
+        if (nwant > sizeof(buffer)) nwant = sizeof(buffer);
+        if (pasynOctetSyncIO->read(pasynUser, buffer, nwant, TIMEOUT,
+                &nread, &eomReason) != asynSuccess)
+            break;
+        for (i = 0; i < nread; i++) {
+            if (buffer[i] != (char)('a' + ((total + i) % 26))) {
+                ok = 0;
+                break;
+            }
+        }
+        total += nread;
+    }
+    epicsEventMustWait(sender.done);
+    epicsEventDestroy(sender.done);
+    pasynOctetSyncIO->setInputEos(pasynUser, "\n", 1);
+    pasynOctetSyncIO->disconnect(pasynUser);
+    testDiag("read %lu of %d characters", (unsigned long)total, BULK_SIZE);
+    return ok && sender.ok && (total == BULK_SIZE);
+}
+
+static void interruptCallback(void *userPvt, asynUser *pasynUser,
+    char *data, size_t numchars, int eomReason)
+{
+    interruptCount *pcount = (interruptCount *)userPvt;
+    size_t         i;
+
+    epicsMutexMustLock(pcount->lock);
+    for (i = 0; i < numchars; i++)
+        if (data[i] != (char)('a' + ((pcount->total + i) % 26)))
+            pcount->ok = 0;
+    pcount->total += numchars;
+    epicsMutexUnlock(pcount->lock);
+}
+
+/* Sends BULK_SIZE characters that only an interrupt user takes */
+static int interruptClient(const char *portName, int addr, SOCKET fd)
+{
+    asynUser       *pasynUser;
+    asynInterface  *pasynInterface;
+    asynOctet      *pasynOctet;
+    void           *registrarPvt;
+    interruptCount count;
+    bulkSender     sender;
+    size_t         total = 0;
+    int            i;
+
+    pasynUser = pasynManager->createAsynUser(0, 0);
+    if ((pasynManager->connectDevice(pasynUser, portName, addr) != asynSuccess) ||
+        !(pasynInterface = pasynManager->findInterface(pasynUser, asynOctetType, 1))) {
+        pasynManager->freeAsynUser(pasynUser);
+        return 0;
+    }
+    pasynOctet = (asynOctet *)pasynInterface->pinterface;
+    count.lock = epicsMutexMustCreate();
+    count.total = 0;
+    count.ok = 1;
+    if (pasynOctet->registerInterruptUser(pasynInterface->drvPvt, pasynUser,
+            interruptCallback, &count, &registrarPvt) != asynSuccess) {
+        epicsMutexDestroy(count.lock);
+        pasynManager->freeAsynUser(pasynUser);
+        return 0;
+    }
+    sender.fd = fd;
+    sender.done = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadCreate("ipServerBulk", epicsThreadPriorityMedium,
+                      epicsThreadGetStackSize(epicsThreadStackSmall),
+                      bulkSenderThread, &sender);
+    epicsEventMustWait(sender.done);
+    epicsEventDestroy(sender.done);
+    for (i = 0; i < 100; i++) {
+        epicsMutexMustLock(count.lock);
+        total = count.total;
+        epicsMutexUnlock(count.lock);
+        if (total >= BULK_SIZE) break;
+        epicsThreadSleep(TIMEOUT / 100);
+    }
+    pasynOctet->cancelInterruptUser(pasynInterface->drvPvt, pasynUser, registrarPvt);
+    /* The input buffer for read() overflowed, start the next test afresh */
+    pasynOctet->flush(pasynInterface->drvPvt, pasynUser);
+    pasynManager->freeAsynUser(pasynUser);
+    epicsMutexDestroy(count.lock);
+    testDiag("interrupt users got %lu of %d characters", (unsigned long)total, BULK_SIZE);
+    return count.ok && sender.ok && (total == BULK_SIZE);
+}
+
+/* Reads one line of two, so the rest stays in asynInterposeEos */
+static int staleClient(const char *portName, int addr, SOCKET fd)
+{
+    asynUser   *pasynUser;
+    char       buffer[40];
+    size_t     nread;
+    int        eomReason;
+    asynStatus status;
+
+    if (pasynOctetSyncIO->connect(portName, addr, &pasynUser, NULL) != asynSuccess)
+        return 0;
+    pasynOctetSyncIO->setInputEos(pasynUser, "\n", 1);
+    status = (send(fd, "old\nstale", 9, 0) == 9) ? asynSuccess : asynError;
+    if (status == asynSuccess)
+        status = pasynOctetSyncIO->read(pasynUser, buffer, sizeof(buffer),
+            TIMEOUT, &nread, &eomReason);
+    pasynOctetSyncIO->disconnect(pasynUser);
+    return (status == asynSuccess) && (strcmp(buffer, "old") == 0);
+}
+
+static void ipServerMultiTest(int port, int nClients)
+{
+    static int portNumber;
+    char       portName[40];
+    char       serverInfo[40];
+    char       buffer[8];
+    SOCKET     client[MAX_CLIENTS];
+    SOCKET     extra;
+    asynUser   *pasynUserCommon;
+    int        i, allOk;
+
+    if (port <= 0) port = 5010;
+    if ((nClients < 3) || (nClients > MAX_CLIENTS)) nClients = 4;
+    epicsSnprintf(portName, sizeof(portName), "ipServerMultiTest%d", portNumber++);
+    epicsSnprintf(serverInfo, sizeof(serverInfo), "localhost:%d", port);
+    testPlan(NTESTS);
+    testDiag("%s on %s, %d clients", portName, serverInfo, nClients);
+    if (!testOk(drvAsynIPServerMultiPortConfigure(portName, serverInfo,
+            nClients, 0, 0, 0) == 0, "configure")) {
+        testSkip(NTESTS-1, "no port");
+        testDone();
+        return;
+    }
+
+    allOk = 1;
+    for (i = 0; i < nClients; i++) {
+        client[i] = connectClient(port);
+        if ((client[i] == INVALID_SOCKET) || !waitConnected(portName, i, 1))
+            allOk = 0;
+    }
+    testOk(allOk, "each client gets the next address");
+    allOk = 1;
+    for (i = 0; i < nClients; i++)
+        if ((client[i] == INVALID_SOCKET) || !echoClient(portName, i, client[i]))
+            allOk = 0;
+    testOk(allOk, "each address echoes its own client");
+
+    extra = connectClient(port);
+    testOk((extra == INVALID_SOCKET) || (recv(extra, buffer, sizeof(buffer), 0) <= 0),
+        "a client beyond maxClients is closed");
+    if (extra != INVALID_SOCKET) epicsSocketDestroy(extra);
+
+    testOk((client[0] != INVALID_SOCKET) && bulkClient(portName, 0, client[0]),
+        "no input is lost while nobody reads");
+    testOk((client[0] != INVALID_SOCKET) && echoClient(portName, 0, client[0]),
+        "the client still echoes after a full buffer");
+    testOk((client[2] != INVALID_SOCKET) && interruptClient(portName, 2, client[2]),
+        "interrupt users get input that nobody reads");
+    testOk((client[2] != INVALID_SOCKET) && echoClient(portName, 2, client[2]),
+        "the client still echoes after its input was dropped");
+
+    testOk((client[1] != INVALID_SOCKET) && staleClient(portName, 1, client[1]),
+        "a partial line is left in asynInterposeEos");
+
+    if (client[1] != INVALID_SOCKET) epicsSocketDestroy(client[1]);
+    testOk(waitConnected(portName, 1, 0),
+        "the address disconnects when its client closes");
+    client[1] = connectClient(port);
+    testOk((client[1] != INVALID_SOCKET) && waitConnected(portName, 1, 1)
+        && echoClient(portName, 1, client[1]),
+        "a new client gets the free address, not the old input");
+
+    /* The new listening socket usually gets the number of the old one */
+    if (client[1] != INVALID_SOCKET) epicsSocketDestroy(client[1]);
+    waitConnected(portName, 1, 0);
+    allOk = 0;
+    if (pasynCommonSyncIO->connect(portName, -1, &pasynUserCommon, NULL) == asynSuccess) {
+        allOk = (pasynCommonSyncIO->disconnectDevice(pasynUserCommon) == asynSuccess)
+             && (pasynCommonSyncIO->connectDevice(pasynUserCommon) == asynSuccess);
+        pasynCommonSyncIO->disconnect(pasynUserCommon);
+    }
+    testOk(allOk, "close and reopen the listening socket");
+    client[1] = connectClient(port);
+    testOk((client[1] != INVALID_SOCKET) && waitConnected(portName, 1, 1)
+        && echoClient(portName, 1, client[1]),
+        "a client is accepted after the listener is reopened");
+
+    for (i = 0; i < nClients; i++)
+        if (client[i] != INVALID_SOCKET) epicsSocketDestroy(client[i]);
+    pasynManager->report(stdout, 2, portName);
+    testDone();
+}
+
+static const iocshArg ipServerMultiTestArg0 = {"port", iocshArgInt};
+static const iocshArg ipServerMultiTestArg1 = {"nClients", iocshArgInt};
+static const iocshArg *const ipServerMultiTestArgs[] = {
+    &ipServerMultiTestArg0, &ipServerMultiTestArg1};
+static const iocshFuncDef ipServerMultiTestDef =
+    {"ipServerMultiTest", 2, ipServerMultiTestArgs};
+static void ipServerMultiTestCall(const iocshArgBuf * args)
+{
+    ipServerMultiTest(args[0].ival, args[1].ival);
+}
+
+static void ipServerMultiTestRegister(void)
+{
+    static int firstTime = 1;
+    if (!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&ipServerMultiTestDef, ipServerMultiTestCall);
+}
+epicsExportRegistrar(ipServerMultiTestRegister);
@@ -0,0 +1,210 @@
+/* testDelayPacing.c */
+/***********************************************************************
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+* National Laboratory.
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+/* Checks the pacing of asynInterposeDelay.  The port is a multi-device
+ * port whose octet write only records what it is given.  The delay is
+ * interposed for address 0, and the asynManager report at the end shows
+ * its statistics after the driver report.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsTime.h>
+#include <epicsStdio.h>
+#include <epicsUnitTest.h>
+#include <asynDriver.h>
+#include <asynOctet.h>
+#include <asynOctetSyncIO.h>
+#include <asynOptionSyncIO.h>
+#include <asynInterposeDelay.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#define MAX_CHARS 1000
+#define TIMEOUT 1.0
+#define NTESTS 10
+
+typedef struct delayPacing {
+    asynInterface  common;
+    asynInterface  octet;
+    asynOctet      asynOctet;
+    char           data[MAX_CHARS];
+    size_t         nData;
+    size_t         maxWrite;
+}delayPacing;
+
+static void pacingReport(void *drvPvt,FILE *fp,int details)
+{
+    delayPacing *pdelayPacing = (delayPacing *)drvPvt;
+
+    fprintf(fp,"    testDelayPacing characters %lu\n",
+        (unsigned long)pdelayPacing->nData);
+}
+
+static asynStatus pacingConnect(void *drvPvt,asynUser *pasynUser)
+{
+    pasynManager->exceptionConnect(pasynUser);
+    return asynSuccess;
+}
+
+static asynStatus pacingDisconnect(void *drvPvt,asynUser *pasynUser)
+{
+    pasynManager->exceptionDisconnect(pasynUser);
+    return asynSuccess;
+}
+
+static asynCommon pacingCommon = {
+    pacingReport,pacingConnect,pacingDisconnect
+};
+
+static asynStatus pacingWrite(void *drvPvt,asynUser *pasynUser,
+    const char *data,size_t numchars,size_t *nbytesTransfered)
+{
+    delayPacing *pdelayPacing = (delayPacing *)drvPvt;
+
+    if(numchars>MAX_CHARS-pdelayPacing->nData)
+        numchars = MAX_CHARS-pdelayPacing->nData;
+    memcpy(pdelayPacing->data+pdelayPacing->nData,data,numchars);
+    pdelayPacing->nData += numchars;
+    if(numchars>pdelayPacing->maxWrite) pdelayPacing->maxWrite = numchars;
+    *nbytesTransfered = numchars;
+    return asynSuccess;
+}
+
+/* Writes message and returns the elapsed time */
+static double timeWrite(delayPacing *pdelayPacing,asynUser *pasynUser,
+    const char *message,size_t nChars)
+{
+    epicsTimeStamp startTime,endTime;
+    size_t         nwrite;
+
+    pdelayPacing->nData = 0;
+    pdelayPacing->maxWrite = 0;
+    epicsTimeGetCurrent(&startTime);
+    pasynOctetSyncIO->write(pasynUser,message,nChars,
+        TIMEOUT+nChars*0.1,&nwrite);
+    epicsTimeGetCurrent(&endTime);
+    return epicsTimeDiffInSeconds(&endTime,&startTime);
+}
+
+static void testDelayPacing(double delay,int nChars)
+{
+    static int   portNumber;
+    char         portName[40];
+    char         message[MAX_CHARS];
+    delayPacing  *pdelayPacing;
+    asynUser     *pasynUserOctet;
+    asynUser     *pasynUserOption;
+    asynStatus   status;
+    double       elapsed,early;
+    int          i;
+
+    if(delay<=0) delay = 0.001;
+    if(nChars<=0 || nChars>MAX_CHARS) nChars = 100;
+    testPlan(NTESTS);
+    /*The port can not be removed so pdelayPacing is never freed*/
+    pdelayPacing = calloc(1,sizeof(delayPacing));
+    if(!pdelayPacing) {
+        testFail("out of memory");
+        testDone();
+        return;
+    }
+    pdelayPacing->common.interfaceType = asynCommonType;
+    pdelayPacing->common.pinterface = &pacingCommon;
+    pdelayPacing->common.drvPvt = pdelayPacing;
+    pdelayPacing->asynOctet.write = pacingWrite;
+    pdelayPacing->octet.interfaceType = asynOctetType;
+    pdelayPacing->octet.pinterface = &pdelayPacing->asynOctet;
+    pdelayPacing->octet.drvPvt = pdelayPacing;
+    epicsSnprintf(portName,sizeof(portName),"delayPacing%d",portNumber++);
+    status = pasynManager->registerPort(portName,ASYN_MULTIDEVICE,1,0,0);
+    if(status==asynSuccess)
+        status = pasynManager->registerInterface(portName,&pdelayPacing->common);
+    if(status==asynSuccess)
+        status = pasynOctetBase->initialize(portName,&pdelayPacing->octet,0,0,0);
+    if(status!=asynSuccess || asynInterposeDelay(portName,0,delay)!=0) {
+        testFail("could not create port %s",portName);
+        testDone();
+        return;
+    }
+    if(pasynOctetSyncIO->connect(portName,0,&pasynUserOctet,NULL)!=asynSuccess) {
+        testFail("can't connect to %s",portName);
+        testDone();
+        return;
+    }
+    if(pasynOptionSyncIO->connect(portName,0,&pasynUserOption,NULL)!=asynSuccess) {
+        testFail("can't connect asynOption to %s",portName);
+        pasynOctetSyncIO->disconnect(pasynUserOctet);
+        testDone();
+        return;
+    }
+    for(i=0; i<nChars; i++) message[i] = 'a' + i%26;
+    testDiag("%s delay %g s, %d characters",portName,delay,nChars);
+
+    elapsed = timeWrite(pdelayPacing,pasynUserOctet,message,nChars);
+    testDiag("sleep pacing %f s, %f s per character",elapsed,elapsed/nChars);
+    testOk(pdelayPacing->maxWrite==1,
+        "sleep pacing writes one character at a time");
+    testOk(elapsed>=nChars*delay,
+        "sleep pacing is never early");
+
+    testOk(pasynOptionSyncIO->setOption(pasynUserOption,
+        "pacing","clock",TIMEOUT)==asynSuccess,
+        "set pacing clock");
+    elapsed = timeWrite(pdelayPacing,pasynUserOctet,message,nChars);
+    testDiag("clock pacing %f s, %f s per character, writes of up to %lu",
+        elapsed,elapsed/nChars,(unsigned long)pdelayPacing->maxWrite);
+    testOk(pdelayPacing->nData==(size_t)nChars
+        && memcmp(pdelayPacing->data,message,nChars)==0,
+        "clock pacing sends every character in order");
+    /* The first write is not delayed, and a burst goes at once */
+    early = (nChars - (double)pdelayPacing->maxWrite)*delay - elapsed;
+    testOk(early<=1e-4,
+        "clock pacing is never early");
+    testOk(elapsed<=nChars*delay + 0.01,
+        "clock pacing keeps the rate (%f s late)",-early);
+
+    testOk(pasynOptionSyncIO->setOption(pasynUserOption,
+        "burst","5",TIMEOUT)==asynSuccess,
+        "set burst 5");
+    elapsed = timeWrite(pdelayPacing,pasynUserOctet,message,nChars);
+    testOk(pdelayPacing->maxWrite<=5 && pdelayPacing->nData==(size_t)nChars
+        && memcmp(pdelayPacing->data,message,nChars)==0,
+        "burst 5 writes up to 5 characters");
+    /* The first burst waits for the deadline left by the last message */
+    testOk(elapsed<=(nChars+5)*delay + 0.01,
+        "burst 5 keeps the rate");
+    testOk(pasynOptionSyncIO->setOption(pasynUserOption,
+        "burst","101",TIMEOUT)!=asynSuccess,
+        "burst 101 is rejected");
+
+    pasynManager->report(stdout,1,portName);
+    pasynOptionSyncIO->disconnect(pasynUserOption);
+    pasynOctetSyncIO->disconnect(pasynUserOctet);
+    testDone();
+}
+
+static const iocshArg testDelayPacingArg0 = {"delay", iocshArgDouble};
+static const iocshArg testDelayPacingArg1 = {"nChars", iocshArgInt};
+static const iocshArg *const testDelayPacingArgs[] = {
+    &testDelayPacingArg0,&testDelayPacingArg1};
+static const iocshFuncDef testDelayPacingDef =
+    {"testDelayPacing", 2, testDelayPacingArgs};
+static void testDelayPacingCall(const iocshArgBuf * args)
+{
+    testDelayPacing(args[0].dval,args[1].ival);
+}
+
+static void testDelayPacingRegister(void)
+{
+    static int firstTime = 1;
+    if(!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&testDelayPacingDef,testDelayPacingCall);
+}
+epicsExportRegistrar(testDelayPacingRegister);
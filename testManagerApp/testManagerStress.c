@@ -0,0 +1,544 @@
+/* testManagerStress.c */
+/***********************************************************************
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+* National Laboratory.
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+/* Stress tests and benchmarks of asynManager methods that are called
+ * from many threads at once.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <epicsStdio.h>
+#include <asynDriver.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+typedef struct stressThread {
+    const char    *portName;
+    int           nLoops;
+    int           failures;
+    epicsEventId  start;
+    epicsEventId  done;
+}stressThread;
+
+/* Each loop does what a SyncIO *Once call does with its asynUser */
+static void asynUserStressThread(stressThread *pstressThread)
+{
+    asynUser   *pasynUser;
+    asynStatus status;
+    int        i;
+
+    epicsEventMustWait(pstressThread->start);
+    for(i=0; i<pstressThread->nLoops; i++) {
+        pasynUser = pasynManager->createAsynUser(0,0);
+        if(pstressThread->portName) {
+            status = pasynManager->connectDevice(pasynUser,
+                pstressThread->portName,0);
+            if(status!=asynSuccess) pstressThread->failures++;
+        }
+        status = pasynManager->freeAsynUser(pasynUser);
+        if(status!=asynSuccess) pstressThread->failures++;
+    }
+    epicsEventSignal(pstressThread->done);
+}
+
+static void testAsynUserStress(int nThreads,int nLoops,const char *portName)
+{
+    stressThread   *pstressThread;
+    epicsTimeStamp startTime,endTime;
+    double         elapsed;
+    char           name[20];
+    int            failures = 0;
+    int            i;
+
+    if(nThreads<=0) nThreads = 8;
+    if(nLoops<=0) nLoops = 100000;
+    if(portName && strlen(portName)==0) portName = 0;
+    pstressThread = calloc(nThreads,sizeof(stressThread));
+    if(!pstressThread) {
+        printf("testAsynUserStress: out of memory\n");
+        return;
+    }
+    for(i=0; i<nThreads; i++) {
+        pstressThread[i].portName = portName;
+        pstressThread[i].nLoops = nLoops;
+        pstressThread[i].start = epicsEventMustCreate(epicsEventEmpty);
+        pstressThread[i].done = epicsEventMustCreate(epicsEventEmpty);
+        epicsSnprintf(name,sizeof(name),"asynUserStress%d",i);
+        epicsThreadCreate(name,epicsThreadPriorityMedium,
+            epicsThreadGetStackSize(epicsThreadStackSmall),
+            (EPICSTHREADFUNC)asynUserStressThread,&pstressThread[i]);
+    }
+    epicsTimeGetCurrent(&startTime);
+    for(i=0; i<nThreads; i++) epicsEventSignal(pstressThread[i].start);
+    for(i=0; i<nThreads; i++) {
+        epicsEventMustWait(pstressThread[i].done);
+        failures += pstressThread[i].failures;
+        epicsEventDestroy(pstressThread[i].start);
+        epicsEventDestroy(pstressThread[i].done);
+    }
+    epicsTimeGetCurrent(&endTime);
+    elapsed = epicsTimeDiffInSeconds(&endTime,&startTime);
+    printf("testAsynUserStress threads %d loops %d port %s failures %d\n",
+        nThreads,nLoops,(portName ? portName : "none"),failures);
+    printf("    elapsed %f seconds, %f microseconds per create/free\n",
+        elapsed,elapsed*1e6/((double)nThreads*nLoops));
+    free(pstressThread);
+}
+
+/* Does what IOC initialization does with many ports and records.
+ * Ports can not be removed so each call registers new ports.
+ */
+static void testPortInitBench(int nPorts,int nAddr)
+{
+    static int     benchNumber = 0;
+    asynUser       *pasynUser;
+    asynStatus     status;
+    epicsTimeStamp startTime,registerTime,connectTime,reconnectTime;
+    char           portName[40];
+    int            failures = 0;
+    int            i,addr,pass;
+
+    if(nPorts<=0) nPorts = 1000;
+    if(nAddr<=0) nAddr = 10;
+    benchNumber++;
+    epicsTimeGetCurrent(&startTime);
+    for(i=0; i<nPorts; i++) {
+        epicsSnprintf(portName,sizeof(portName),"bench%d_%d",benchNumber,i);
+        status = pasynManager->registerPort(portName,ASYN_MULTIDEVICE,0,0,0);
+        if(status!=asynSuccess) failures++;
+    }
+    epicsTimeGetCurrent(&registerTime);
+    /*The first pass creates the devices, the second finds them*/
+    for(pass=0; pass<2; pass++) {
+        for(i=0; i<nPorts; i++) {
+            epicsSnprintf(portName,sizeof(portName),"bench%d_%d",benchNumber,i);
+            for(addr=0; addr<nAddr; addr++) {
+                pasynUser = pasynManager->createAsynUser(0,0);
+                status = pasynManager->connectDevice(pasynUser,portName,addr);
+                if(status!=asynSuccess) failures++;
+                pasynManager->freeAsynUser(pasynUser);
+            }
+        }
+        epicsTimeGetCurrent(pass==0 ? &connectTime : &reconnectTime);
+    }
+    printf("testPortInitBench ports %d addresses %d failures %d\n",
+        nPorts,nAddr,failures);
+    printf("    registerPort %f seconds\n",
+        epicsTimeDiffInSeconds(&registerTime,&startTime));
+    printf("    connectDevice new devices %f seconds, existing devices %f seconds\n",
+        epicsTimeDiffInSeconds(&connectTime,&registerTime),
+        epicsTimeDiffInSeconds(&reconnectTime,&connectTime));
+}
+
+/* A port for testQueueBench. Odd addresses never connect */
+typedef struct queueBench {
+    asynInterface common;
+    int           nProcessed;
+    int           nTimeout;
+    int           nExpected;
+    epicsEventId  done;
+}queueBench;
+
+static void queueBenchReport(void *drvPvt,FILE *fp,int details) {}
+
+static asynStatus queueBenchConnect(void *drvPvt,asynUser *pasynUser)
+{
+    int addr;
+
+    pasynManager->getAddr(pasynUser,&addr);
+    if(addr>=0 && (addr&1)) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "addr %d never connects",addr);
+        return asynError;
+    }
+    pasynManager->exceptionConnect(pasynUser);
+    return asynSuccess;
+}
+
+static asynStatus queueBenchDisconnect(void *drvPvt,asynUser *pasynUser)
+{
+    pasynManager->exceptionDisconnect(pasynUser);
+    return asynSuccess;
+}
+
+static asynCommon queueBenchCommon = {
+    queueBenchReport,queueBenchConnect,queueBenchDisconnect
+};
+
+static void queueBenchCallback(queueBench *pqueueBench,int timeout)
+{
+    /*Only called by the port thread*/
+    if(timeout) pqueueBench->nTimeout++;
+    if(++pqueueBench->nProcessed==pqueueBench->nExpected)
+        epicsEventSignal(pqueueBench->done);
+}
+static void queueBenchProcess(asynUser *pasynUser)
+{
+    queueBenchCallback((queueBench *)pasynUser->userPvt,0);
+}
+static void queueBenchTimeout(asynUser *pasynUser)
+{
+    queueBenchCallback((queueBench *)pasynUser->userPvt,1);
+}
+
+/* Measures how long the port thread takes to process nRequests requests for
+ * nAddr addresses, half of which are not connected, while nParked requests
+ * are queued for other addresses that are disabled.
+ */
+static void testQueueBench(int nParked,int nRequests,int nAddr)
+{
+    static int     benchNumber = 0;
+    char           portName[40];
+    queueBench     *pbench;
+    asynUser       **pasynUsers;
+    asynUser       *pasynUser;
+    asynStatus     status;
+    epicsTimeStamp startTime,endTime;
+    double         elapsed;
+    int            nTotal,i,addr;
+
+    if(nParked<0) nParked = 10000;
+    if(nRequests<=0) nRequests = 10000;
+    if(nAddr<=0) nAddr = 10;
+    nTotal = nParked + nRequests;
+    pasynUsers = calloc(nTotal,sizeof(asynUser *));
+    /*The port can not be removed so pbench is never freed*/
+    pbench = calloc(1,sizeof(queueBench));
+    if(!pasynUsers || !pbench) {
+        printf("testQueueBench: out of memory\n");
+        free(pasynUsers); free(pbench);
+        return;
+    }
+    benchNumber++;
+    epicsSnprintf(portName,sizeof(portName),"benchQueue%d",benchNumber);
+    pbench->common.interfaceType = asynCommonType;
+    pbench->common.pinterface = &queueBenchCommon;
+    pbench->common.drvPvt = pbench;
+    status = pasynManager->registerPort(portName,
+        ASYN_CANBLOCK|ASYN_MULTIDEVICE,1,0,0);
+    if(status==asynSuccess)
+        status = pasynManager->registerInterface(portName,&pbench->common);
+    if(status!=asynSuccess) {
+        printf("testQueueBench: could not create port %s\n",portName);
+        free(pasynUsers);
+        return;
+    }
+    pbench->nExpected = nRequests;
+    pbench->done = epicsEventMustCreate(epicsEventEmpty);
+    for(i=0; i<nTotal; i++) {
+        /*Parked requests use addresses nAddr to 2*nAddr-1*/
+        addr = (i<nParked) ? nAddr + i%nAddr : (i-nParked)%nAddr;
+        pasynUser = pasynManager->createAsynUser(
+            queueBenchProcess,queueBenchTimeout);
+        pasynUser->userPvt = pbench;
+        status = pasynManager->connectDevice(pasynUser,portName,addr);
+        if(status!=asynSuccess) {
+            printf("testQueueBench: connectDevice %s\n",pasynUser->errorMessage);
+        }
+        if(i<nParked && i<nAddr) pasynManager->enable(pasynUser,0);
+        pasynUsers[i] = pasynUser;
+    }
+    for(i=0; i<nParked; i++) {
+        pasynManager->queueRequest(pasynUsers[i],asynQueuePriorityLow,0.0);
+    }
+    epicsTimeGetCurrent(&startTime);
+    for(i=nParked; i<nTotal; i++) {
+        status = pasynManager->queueRequest(pasynUsers[i],
+            asynQueuePriorityLow,0.0);
+        if(status!=asynSuccess) {
+            printf("testQueueBench: queueRequest %s\n",
+                pasynUsers[i]->errorMessage);
+            pbench->nExpected--;
+        }
+    }
+    epicsEventMustWait(pbench->done);
+    epicsTimeGetCurrent(&endTime);
+    elapsed = epicsTimeDiffInSeconds(&endTime,&startTime);
+    printf("testQueueBench port %s parked %d requests %d addresses %d\n",
+        portName,nParked,nRequests,nAddr);
+    printf("    processed %d, %d not connected, in %f seconds, "
+        "%f microseconds per request\n",
+        pbench->nProcessed,pbench->nTimeout,elapsed,elapsed*1e6/nRequests);
+    /*Enable the parked addresses so that their requests are processed*/
+    pbench->nProcessed = 0;
+    pbench->nExpected = nParked;
+    for(i=0; i<nParked && i<nAddr; i++) pasynManager->enable(pasynUsers[i],1);
+    if(nParked>0) epicsEventMustWait(pbench->done);
+    for(i=0; i<nTotal; i++) pasynManager->freeAsynUser(pasynUsers[i]);
+    epicsEventDestroy(pbench->done);
+    free(pasynUsers);
+}
+
+/* A port for testMultiThread. It is registered with ASYN_MULTITHREAD and
+ * checks the rules that asynManager must keep for such a port.
+ */
+typedef struct multiThread {
+    asynInterface common;
+    epicsMutexId  lock;
+    int           *active;       /* Per address */
+    int           *lastSeq;      /* Per address */
+    int           nActive;       /* Device requests that are running */
+    int           maxActive;
+    int           portActive;
+    int           nSameAddr;     /* Two requests for one address at once */
+    int           nOutOfOrder;
+    int           nPortOverlap;  /* A port request ran with another request */
+    int           nLockOrder;    /* A lockPort broke the lock order */
+    int           nProcessed;
+    int           nExpected;
+    epicsEventId  done;
+}multiThread;
+
+typedef struct multiRequest {
+    multiThread *pmultiThread;
+    int         addr;
+    int         seq;
+}multiRequest;
+
+static void multiThreadProcess(asynUser *pasynUser)
+{
+    multiRequest *prequest = (multiRequest *)pasynUser->userPvt;
+    multiThread  *pmultiThread = prequest->pmultiThread;
+    int          addr = prequest->addr;
+
+    epicsMutexMustLock(pmultiThread->lock);
+    if(pmultiThread->portActive) pmultiThread->nPortOverlap++;
+    if(addr<0) {
+        if(pmultiThread->nActive>0) pmultiThread->nPortOverlap++;
+        pmultiThread->portActive = 1;
+    } else {
+        if(pmultiThread->active[addr]) pmultiThread->nSameAddr++;
+        if(prequest->seq!=pmultiThread->lastSeq[addr]+1)
+            pmultiThread->nOutOfOrder++;
+        pmultiThread->lastSeq[addr] = prequest->seq;
+        pmultiThread->active[addr] = 1;
+        if(++pmultiThread->nActive>pmultiThread->maxActive)
+            pmultiThread->maxActive = pmultiThread->nActive;
+    }
+    epicsMutexUnlock(pmultiThread->lock);
+    epicsThreadSleep(0.01);
+    epicsMutexMustLock(pmultiThread->lock);
+    if(addr<0) {
+        pmultiThread->portActive = 0;
+    } else {
+        pmultiThread->active[addr] = 0;
+        pmultiThread->nActive--;
+    }
+    if(++pmultiThread->nProcessed==pmultiThread->nExpected)
+        epicsEventSignal(pmultiThread->done);
+    epicsMutexUnlock(pmultiThread->lock);
+}
+
+/* Locks an address that was created while the port was locked */
+static void multiThreadLocker(asynUser *pasynUser)
+{
+    multiThread *pmultiThread = (multiThread *)pasynUser->userPvt;
+
+    if(pasynManager->lockPort(pasynUser)==asynSuccess) {
+        pasynManager->unlockPort(pasynUser);
+        epicsEventSignal(pmultiThread->done);
+    }
+}
+
+/* The port lock must be taken before any device lock */
+static void testMultiThreadLockOrder(multiThread *pmultiThread,
+    const char *portName,int newAddr)
+{
+    asynUser *pportUser = pasynManager->createAsynUser(0,0);
+    asynUser *pdevUser = pasynManager->createAsynUser(0,0);
+    asynUser *pnewUser = pasynManager->createAsynUser(0,0);
+
+    pasynManager->connectDevice(pportUser,portName,-1);
+    pasynManager->connectDevice(pdevUser,portName,0);
+    /*A thread that holds a device lock can not lock the port*/
+    pasynManager->lockPort(pdevUser);
+    if(pasynManager->lockPort(pportUser)==asynSuccess) {
+        pmultiThread->nLockOrder++;
+        pasynManager->unlockPort(pportUser);
+    }
+    pasynManager->unlockPort(pdevUser);
+    /*but it can lock devices while it holds the port lock*/
+    pasynManager->lockPort(pportUser);
+    if(pasynManager->lockPort(pdevUser)!=asynSuccess) pmultiThread->nLockOrder++;
+    else pasynManager->unlockPort(pdevUser);
+    /*A device created while the port is locked is locked too*/
+    pasynManager->connectDevice(pnewUser,portName,newAddr);
+    pnewUser->userPvt = pmultiThread;
+    epicsThreadCreate("multiThreadLocker",epicsThreadPriorityMedium,
+        epicsThreadGetStackSize(epicsThreadStackSmall),
+        (EPICSTHREADFUNC)multiThreadLocker,pnewUser);
+    if(epicsEventWaitWithTimeout(pmultiThread->done,0.2)!=epicsEventWaitTimeout)
+        pmultiThread->nLockOrder++;
+    pasynManager->unlockPort(pportUser);
+    if(epicsEventWaitWithTimeout(pmultiThread->done,5.0)!=epicsEventWaitOK)
+        pmultiThread->nLockOrder++;
+    pasynManager->freeAsynUser(pportUser);
+    pasynManager->freeAsynUser(pdevUser);
+    pasynManager->freeAsynUser(pnewUser);
+}
+
+/* Queues nLoops requests for each of nAddr addresses and one request for
+ * the port itself after each round.  Requests for different addresses must
+ * run at the same time, requests for one address must run one at a time in
+ * queue order, and a port request must run alone.  Then checks the lock
+ * order of lockPort.
+ */
+static void testMultiThread(int nAddr,int nLoops)
+{
+    static int     testNumber = 0;
+    char           portName[40];
+    multiThread    *pmultiThread;
+    multiRequest   *prequests;
+    asynUser       **pasynUsers;
+    asynStatus     status;
+    epicsTimeStamp startTime,endTime;
+    int            nTotal,i,loop,addr;
+
+    if(nAddr<=0) nAddr = 8;
+    if(nLoops<=0) nLoops = 10;
+    nTotal = (nAddr + 1)*nLoops;
+    /*The port can not be removed so pmultiThread is never freed*/
+    pmultiThread = calloc(1,sizeof(multiThread) + 2*nAddr*sizeof(int));
+    prequests = calloc(nTotal,sizeof(multiRequest));
+    pasynUsers = calloc(nTotal,sizeof(asynUser *));
+    if(!pmultiThread || !prequests || !pasynUsers) {
+        printf("testMultiThread: out of memory\n");
+        free(pmultiThread); free(prequests); free(pasynUsers);
+        return;
+    }
+    pmultiThread->active = (int *)(pmultiThread + 1);
+    pmultiThread->lastSeq = pmultiThread->active + nAddr;
+    for(addr=0; addr<nAddr; addr++) pmultiThread->lastSeq[addr] = -1;
+    pmultiThread->lock = epicsMutexMustCreate();
+    pmultiThread->done = epicsEventMustCreate(epicsEventEmpty);
+    pmultiThread->nExpected = nTotal;
+    pmultiThread->common.interfaceType = asynCommonType;
+    pmultiThread->common.pinterface = &queueBenchCommon;
+    pmultiThread->common.drvPvt = pmultiThread;
+    epicsSnprintf(portName,sizeof(portName),"multiThread%d",testNumber++);
+    status = pasynManager->registerPort(portName,
+        ASYN_CANBLOCK|ASYN_MULTIDEVICE|ASYN_MULTITHREAD,1,0,0);
+    if(status==asynSuccess)
+        status = pasynManager->registerInterface(portName,&pmultiThread->common);
+    if(status!=asynSuccess) {
+        printf("testMultiThread: could not create port %s\n",portName);
+        free(prequests); free(pasynUsers);
+        return;
+    }
+    i = 0;
+    for(loop=0; loop<nLoops; loop++) {
+        for(addr=0; addr<=nAddr; addr++) {
+            /*Odd addresses never connect, so use even ones; addr nAddr is the port*/
+            prequests[i].pmultiThread = pmultiThread;
+            prequests[i].addr = (addr<nAddr) ? addr : -1;
+            prequests[i].seq = loop;
+            pasynUsers[i] = pasynManager->createAsynUser(multiThreadProcess,0);
+            pasynUsers[i]->userPvt = &prequests[i];
+            status = pasynManager->connectDevice(pasynUsers[i],portName,
+                (addr<nAddr) ? 2*addr : -1);
+            if(status!=asynSuccess) {
+                printf("testMultiThread: connectDevice %s\n",
+                    pasynUsers[i]->errorMessage);
+            }
+            i++;
+        }
+    }
+    epicsTimeGetCurrent(&startTime);
+    for(i=0; i<nTotal; i++) {
+        status = pasynManager->queueRequest(pasynUsers[i],
+            asynQueuePriorityLow,0.0);
+        if(status!=asynSuccess) {
+            printf("testMultiThread: queueRequest %s\n",
+                pasynUsers[i]->errorMessage);
+            epicsMutexMustLock(pmultiThread->lock);
+            if(--pmultiThread->nExpected==pmultiThread->nProcessed)
+                epicsEventSignal(pmultiThread->done);
+            epicsMutexUnlock(pmultiThread->lock);
+        }
+    }
+    epicsEventMustWait(pmultiThread->done);
+    epicsTimeGetCurrent(&endTime);
+    testMultiThreadLockOrder(pmultiThread,portName,2*nAddr);
+    printf("testMultiThread port %s addresses %d loops %d in %f seconds\n",
+        portName,nAddr,nLoops,epicsTimeDiffInSeconds(&endTime,&startTime));
+    printf("    most at once %d, same address %d, out of order %d, "
+        "port overlap %d, lock order %d\n",
+        pmultiThread->maxActive,pmultiThread->nSameAddr,
+        pmultiThread->nOutOfOrder,pmultiThread->nPortOverlap,
+        pmultiThread->nLockOrder);
+    printf("testMultiThread: %s\n",
+        (pmultiThread->nProcessed==nTotal && pmultiThread->maxActive>1
+        && pmultiThread->nSameAddr==0 && pmultiThread->nOutOfOrder==0
+        && pmultiThread->nPortOverlap==0 && pmultiThread->nLockOrder==0)
+        ? "passed" : "FAILED");
+    for(i=0; i<nTotal; i++) pasynManager->freeAsynUser(pasynUsers[i]);
+    free(prequests);
+    free(pasynUsers);
+}
+
+static const iocshArg testAsynUserStressArg0 = {"nThreads", iocshArgInt};
+static const iocshArg testAsynUserStressArg1 = {"nLoops", iocshArgInt};
+static const iocshArg testAsynUserStressArg2 = {"port", iocshArgString};
+static const iocshArg *const testAsynUserStressArgs[] = {
+    &testAsynUserStressArg0,&testAsynUserStressArg1,&testAsynUserStressArg2};
+static const iocshFuncDef testAsynUserStressDef =
+    {"testAsynUserStress", 3, testAsynUserStressArgs};
+static void testAsynUserStressCall(const iocshArgBuf * args)
+{
+    testAsynUserStress(args[0].ival,args[1].ival,args[2].sval);
+}
+
+static const iocshArg testPortInitBenchArg0 = {"nPorts", iocshArgInt};
+static const iocshArg testPortInitBenchArg1 = {"nAddr", iocshArgInt};
+static const iocshArg *const testPortInitBenchArgs[] = {
+    &testPortInitBenchArg0,&testPortInitBenchArg1};
+static const iocshFuncDef testPortInitBenchDef =
+    {"testPortInitBench", 2, testPortInitBenchArgs};
+static void testPortInitBenchCall(const iocshArgBuf * args)
+{
+    testPortInitBench(args[0].ival,args[1].ival);
+}
+
+static const iocshArg testQueueBenchArg0 = {"nParked", iocshArgInt};
+static const iocshArg testQueueBenchArg1 = {"nRequests", iocshArgInt};
+static const iocshArg testQueueBenchArg2 = {"nAddr", iocshArgInt};
+static const iocshArg *const testQueueBenchArgs[] = {
+    &testQueueBenchArg0,&testQueueBenchArg1,&testQueueBenchArg2};
+static const iocshFuncDef testQueueBenchDef =
+    {"testQueueBench", 3, testQueueBenchArgs};
+static void testQueueBenchCall(const iocshArgBuf * args)
+{
+    testQueueBench(args[0].ival,args[1].ival,args[2].ival);
+}
+
+static const iocshArg testMultiThreadArg0 = {"nAddr", iocshArgInt};
+static const iocshArg testMultiThreadArg1 = {"nLoops", iocshArgInt};
+static const iocshArg *const testMultiThreadArgs[] = {
+    &testMultiThreadArg0,&testMultiThreadArg1};
+static const iocshFuncDef testMultiThreadDef =
+    {"testMultiThread", 2, testMultiThreadArgs};
+static void testMultiThreadCall(const iocshArgBuf * args)
+{
+    testMultiThread(args[0].ival,args[1].ival);
+}
+
+static void testManagerStressRegister(void)
+{
+    static int firstTime = 1;
+    if(!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&testAsynUserStressDef,testAsynUserStressCall);
+    iocshRegister(&testPortInitBenchDef,testPortInitBenchCall);
+    iocshRegister(&testQueueBenchDef,testQueueBenchCall);
+    iocshRegister(&testMultiThreadDef,testMultiThreadCall);
+}
+epicsExportRegistrar(testManagerStressRegister);
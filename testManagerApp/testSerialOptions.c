@@ -0,0 +1,171 @@
+/* testSerialOptions.c */
+/***********************************************************************
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+* National Laboratory.
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+/* Checks the Linux specific drvAsynSerialPort options on the slave side
+ * of a pseudo terminal.  The line settings are read back from the kernel
+ * through a second file descriptor.  A pseudo terminal has no low latency
+ * or RS-485 mode, so those options must fail without changing anything.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsStdio.h>
+#include <epicsUnitTest.h>
+#include <asynDriver.h>
+#include <asynOctetSyncIO.h>
+#include <asynOptionSyncIO.h>
+#include <drvAsynSerialPort.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+
+#define TIMEOUT 1.0
+#define NTESTS 8
+
+static int optionIs(asynUser *pasynUser, const char *key, const char *expect)
+{
+    char val[40];
+
+    if(pasynOptionSyncIO->getOption(pasynUser,key,val,sizeof(val),TIMEOUT))
+        return 0;
+    return strcmp(val,expect) == 0;
+}
+
+static void testSerialOptions(void)
+{
+    static int     portNumber;
+    char           portName[40];
+    char           *slaveName;
+    int            master, probe;
+    asynUser       *pasynUserOption;
+    asynUser       *pasynUserOctet;
+    asynStatus     status;
+    struct termios t;
+    struct pollfd  pfd;
+    char           buffer[20];
+    size_t         nwrite;
+    int            n;
+
+    testPlan(NTESTS);
+    master = posix_openpt(O_RDWR|O_NOCTTY);
+    if(master<0 || grantpt(master)<0 || unlockpt(master)<0
+    || !(slaveName = ptsname(master))) {
+        testFail("can't create pseudo terminal: %s",strerror(errno));
+        if(master>=0) close(master);
+        testDone();
+        return;
+    }
+    probe = open(slaveName,O_RDWR|O_NOCTTY|O_NONBLOCK);
+    if(probe<0) {
+        testFail("can't open %s: %s",slaveName,strerror(errno));
+        close(master);
+        testDone();
+        return;
+    }
+    epicsSnprintf(portName,sizeof(portName),"serialOptions%d",portNumber++);
+    drvAsynSerialPortConfigure(portName,slaveName,0,0,0);
+    if(pasynOptionSyncIO->connect(portName,0,&pasynUserOption,NULL)
+    || pasynOctetSyncIO->connect(portName,0,&pasynUserOctet,NULL)) {
+        testFail("can't connect to %s",slaveName);
+        close(probe);
+        close(master);
+        testDone();
+        return;
+    }
+    testDiag("%s on %s",portName,slaveName);
+
+    status = pasynOptionSyncIO->setOption(pasynUserOption,"baud","115200",TIMEOUT);
+    tcgetattr(probe,&t);
+    testOk(status==asynSuccess && cfgetospeed(&t)==B115200,
+        "baud 115200");
+
+    /* Rates without a Bxxx code are set with termios2 and BOTHER (CBAUDEX) */
+    status = pasynOptionSyncIO->setOption(pasynUserOption,"baud","250000",TIMEOUT);
+    tcgetattr(probe,&t);
+    testOk(status==asynSuccess
+        && (t.c_cflag&CBAUD)==CBAUDEX && optionIs(pasynUserOption,"baud","250000"),
+        "baud 250000");
+
+    /* A pseudo terminal always has 8 bits and no parity, so use stop bits */
+    status = pasynOptionSyncIO->setOption(pasynUserOption,"stop","2",TIMEOUT);
+    tcgetattr(probe,&t);
+    testOk(status==asynSuccess
+        && (t.c_cflag&CSTOPB) && (t.c_cflag&CBAUD)==CBAUDEX,
+        "stop 2 keeps 250000 baud");
+
+    status = pasynOptionSyncIO->setOption(pasynUserOption,"baud","9600",TIMEOUT);
+    pasynOptionSyncIO->setOption(pasynUserOption,"stop","1",TIMEOUT);
+    tcgetattr(probe,&t);
+    testOk(status==asynSuccess && cfgetospeed(&t)==B9600,
+        "baud 9600");
+
+    status = pasynOptionSyncIO->setOption(pasynUserOption,"baud","-5",TIMEOUT);
+    testOk(status!=asynSuccess
+        && optionIs(pasynUserOption,"baud","9600"),
+        "baud -5 is rejected");
+
+    status = pasynOptionSyncIO->setOption(pasynUserOption,"low_latency","Y",TIMEOUT);
+    testDiag("low_latency Y: %s",
+        status ? pasynUserOption->errorMessage : "accepted");
+    testOk(status!=asynSuccess
+        && optionIs(pasynUserOption,"low_latency","N"),
+        "low_latency fails cleanly on a pty");
+
+    status = pasynOptionSyncIO->setOption(pasynUserOption,"rs485_enable","Y",TIMEOUT);
+    testDiag("rs485_enable Y: %s",
+        status ? pasynUserOption->errorMessage : "accepted");
+    testOk(status!=asynSuccess
+        && optionIs(pasynUserOption,"rs485_enable","N"),
+        "rs485_enable fails cleanly on a pty");
+
+    /* The port must still work */
+    tcflush(master,TCIFLUSH);
+    status = pasynOctetSyncIO->write(pasynUserOctet,"ping\n",5,TIMEOUT,&nwrite);
+    pfd.fd = master;
+    pfd.events = POLLIN;
+    n = 0;
+    if(status==asynSuccess && poll(&pfd,1,1000)==1)
+        n = read(master,buffer,sizeof(buffer));
+    testOk(n==5 && memcmp(buffer,"ping\n",5)==0,
+        "write after failed options");
+
+    pasynOctetSyncIO->disconnect(pasynUserOctet);
+    pasynOptionSyncIO->disconnect(pasynUserOption);
+    close(probe);
+    close(master);
+    testDone();
+}
+#else
+static void testSerialOptions(void)
+{
+    testPlan(1);
+    testSkip(1,"these options are only supported on Linux");
+    testDone();
+}
+#endif
+
+static const iocshFuncDef testSerialOptionsDef = {"testSerialOptions", 0, NULL};
+static void testSerialOptionsCall(const iocshArgBuf * args)
+{
+    testSerialOptions();
+}
+
+static void testSerialOptionsRegister(void)
+{
+    static int firstTime = 1;
+    if(!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&testSerialOptionsDef,testSerialOptionsCall);
+}
+epicsExportRegistrar(testSerialOptionsRegister);
@@ -0,0 +1,173 @@
+/* testSerialTimeout.c */
+/***********************************************************************
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+* National Laboratory.
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+/* Measures the accuracy of drvAsynSerialPort read timeouts and the
+ * latency of replies.  The serial port is the slave side of a pseudo
+ * terminal so no hardware is needed.  A thread on the master side echoes
+ * every line that it receives.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsTime.h>
+#include <epicsStdio.h>
+#include <asynDriver.h>
+#include <asynOctet.h>
+#include <asynOctetSyncIO.h>
+#include <asynCommonSyncIO.h>
+#include <drvAsynSerialPort.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+
+typedef struct ptyEcho {
+    int           fd;
+    int           stop;
+    epicsEventId  done;
+}ptyEcho;
+
+static void ptyEchoThread(ptyEcho *pptyEcho)
+{
+    struct pollfd pfd;
+    char   buffer[256];
+    int    n;
+
+    pfd.fd = pptyEcho->fd;
+    pfd.events = POLLIN;
+    while(!pptyEcho->stop) {
+        if(poll(&pfd,1,100) <= 0) continue;
+        n = read(pptyEcho->fd,buffer,sizeof(buffer));
+        if(n < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+        if(n <= 0) break;
+        if(write(pptyEcho->fd,buffer,n) != n) break;
+    }
+    epicsEventSignal(pptyEcho->done);
+}
+
+static void testSerialTimeout(int nLoops)
+{
+    static const double timeouts[] = {0.0, 0.002, 0.005, 0.01, 0.05, 0.1, 0.5};
+    static int     portNumber;
+    char           portName[40];
+    char           *slaveName;
+    ptyEcho        echo;
+    asynUser       *pasynUser;
+    asynUser       *pcommonUser;
+    asynStatus     status;
+    epicsTimeStamp startTime,endTime;
+    char           buffer[80];
+    size_t         nwrite,nread;
+    int            eomReason;
+    double         late,sum,min,max;
+    int            nBad;
+    int            i,j;
+
+    if(nLoops<=0) nLoops = 20;
+    echo.fd = posix_openpt(O_RDWR|O_NOCTTY);
+    if(echo.fd<0 || grantpt(echo.fd)<0 || unlockpt(echo.fd)<0
+    || !(slaveName = ptsname(echo.fd))) {
+        printf("testSerialTimeout: can't create pseudo terminal: %s\n",
+            strerror(errno));
+        if(echo.fd>=0) close(echo.fd);
+        return;
+    }
+    epicsSnprintf(portName,sizeof(portName),"serialTimeout%d",portNumber++);
+    drvAsynSerialPortConfigure(portName,slaveName,0,0,0);
+    status = pasynOctetSyncIO->connect(portName,0,&pasynUser,NULL);
+    if(status!=asynSuccess) {
+        printf("testSerialTimeout: can't connect to %s\n",slaveName);
+        close(echo.fd);
+        return;
+    }
+    pasynOctetSyncIO->setInputEos(pasynUser,"\n",1);
+    pasynOctetSyncIO->setOutputEos(pasynUser,"\n",1);
+    echo.stop = 0;
+    echo.done = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadCreate("ptyEcho",epicsThreadPriorityHigh,
+        epicsThreadGetStackSize(epicsThreadStackSmall),
+        (EPICSTHREADFUNC)ptyEchoThread,&echo);
+    printf("testSerialTimeout: %s on %s, %d reads per timeout\n",
+        portName,slaveName,nLoops);
+    printf("  timeout(ms)  late min(ms)  mean(ms)   max(ms)  bad\n");
+    for(i=0; i<(int)(sizeof(timeouts)/sizeof(timeouts[0])); i++) {
+        sum = max = 0.0;
+        min = 1e9;
+        nBad = 0;
+        for(j=0; j<nLoops; j++) {
+            epicsTimeGetCurrent(&startTime);
+            status = pasynOctetSyncIO->read(pasynUser,buffer,sizeof(buffer),
+                timeouts[i],&nread,&eomReason);
+            epicsTimeGetCurrent(&endTime);
+            late = epicsTimeDiffInSeconds(&endTime,&startTime) - timeouts[i];
+            if(status!=asynTimeout || nread!=0 || late<0) nBad++;
+            sum += late;
+            if(late<min) min = late;
+            if(late>max) max = late;
+        }
+        printf("  %11.1f  %12.3f  %8.3f  %8.3f  %3d\n",timeouts[i]*1e3,
+            min*1e3,sum*1e3/nLoops,max*1e3,nBad);
+    }
+    sum = max = 0.0;
+    min = 1e9;
+    nBad = 0;
+    for(j=0; j<nLoops; j++) {
+        epicsSnprintf(buffer,sizeof(buffer),"reply %d",j);
+        epicsTimeGetCurrent(&startTime);
+        status = pasynOctetSyncIO->writeRead(pasynUser,buffer,strlen(buffer),
+            buffer,sizeof(buffer),1.0,&nwrite,&nread,&eomReason);
+        epicsTimeGetCurrent(&endTime);
+        late = epicsTimeDiffInSeconds(&endTime,&startTime);
+        if(status!=asynSuccess || !(eomReason&ASYN_EOM_EOS)) nBad++;
+        sum += late;
+        if(late<min) min = late;
+        if(late>max) max = late;
+    }
+    printf("  reply latency %8.3f  %8.3f  %8.3f  %3d\n",
+        min*1e3,sum*1e3/nLoops,max*1e3,nBad);
+    pasynOctetSyncIO->disconnect(pasynUser);
+    if(pasynCommonSyncIO->connect(portName,-1,&pcommonUser,NULL)==asynSuccess) {
+        pasynCommonSyncIO->disconnectDevice(pcommonUser);
+        pasynCommonSyncIO->disconnect(pcommonUser);
+    }
+    echo.stop = 1;
+    epicsEventMustWait(echo.done);
+    epicsEventDestroy(echo.done);
+    close(echo.fd);
+}
+#else
+static void testSerialTimeout(int nLoops)
+{
+    printf("testSerialTimeout: pseudo terminals are only used on Linux\n");
+}
+#endif
+
+static const iocshArg testSerialTimeoutArg0 = {"nLoops", iocshArgInt};
+static const iocshArg *const testSerialTimeoutArgs[] = {
+    &testSerialTimeoutArg0};
+static const iocshFuncDef testSerialTimeoutDef =
+    {"testSerialTimeout", 1, testSerialTimeoutArgs};
+static void testSerialTimeoutCall(const iocshArgBuf * args)
+{
+    testSerialTimeout(args[0].ival);
+}
+
+static void testSerialTimeoutRegister(void)
+{
+    static int firstTime = 1;
+    if(!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&testSerialTimeoutDef,testSerialTimeoutCall);
+}
+epicsExportRegistrar(testSerialTimeoutRegister);
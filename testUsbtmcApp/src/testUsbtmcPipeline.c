@@ -0,0 +1,186 @@
+/* testUsbtmcPipeline.c */
+/***********************************************************************
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+* National Laboratory.
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+/* Checks drvAsynUSBTMC reads against the simulated device in usbtmcMock.c,
+ * so no USB hardware is needed.  Large reads are done with pipelined
+ * bulk-in transfers of TRANSFER_SIZE bytes, small reads with the
+ * synchronous 4096 byte transfers.
+ *     testUsbtmcPipeline transferCount
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cantProceed.h>
+#include <epicsStdio.h>
+#include <epicsUnitTest.h>
+#include <asynDriver.h>
+#include <asynOctet.h>
+#include <asynOctetSyncIO.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+#include "usbtmcMock.h"
+
+#define TRANSFER_SIZE 65536
+#define HEADER_SIZE 12
+#define TIMEOUT 1.0
+#define NTESTS 12
+
+/* Asks the device for a message of nChars and reads it with reads of
+ * up to bufSize.  Returns the number of reads, or 0 if the message was
+ * not read correctly. */
+static int readMessage(asynUser *pasynUser, size_t nChars, size_t bufSize,
+    usbtmcMockStats *pstats)
+{
+    char         command[40];
+    char         *buffer;
+    size_t       nwrite, nread, total = 0, i;
+    int          eomReason = 0, nReads = 0, ok = 1;
+    asynStatus   status;
+    usbtmcMockStats start, end;
+
+    buffer = malloc(bufSize);
+    if(!buffer) return 0;
+    epicsSnprintf(command, sizeof(command), "DATA %lu", (unsigned long)nChars);
+    usbtmcMockGetStats(&start);
+    status = pasynOctetSyncIO->write(pasynUser, command, strlen(command),
+        TIMEOUT, &nwrite);
+    while(status==asynSuccess && !(eomReason & ASYN_EOM_END)) {
+        status = pasynOctetSyncIO->read(pasynUser, buffer, bufSize, TIMEOUT,
+            &nread, &eomReason);
+        if(status!=asynSuccess) {
+            testDiag("read failed: %s", pasynUser->errorMessage);
+            break;
+        }
+        for(i=0; i<nread; i++) {
+            if((unsigned char)buffer[i]!=usbtmcMockByte(total+i)) {
+                testDiag("wrong data at %lu", (unsigned long)(total+i));
+                ok = 0;
+                break;
+            }
+        }
+        total += nread;
+        nReads++;
+        /* A read that did not end the message must have filled the buffer */
+        if(!ok || (!(eomReason & ASYN_EOM_END) && nread!=bufSize)) {
+            ok = 0;
+            break;
+        }
+    }
+    free(buffer);
+    usbtmcMockGetStats(&end);
+    pstats->requests = end.requests - start.requests;
+    pstats->submitted = end.submitted - start.submitted;
+    pstats->cancelled = end.cancelled - start.cancelled;
+    pstats->transfers = end.transfers;
+    if(status!=asynSuccess || !ok || total!=nChars) {
+        testDiag("read %lu of %lu characters",
+            (unsigned long)total, (unsigned long)nChars);
+        return 0;
+    }
+    return nReads;
+}
+
+static void testUsbtmcPipeline(int transferCount)
+{
+    static int      portNumber;
+    char            portName[40];
+    asynUser        *pasynUser;
+    usbtmcMockStats stats;
+    char            *buffer;
+    size_t          nwrite, nread;
+    int             eomReason, nReads, transfers;
+    asynStatus      status;
+
+    if(transferCount<=0 || transferCount>32) transferCount = 4;
+    epicsSnprintf(portName, sizeof(portName), "usbtmcMock%d", portNumber++);
+    testPlan(NTESTS);
+    testDiag("%s %d transfers of %d bytes",
+        portName, transferCount, TRANSFER_SIZE);
+    usbtmcConfigureTransferLayer(portName, 0, 0, NULL, 0, 0,
+        TRANSFER_SIZE, transferCount, &usbtmcMockLayer);
+    if(!testOk(pasynOctetSyncIO->connect(portName, 0, &pasynUser, NULL)==asynSuccess,
+            "connect to the simulated device")) {
+        testSkip(NTESTS-1, "no device");
+        testDone();
+        return;
+    }
+
+    nReads = readMessage(pasynUser, 1000000, 2000000, &stats);
+    testOk(nReads==1 && stats.requests==1 && stats.submitted>1,
+        "1 MB in one read uses pipelined transfers");
+    nReads = readMessage(pasynUser, 1000000, 4096, &stats);
+    testOk(nReads>0 && stats.submitted==0, "1 MB in 4096 byte reads does not");
+    nReads = readMessage(pasynUser, TRANSFER_SIZE - HEADER_SIZE, 100000, &stats);
+    testOk(nReads==1 && stats.requests==1,
+        "message that ends on a transfer boundary");
+    nReads = readMessage(pasynUser, TRANSFER_SIZE - 1000, 100000, &stats);
+    /* Transfers are submitted for the whole buffer, those not needed are cancelled */
+    testOk(nReads==1 && stats.requests==1 && stats.cancelled==stats.submitted-1,
+        "message in one short transfer");
+    nReads = readMessage(pasynUser, 300000, 100000, &stats);
+    testOk(nReads==3 && stats.requests==3,
+        "message longer than the buffer is read in parts");
+    nReads = readMessage(pasynUser, 5, 100000, &stats);
+    testOk(nReads==1 && stats.requests==1, "short message into a large buffer");
+
+    usbtmcMockGetStats(&stats);
+    transfers = stats.submitted;
+    pasynOctetSyncIO->write(pasynUser, "NOREPLY", 7, TIMEOUT, &nwrite);
+    buffer = mallocMustSucceed(TRANSFER_SIZE * 2, "testUsbtmcPipeline");
+    status = pasynOctetSyncIO->read(pasynUser, buffer, TRANSFER_SIZE * 2, 0.2,
+        &nread, &eomReason);
+    free(buffer);
+    testDiag("no reply: %s", pasynUser->errorMessage);
+    testOk(status!=asynSuccess, "no reply times out");
+    usbtmcMockGetStats(&stats);
+    testOk(stats.cancelled>0 && stats.submitted>transfers,
+        "the transfers in flight are cancelled");
+    nReads = readMessage(pasynUser, 200000, 1000000, &stats);
+    testOk(nReads==1, "a read after the timeout works");
+    pasynManager->report(stdout, 2, portName);
+    pasynOctetSyncIO->disconnect(pasynUser);
+
+    /* A second port whose second transfer can't be allocated */
+    epicsSnprintf(portName, sizeof(portName), "usbtmcMock%d", portNumber++);
+    usbtmcMockGetStats(&stats);
+    transfers = stats.transfers;
+    usbtmcMockFailAlloc(transferCount>1 ? 2 : 1);
+    usbtmcConfigureTransferLayer(portName, 0, 0, NULL, 0, 0,
+        TRANSFER_SIZE, transferCount, &usbtmcMockLayer);
+    usbtmcMockGetStats(&stats);
+    testOk(stats.transfers==transfers,
+        "a failed transfer allocation frees the others");
+    if(pasynOctetSyncIO->connect(portName, 0, &pasynUser, NULL)==asynSuccess) {
+        nReads = readMessage(pasynUser, 1000000, 2000000, &stats);
+        testOk(nReads==1 && stats.submitted==0,
+            "reads still work, without pipelining");
+        pasynOctetSyncIO->disconnect(pasynUser);
+    }
+    else {
+        testFail("connect to the port without pipelining");
+    }
+    testDone();
+}
+
+static const iocshArg testUsbtmcPipelineArg0 = {"transferCount", iocshArgInt};
+static const iocshArg *const testUsbtmcPipelineArgs[] = {&testUsbtmcPipelineArg0};
+static const iocshFuncDef testUsbtmcPipelineDef =
+    {"testUsbtmcPipeline", 1, testUsbtmcPipelineArgs};
+static void testUsbtmcPipelineCall(const iocshArgBuf * args)
+{
+    testUsbtmcPipeline(args[0].ival);
+}
+
+static void testUsbtmcPipelineRegister(void)
+{
+    static int firstTime = 1;
+    if(!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&testUsbtmcPipelineDef, testUsbtmcPipelineCall);
+}
+epicsExportRegistrar(testUsbtmcPipelineRegister);
@@ -0,0 +1,505 @@
+/* usbtmcMock.c */
+/***********************************************************************
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+* National Laboratory.
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/*
+ * A usbtmcTransferLayer that simulates a single USBTMC device.  The device
+ * answers each REQUEST_DEV_DEP_MSG_IN with a DEV_DEP_MSG_IN that is cut
+ * into bulk-in transfers the way the USB host controller would: a transfer
+ * ends at the end of the message, and a message that fills a transfer
+ * exactly and ends on a packet boundary is followed by a zero length packet.
+ * Asynchronous transfers complete in the order they were submitted, when
+ * the driver handles events.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <cantProceed.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include "usbtmcMock.h"
+
+#define MAX_PACKET_SIZE  512
+#define MAX_QUEUED       64
+#define HEADER_SIZE      12
+
+#define MESSAGE_ID_DEV_DEP_MSG_OUT         1
+#define MESSAGE_ID_REQUEST_DEV_DEP_MSG_IN  2
+#define MESSAGE_ID_DEV_DEP_MSG_IN          2
+
+typedef struct mockDevice {
+    epicsMutexId            lock;
+    usbtmcMockStats         stats;
+    int                     failAlloc;
+
+    /* Message the device will send next */
+    size_t                  pending;
+    size_t                  pattern;
+    int                     noReply;
+
+    /* DEV_DEP_MSG_IN being sent */
+    unsigned char          *response;
+    size_t                  responseSize;
+    size_t                  responseSent;
+    int                     zeroLengthPacket;
+
+    /* Submitted asynchronous transfers, oldest first */
+    struct libusb_transfer *queue[MAX_QUEUED];
+    int                     cancelled[MAX_QUEUED];
+    int                     nQueued;
+} mockDevice;
+
+static mockDevice device;
+static epicsThreadOnceId onceId = EPICS_THREAD_ONCE_INIT;
+
+static const struct libusb_endpoint_descriptor endpoints[] = {
+    { .bEndpointAddress = 0x81, .bmAttributes = LIBUSB_TRANSFER_TYPE_BULK,
+      .wMaxPacketSize = MAX_PACKET_SIZE },
+    { .bEndpointAddress = 0x02, .bmAttributes = LIBUSB_TRANSFER_TYPE_BULK,
+      .wMaxPacketSize = MAX_PACKET_SIZE },
+};
+static const struct libusb_interface_descriptor interfaceDescriptor = {
+    .bInterfaceNumber   = 0,
+    .bNumEndpoints      = 2,
+    .bInterfaceClass    = 0xFE,
+    .bInterfaceSubClass = 0x03,
+    .bInterfaceProtocol = 0,
+    .endpoint           = endpoints,
+};
+static const struct libusb_interface usbInterface = {
+    .altsetting     = &interfaceDescriptor,
+    .num_altsetting = 1,
+};
+static struct libusb_config_descriptor configDescriptor = {
+    .bNumInterfaces = 1,
+    .interface      = &usbInterface,
+};
+
+/* The libusb handles only need to be distinct non-NULL pointers */
+#define MOCK_CONTEXT ((libusb_context *)&device)
+#define MOCK_DEVICE  ((libusb_device *)&device)
+#define MOCK_HANDLE  ((libusb_device_handle *)&device)
+
+static void mockInit(void *arg)
+{
+    device.lock = epicsMutexMustCreate();
+}
+
+unsigned char usbtmcMockByte(size_t i)
+{
+    return (unsigned char)(i * 7 + 3);
+}
+
+void usbtmcMockGetStats(usbtmcMockStats *pstats)
+{
+    epicsThreadOnce(&onceId, mockInit, NULL);
+    epicsMutexMustLock(device.lock);
+    *pstats = device.stats;
+    epicsMutexUnlock(device.lock);
+}
+
+void usbtmcMockFailAlloc(int n)
+{
+    epicsThreadOnce(&onceId, mockInit, NULL);
+    epicsMutexMustLock(device.lock);
+    device.failAlloc = n;
+    epicsMutexUnlock(device.lock);
+}
+
+/*
+ * Build the DEV_DEP_MSG_IN that answers a request.
+ * Called with the lock held.
+ */
+static void makeResponse(const unsigned char *request)
+{
+    size_t transferSize, n, i;
+
+    transferSize = (size_t)request[4] | ((size_t)request[5] << 8) |
+                   ((size_t)request[6] << 16) | ((size_t)request[7] << 24);
+    n = (device.pending < transferSize) ? device.pending : transferSize;
+    free(device.response);
+    device.responseSize = (HEADER_SIZE + n + 3) & ~(size_t)3;
+    device.response = callocMustSucceed(1, device.responseSize, "usbtmcMock");
+    device.responseSent = 0;
+    device.zeroLengthPacket = 0;
+    device.response[0] = MESSAGE_ID_DEV_DEP_MSG_IN;
+    device.response[1] = request[1];
+    device.response[2] = request[2];
+    device.response[4] = n & 0xFF;
+    device.response[5] = (n >> 8) & 0xFF;
+    device.response[6] = (n >> 16) & 0xFF;
+    device.response[7] = (n >> 24) & 0xFF;
+    device.response[8] = (n == device.pending) ? 1 : 0;
+    for (i = 0 ; i < n ; i++)
+        device.response[HEADER_SIZE + i] = usbtmcMockByte(device.pattern++);
+    device.pending -= n;
+}
+
+/*
+ * Fill one bulk-in transfer.  Returns 0 if the device has nothing to send.
+ * Called with the lock held.
+ */
+static int deliver(unsigned char *buf, int length, int *actualLength)
+{
+    size_t n;
+
+    if (device.zeroLengthPacket) {
+        device.zeroLengthPacket = 0;
+        *actualLength = 0;
+        return 1;
+    }
+    if (device.response == NULL)
+        return 0;
+    n = device.responseSize - device.responseSent;
+    if (n > (size_t)length)
+        n = length;
+    memcpy(buf, device.response + device.responseSent, n);
+    device.responseSent += n;
+    *actualLength = (int)n;
+    if (device.responseSent == device.responseSize) {
+        if ((n == (size_t)length) && ((n % MAX_PACKET_SIZE) == 0))
+            device.zeroLengthPacket = 1;
+        free(device.response);
+        device.response = NULL;
+    }
+    return 1;
+}
+
+/*
+ * A DEV_DEP_MSG_OUT is a command, a REQUEST_DEV_DEP_MSG_IN asks for a reply.
+ * Called with the lock held.
+ */
+static void receive(const unsigned char *buf, int length)
+{
+    char command[40];
+    size_t n;
+
+    if (length < HEADER_SIZE)
+        return;
+    if (buf[0] == MESSAGE_ID_DEV_DEP_MSG_OUT) {
+        n = (size_t)buf[4] | ((size_t)buf[5] << 8);
+        if (n > sizeof command - 1)
+            n = sizeof command - 1;
+        memcpy(command, buf + HEADER_SIZE, n);
+        command[n] = '\0';
+        if (strncmp(command, "DATA ", 5) == 0) {
+            device.pending = strtoul(command + 5, NULL, 10);
+            device.pattern = 0;
+            device.noReply = 0;
+        }
+        else if (strcmp(command, "NOREPLY") == 0) {
+            device.noReply = 1;
+        }
+    }
+    else if (buf[0] == MESSAGE_ID_REQUEST_DEV_DEP_MSG_IN) {
+        device.stats.requests++;
+        if (!device.noReply)
+            makeResponse(buf);
+    }
+}
+
+static int LIBUSB_CALL
+mockInitContext(libusb_context **ctx)
+{
+    epicsThreadOnce(&onceId, mockInit, NULL);
+    *ctx = MOCK_CONTEXT;
+    return 0;
+}
+
+static void LIBUSB_CALL
+mockSetDebug(libusb_context *ctx, int level)
+{
+}
+
+static ssize_t LIBUSB_CALL
+mockGetDeviceList(libusb_context *ctx, libusb_device ***list)
+{
+    *list = callocMustSucceed(2, sizeof **list, "usbtmcMock");
+    (*list)[0] = MOCK_DEVICE;
+    return 1;
+}
+
+static void LIBUSB_CALL
+mockFreeDeviceList(libusb_device **list, int unrefDevices)
+{
+    free(list);
+}
+
+static int LIBUSB_CALL
+mockGetDeviceDescriptor(libusb_device *dev, struct libusb_device_descriptor *desc)
+{
+    memset(desc, 0, sizeof *desc);
+    desc->bDeviceClass = LIBUSB_CLASS_PER_INTERFACE;
+    desc->idVendor = 0xFFFF;
+    desc->idProduct = 0x0001;
+    desc->iManufacturer = 1;
+    desc->iProduct = 2;
+    desc->iSerialNumber = 3;
+    return 0;
+}
+
+static int LIBUSB_CALL
+mockGetActiveConfigDescriptor(libusb_device *dev,
+                              struct libusb_config_descriptor **config)
+{
+    *config = &configDescriptor;
+    return 0;
+}
+
+static int LIBUSB_CALL
+mockGetConfigDescriptor(libusb_device *dev, uint8_t index,
+                        struct libusb_config_descriptor **config)
+{
+    *config = &configDescriptor;
+    return 0;
+}
+
+static void LIBUSB_CALL
+mockFreeConfigDescriptor(struct libusb_config_descriptor *config)
+{
+}
+
+static int LIBUSB_CALL
+mockOpen(libusb_device *dev, libusb_device_handle **handle)
+{
+    *handle = MOCK_HANDLE;
+    return 0;
+}
+
+static void LIBUSB_CALL
+mockClose(libusb_device_handle *handle)
+{
+}
+
+static int LIBUSB_CALL
+mockGetStringDescriptorAscii(libusb_device_handle *handle, uint8_t index,
+                             unsigned char *data, int length)
+{
+    static const char *strings[] = { "", "asyn", "USBTMC mock", "0" };
+
+    if ((index >= sizeof strings / sizeof strings[0]) || (length <= 0))
+        return LIBUSB_ERROR_INVALID_PARAM;
+    strncpy((char *)data, strings[index], length);
+    data[length - 1] = '\0';
+    return (int)strlen((char *)data);
+}
+
+static int LIBUSB_CALL
+mockClaimInterface(libusb_device_handle *handle, int interfaceNumber)
+{
+    return 0;
+}
+
+static int LIBUSB_CALL
+mockDetachKernelDriver(libusb_device_handle *handle, int interfaceNumber)
+{
+    return 0;
+}
+
+static int LIBUSB_CALL
+mockResetDevice(libusb_device_handle *handle)
+{
+    return 0;
+}
+
+static int LIBUSB_CALL
+mockClearHalt(libusb_device_handle *handle, unsigned char endpoint)
+{
+    return 0;
+}
+
+/*
+ * Every USBTMC control request succeeds.  INITIATE_CLEAR drops the
+ * message being sent.
+ */
+static int LIBUSB_CALL
+mockControlTransfer(libusb_device_handle *handle, uint8_t requestType,
+                    uint8_t request, uint16_t value, uint16_t index,
+                    unsigned char *data, uint16_t length, unsigned int timeout)
+{
+    memset(data, 0, length);
+    if (length > 0)
+        data[0] = 1;  /* STATUS_SUCCESS */
+    if (request == 0x05) {
+        epicsMutexMustLock(device.lock);
+        free(device.response);
+        device.response = NULL;
+        device.zeroLengthPacket = 0;
+        epicsMutexUnlock(device.lock);
+    }
+    return length;
+}
+
+static int LIBUSB_CALL
+mockBulkTransfer(libusb_device_handle *handle, unsigned char endpoint,
+                 unsigned char *data, int length, int *actualLength,
+                 unsigned int timeout)
+{
+    int ok = 1;
+
+    epicsMutexMustLock(device.lock);
+    if (endpoint & LIBUSB_ENDPOINT_IN) {
+        ok = deliver(data, length, actualLength);
+    }
+    else {
+        receive(data, length);
+        *actualLength = length;
+    }
+    epicsMutexUnlock(device.lock);
+    if (!ok) {
+        epicsThreadSleep(timeout / 1000.0);
+        return LIBUSB_ERROR_TIMEOUT;
+    }
+    return 0;
+}
+
+/* There is no interrupt endpoint */
+static int LIBUSB_CALL
+mockInterruptTransfer(libusb_device_handle *handle, unsigned char endpoint,
+                      unsigned char *data, int length, int *actualLength,
+                      unsigned int timeout)
+{
+    return LIBUSB_ERROR_NOT_FOUND;
+}
+
+static struct libusb_transfer * LIBUSB_CALL
+mockAllocTransfer(int isoPackets)
+{
+    int fail;
+
+    epicsThreadOnce(&onceId, mockInit, NULL);
+    epicsMutexMustLock(device.lock);
+    fail = (device.failAlloc > 0) && (--device.failAlloc == 0);
+    if (!fail)
+        device.stats.transfers++;
+    epicsMutexUnlock(device.lock);
+    if (fail)
+        return NULL;
+    return callocMustSucceed(1, sizeof(struct libusb_transfer), "usbtmcMock");
+}
+
+static void LIBUSB_CALL
+mockFreeTransfer(struct libusb_transfer *transfer)
+{
+    if (transfer == NULL)
+        return;
+    epicsMutexMustLock(device.lock);
+    device.stats.transfers--;
+    epicsMutexUnlock(device.lock);
+    free(transfer);
+}
+
+static int LIBUSB_CALL
+mockSubmitTransfer(struct libusb_transfer *transfer)
+{
+    int s = 0;
+
+    epicsMutexMustLock(device.lock);
+    if ((transfer->length % MAX_PACKET_SIZE) != 0) {
+        s = LIBUSB_ERROR_INVALID_PARAM;
+    }
+    else if (device.nQueued == MAX_QUEUED) {
+        s = LIBUSB_ERROR_BUSY;
+    }
+    else {
+        device.queue[device.nQueued] = transfer;
+        device.cancelled[device.nQueued] = 0;
+        device.nQueued++;
+        device.stats.submitted++;
+    }
+    epicsMutexUnlock(device.lock);
+    return s;
+}
+
+static int LIBUSB_CALL
+mockCancelTransfer(struct libusb_transfer *transfer)
+{
+    int i, s = LIBUSB_ERROR_NOT_FOUND;
+
+    epicsMutexMustLock(device.lock);
+    for (i = 0 ; i < device.nQueued ; i++) {
+        if (device.queue[i] == transfer) {
+            device.cancelled[i] = 1;
+            device.stats.cancelled++;
+            s = 0;
+        }
+    }
+    epicsMutexUnlock(device.lock);
+    return s;
+}
+
+/*
+ * Complete the oldest transfer if the device has something for it,
+ * otherwise wait for up to 10 ms
+ */
+static int LIBUSB_CALL
+mockHandleEventsTimeoutCompleted(libusb_context *ctx, struct timeval *tv,
+                                 int *completed)
+{
+    struct libusb_transfer *transfer = NULL;
+    double wait;
+
+    if (completed && *completed)
+        return 0;
+    epicsMutexMustLock(device.lock);
+    if (device.nQueued > 0) {
+        transfer = device.queue[0];
+        if (device.cancelled[0]) {
+            transfer->status = LIBUSB_TRANSFER_CANCELLED;
+            transfer->actual_length = 0;
+        }
+        else if (deliver(transfer->buffer, transfer->length,
+                                                &transfer->actual_length)) {
+            transfer->status = LIBUSB_TRANSFER_COMPLETED;
+        }
+        else {
+            transfer = NULL;
+        }
+        if (transfer) {
+            device.nQueued--;
+            memmove(&device.queue[0], &device.queue[1],
+                                    device.nQueued * sizeof device.queue[0]);
+            memmove(&device.cancelled[0], &device.cancelled[1],
+                                    device.nQueued * sizeof device.cancelled[0]);
+        }
+    }
+    epicsMutexUnlock(device.lock);
+    if (transfer) {
+        transfer->callback(transfer);
+        return 0;
+    }
+    wait = tv->tv_sec + tv->tv_usec * 1e-6;
+    epicsThreadSleep(wait < 0.01 ? wait : 0.01);
+    return 0;
+}
+
+const usbtmcTransferLayer usbtmcMockLayer = {
+    .init                         = mockInitContext,
+    .setDebug                     = mockSetDebug,
+    .getDeviceList                = mockGetDeviceList,
+    .freeDeviceList               = mockFreeDeviceList,
+    .getDeviceDescriptor          = mockGetDeviceDescriptor,
+    .getActiveConfigDescriptor    = mockGetActiveConfigDescriptor,
+    .getConfigDescriptor          = mockGetConfigDescriptor,
+    .freeConfigDescriptor         = mockFreeConfigDescriptor,
+    .open                         = mockOpen,
+    .close                        = mockClose,
+    .getStringDescriptorAscii     = mockGetStringDescriptorAscii,
+    .claimInterface               = mockClaimInterface,
+    .detachKernelDriver           = mockDetachKernelDriver,
+    .resetDevice                  = mockResetDevice,
+    .clearHalt                    = mockClearHalt,
+    .controlTransfer              = mockControlTransfer,
+    .bulkTransfer                 = mockBulkTransfer,
+    .interruptTransfer            = mockInterruptTransfer,
+    .allocTransfer                = mockAllocTransfer,
+    .freeTransfer                 = mockFreeTransfer,
+    .submitTransfer               = mockSubmitTransfer,
+    .cancelTransfer               = mockCancelTransfer,
+    .handleEventsTimeoutCompleted = mockHandleEventsTimeoutCompleted,
+};
@@ -0,0 +1,43 @@
+/* usbtmcMock.h */
+/***********************************************************************
+* Copyright (c) 2020 UChicago Argonne LLC, as Operator of Argonne
+* National Laboratory.
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/* Simulated USBTMC device for testing drvAsynUSBTMC without hardware */
+
+#ifndef USBTMCMOCK_H
+#define USBTMCMOCK_H
+
+#include <drvAsynUSBTMC.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+/*
+ * The device has one USBTMC interface with a bulk-out and a bulk-in
+ * endpoint.  It understands two messages:
+ *     DATA n     The next message it sends has n bytes of usbtmcMockByte(i)
+ *     NOREPLY    It ignores REQUEST_DEV_DEP_MSG_IN until the next DATA
+ */
+typedef struct usbtmcMockStats {
+    int requests;   /* REQUEST_DEV_DEP_MSG_IN received */
+    int submitted;  /* Asynchronous bulk-in transfers submitted */
+    int cancelled;  /* Asynchronous bulk-in transfers cancelled */
+    int transfers;  /* Transfers allocated and not freed */
+} usbtmcMockStats;
+
+extern const usbtmcTransferLayer usbtmcMockLayer;
+
+unsigned char usbtmcMockByte(size_t i);
+void usbtmcMockGetStats(usbtmcMockStats *pstats);
+/* Make the n'th allocTransfer from now on fail */
+void usbtmcMockFailAlloc(int n);
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+#endif  /* USBTMCMOCK_H */